@@ -6,15 +6,45 @@ extern "C" {
 #endif
 
 #define BP_PADDING 64
+#define BP_CHUNK_SIZE 1048576
+
+#define BP_PARTITION_HASH 0
+#define BP_PARTITION_RANGE 1
+
+#define BP_KEY_BYTES 0
+#define BP_KEY_UINT64 1
+
+#define BP_COMPARE_BYTES 0
+#define BP_COMPARE_UINT 1
+#define BP_COMPARE_REVERSE 2
+
+#define BP_CODEC_NONE 0
+#define BP_CODEC_SNAPPY 1
+#define BP_CODEC_LZ4 2
+#define BP_CODEC_ZSTD 3
+
+#define BP_MERGE_ADD 1
+#define BP_MERGE_APPEND 2
+#define BP_MERGE_MAX 3
+#define BP_MERGE_MIN 4
+#define BP_MERGE_UNION 5
 
 #define BP_KEY_FIELDS \
   uint64_t length;\
   char* value;
 
+#include <stddef.h> /* size_t */
 #include <stdint.h> /* uintx_t */
 #include "private/errors.h"
 
 typedef struct bp_db_s bp_db_t;
+typedef struct bp_snapshot_s bp_snapshot_t;
+typedef struct bp_cursor_s bp_cursor_t;
+typedef struct bp_stream_s bp_stream_t;
+typedef struct bp_revision_s bp_revision_t;
+typedef struct bp_pdb_s bp_pdb_t;
+typedef struct bp_pdb_cursor_s bp_pdb_cursor_t;
+typedef struct bp_options_s bp_options_t;
 
 typedef struct bp_key_s bp_key_t;
 typedef struct bp_key_s bp_value_t;
@@ -29,8 +59,15 @@ typedef void (*bp_range_cb)(void* arg,
                             const bp_key_t* key,
                             const bp_value_t* value);
 typedef int (*bp_filter_cb)(void* arg, const bp_key_t* key);
+typedef int (*bp_stop_cb)(void* arg);
+typedef void (*bp_revision_cb)(void* arg, const bp_revision_t* revision);
+typedef void* (*bp_malloc_cb)(size_t size);
+typedef void (*bp_free_cb)(void* ptr);
 
 #include "private/tree.h"
+#include "private/cursor.h"
+#include "private/chunks.h"
+#include "private/partitions.h"
 
 /*
  * Open and close database
@@ -38,12 +75,34 @@ typedef int (*bp_filter_cb)(void* arg, const bp_key_t* key);
 int bp_open(bp_db_t* tree, const char* filename);
 int bp_close(bp_db_t* tree);
 
+/*
+ * Open database with options (NULL - defaults), options are stored in
+ * database file on creation and are ignored when existing file is opened.
+ * bp_options_init fills options with defaults.
+ */
+void bp_options_init(bp_options_t* options);
+int bp_open_opts(bp_db_t* tree,
+                 const char* filename,
+                 const bp_options_t* options);
+
 /*
  * Get one value by key
  */
 int bp_get(bp_db_t* tree, const bp_key_t* key, bp_value_t* value);
 int bp_gets(bp_db_t* tree, const char* key, char** value);
 
+/*
+ * Get `length` bytes of value starting at `offset` (`value->length` may be
+ * less at the end of value). Only chunks covering the range are read
+ * (see bp_options_t), values that aren't chunked are loaded whole.
+ * Previous value isn't available through the result.
+ */
+int bp_get_partial(bp_db_t* tree,
+                   const bp_key_t* key,
+                   const uint64_t offset,
+                   const uint64_t length,
+                   bp_value_t* value);
+
 /*
  * Get previous value (MVCC)
  */
@@ -61,6 +120,34 @@ int bp_sets(bp_db_t* tree,
             const char* key,
             const char* value);
 
+/*
+ * Set value that expires in `ttl` seconds (0 - never, same as bp_set).
+ * Expired key is missing for lookups, range queries and cursors, it's
+ * removed by bp_expire or dropped by compaction. Returns BP_EEXPIRY if
+ * database wasn't created with `expiry` option (see bp_options_t).
+ */
+int bp_set_ttl(bp_db_t* tree,
+               const bp_key_t* key,
+               const bp_value_t* value,
+               const uint64_t ttl);
+
+/*
+ * Merge `operand` into value of key with built-in operator, previous value
+ * is read and replaced in one write (missing key is created from operand,
+ * expiry time of existing key is kept):
+ * BP_MERGE_ADD - 8-byte big-endian signed integers are added
+ * BP_MERGE_APPEND - operand is appended to value
+ * BP_MERGE_MAX, BP_MERGE_MIN - greater (lower) of 8-byte big-endian signed
+ * integers is kept
+ * BP_MERGE_UNION - value is a sorted set of 8-byte big-endian ids, ids from
+ * operand (in any order) are added to it
+ * Returns BP_EMERGE for other operators and values of wrong size.
+ */
+int bp_merge(bp_db_t* tree,
+             const bp_key_t* key,
+             const int op,
+             const bp_value_t* operand);
+
 /*
  * Update or create value by key (with solving conflicts)
  * **MVCC**
@@ -76,6 +163,16 @@ int bp_updates(bp_db_t* tree,
                bp_update_cb update_cb,
                void* arg);
 
+/*
+ * Same as bp_update, but value isn't created: BP_EUPDATECONFLICT is
+ * returned if key is missing (it's checked in the same write)
+ */
+int bp_update_existing(bp_db_t* tree,
+                       const bp_key_t* key,
+                       const bp_value_t* value,
+                       bp_update_cb update_cb,
+                       void* arg);
+
 /*
  * Set multiple values by keys
  */
@@ -111,6 +208,15 @@ int bp_bulk_updates(bp_db_t* tree,
 int bp_remove(bp_db_t* tree, const bp_key_t* key);
 int bp_removes(bp_db_t* tree, const char* key);
 
+/*
+ * Remove up to `limit` expired keys (see bp_set_ttl) in one revision,
+ * pages that are left without keys are removed too. `removed` is set to
+ * number of removed keys, it's less than `limit` only if no expired keys
+ * are left. Every call reads pages from the start of tree, so it's meant
+ * to run periodically (in separate thread, other operations wait for it).
+ */
+int bp_expire(bp_db_t* tree, const uint64_t limit, uint64_t* removed);
+
 /*
  * Remove value by key only if it's equal to specified one
  * **MVCC**
@@ -156,21 +262,267 @@ int bp_get_filtered_ranges(bp_db_t* tree,
                            bp_range_cb cb,
                            void* arg);
 
+/*
+ * Same as bp_get_filtered_range, but `stop` is invoked (with `arg`) before
+ * each leaf key: once it returns non-zero scan is stopped and BP_OK is
+ * returned, rest of range isn't read
+ */
+int bp_get_stoppable_range(bp_db_t* tree,
+                           const bp_key_t* start,
+                           const bp_key_t* end,
+                           bp_filter_cb filter,
+                           bp_stop_cb stop,
+                           bp_range_cb cb,
+                           void* arg);
+
+/*
+ * Open and close snapshot (consistent read-only view of database)
+ * Note: snapshot should be closed before closing database and should be
+ * short-lived: while it's opened compaction (and segment cleaning) fails
+ * with BP_ECOMPACT_SNAPSHOT, and with `reuse_space` released space isn't
+ * reused, so file keeps growing until snapshot is closed
+ */
+int bp_snapshot_open(bp_db_t* tree, bp_snapshot_t* snapshot);
+int bp_snapshot_close(bp_db_t* tree, bp_snapshot_t* snapshot);
+
+/*
+ * List all revisions (committed heads) of database, starting from latest.
+ * Note: compaction is discarding all previous revisions
+ */
+int bp_get_revisions(bp_db_t* tree, bp_revision_cb cb, void* arg);
+
+/*
+ * Open snapshot at specific revision (`revision->offset`),
+ * returns BP_ENOTFOUND if there's no valid revision at that offset
+ */
+int bp_snapshot_open_at(bp_db_t* tree,
+                        const uint64_t revision,
+                        bp_snapshot_t* snapshot);
+
+/*
+ * Get one value by key from snapshot
+ */
+int bp_snapshot_get(bp_db_t* tree,
+                    bp_snapshot_t* snapshot,
+                    const bp_key_t* key,
+                    bp_value_t* value);
+int bp_snapshot_gets(bp_db_t* tree,
+                     bp_snapshot_t* snapshot,
+                     const char* key,
+                     char** value);
+
+/*
+ * Get values in range from snapshot (with optional key-filter)
+ * Note: value will be automatically freed after invokation of callback
+ */
+int bp_snapshot_get_range(bp_db_t* tree,
+                          bp_snapshot_t* snapshot,
+                          const bp_key_t* start,
+                          const bp_key_t* end,
+                          bp_range_cb cb,
+                          void* arg);
+int bp_snapshot_get_ranges(bp_db_t* tree,
+                           bp_snapshot_t* snapshot,
+                           const char* start,
+                           const char* end,
+                           bp_range_cb cb,
+                           void* arg);
+int bp_snapshot_get_filtered_range(bp_db_t* tree,
+                                   bp_snapshot_t* snapshot,
+                                   const bp_key_t* start,
+                                   const bp_key_t* end,
+                                   bp_filter_cb filter,
+                                   bp_range_cb cb,
+                                   void* arg);
+
+/*
+ * Iterate over key/values in range [start, end] one-by-one.
+ * `start` and `end` may be NULL (unbounded range).
+ * If `snapshot` is NULL - cursor will open (and close) it's own snapshot,
+ * it blocks compaction and reuse of space until cursor is closed
+ * (see bp_snapshot_open).
+ * `bp_cursor_next` returns BP_ENOTFOUND when there're no more items,
+ * both key and value should be freed by caller.
+ */
+int bp_cursor_open(bp_db_t* tree,
+                   bp_snapshot_t* snapshot,
+                   const bp_key_t* start,
+                   const bp_key_t* end,
+                   bp_cursor_t* cursor);
+int bp_cursor_next(bp_db_t* tree,
+                   bp_cursor_t* cursor,
+                   bp_key_t* key,
+                   bp_value_t* value);
+int bp_cursor_close(bp_db_t* tree, bp_cursor_t* cursor);
+
+/*
+ * Read value by key in parts: `stream->length` is length of whole value,
+ * `bp_stream_read` copies up to `length` bytes starting at `offset` into
+ * `data` (`read` - number of copied bytes, 0 at the end of value).
+ * Only one chunk of large value (see bp_options_t) is kept in memory.
+ * Note: stream should be closed before closing database, it holds
+ * snapshot of database: compaction fails with BP_ECOMPACT_SNAPSHOT and
+ * space isn't reused while stream is opened (see bp_snapshot_open)
+ */
+int bp_stream_open(bp_db_t* tree, const bp_key_t* key, bp_stream_t* stream);
+int bp_stream_read(bp_db_t* tree,
+                   bp_stream_t* stream,
+                   const uint64_t offset,
+                   const uint64_t length,
+                   char* data,
+                   uint64_t* read);
+
+/*
+ * Write value in parts: full chunks are compressed and written by
+ * `bp_stream_write`, `bp_stream_commit` sets value of `key` to all data
+ * written so far (as bp_set does). Data that wasn't committed is released
+ * by `bp_stream_close`. Returns BP_ECHUNK if database doesn't chunk values.
+ */
+int bp_stream_create(bp_db_t* tree, bp_stream_t* stream);
+int bp_stream_write(bp_db_t* tree,
+                    bp_stream_t* stream,
+                    const char* data,
+                    const uint64_t length);
+int bp_stream_commit(bp_db_t* tree,
+                     bp_stream_t* stream,
+                     const bp_key_t* key);
+int bp_stream_close(bp_db_t* tree, bp_stream_t* stream);
+
 /*
  * Run compaction on database
+ * Note: compaction doesn't wait for opened snapshots, cursors and streams,
+ * BP_ECOMPACT_SNAPSHOT is returned if any of them is opened before or
+ * during copy. Database is left untouched in that case,
+ * retry bp_compact after closing them.
  */
 int bp_compact(bp_db_t* tree);
 
+/*
+ * Compaction of database with value log (see bp_options_t) rewrites only
+ * pages, bp_compact_values copies live values into the new log too
+ * and removes the old one. Same as bp_compact for other databases.
+ */
+int bp_compact_values(bp_db_t* tree);
+
+/*
+ * Copy live blocks out of segments that have at least `min_garbage`
+ * percent (0-100) of garbage and remove them, so cost of it depends on
+ * amount of garbage rather than on size of database. Pages are read to
+ * find blocks, values are only copied. Segment being written isn't
+ * cleaned, bp_compact cleans all others. Previous values and revisions
+ * that were stored in removed segments are lost.
+ * Returns BP_ESEGMENT if database isn't segmented (or `min_garbage` is
+ * out of range) and BP_ECOMPACT_SNAPSHOT if there are opened snapshots.
+ * It may run in separate thread, other operations wait for it.
+ */
+int bp_clean(bp_db_t* tree, const int min_garbage);
+
 /*
  * Set compare function to define order of keys in database
  */
 void bp_set_compare_cb(bp_db_t* tree, bp_compare_cb cb);
 
+/*
+ * Change codec used for new blocks (see bp_options_t), blocks that were
+ * already written stay readable. Returns BP_ECODEC if codec wasn't compiled
+ * in or database was created without codec support (use bp_compact).
+ */
+int bp_set_codec(bp_db_t* tree, const int codec, const int level);
+
+/*
+ * Compact database (see bp_compact) training new zstd dictionary of at most
+ * `dict_size` bytes from it's values, `pages` - use dictionary for pages too.
+ * `dict_size` = 0 removes dictionary. Requires library built with ZSTD=1.
+ */
+int bp_compact_dict(bp_db_t* tree, const uint64_t dict_size, const int pages);
+
 /*
  * Ensure that all data is written to disk
  */
 int bp_fsync(bp_db_t* tree);
 
+/*
+ * Replace malloc/free used by library (NULL restores default one).
+ * Should be called before opening any database, values returned by
+ * library should be released with `free_cb`.
+ * Short-lived allocations are served from per-thread arena which
+ * takes memory from `malloc_cb` too.
+ */
+void bp_set_allocator(bp_malloc_cb malloc_cb, bp_free_cb free_cb);
+
+/*
+ * Partitioned database: `count` independent trees (each with it's own head
+ * and lock) stored in `filename.0` ... `filename.N` files.
+ * Keys are routed either by hash, or by range: partition `i` holds keys
+ * in [bounds[i - 1], bounds[i]), `bounds` should contain `count - 1` keys
+ * sorted by comparator of partitions (BP_EPARTITION otherwise).
+ * Partitioning (type, count and bounds) is stored in `filename.meta`,
+ * opening database with a different one fails with BP_EPARTITION.
+ */
+int bp_pdb_open(bp_pdb_t* db, const char* filename, const uint64_t count);
+int bp_pdb_open_range(bp_pdb_t* db,
+                      const char* filename,
+                      const uint64_t count,
+                      const bp_key_t* bounds);
+int bp_pdb_close(bp_pdb_t* db);
+
+int bp_pdb_get(bp_pdb_t* db, const bp_key_t* key, bp_value_t* value);
+int bp_pdb_gets(bp_pdb_t* db, const char* key, char** value);
+int bp_pdb_set(bp_pdb_t* db, const bp_key_t* key, const bp_value_t* value);
+int bp_pdb_sets(bp_pdb_t* db, const char* key, const char* value);
+int bp_pdb_update(bp_pdb_t* db,
+                  const bp_key_t* key,
+                  const bp_value_t* value,
+                  bp_update_cb update_cb,
+                  void* arg);
+int bp_pdb_remove(bp_pdb_t* db, const bp_key_t* key);
+int bp_pdb_removes(bp_pdb_t* db, const char* key);
+int bp_pdb_removev(bp_pdb_t* db,
+                   const bp_key_t* key,
+                   bp_remove_cb remove_cb,
+                   void* arg);
+
+/*
+ * Set multiple values by keys.
+ * Note: atomic only within each partition
+ */
+int bp_pdb_bulk_set(bp_pdb_t* db,
+                    const uint64_t count,
+                    const bp_key_t** keys,
+                    const bp_value_t** values);
+
+/*
+ * Get values in range from all partitions (merged in key order)
+ * Note: value will be automatically freed after invokation of callback
+ */
+int bp_pdb_get_range(bp_pdb_t* db,
+                     const bp_key_t* start,
+                     const bp_key_t* end,
+                     bp_range_cb cb,
+                     void* arg);
+int bp_pdb_get_ranges(bp_pdb_t* db,
+                      const char* start,
+                      const char* end,
+                      bp_range_cb cb,
+                      void* arg);
+
+/*
+ * Iterate over key/values in range [start, end] of all partitions
+ * (see bp_cursor_open). Every partition is read through it's own snapshot.
+ */
+int bp_pdb_cursor_open(bp_pdb_t* db,
+                       const bp_key_t* start,
+                       const bp_key_t* end,
+                       bp_pdb_cursor_t* cursor);
+int bp_pdb_cursor_next(bp_pdb_cursor_t* cursor,
+                       bp_key_t* key,
+                       bp_value_t* value);
+int bp_pdb_cursor_close(bp_pdb_cursor_t* cursor);
+
+int bp_pdb_compact(bp_pdb_t* db);
+int bp_pdb_fsync(bp_pdb_t* db);
+void bp_pdb_set_compare_cb(bp_pdb_t* db, bp_compare_cb cb);
+
 struct bp_db_s {
   BP_TREE_PRIVATE
 };
@@ -184,6 +536,131 @@ struct bp_key_s {
   BP_KEY_PRIVATE
 };
 
+struct bp_options_s {
+  /*
+   * BP_KEY_BYTES - arbitrary byte strings (default)
+   * BP_KEY_UINT64 - 8-byte big-endian integers, other keys are rejected
+   * with BP_EKEYSIZE
+   */
+  int key_mode;
+
+  /*
+   * Built-in comparator:
+   * BP_COMPARE_BYTES - lexicographic order of bytes (default)
+   * BP_COMPARE_UINT - big-endian unsigned integers of any length
+   * BP_COMPARE_REVERSE - reversed lexicographic order
+   * (bp_set_compare_cb may still be used to replace it after opening)
+   */
+  int compare;
+
+  /*
+   * Compression codec of blocks:
+   * BP_CODEC_NONE, BP_CODEC_SNAPPY (default if compiled in),
+   * BP_CODEC_LZ4, BP_CODEC_ZSTD (if library was built with LZ4=1, ZSTD=1).
+   * BP_ECODEC is returned for codecs that weren't compiled in.
+   */
+  int codec;
+
+  /*
+   * Codec-specific level (0 - codec's default): LZ4 uses high compression
+   * mode for levels above zero, zstd accepts 1-22
+   */
+  int codec_level;
+
+  /*
+   * Blocks are stored raw (and read without codec) when compression saves
+   * less than this percent of their size (0-100, default: 10).
+   * Unlike other options it's applied every time database is opened.
+   */
+  int codec_min_saving;
+
+  /*
+   * Records are aligned to this many bytes in file: power of two from 1
+   * (no padding) to 4096 (sector-aligned), default: BP_PADDING.
+   * BP_EALIGNMENT is returned for other values.
+   */
+  int alignment;
+
+  /*
+   * zstd dictionary for values of new database (NULL - none),
+   * `dict_pages` - compress pages with it too. BP_ECODEC is returned if
+   * library was built without zstd.
+   */
+  const char* dict;
+  uint64_t dict_size;
+  int dict_pages;
+
+  /*
+   * Reuse space of replaced pages and values in new database instead of
+   * only appending (default: 0). Space released by a revision is reused
+   * only after it was made durable by bp_fsync (or bp_close, database is
+   * also synced at least every 63 writes) and while no snapshot is opened.
+   * Previous values (bp_get_previous) and revisions (bp_get_revisions)
+   * aren't kept, only the latest one may be opened with bp_snapshot_open_at.
+   */
+  int reuse_space;
+
+  /*
+   * Store new database as a directory of segment files, each one holds up
+   * to `segment_size` bytes (power of two from 4096 to 4GB, default: 0 -
+   * single file). Space of segments is reclaimed by bp_clean.
+   * BP_ESEGMENT is returned for other sizes, with `reuse_space` or
+   * `value_log`.
+   */
+  uint64_t segment_size;
+
+  /*
+   * Store values of new database in separate `filename.00.vlog` file,
+   * database file holds only pages (default: 0). Index stays small and
+   * is compacted without copying values (see bp_compact_values).
+   * With `reuse_space` only space of pages is reused.
+   */
+  int value_log;
+
+  /*
+   * Values larger than this are stored as separately compressed chunks
+   * of this size, so they may be read and written in parts (see
+   * bp_stream_open) and never have to be compressed at once: power of two
+   * from 4096 to 1GB or 0 - never (default: BP_CHUNK_SIZE).
+   * BP_ECHUNK is returned for other sizes.
+   */
+  uint64_t chunk_size;
+
+  /*
+   * Store expiry time with keys of new database, so they may be set with
+   * bp_set_ttl (default: 0). Each key takes up to 10 more bytes in leaf
+   * pages.
+   */
+  int expiry;
+};
+
+struct bp_revision_s {
+  uint64_t offset;
+  uint64_t seq;
+  uint64_t time;
+};
+
+struct bp_snapshot_s {
+  BP_SNAPSHOT_PRIVATE
+};
+
+struct bp_cursor_s {
+  BP_CURSOR_PRIVATE
+};
+
+struct bp_stream_s {
+  uint64_t length;
+  BP_STREAM_PRIVATE
+};
+
+struct bp_pdb_s {
+  BP_PDB_PRIVATE
+};
+
+struct bp_pdb_cursor_s {
+  BP_PDB_CURSOR_PRIVATE
+};
+
 #ifdef __cplusplus
 } // extern "C"
 #endif
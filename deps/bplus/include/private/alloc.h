@@ -0,0 +1,89 @@
+#ifndef _PRIVATE_ALLOC_H_
+#define _PRIVATE_ALLOC_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h> /* size_t */
+#include <stdint.h> /* uintx_t */
+
+#define BP__ARENA_CHUNK_SIZE 65536
+#define BP__ARENA_ALIGN 16
+
+/* scratch buffers that grew larger than this are released after use */
+#define BP__SCRATCH_MAX_SIZE 4194304
+
+typedef struct bp__arena_s bp__arena_t;
+typedef struct bp__arena_chunk_s bp__arena_chunk_t;
+typedef struct bp__arena_mark_s bp__arena_mark_t;
+
+enum alloc_type {
+  kNoAlloc = 0,
+  kHeapAlloc = 1,
+  kArenaAlloc = 2
+};
+
+/*
+ * Allocator hook, everything that outlives an operation
+ * (and all values returned to user) is allocated here
+ */
+void* bp__malloc(size_t size);
+void bp__free(void* ptr);
+
+/*
+ * Per-thread arena for short-lived allocations of one operation.
+ * Outside of enter/leave arena falls back to bp__malloc.
+ * bp__arena_free may be called on any pointer returned by
+ * bp__arena_alloc or bp__malloc.
+ */
+void bp__arena_enter(void);
+void bp__arena_leave(void);
+
+void* bp__arena_alloc(size_t size);
+void bp__arena_free(void* ptr);
+
+void* bp__alloc(const enum alloc_type type, size_t size);
+
+/*
+ * Per-thread growable buffer for data that is consumed right away
+ * (compressed blocks on their way to/from disk), it's reused by all
+ * operations of thread. Only one scratch buffer may be in use at a time,
+ * nested calls are served from heap. Every bp__scratch_alloc should be
+ * followed by bp__scratch_release.
+ */
+void* bp__scratch_alloc(size_t size);
+void bp__scratch_release(void* ptr);
+
+/*
+ * Release everything allocated from arena after mark.
+ * Caller should ensure that none of this memory is referenced anymore.
+ */
+void bp__arena_mark(bp__arena_mark_t* mark);
+void bp__arena_rewind(const bp__arena_mark_t* mark);
+
+struct bp__arena_chunk_s {
+  bp__arena_chunk_t* next;
+  uint64_t size;
+  uint64_t used;
+};
+
+struct bp__arena_s {
+  bp__arena_chunk_t* chunks;
+  uint64_t depth;
+
+  char* scratch;
+  uint64_t scratch_size;
+  int scratch_used;
+};
+
+struct bp__arena_mark_s {
+  bp__arena_chunk_t* chunk;
+  uint64_t used;
+};
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_ALLOC_H_ */
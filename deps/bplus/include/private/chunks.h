@@ -0,0 +1,124 @@
+#ifndef _PRIVATE_CHUNKS_H_
+#define _PRIVATE_CHUNKS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "private/alloc.h"
+#include <stdint.h>
+
+/*
+ * Values larger than chunk size of database are stored as separately
+ * compressed chunks and a table of them:
+ *
+ *   table := uint64 previous value offset, uint64 previous value config,
+ *            uint64 length, uint64 chunk size, uint64 count,
+ *            (uint64 chunk offset, uint64 chunk size) * count
+ *
+ * Table is written as any other value, config of value (in leaf pages
+ * and previous value fields) has BP__CHUNKED bit set. All chunks but the
+ * last one have `chunk size` bytes.
+ */
+#define BP__CHUNKED ((uint64_t) 1 << 63)
+#define BP__VALUE_SIZE(config) ((config) & ~BP__CHUNKED)
+#define BP__CHUNKS_HEADER_SIZE 40
+
+/* limits of bp_options_t.chunk_size */
+#define BP__CHUNK_MIN_SIZE 4096
+#define BP__CHUNK_MAX_SIZE ((uint64_t) 1 << 30)
+
+typedef struct bp__chunk_s bp__chunk_t;
+typedef struct bp__chunks_s bp__chunks_t;
+
+#define BP_STREAM_PRIVATE\
+    int writing;\
+    bp__chunks_t chunks;\
+    char* buffer;\
+    uint64_t buffer_index;\
+    uint64_t buffer_size;
+
+void bp__chunks_init(bp__chunks_t* c, const uint64_t chunk_size);
+void bp__chunks_destroy(bp__chunks_t* c);
+
+/* number of bytes in chunk `index` */
+uint64_t bp__chunks_length(const bp__chunks_t* c, const uint64_t index);
+
+/* compress and write next chunk of value */
+int bp__chunks_append(bp_db_t* t,
+                      bp__chunks_t* c,
+                      const char* data,
+                      const uint64_t size);
+
+/* read and uncompress chunk `index` */
+int bp__chunks_read(bp_db_t* t,
+                    const bp__chunks_t* c,
+                    const uint64_t index,
+                    const enum alloc_type alloc,
+                    char** data);
+
+/* write table of chunks, `config` gets BP__CHUNKED bit */
+int bp__chunks_save(bp_db_t* t,
+                    const bp__chunks_t* c,
+                    const uint64_t prev_offset,
+                    const uint64_t prev_config,
+                    uint64_t* offset,
+                    uint64_t* config);
+int bp__chunks_load(bp_db_t* t,
+                    const uint64_t offset,
+                    const uint64_t config,
+                    bp__chunks_t* c,
+                    uint64_t* prev_offset,
+                    uint64_t* prev_config);
+
+/* chunks (but not the table) aren't referenced anymore */
+int bp__chunks_release(bp_db_t* t, const bp__chunks_t* c);
+
+/*
+ * Streams (see bp_stream_open), value of stream being read is either
+ * in `buffer` (if it isn't chunked) or `buffer` holds chunk
+ * `buffer_index`. Stream being written keeps incomplete chunk in `buffer`.
+ */
+int bp__stream_init(bp_db_t* t,
+                    bp_stream_t* stream,
+                    const uint64_t offset,
+                    const uint64_t config);
+int bp__stream_read(bp_db_t* t,
+                    bp_stream_t* stream,
+                    const uint64_t offset,
+                    const uint64_t length,
+                    char* data,
+                    uint64_t* read);
+int bp__stream_create(bp_db_t* t, bp_stream_t* stream);
+int bp__stream_write(bp_db_t* t,
+                     bp_stream_t* stream,
+                     const char* data,
+                     const uint64_t length);
+
+/*
+ * Value that should be inserted to commit stream: either incomplete chunk
+ * itself or table of chunks (see bp__value_save)
+ */
+int bp__stream_value(bp_db_t* t, bp_stream_t* stream, bp_value_t* value);
+void bp__stream_committed(bp_stream_t* stream);
+int bp__stream_destroy(bp_db_t* t, bp_stream_t* stream);
+
+struct bp__chunk_s {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct bp__chunks_s {
+  uint64_t length;
+  uint64_t chunk_size;
+
+  bp__chunk_t* list;
+  uint64_t count;
+  uint64_t capacity;
+};
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_CHUNKS_H_ */
@@ -0,0 +1,70 @@
+#ifndef _PRIVATE_COMPARE_H_
+#define _PRIVATE_COMPARE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "private/pages.h"
+
+/* compare_id of tree with user-defined compare_cb */
+#define BP__COMPARE_CUSTOM -1
+
+/*
+ * comparator of database is stored in head flags (low half of the byte,
+ * the other one holds flags, see BP__HEAD_FLAG_EXPIRY)
+ */
+#define BP__HEAD_COMPARE_SHIFT 8
+#define BP__HEAD_COMPARE_MASK 0xf
+#define BP__HEAD_COMPARE(flags)\
+    (int) (((flags) >> BP__HEAD_COMPARE_SHIFT) & BP__HEAD_COMPARE_MASK)
+
+/*
+ * Built-in comparators, BP_COMPARE_*.
+ * bp__default_compare_cb is BP_COMPARE_BYTES.
+ */
+int bp__uint_compare_cb(const bp_key_t* a, const bp_key_t* b);
+int bp__reverse_compare_cb(const bp_key_t* a, const bp_key_t* b);
+
+/* NULL if id is unknown */
+bp_compare_cb bp__compare_builtin(const int id);
+/* BP__COMPARE_CUSTOM if cb is not built-in */
+int bp__compare_id(bp_compare_cb cb);
+
+/*
+ * Compare keys with tree's comparator, built-in ones are called directly
+ */
+int bp__compare(const bp_db_t* t, const bp_key_t* a, const bp_key_t* b);
+
+/*
+ * Prefix of key (uint64) that is ordered the same way as keys by built-in
+ * comparator (a < b => prefix(a) <= prefix(b)). Only keys with equal
+ * prefixes need to be compared.
+ */
+uint64_t bp__compare_prefix(const bp_db_t* t, const bp_key_t* key);
+
+/*
+ * Index of first key in page->keys[start, length) that isn't lower than
+ * `key` (page->length if there're no such keys), `cmp` is the result of
+ * comparison of that key with `key`.
+ */
+uint64_t bp__compare_search(const bp_db_t* t,
+                            const bp__page_t* page,
+                            const uint64_t start,
+                            const bp_key_t* key,
+                            int* cmp);
+
+/*
+ * Shortest key that is greater than `left` and not greater than `right`
+ * (`right` itself if comparator is not built-in)
+ */
+void bp__compare_separator(const bp_db_t* t,
+                           const bp__kv_t* left,
+                           const bp__kv_t* right,
+                           bp__kv_t* separator);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_COMPARE_H_ */
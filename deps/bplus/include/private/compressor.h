@@ -7,20 +7,104 @@
 extern "C" {
 #endif
 
-size_t bp__max_compressed_size(size_t size);
-int bp__compress(const char* input,
+/*
+ * Databases created before codecs were introduced have no codec tags,
+ * their blocks are compressed with snappy (or not compressed at all if
+ * library was built with SNAPPY=0).
+ */
+#define BP__CODEC_LEGACY -1
+
+/* tag of blocks compressed with zstd and database's dictionary */
+#define BP__CODEC_ZSTD_DICT 4
+
+/* codec and it's level are stored in head flags */
+#define BP__HEAD_CODEC_SHIFT 16
+#define BP__HEAD_CODEC_LEVEL_SHIFT 24
+#define BP__HEAD_CODEC_MASK 0xff
+#define BP__HEAD_CODEC(flags)\
+    (int) (((flags) >> BP__HEAD_CODEC_SHIFT) & BP__HEAD_CODEC_MASK)
+#define BP__HEAD_CODEC_LEVEL(flags)\
+    (int) (((flags) >> BP__HEAD_CODEC_LEVEL_SHIFT) & BP__HEAD_CODEC_MASK)
+
+/*
+ * Tagged blocks that are smaller than this aren't compressed at all,
+ * others are stored raw (with BP_CODEC_NONE tag) when compression saves less
+ * than `min_saving` percent of block's size.
+ */
+#define BP__COMPRESS_MIN_SIZE 64
+#define BP__COMPRESS_MIN_SAVING 10
+
+typedef struct bp__dict_s bp__dict_t;
+
+/* BP_CODEC_* that was compiled in (BP__CODEC_LEGACY is always supported) */
+int bp__codec_supported(const int codec);
+int bp__codec_default(void);
+
+/*
+ * Every compressed block of database with codec != BP__CODEC_LEGACY
+ * starts with one byte tag - id of codec used for this block, so blocks
+ * compressed with different codecs may coexist in one file.
+ * On reads `codec` only tells whether block is tagged.
+ * For raw blocks (see bp__compressed_raw) bp__compress writes only the tag,
+ * input should be written right after it.
+ */
+size_t bp__max_compressed_size(const int codec,
+                               const bp__dict_t* dict,
+                               size_t size);
+int bp__compress(const int codec,
+                 bp__dict_t* dict,
+                 const int level,
+                 const int min_saving,
+                 const char* input,
                  size_t input_length,
                  char* compressed,
                  size_t* compressed_length);
 
-int bp__uncompressed_length(const char* compressed,
+int bp__uncompressed_length(const int codec,
+                            const char* compressed,
                             size_t compressed_length,
                             size_t* result);
-int bp__uncompress(const char* compressed,
+int bp__uncompress(const int codec,
+                   const bp__dict_t* dict,
+                   const char* compressed,
                    size_t compressed_length,
                    char* uncompressed,
                    size_t* uncompressed_length);
 
+/* block is tagged and stored raw, data starts after the tag */
+int bp__compressed_raw(const int codec,
+                       const char* compressed,
+                       size_t compressed_length);
+
+/*
+ * zstd dictionary (`data` is a copy of it) digested for compression with
+ * `level` (0 - default) and decompression. Blocks are compressed with it
+ * if `dict` argument of bp__compress isn't NULL.
+ * BP_ECODEC is returned if library was built without zstd.
+ */
+int bp__dict_create(const char* data,
+                    const size_t size,
+                    const int level,
+                    bp__dict_t** dict);
+void bp__dict_destroy(bp__dict_t* dict);
+
+/*
+ * Train dictionary of at most `*size` bytes from `count` samples stored
+ * one after another in `samples`
+ */
+int bp__dict_train(const char* samples,
+                   const size_t* sizes,
+                   const unsigned count,
+                   char* dict,
+                   size_t* size);
+
+struct bp__dict_s {
+  char* data;
+  size_t size;
+  void* cdict;
+  void* ddict;
+};
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
@@ -0,0 +1,35 @@
+#ifndef _PRIVATE_CURSOR_H_
+#define _PRIVATE_CURSOR_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "private/pages.h"
+
+#define BP__CURSOR_MAX_DEPTH 32
+
+#define BP_CURSOR_PRIVATE\
+    bp_snapshot_t* snapshot;\
+    bp_snapshot_t own_snapshot;\
+    bp_key_t end;\
+    int has_end;\
+    uint64_t depth;\
+    bp__page_t* pages[BP__CURSOR_MAX_DEPTH];\
+    uint64_t indexes[BP__CURSOR_MAX_DEPTH];
+
+int bp__cursor_init(bp_db_t* t,
+                    bp_cursor_t* cursor,
+                    const bp_key_t* start,
+                    const bp_key_t* end);
+void bp__cursor_destroy(bp_db_t* t, bp_cursor_t* cursor);
+int bp__cursor_next(bp_db_t* t,
+                    bp_cursor_t* cursor,
+                    bp_key_t* key,
+                    bp_value_t* value);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_CURSOR_H_ */
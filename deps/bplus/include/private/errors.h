@@ -3,16 +3,23 @@
 
 #define BP_OK 0
 
-#define BP_EFILE           0x101
-#define BP_EFILEREAD_OOB   0x102
-#define BP_EFILEREAD       0x103
-#define BP_EFILEWRITE      0x104
-#define BP_EFILEFLUSH      0x105
-#define BP_EFILERENAME     0x106
-#define BP_ECOMPACT_EXISTS 0x107
+#define BP_EFILE             0x101
+#define BP_EFILEREAD_OOB     0x102
+#define BP_EFILEREAD         0x103
+#define BP_EFILEWRITE        0x104
+#define BP_EFILEFLUSH        0x105
+#define BP_EFILERENAME       0x106
+#define BP_ECOMPACT_EXISTS   0x107
+#define BP_ECOMPACT_SNAPSHOT 0x108
+#define BP_EALIGNMENT        0x109
+#define BP_ESEGMENT          0x10a
+#define BP_ECHUNK            0x10b
+#define BP_EEXPIRY           0x10c
+#define BP_EPARTITION        0x10d
 
 #define BP_ECOMP 0x201
 #define BP_EDECOMP 0x202
+#define BP_ECODEC 0x203
 
 #define BP_EALLOC  0x301
 #define BP_EMUTEX  0x302
@@ -23,5 +30,10 @@
 #define BP_EEMPTYPAGE      0x403
 #define BP_EUPDATECONFLICT 0x404
 #define BP_EREMOVECONFLICT 0x405
+#define BP_ECURSORDEPTH    0x406
+#define BP_EKEYSIZE        0x407
+#define BP_ECOMPARE        0x408
+#define BP_EMERGE          0x409
+#define BP_ERANGEABORT     0x40a
 
 #endif /* _PRIVATE_ERRORS_H_ */
@@ -0,0 +1,91 @@
+#ifndef _PRIVATE_FREELIST_H_
+#define _PRIVATE_FREELIST_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Blocks smaller than this are allocated from the end of free space,
+ * so values don't fragment extents that pages are written into
+ */
+#define BP__FREELIST_SMALL_SIZE 512
+
+typedef struct bp__extent_s bp__extent_t;
+typedef struct bp__freelist_s bp__freelist_t;
+
+/*
+ * Extents of file released by copy-on-write pass three stages:
+ * `released` - block isn't referenced by tree that is being modified,
+ * `pending` - it isn't referenced by written head (bp__freelist_seal),
+ * `free` - that head is durable (bp__freelist_commit), space may be reused.
+ *
+ * Free extents are sorted and persisted only when they're committed,
+ * blocks are allocated from both ends of them sequentially and every head
+ * stores position of allocation: `next` extent and bytes `used` from its
+ * start, `last` extent and bytes `last_used` from its end. Everything
+ * outside of [next, last] was allocated as of that head, so allocations
+ * made after the durable head are free again after crash.
+ * Pending extents and remainders of skipped ones are kept in memory until
+ * commit, they're lost on crash and may be reclaimed only by compaction.
+ */
+int bp__freelist_create(bp__freelist_t** list);
+void bp__freelist_destroy(bp__freelist_t* list);
+
+int bp__freelist_release(bp__freelist_t* list,
+                         const uint64_t offset,
+                         const uint64_t size);
+void bp__freelist_discard(bp__freelist_t* list);
+void bp__freelist_seal(bp__freelist_t* list);
+int bp__freelist_commit(bp__freelist_t* list);
+
+/* next fit, returns BP_ENOTFOUND if there's no free extent that large */
+int bp__freelist_alloc(bp__freelist_t* list,
+                       const uint64_t size,
+                       uint64_t* offset);
+
+/* serialized free extents: count, then offset and size of each one */
+uint64_t bp__freelist_size(const bp__freelist_t* list);
+void bp__freelist_encode(const bp__freelist_t* list, char* buff);
+int bp__freelist_decode(bp__freelist_t* list,
+                        const char* buff,
+                        const uint64_t size,
+                        const uint64_t next,
+                        const uint64_t used,
+                        const uint64_t last,
+                        const uint64_t last_used);
+
+struct bp__extent_s {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct bp__freelist_s {
+  bp__extent_t* free;
+  uint64_t free_count;
+  uint64_t free_capacity;
+
+  /* allocation position */
+  uint64_t next;
+  uint64_t used;
+  uint64_t last;
+  uint64_t last_used;
+
+  bp__extent_t* pending;
+  uint64_t pending_count;
+  uint64_t pending_capacity;
+
+  /* released extents are at the end of `pending` */
+  uint64_t released_count;
+
+  /* free extents were committed after they were persisted */
+  int dirty;
+};
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_FREELIST_H_ */
@@ -0,0 +1,48 @@
+#ifndef _PRIVATE_LEAF_H_
+#define _PRIVATE_LEAF_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "private/pages.h"
+
+/*
+ * Front-coded leaf page format (BP__HEAD_FLAG_FRONTCODED):
+ *
+ *   entry := varint shared, varint unshared,
+ *            varint value offset, varint value config,
+ *            [varint expiry time (BP__HEAD_FLAG_EXPIRY)],
+ *            unshared bytes of key
+ *   leaf := entry * length,
+ *           uint32 restart offset * restart count,
+ *           uint32 restart count
+ *
+ * Every BP__LEAF_RESTART_INTERVAL-th entry is a restart point that stores
+ * whole key (shared = 0), all other entries store only the suffix that
+ * differs from the previous key. Restart points allow binary search in
+ * encoded leaf.
+ */
+#define BP__LEAF_RESTART_INTERVAL 16
+
+uint64_t bp__leaf_max_size(const bp__page_t* page);
+int bp__leaf_encode(bp_db_t* t,
+                    const bp__page_t* page,
+                    char* buff,
+                    uint64_t* size);
+int bp__leaf_decode(bp_db_t* t,
+                    bp__page_t* page,
+                    const char* buff,
+                    const uint64_t size);
+int bp__leaf_get(bp_db_t* t,
+                 const uint64_t offset,
+                 const uint64_t config,
+                 const bp_key_t* key,
+                 bp_value_t* value,
+                 bp__kv_t* ref);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_LEAF_H_ */
@@ -0,0 +1,34 @@
+#ifndef _PRIVATE_MERGE_H_
+#define _PRIVATE_MERGE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* operand replaces value (bp_set) */
+#define BP__MERGE_NONE 0
+
+/* operand replaces value only if key exists (bp_update_existing) */
+#define BP__MERGE_EXISTING -1
+
+/*
+ * Built-in merge operators, BP_MERGE_*. Numbers are 8-byte big-endian
+ * (signed for BP_MERGE_ADD, BP_MERGE_MAX and BP_MERGE_MIN), sets of
+ * BP_MERGE_UNION are sorted arrays of 8-byte big-endian ids.
+ *
+ * Result of merging `operand` into `previous` value (NULL - key is missing)
+ * is allocated with bp__malloc. Returns BP_EMERGE if operator is unknown or
+ * values have wrong size for it.
+ */
+int bp__merge(const int op,
+              const bp_value_t* previous,
+              const bp_value_t* operand,
+              bp_value_t* result);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_MERGE_H_ */
@@ -0,0 +1,44 @@
+#ifndef _PRIVATE_PACKED_H_
+#define _PRIVATE_PACKED_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "private/pages.h"
+
+/*
+ * Page format of databases with BP_KEY_UINT64 keys
+ * (BP__HEAD_FLAG_UINT64_KEYS):
+ *
+ *   page := uint64 key * length,
+ *           uint64 value offset * length,
+ *           uint64 value config * length,
+ *           [uint64 expiry time * length (leaf pages, BP__HEAD_FLAG_EXPIRY)]
+ *
+ * All fields are big-endian. Encoded page is never larger than page's
+ * byte_size (which is still counted as in generic format).
+ */
+uint64_t bp__packed_encode(const bp_db_t* t,
+                           const bp__page_t* page,
+                           char* buff);
+int bp__packed_decode(bp_db_t* t,
+                      bp__page_t* page,
+                      char* buff,
+                      const uint64_t size);
+
+/*
+ * Index of first item in sorted keys[start, end) that is not lower than key
+ * (end if there is no such item). Uses AVX2 or SSE4.2 if they're enabled
+ * at compile time.
+ */
+uint64_t bp__packed_lower_bound(const uint64_t* keys,
+                                const uint64_t start,
+                                const uint64_t end,
+                                const uint64_t key);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_PACKED_H_ */
@@ -7,6 +7,7 @@ extern "C" {
 
 #include "private/tree.h"
 #include "private/values.h"
+#include "private/alloc.h"
 
 typedef struct bp__page_s bp__page_t;
 typedef struct bp__page_search_res_s bp__page_search_res_t;
@@ -25,6 +26,7 @@ int bp__page_create(bp_db_t* t,
                     const enum page_type type,
                     const uint64_t offset,
                     const uint64_t config,
+                    const enum alloc_type alloc,
                     bp__page_t** page);
 void bp__page_destroy(bp_db_t* t, bp__page_t* page);
 int bp__page_clone(bp_db_t* t, bp__page_t* page, bp__page_t** clone);
@@ -33,8 +35,10 @@ int bp__page_read(bp_db_t* t, bp__page_t* page);
 int bp__page_load(bp_db_t* t,
                   const uint64_t offset,
                   const uint64_t config,
+                  const enum alloc_type alloc,
                   bp__page_t** page);
 int bp__page_save(bp_db_t* t, bp__page_t* page);
+int bp__page_release(bp_db_t* t, bp__page_t* page);
 
 int bp__page_load_value(bp_db_t* t,
                         bp__page_t* page,
@@ -46,6 +50,8 @@ int bp__page_save_value(bp_db_t* t,
                         const int cmp,
                         const bp_key_t* key,
                         const bp_value_t* value,
+                        const uint64_t expires,
+                        const int merge,
                         bp_update_cb cb,
                         void* arg);
 
@@ -54,21 +60,32 @@ int bp__page_search(bp_db_t* t,
                     const bp_key_t* key,
                     const enum search_type type,
                     bp__page_search_res_t* result);
+/* `ref` (if not NULL) gets offset and config of value instead of value */
 int bp__page_get(bp_db_t* t,
                  bp__page_t* page,
                  const bp_key_t* key,
-                 bp_value_t* value);
+                 bp_value_t* value,
+                 bp__kv_t* ref);
+/* `stop` may be NULL, otherwise BP_ERANGEABORT is returned once it's set */
 int bp__page_get_range(bp_db_t* t,
                        bp__page_t* page,
                        const bp_key_t* start,
                        const bp_key_t* end,
                        bp_filter_cb filter,
+                       bp_stop_cb stop,
                        bp_range_cb cb,
                        void* arg);
+/*
+ * `expires` - unix time of key's expiry (0 - never),
+ * `merge` - operator applied to previous value and `value` (see
+ * private/merge.h), BP__MERGE_NONE replaces previous value
+ */
 int bp__page_insert(bp_db_t* t,
                     bp__page_t* page,
                     const bp_key_t* key,
                     const bp_value_t* value,
+                    const uint64_t expires,
+                    const int merge,
                     bp_update_cb update_cb,
                     void* arg);
 int bp__page_bulk_insert(bp_db_t* t,
@@ -84,7 +101,35 @@ int bp__page_remove(bp_db_t* t,
                     const bp_key_t* key,
                     bp_remove_cb remove_cb,
                     void* arg);
-int bp__page_copy(bp_db_t* source, bp_db_t* target, bp__page_t* page);
+/*
+ * Copy subtree into `target`, `values` - copy values too, otherwise
+ * both databases share value log and offsets of values are kept
+ */
+int bp__page_copy(bp_db_t* source,
+                  bp_db_t* target,
+                  bp__page_t* page,
+                  const int values);
+
+/*
+ * Copy blocks of subtree that are stored in segments with non-zero
+ * `victims[segment]` (`count` of them) to the end of database, `moved` is
+ * set if page's keys were changed and it should be saved
+ */
+int bp__page_relocate(bp_db_t* t,
+                      bp__page_t* page,
+                      const char* victims,
+                      const uint64_t count,
+                      int* moved);
+
+/*
+ * Remove up to `limit` expired keys (and subtrees that have only them) from
+ * subtree, `limit` is decreased by number of removed keys. `changed` is set
+ * if page's keys were changed and it should be saved
+ */
+int bp__page_expire(bp_db_t* t,
+                    bp__page_t* page,
+                    uint64_t* limit,
+                    int* changed);
 
 int bp__page_remove_idx(bp_db_t* t, bp__page_t* page, const uint64_t index);
 int bp__page_split(bp_db_t* t,
@@ -93,6 +138,9 @@ int bp__page_split(bp_db_t* t,
                    bp__page_t* child);
 int bp__page_split_head(bp_db_t* t, bp__page_t** page);
 
+void bp__page_set_prefix(bp_db_t* t,
+                         bp__page_t* page,
+                         const uint64_t index);
 void bp__page_shiftr(bp_db_t* t, bp__page_t* page, const uint64_t index);
 void bp__page_shiftl(bp_db_t* t, bp__page_t* page, const uint64_t index);
 
@@ -108,6 +156,15 @@ struct bp__page_s {
   void* buff_;
   int is_head;
 
+  /* where page, it's buffer and keys are allocated */
+  enum alloc_type alloc;
+
+  /*
+   * Key prefixes (see bp__kv_prefix) stored contiguously after keys,
+   * so search may skip most of keys without dereferencing them
+   */
+  uint64_t* prefixes;
+
   bp__kv_t keys[1];
 };
 
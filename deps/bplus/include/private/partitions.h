@@ -0,0 +1,35 @@
+#ifndef _PRIVATE_PARTITIONS_H_
+#define _PRIVATE_PARTITIONS_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h> /* uint64_t */
+
+#define BP_PDB_PRIVATE\
+    int type;\
+    uint64_t count;\
+    bp_db_t* trees;\
+    bp_key_t* bounds;
+
+#define BP_PDB_CURSOR_PRIVATE\
+    bp_pdb_t* db;\
+    bp_cursor_t* cursors;\
+    bp_key_t* keys;\
+    bp_value_t* values;\
+    uint64_t* heap;\
+    uint64_t heap_size;
+
+int bp__pdb_open(bp_pdb_t* db,
+                 const char* filename,
+                 const int type,
+                 const uint64_t count,
+                 const bp_key_t* bounds);
+uint64_t bp__pdb_route(bp_pdb_t* db, const bp_key_t* key);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_PARTITIONS_H_ */
@@ -0,0 +1,90 @@
+#ifndef _PRIVATE_SEGMENTS_H_
+#define _PRIVATE_SEGMENTS_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Segmented database is a directory of files that are appended one after
+ * another. Offsets of blocks keep segment's number in the high bits,
+ * so they're still ordered by time of write.
+ */
+#define BP__SEGMENT_SHIFT 40
+#define BP__SEGMENT(offset) ((offset) >> BP__SEGMENT_SHIFT)
+#define BP__SEGMENT_OFFSET(offset)\
+    ((offset) & (((uint64_t) 1 << BP__SEGMENT_SHIFT) - 1))
+
+/* limits of bp_options_t.segment_size */
+#define BP__SEGMENT_MIN_SIZE 4096
+#define BP__SEGMENT_MAX_SIZE ((uint64_t) 1 << 32)
+
+typedef struct bp__segment_s bp__segment_t;
+typedef struct bp__segments_s bp__segments_t;
+
+/* create directory of new database, existing one is ok */
+int bp__segments_mkdir(const char* dir);
+
+/*
+ * Open all segments found in `dir`, the first one is created
+ * if there are none
+ */
+int bp__segments_open(bp__segments_t** s, const char* dir);
+int bp__segments_destroy(bp__segments_t* s);
+
+/* start new segment after the last one, which is synced */
+int bp__segments_next(bp__segments_t* s);
+
+/* descriptor of segment with `offset`, BP_ENOTFOUND if it was removed */
+int bp__segments_fd(const bp__segments_t* s,
+                    const uint64_t offset,
+                    const uint64_t size,
+                    int* fd);
+
+/* sync the last segment and directory (if segments were created) */
+int bp__segments_fsync(bp__segments_t* s);
+
+/* block isn't referenced anymore, it's garbage of its segment */
+void bp__segments_release(bp__segments_t* s,
+                          const uint64_t offset,
+                          const uint64_t size);
+
+/* delete file of the segment (it should have no live blocks) */
+int bp__segments_remove(bp__segments_t* s, const uint64_t index);
+
+/* serialized garbage of segments: count, then dead bytes of each one */
+uint64_t bp__segments_size(const bp__segments_t* s);
+void bp__segments_encode(const bp__segments_t* s, char* buff);
+int bp__segments_decode(bp__segments_t* s,
+                        const char* buff,
+                        const uint64_t size);
+
+struct bp__segment_s {
+  /* -1 - segment was removed */
+  int fd;
+  uint64_t size;
+  uint64_t dead;
+};
+
+struct bp__segments_s {
+  char* dir;
+
+  /* indexed by number of segment, the last one is being appended */
+  bp__segment_t* list;
+  uint64_t count;
+  uint64_t capacity;
+
+  /* garbage has changed since it was persisted */
+  int dirty;
+
+  /* directory has entries that weren't synced yet */
+  int dir_dirty;
+};
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* _PRIVATE_SEGMENTS_H_ */
@@ -6,10 +6,45 @@ extern "C" {
 #endif
 
 #include <pthread.h>
+#include <stdint.h> /* uintx_t */
+
+#ifndef BP_USE_SCALABLE_RWLOCK
+#define BP_USE_SCALABLE_RWLOCK 0
+#endif
+
+#define BP__RWLOCK_SLOTS 64
+#define BP__CACHELINE 64
 
 typedef pthread_mutex_t bp__mutex_t;
+
+#if BP_USE_SCALABLE_RWLOCK
+
+/*
+ * Readers are counted in per-thread slots (each on its own cache line),
+ * so they never touch shared state unless a writer is active.
+ * Writer sets flag (new readers will back off and wait on mutex)
+ * and waits for all slots to drain.
+ */
+typedef struct bp__rwlock_slot_s bp__rwlock_slot_t;
+typedef struct bp__rwlock_s bp__rwlock_t;
+
+struct bp__rwlock_slot_s {
+  volatile uint64_t readers;
+  char padding[BP__CACHELINE - sizeof(uint64_t)];
+};
+
+struct bp__rwlock_s {
+  bp__rwlock_slot_t slots[BP__RWLOCK_SLOTS];
+  volatile int writer;
+  bp__mutex_t mutex;
+};
+
+#else
+
 typedef pthread_rwlock_t bp__rwlock_t;
 
+#endif /* BP_USE_SCALABLE_RWLOCK */
+
 
 int bp__mutex_init(bp__mutex_t* mutex);
 void bp__mutex_destroy(bp__mutex_t* mutex);
@@ -18,9 +53,15 @@ void bp__mutex_unlock(bp__mutex_t* mutex);
 
 int bp__rwlock_init(bp__rwlock_t* rwlock);
 void bp__rwlock_destroy(bp__rwlock_t* rwlock);
+/*
+ * Read lock isn't reentrant: with scalable lock waiting writer blocks new
+ * readers, so taking read lock again in the same thread (while holding it)
+ * deadlocks once writer is waiting
+ */
 void bp__rwlock_rdlock(bp__rwlock_t* rwlock);
 void bp__rwlock_wrlock(bp__rwlock_t* rwlock);
-void bp__rwlock_unlock(bp__rwlock_t* rwlock);
+void bp__rwlock_rdunlock(bp__rwlock_t* rwlock);
+void bp__rwlock_wrunlock(bp__rwlock_t* rwlock);
 
 #ifdef __cplusplus
 } /* extern "C" */
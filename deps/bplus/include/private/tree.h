@@ -9,22 +9,140 @@ extern "C" {
 #include "private/writer.h"
 #include "private/pages.h"
 
-#define BP__HEAD_SIZE sizeof(uint64_t) * 4
+#define BP__HEAD_SIZE sizeof(uint64_t) * 8
+
+/*
+ * heads with BP__HEAD_FLAG_REUSE or BP__HEAD_FLAG_SEGMENTS are followed by
+ * state of free list and garbage of segments
+ */
+#define BP__HEAD_MAX_SIZE sizeof(uint64_t) * 16
+
+/*
+ * Databases reusing space don't append heads, head with `seq` is written
+ * into slot `seq % BP__HEAD_RING_SLOTS` of ring at the start of file and
+ * the one with the highest `seq` is loaded. Database is synced before slot
+ * of the last durable head is overwritten.
+ */
+#define BP__HEAD_RING_SLOTS 64
+#define BP__HEAD_RING_SIZE BP__HEAD_MAX_SIZE * BP__HEAD_RING_SLOTS
+
+/* leaf pages are front-coded (see private/leaf.h) */
+#define BP__HEAD_FLAG_FRONTCODED 0x1
+/* all keys are uint64, pages are packed (see private/packed.h) */
+#define BP__HEAD_FLAG_UINT64_KEYS 0x2
+/* compressed blocks are tagged with codec (see private/compressor.h) */
+#define BP__HEAD_FLAG_CODEC_TAGS 0x4
+/*
+ * first block of file (after ring of heads) is zstd dictionary used for
+ * values (and pages)
+ */
+#define BP__HEAD_FLAG_DICT 0x8
+#define BP__HEAD_FLAG_DICT_PAGES 0x10
+/* space of replaced blocks is reused (see private/freelist.h) */
+#define BP__HEAD_FLAG_REUSE 0x20
+/* database is a directory of segments (see private/segments.h) */
+#define BP__HEAD_FLAG_SEGMENTS 0x40
+/* values are stored in value log file (see bp__writer_open_vlog) */
+#define BP__HEAD_FLAG_VLOG 0x80
+/* keys of leaf pages have expiry time (see bp_set_ttl) */
+#define BP__HEAD_FLAG_EXPIRY 0x1000
+
+/*
+ * Alignment of records in file is stored in head flags as log2 + 1,
+ * 0 - BP_PADDING (databases created before it became configurable)
+ */
+#define BP__HEAD_ALIGN_SHIFT 32
+#define BP__HEAD_ALIGN_MASK 0xff
+
+/* and size of segments too, 0 - segments aren't limited */
+#define BP__HEAD_SEGMENT_SHIFT 40
+#define BP__HEAD_SEGMENT_MASK 0xff
+
+/*
+ * Generation of value log, it's increased by compaction of values,
+ * which writes them to the new file (`filename.GG.vlog`)
+ */
+#define BP__HEAD_VLOG_SHIFT 48
+#define BP__HEAD_VLOG_MASK 0xff
+#define BP__HEAD_VLOG(flags)\
+    (((flags) >> BP__HEAD_VLOG_SHIFT) & BP__HEAD_VLOG_MASK)
+
+/*
+ * Size of value chunks (see private/chunks.h) as log2 + 1,
+ * 0 - values aren't chunked (databases created before chunking)
+ */
+#define BP__HEAD_CHUNK_SHIFT 56
+#define BP__HEAD_CHUNK_MASK 0xff
+
+/* dictionary is trained from up to this many bytes of values per byte */
+#define BP__DICT_SAMPLE_RATIO 100
 
 #define BP_TREE_PRIVATE\
     BP_WRITER_PRIVATE\
     bp__rwlock_t rwlock;\
     bp__tree_head_t head;\
-    bp_compare_cb compare_cb;
+    bp_compare_cb compare_cb;\
+    int compare_id;\
+    uint64_t snapshots;\
+    uint64_t durable_seq;\
+    uint64_t chunk_size;
+
+#define BP_SNAPSHOT_PRIVATE\
+    uint64_t offset;\
+    uint64_t config;\
+    bp__page_t* page;
 
 typedef struct bp__tree_head_s bp__tree_head_t;
 
 int bp__init(bp_db_t* tree);
 void bp__destroy(bp_db_t* tree);
 
-int bp__tree_read_head(bp__writer_t* w, void* data);
+int bp__snapshot_init(bp_db_t* tree,
+                      const uint64_t offset,
+                      const uint64_t config,
+                      bp_snapshot_t* snapshot);
+void bp__snapshot_destroy(bp_db_t* tree, bp_snapshot_t* snapshot);
+
+/* bp_update with `expires` time of key and `merge` (see bp__page_insert) */
+int bp__tree_insert(bp_db_t* t,
+                    const bp_key_t* key,
+                    const bp_value_t* value,
+                    const uint64_t expires,
+                    const int merge,
+                    bp_update_cb update_cb,
+                    void* arg);
+int bp__tree_parse_head(const void* data, bp__tree_head_t* head);
+int bp__tree_load_head(bp_db_t* t,
+                       const uint64_t offset,
+                       bp__tree_head_t* head);
+int bp__tree_read_head(bp__writer_t* w, const uint64_t offset, void* data);
 int bp__tree_write_head(bp__writer_t* w, void* data);
+int bp__tree_read_ring(bp_db_t* t);
+int bp__tree_write_ring(bp_db_t* t);
+int bp__tree_sync(bp_db_t* t);
+int bp__tree_load_freelist(bp_db_t* t);
+int bp__tree_write_freelist(bp_db_t* t, uint64_t* offset, uint64_t* size);
+void bp__tree_set_codec(bp_db_t* t);
+void bp__tree_set_alignment(bp_db_t* t);
+void bp__tree_set_segment_size(bp_db_t* t);
+void bp__tree_set_chunk_size(bp_db_t* t);
+int bp__tree_load_segments(bp_db_t* t);
+int bp__tree_write_segments(bp_db_t* t);
+int bp__tree_clean(bp_db_t* t, const int min_garbage);
+int bp__tree_open_vlog(bp_db_t* t, const char* filename, const int fresh);
+int bp__tree_codecs_supported(const bp_db_t* t);
+uint64_t bp__tree_dict_offset(const bp_db_t* t);
+int bp__tree_load_dict(bp_db_t* t);
+int bp__tree_write_dict(bp_db_t* t, const char* dict, const uint64_t size);
+int bp__tree_train_dict(bp_db_t* t, uint64_t* size, char** dict);
+int bp__tree_compact(bp_db_t* t,
+                     const char* dict,
+                     const uint64_t dict_size,
+                     const int dict_pages,
+                     const int values);
+uint64_t bp__tree_head_hash(const bp__tree_head_t* head);
 
+/* BP_COMPARE_BYTES, see private/compare.h for others */
 int bp__default_compare_cb(const bp_key_t* a, const bp_key_t* b);
 int bp__default_filter_cb(void* arg, const bp_key_t* key);
 
@@ -35,6 +153,28 @@ struct bp__tree_head_s {
   uint64_t page_size;
   uint64_t hash;
 
+  /* revision number, offset of previous head and time of commit */
+  uint64_t seq;
+  uint64_t prev;
+  uint64_t time;
+
+  /* format of database, BP__HEAD_FLAG_* */
+  uint64_t flags;
+
+  /* block with free extents and allocation position in it */
+  uint64_t free_offset;
+  uint64_t free_size;
+  uint64_t free_next;
+  uint64_t free_used;
+  uint64_t free_last;
+  uint64_t free_last_used;
+
+  /* block with garbage of segments */
+  uint64_t segments_offset;
+  uint64_t segments_size;
+
+  /* offset of head itself */
+  uint64_t record;
   bp__page_t* page;
 };
 
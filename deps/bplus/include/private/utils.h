@@ -8,6 +8,9 @@ extern "C" {
 #include <stdint.h> /* uint64_t */
 
 uint64_t bp__compute_hashl(uint64_t key);
+uint64_t bp__compute_hashb(const char* data, const uint64_t length);
+uint64_t bp__varint_write(char* buff, uint64_t value);
+uint64_t bp__varint_read(const char* buff, const char* end, uint64_t* value);
 uint64_t htonll(uint64_t value);
 uint64_t ntohll(uint64_t value);
 
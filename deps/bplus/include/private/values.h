@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include "private/tree.h"
+#include "private/alloc.h"
 #include <stdint.h>
 
 #define BP__KV_HEADER_SIZE 24
@@ -21,6 +22,8 @@ extern "C" {
 typedef struct bp__kv_s bp__kv_t;
 
 
+bp__writer_t* bp__value_writer(bp_db_t* t);
+
 int bp__value_load(bp_db_t* t,
                    const uint64_t offset,
                    const uint64_t length,
@@ -30,8 +33,17 @@ int bp__value_save(bp_db_t* t,
                    const bp__kv_t* previous,
                    uint64_t* offset,
                    uint64_t* length);
+int bp__value_release(bp_db_t* t,
+                      const uint64_t offset,
+                      const uint64_t length);
 
-int bp__kv_copy(const bp__kv_t* source, bp__kv_t* target, int alloc);
+uint64_t bp__kv_prefix(const bp_key_t* key);
+uint64_t bp__kv_separator(const bp_key_t* left, const bp_key_t* right);
+int bp__kv_copy(const bp__kv_t* source,
+                bp__kv_t* target,
+                const enum alloc_type alloc);
+/* expiry time has passed (0 - key never expires) */
+int bp__kv_expired(const uint64_t expires);
 
 struct bp__kv_s {
   BP_KEY_FIELDS
@@ -39,6 +51,9 @@ struct bp__kv_s {
   uint64_t offset;
   uint64_t config;
 
+  /* unix time, only keys of leaf pages may expire */
+  uint64_t expires;
+
   uint8_t allocated;
 };
 
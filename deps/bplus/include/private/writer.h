@@ -3,6 +3,10 @@
 
 #include <stdint.h>
 #include "private/threads.h"
+#include "private/alloc.h"
+#include "private/compressor.h"
+#include "private/freelist.h"
+#include "private/segments.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,14 +16,35 @@ extern "C" {
     int fd;\
     char* filename;\
     uint64_t filesize;\
-    char padding[BP_PADDING];
+    int codec;\
+    int codec_level;\
+    int codec_min_saving;\
+    bp__dict_t* dict;\
+    uint64_t alignment;\
+    int pfd;\
+    bp__freelist_t* freelist;\
+    bp__segments_t* segments;\
+    uint64_t segment_size;\
+    struct bp__writer_s* vlog;
+
+/* alignment of records is a power of two up to this */
+#define BP__WRITER_MAX_ALIGNMENT 4096
+
+/* bp__writer_find reads file by chunks of this size */
+#define BP__WRITER_FIND_WINDOW 65536
 
 typedef struct bp__writer_s bp__writer_t;
 typedef int (*bp__writer_cb)(bp__writer_t* w, void* data);
+typedef int (*bp__writer_seek_cb)(bp__writer_t* w,
+                                  const uint64_t offset,
+                                  void* data);
 
 enum comp_type {
   kNotCompressed = 0,
-  kCompressed = 1
+  kCompressed = 1,
+
+  /* compressed with database's dictionary if it has one */
+  kDictCompressed = 2
 };
 
 int bp__writer_create(bp__writer_t* w, const char* filename);
@@ -32,6 +57,7 @@ int bp__writer_compact_finalize(bp__writer_t* s, bp__writer_t* t);
 
 int bp__writer_read(bp__writer_t* w,
                     const enum comp_type comp,
+                    const enum alloc_type alloc,
                     const uint64_t offset,
                     uint64_t* size,
                     void** data);
@@ -41,11 +67,49 @@ int bp__writer_write(bp__writer_t* w,
                      uint64_t* offset,
                      uint64_t* size);
 
+/*
+ * Space reuse: blocks released by copy-on-write are written over after
+ * they've become free (see private/freelist.h). Pages, values and
+ * free list itself are written into free extents through `pfd`,
+ * which is opened without O_APPEND, heads are written in place with
+ * bp__writer_write_at (see BP__HEAD_RING_SLOTS in private/tree.h).
+ */
+int bp__writer_reuse(bp__writer_t* w);
+int bp__writer_write_at(bp__writer_t* w,
+                        const void* data,
+                        const uint64_t offset,
+                        const uint64_t size);
+int bp__writer_release(bp__writer_t* w,
+                       const uint64_t offset,
+                       const uint64_t size);
+void bp__writer_discard(bp__writer_t* w);
+
+/*
+ * Segmented database: `filename` is a directory, `fd` and `filesize` are
+ * descriptor and end of its last segment (see private/segments.h).
+ * Records are appended to the next segment once the last one has
+ * `segment_size` bytes (0 - never), removed segments are reported as
+ * BP_ENOTFOUND by bp__writer_read.
+ */
+int bp__writer_next_segment(bp__writer_t* w);
+
+/*
+ * Value log: values are written to separate file `vlog` with codec,
+ * dictionary and alignment of database (bp__writer_vlog_update copies
+ * them after they were changed), pages stay in database file.
+ * bp__writer_fsync syncs value log before database.
+ */
+int bp__writer_vlog_name(const char* filename,
+                         const uint64_t generation,
+                         char** name);
+int bp__writer_open_vlog(bp__writer_t* w, const char* name);
+void bp__writer_vlog_update(bp__writer_t* w);
+
 int bp__writer_find(bp__writer_t* w,
                     const enum comp_type comp,
                     const uint64_t size,
                     void* data,
-                    bp__writer_cb seek,
+                    bp__writer_seek_cb seek,
                     bp__writer_cb miss);
 
 struct bp__writer_s {
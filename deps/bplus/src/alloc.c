@@ -0,0 +1,257 @@
+#include <stdlib.h> /* malloc, free */
+#include <pthread.h>
+
+#include "bplus.h"
+#include "private/alloc.h"
+
+#define BP__ARENA_ROUND(size)\
+    (((size) + BP__ARENA_ALIGN - 1) & ~((uint64_t) BP__ARENA_ALIGN - 1))
+#define BP__ARENA_HEADER_SIZE BP__ARENA_ROUND(sizeof(bp__arena_chunk_t))
+#define BP__ARENA_DATA(chunk) ((char*) (chunk) + BP__ARENA_HEADER_SIZE)
+
+static bp_malloc_cb bp__malloc_cb = malloc;
+static bp_free_cb bp__free_cb = free;
+
+static pthread_once_t bp__arena_once = PTHREAD_ONCE_INIT;
+static pthread_key_t bp__arena_key;
+static int bp__arena_key_ret = -1;
+
+
+void bp_set_allocator(bp_malloc_cb malloc_cb, bp_free_cb free_cb) {
+  bp__malloc_cb = malloc_cb == NULL ? malloc : malloc_cb;
+  bp__free_cb = free_cb == NULL ? free : free_cb;
+}
+
+
+void* bp__malloc(size_t size) {
+  return bp__malloc_cb(size);
+}
+
+
+void bp__free(void* ptr) {
+  if (ptr != NULL) bp__free_cb(ptr);
+}
+
+
+static void bp__arena_destroy(void* data) {
+  bp__arena_t* arena = (bp__arena_t*) data;
+  bp__arena_chunk_t* chunk;
+
+  while (arena->chunks != NULL) {
+    chunk = arena->chunks;
+    arena->chunks = chunk->next;
+    bp__free(chunk);
+  }
+  bp__free(arena->scratch);
+  bp__free(arena);
+}
+
+
+static void bp__arena_key_init(void) {
+  bp__arena_key_ret = pthread_key_create(&bp__arena_key, bp__arena_destroy);
+}
+
+
+static bp__arena_t* bp__arena_get(void) {
+  if (bp__arena_key_ret != 0) return NULL;
+  return (bp__arena_t*) pthread_getspecific(bp__arena_key);
+}
+
+
+static bp__arena_t* bp__arena_create(void) {
+  bp__arena_t* arena;
+
+  pthread_once(&bp__arena_once, bp__arena_key_init);
+  if (bp__arena_key_ret != 0) return NULL;
+
+  arena = bp__arena_get();
+  if (arena != NULL) return arena;
+
+  /* no arena - all allocations will go to heap */
+  arena = bp__malloc(sizeof(*arena));
+  if (arena == NULL) return NULL;
+
+  arena->chunks = NULL;
+  arena->depth = 0;
+  arena->scratch = NULL;
+  arena->scratch_size = 0;
+  arena->scratch_used = 0;
+  if (pthread_setspecific(bp__arena_key, arena) != 0) {
+    bp__free(arena);
+    return NULL;
+  }
+
+  return arena;
+}
+
+
+void bp__arena_enter(void) {
+  bp__arena_t* arena;
+
+  arena = bp__arena_create();
+  if (arena == NULL) return;
+
+  arena->depth++;
+}
+
+
+void bp__arena_leave(void) {
+  bp__arena_t* arena;
+  bp__arena_chunk_t* chunk;
+
+  arena = bp__arena_get();
+  if (arena == NULL || arena->depth == 0) return;
+
+  if (--arena->depth != 0) return;
+
+  /* keep only one regular chunk for the next operation */
+  while (arena->chunks != NULL &&
+         (arena->chunks->next != NULL ||
+          arena->chunks->size != BP__ARENA_CHUNK_SIZE)) {
+    chunk = arena->chunks;
+    arena->chunks = chunk->next;
+    bp__free(chunk);
+  }
+  if (arena->chunks != NULL) arena->chunks->used = 0;
+}
+
+
+void* bp__arena_alloc(size_t size) {
+  bp__arena_t* arena;
+  bp__arena_chunk_t* chunk;
+  uint64_t rsize, csize;
+  char* res;
+
+  arena = bp__arena_get();
+  if (arena == NULL || arena->depth == 0) return bp__malloc(size);
+
+  rsize = BP__ARENA_ROUND(size);
+  chunk = arena->chunks;
+  if (chunk == NULL || chunk->used + rsize > chunk->size) {
+    csize = rsize > BP__ARENA_CHUNK_SIZE ? rsize : BP__ARENA_CHUNK_SIZE;
+
+    chunk = bp__malloc(BP__ARENA_HEADER_SIZE + csize);
+    if (chunk == NULL) return NULL;
+
+    chunk->size = csize;
+    chunk->used = 0;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+  }
+
+  res = BP__ARENA_DATA(chunk) + chunk->used;
+  chunk->used += rsize;
+
+  return res;
+}
+
+
+void bp__arena_free(void* ptr) {
+  bp__arena_t* arena;
+  bp__arena_chunk_t* chunk;
+  char* data;
+
+  if (ptr == NULL) return;
+
+  /* memory is owned by arena and will be released at once */
+  arena = bp__arena_get();
+  if (arena != NULL) {
+    for (chunk = arena->chunks; chunk != NULL; chunk = chunk->next) {
+      data = BP__ARENA_DATA(chunk);
+      if ((char*) ptr >= data && (char*) ptr < data + chunk->size) return;
+    }
+  }
+
+  bp__free(ptr);
+}
+
+
+void* bp__alloc(const enum alloc_type type, size_t size) {
+  return type == kArenaAlloc ? bp__arena_alloc(size) : bp__malloc(size);
+}
+
+
+void* bp__scratch_alloc(size_t size) {
+  bp__arena_t* arena;
+  uint64_t new_size;
+  char* scratch;
+
+  arena = bp__arena_create();
+  if (arena == NULL || arena->scratch_used) return bp__malloc(size);
+
+  if (arena->scratch_size < size) {
+    new_size = arena->scratch_size == 0 ? BP__ARENA_CHUNK_SIZE :
+                                          arena->scratch_size;
+    while (new_size < size) new_size <<= 1;
+
+    scratch = bp__malloc(new_size);
+    if (scratch == NULL) return NULL;
+
+    bp__free(arena->scratch);
+    arena->scratch = scratch;
+    arena->scratch_size = new_size;
+  }
+
+  arena->scratch_used = 1;
+  return arena->scratch;
+}
+
+
+void bp__scratch_release(void* ptr) {
+  bp__arena_t* arena;
+
+  if (ptr == NULL) return;
+
+  arena = bp__arena_get();
+  if (arena == NULL || ptr != arena->scratch) {
+    bp__free(ptr);
+    return;
+  }
+
+  arena->scratch_used = 0;
+
+  /* don't keep memory after huge blocks */
+  if (arena->scratch_size > BP__SCRATCH_MAX_SIZE) {
+    bp__free(arena->scratch);
+    arena->scratch = NULL;
+    arena->scratch_size = 0;
+  }
+}
+
+
+void bp__arena_mark(bp__arena_mark_t* mark) {
+  bp__arena_t* arena;
+
+  arena = bp__arena_get();
+  if (arena == NULL || arena->depth == 0) {
+    mark->chunk = NULL;
+    mark->used = 0;
+    return;
+  }
+
+  mark->chunk = arena->chunks;
+  mark->used = arena->chunks == NULL ? 0 : arena->chunks->used;
+}
+
+
+void bp__arena_rewind(const bp__arena_mark_t* mark) {
+  bp__arena_t* arena;
+  bp__arena_chunk_t* chunk;
+
+  arena = bp__arena_get();
+  if (arena == NULL || arena->depth == 0) return;
+
+  while (arena->chunks != mark->chunk) {
+    chunk = arena->chunks;
+
+    /* arena was empty at mark, reuse last chunk instead of freeing it */
+    if (chunk->next == NULL && mark->chunk == NULL) {
+      chunk->used = 0;
+      return;
+    }
+
+    arena->chunks = chunk->next;
+    bp__free(chunk);
+  }
+  if (arena->chunks != NULL) arena->chunks->used = mark->used;
+}
@@ -1,20 +1,185 @@
-#include <stdlib.h> /* malloc */
-#include <string.h> /* strlen */
+#include <assert.h> /* assert */
+#include <string.h> /* strlen, memcpy, memset */
+#include <unistd.h> /* unlink */
+#include <time.h> /* time */
 
 #include "bplus.h"
+#include "private/compare.h"
+#include "private/compressor.h"
+#include "private/merge.h"
 #include "private/utils.h"
 
 
+void bp_options_init(bp_options_t* options) {
+  options->key_mode = BP_KEY_BYTES;
+  options->compare = BP_COMPARE_BYTES;
+  options->codec = bp__codec_default();
+  options->codec_level = 0;
+  options->codec_min_saving = BP__COMPRESS_MIN_SAVING;
+  options->alignment = BP_PADDING;
+  options->dict = NULL;
+  options->dict_size = 0;
+  options->dict_pages = 0;
+  options->reuse_space = 0;
+  options->segment_size = 0;
+  options->value_log = 0;
+  options->chunk_size = BP_CHUNK_SIZE;
+  options->expiry = 0;
+}
+
+
 int bp_open(bp_db_t* tree, const char* filename) {
+  return bp_open_opts(tree, filename, NULL);
+}
+
+
+int bp_open_opts(bp_db_t* tree,
+                 const char* filename,
+                 const bp_options_t* options) {
   int ret;
+  int align_log;
+  int segment_log;
+  int chunk_log;
+  int created;
+  bp_options_t defaults;
+
+  if (options == NULL) {
+    bp_options_init(&defaults);
+    options = &defaults;
+  }
+
+  if (bp__compare_builtin(options->compare) == NULL) return BP_ECOMPARE;
+  if (!bp__codec_supported(options->codec) ||
+      options->codec_level < 0 ||
+      options->codec_level > BP__HEAD_CODEC_MASK ||
+      options->codec_min_saving < 0 ||
+      options->codec_min_saving > 100) {
+    return BP_ECODEC;
+  }
+  if (options->dict != NULL && !bp__codec_supported(BP_CODEC_ZSTD)) {
+    return BP_ECODEC;
+  }
+  if (options->alignment <= 0 ||
+      options->alignment > BP__WRITER_MAX_ALIGNMENT ||
+      (options->alignment & (options->alignment - 1)) != 0) {
+    return BP_EALIGNMENT;
+  }
+  if (options->segment_size != 0 &&
+      (options->segment_size < BP__SEGMENT_MIN_SIZE ||
+       options->segment_size > BP__SEGMENT_MAX_SIZE ||
+       (options->segment_size & (options->segment_size - 1)) != 0 ||
+       options->reuse_space ||
+       options->value_log)) {
+    return BP_ESEGMENT;
+  }
+  if (options->chunk_size != 0 &&
+      (options->chunk_size < BP__CHUNK_MIN_SIZE ||
+       options->chunk_size > BP__CHUNK_MAX_SIZE ||
+       (options->chunk_size & (options->chunk_size - 1)) != 0)) {
+    return BP_ECHUNK;
+  }
+
+  /* directory of new segmented database */
+  if (options->segment_size != 0) {
+    ret = bp__segments_mkdir(filename);
+    if (ret != BP_OK) return ret;
+  }
 
   ret = bp__rwlock_init(&tree->rwlock);
   if (ret != BP_OK) return ret;
 
   ret = bp__writer_create((bp__writer_t*) tree, filename);
   if (ret != BP_OK) goto fatal;
+  created = tree->filesize == 0;
 
   tree->head.page = NULL;
+  tree->head.seq = 0;
+  tree->head.record = 0;
+  tree->head.free_offset = 0;
+  tree->head.free_size = 0;
+  tree->head.free_next = 0;
+  tree->head.free_used = 0;
+  tree->head.free_last = 0;
+  tree->head.free_last_used = 0;
+  tree->head.segments_offset = 0;
+  tree->head.segments_size = 0;
+  tree->snapshots = 0;
+  tree->durable_seq = 0;
+
+  /* format of new database, will be replaced by existing head's one */
+  if (options->key_mode == BP_KEY_UINT64) {
+    tree->head.flags = BP__HEAD_FLAG_UINT64_KEYS;
+  } else {
+    tree->head.flags = BP__HEAD_FLAG_FRONTCODED;
+  }
+  tree->head.flags |= (uint64_t) options->compare << BP__HEAD_COMPARE_SHIFT;
+  if (options->expiry) tree->head.flags |= BP__HEAD_FLAG_EXPIRY;
+  tree->head.flags |= BP__HEAD_FLAG_CODEC_TAGS;
+  tree->head.flags |= (uint64_t) options->codec << BP__HEAD_CODEC_SHIFT;
+  tree->head.flags |=
+      (uint64_t) options->codec_level << BP__HEAD_CODEC_LEVEL_SHIFT;
+  for (align_log = 0; (1 << align_log) < options->alignment; align_log++);
+  tree->head.flags |= (uint64_t) (align_log + 1) << BP__HEAD_ALIGN_SHIFT;
+  if (tree->segments != NULL) {
+    tree->head.flags |= BP__HEAD_FLAG_SEGMENTS;
+    if (options->segment_size != 0) {
+      for (segment_log = 0;
+           ((uint64_t) 1 << segment_log) < options->segment_size;
+           segment_log++);
+      tree->head.flags |=
+          (uint64_t) (segment_log + 1) << BP__HEAD_SEGMENT_SHIFT;
+    }
+  }
+  if (options->chunk_size != 0) {
+    for (chunk_log = 0;
+         ((uint64_t) 1 << chunk_log) < options->chunk_size;
+         chunk_log++);
+    tree->head.flags |= (uint64_t) (chunk_log + 1) << BP__HEAD_CHUNK_SHIFT;
+  }
+  bp__tree_set_codec(tree);
+  bp__tree_set_alignment(tree);
+  bp__tree_set_segment_size(tree);
+  bp__tree_set_chunk_size(tree);
+  tree->codec_min_saving = options->codec_min_saving;
+
+  /* ring of heads is the first block of new database reusing space */
+  if (options->reuse_space && created && tree->segments == NULL) {
+    tree->head.flags |= BP__HEAD_FLAG_REUSE;
+
+    ret = bp__tree_write_ring(tree);
+    if (ret != BP_OK) {
+      bp__writer_destroy((bp__writer_t*) tree);
+      goto fatal;
+    }
+  }
+
+  /* dictionary follows it */
+  if (options->dict != NULL && options->dict_size != 0 && created) {
+    tree->head.flags |= BP__HEAD_FLAG_DICT;
+    if (options->dict_pages) tree->head.flags |= BP__HEAD_FLAG_DICT_PAGES;
+
+    ret = bp__tree_write_dict(tree, options->dict, options->dict_size);
+
+    /* segment with it is never cleaned, so it has nothing else */
+    if (ret == BP_OK && tree->segments != NULL) {
+      ret = bp__writer_next_segment((bp__writer_t*) tree);
+    }
+    if (ret != BP_OK) {
+      bp__writer_destroy((bp__writer_t*) tree);
+      goto fatal;
+    }
+  }
+
+  /* existing value log is opened after reading head */
+  if (options->value_log && created) {
+    tree->head.flags |= BP__HEAD_FLAG_VLOG;
+
+    ret = bp__tree_open_vlog(tree, filename, 0);
+    if (ret != BP_OK) {
+      bp__writer_destroy((bp__writer_t*) tree);
+      goto fatal;
+    }
+  }
 
   ret = bp__init(tree);
   if (ret != BP_OK) goto fatal;
@@ -28,34 +193,65 @@ fatal:
 
 
 int bp_close(bp_db_t* tree) {
+  int ret = BP_OK;
+
   bp__rwlock_wrlock(&tree->rwlock);
+
+  /* make space released since last bp_fsync reusable after reopening */
+  if (tree->freelist != NULL && tree->freelist->pending_count != 0 &&
+      tree->snapshots == 0) {
+    ret = bp__tree_sync(tree);
+    if (ret == BP_OK) ret = bp__tree_write_head((bp__writer_t*) tree, NULL);
+  }
+
+  /* and keep garbage of segments found since it was opened */
+  if (tree->segments != NULL && tree->segments->dirty) {
+    ret = bp__tree_write_segments(tree);
+    if (ret == BP_OK) ret = bp__tree_write_head((bp__writer_t*) tree, NULL);
+  }
+
   bp__destroy(tree);
-  bp__rwlock_unlock(&tree->rwlock);
+  bp__rwlock_wrunlock(&tree->rwlock);
 
   bp__rwlock_destroy(&tree->rwlock);
-  return BP_OK;
+  return ret;
 }
 
 
 int bp__init(bp_db_t* tree) {
   int ret;
+  bp_compare_cb compare_cb;
   /*
    * Load head.
    * Writer will not compress data chunk smaller than head,
    * that's why we're passing head size as compressed size here
    */
-  ret = bp__writer_find((bp__writer_t*) tree,
-                        kNotCompressed,
-                        BP__HEAD_SIZE,
-                        &tree->head,
-                        bp__tree_read_head,
-                        bp__tree_write_head);
-  if (ret == BP_OK) {
-    /* set default compare function */
-    bp_set_compare_cb(tree, bp__default_compare_cb);
+  ret = bp__tree_read_ring(tree);
+  if (ret == BP_ENOTFOUND) {
+    ret = bp__writer_find((bp__writer_t*) tree,
+                          kNotCompressed,
+                          BP__HEAD_MAX_SIZE,
+                          &tree->head,
+                          bp__tree_read_head,
+                          bp__tree_write_head);
   }
+  if (ret != BP_OK) return ret;
 
-  return ret;
+  /* database was written with codec that wasn't compiled in */
+  if (!bp__tree_codecs_supported(tree)) {
+    bp__destroy(tree);
+    return BP_ECODEC;
+  }
+
+  /* set compare function stored in head */
+  compare_cb = bp__compare_builtin(BP__HEAD_COMPARE(tree->head.flags));
+  if (compare_cb == NULL) {
+    bp__destroy(tree);
+    return BP_ECOMPARE;
+  }
+  bp_set_compare_cb(tree, compare_cb);
+
+  return BP_OK;
 }
 
 
@@ -72,10 +268,58 @@ int bp_get(bp_db_t* tree, const bp_key_t* key, bp_value_t* value) {
   int ret;
 
   bp__rwlock_rdlock(&tree->rwlock);
+  bp__arena_enter();
+
+  ret = bp__page_get(tree, tree->head.page, key, value, NULL);
+
+  bp__arena_leave();
+  bp__rwlock_rdunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+int bp_get_partial(bp_db_t* tree,
+                   const bp_key_t* key,
+                   const uint64_t offset,
+                   const uint64_t length,
+                   bp_value_t* value) {
+  int ret;
+  uint64_t size;
+  bp__kv_t ref;
+  bp_stream_t stream;
+
+  bp__rwlock_rdlock(&tree->rwlock);
+  bp__arena_enter();
 
-  ret = bp__page_get(tree, tree->head.page, key, value);
+  ret = bp__page_get(tree, tree->head.page, key, NULL, &ref);
+  if (ret == BP_OK) {
+    ret = bp__stream_init(tree, &stream, ref.offset, ref.config);
+  }
+  if (ret != BP_OK) goto done;
+
+  size = offset < stream.length ? stream.length - offset : 0;
+  if (size > length) size = length;
+
+  value->value = bp__malloc(size);
+  if (value->value == NULL && size != 0) {
+    ret = BP_EALLOC;
+  } else {
+    ret = bp__stream_read(tree,
+                          &stream,
+                          offset,
+                          size,
+                          value->value,
+                          &value->length);
+    if (ret != BP_OK) bp__free(value->value);
+  }
+  value->_prev_offset = 0;
+  value->_prev_length = 0;
+  bp__stream_destroy(tree, &stream);
 
-  bp__rwlock_unlock(&tree->rwlock);
+done:
+  bp__arena_leave();
+  bp__rwlock_rdunlock(&tree->rwlock);
 
   return ret;
 }
@@ -99,16 +343,52 @@ int bp_update(bp_db_t* tree,
               const bp_value_t* value,
               bp_update_cb update_cb,
               void* arg) {
+  return bp__tree_insert(tree, key, value, 0, BP__MERGE_NONE, update_cb, arg);
+}
+
+
+int bp_update_existing(bp_db_t* tree,
+                       const bp_key_t* key,
+                       const bp_value_t* value,
+                       bp_update_cb update_cb,
+                       void* arg) {
+  return bp__tree_insert(tree,
+                         key,
+                         value,
+                         0,
+                         BP__MERGE_EXISTING,
+                         update_cb,
+                         arg);
+}
+
+
+int bp__tree_insert(bp_db_t* tree,
+                    const bp_key_t* key,
+                    const bp_value_t* value,
+                    const uint64_t expires,
+                    const int merge,
+                    bp_update_cb update_cb,
+                    void* arg) {
   int ret;
 
   bp__rwlock_wrlock(&tree->rwlock);
-
-  ret = bp__page_insert(tree, tree->head.page, key, value, update_cb, arg);
+  bp__arena_enter();
+
+  ret = bp__page_insert(tree,
+                        tree->head.page,
+                        key,
+                        value,
+                        expires,
+                        merge,
+                        update_cb,
+                        arg);
   if (ret == BP_OK) {
     ret = bp__tree_write_head((bp__writer_t*) tree, NULL);
   }
+  if (ret != BP_OK) bp__writer_discard((bp__writer_t*) tree);
 
-  bp__rwlock_unlock(&tree->rwlock);
+  bp__arena_leave();
+  bp__rwlock_wrunlock(&tree->rwlock);
 
   return ret;
 }
@@ -126,6 +406,7 @@ int bp_bulk_update(bp_db_t* tree,
   uint64_t left = count;
 
   bp__rwlock_wrlock(&tree->rwlock);
+  bp__arena_enter();
 
   ret = bp__page_bulk_insert(tree,
                              tree->head.page,
@@ -138,8 +419,10 @@ int bp_bulk_update(bp_db_t* tree,
   if (ret == BP_OK) {
     ret =  bp__tree_write_head((bp__writer_t*) tree, NULL);
   }
+  if (ret != BP_OK) bp__writer_discard((bp__writer_t*) tree);
 
-  bp__rwlock_unlock(&tree->rwlock);
+  bp__arena_leave();
+  bp__rwlock_wrunlock(&tree->rwlock);
 
   return ret;
 }
@@ -150,6 +433,31 @@ int bp_set(bp_db_t* tree, const bp_key_t* key, const bp_value_t* value) {
 }
 
 
+int bp_set_ttl(bp_db_t* tree,
+               const bp_key_t* key,
+               const bp_value_t* value,
+               const uint64_t ttl) {
+  if (ttl == 0) return bp_set(tree, key, value);
+  if (!(tree->head.flags & BP__HEAD_FLAG_EXPIRY)) return BP_EEXPIRY;
+
+  return bp__tree_insert(tree,
+                         key,
+                         value,
+                         (uint64_t) time(NULL) + ttl,
+                         BP__MERGE_NONE,
+                         NULL,
+                         NULL);
+}
+
+
+int bp_merge(bp_db_t* tree,
+             const bp_key_t* key,
+             const int op,
+             const bp_value_t* operand) {
+  return bp__tree_insert(tree, key, operand, 0, op, NULL, NULL);
+}
+
+
 int bp_bulk_set(bp_db_t* tree,
                 const uint64_t count,
                 const bp_key_t** keys,
@@ -165,13 +473,16 @@ int bp_removev(bp_db_t* tree,
   int ret;
 
   bp__rwlock_wrlock(&tree->rwlock);
+  bp__arena_enter();
 
   ret = bp__page_remove(tree, tree->head.page, key, remove_cb, arg);
   if (ret == BP_OK) {
     ret = bp__tree_write_head((bp__writer_t*) tree, NULL);
   }
+  if (ret != BP_OK) bp__writer_discard((bp__writer_t*) tree);
 
-  bp__rwlock_unlock(&tree->rwlock);
+  bp__arena_leave();
+  bp__rwlock_wrunlock(&tree->rwlock);
 
   return ret;
 }
@@ -182,42 +493,299 @@ int bp_remove(bp_db_t* tree, const bp_key_t* key) {
 }
 
 
+int bp_expire(bp_db_t* tree, const uint64_t limit, uint64_t* removed) {
+  int ret;
+  int changed;
+  uint64_t left = limit;
+
+  *removed = 0;
+  if (!(tree->head.flags & BP__HEAD_FLAG_EXPIRY)) return BP_OK;
+
+  bp__rwlock_wrlock(&tree->rwlock);
+  bp__arena_enter();
+
+  ret = bp__page_expire(tree, tree->head.page, &left, &changed);
+  if (ret == BP_OK && changed) {
+    ret = bp__page_release(tree, tree->head.page);
+    if (ret == BP_OK) ret = bp__page_save(tree, tree->head.page);
+    if (ret == BP_OK) {
+      ret = bp__tree_write_head((bp__writer_t*) tree, NULL);
+    }
+  }
+  if (ret == BP_OK) {
+    *removed = limit - left;
+  } else {
+    bp__writer_discard((bp__writer_t*) tree);
+  }
+
+  bp__arena_leave();
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
 int bp_compact(bp_db_t* tree) {
+  /* segments are cleaned in place */
+  if (tree->segments != NULL) return bp__tree_clean(tree, 0);
+
+  /* keep current dictionary */
+  if (tree->dict != NULL) {
+    return bp__tree_compact(tree,
+                            tree->dict->data,
+                            tree->dict->size,
+                            tree->head.flags & BP__HEAD_FLAG_DICT_PAGES,
+                            0);
+  }
+  return bp__tree_compact(tree, NULL, 0, 0, 0);
+}
+
+
+int bp_compact_values(bp_db_t* tree) {
+  if (tree->segments != NULL) return bp__tree_clean(tree, 0);
+
+  if (tree->dict != NULL) {
+    return bp__tree_compact(tree,
+                            tree->dict->data,
+                            tree->dict->size,
+                            tree->head.flags & BP__HEAD_FLAG_DICT_PAGES,
+                            1);
+  }
+  return bp__tree_compact(tree, NULL, 0, 0, 1);
+}
+
+
+int bp_clean(bp_db_t* tree, const int min_garbage) {
+  if (tree->segments == NULL || min_garbage < 0 || min_garbage > 100) {
+    return BP_ESEGMENT;
+  }
+  return bp__tree_clean(tree, min_garbage);
+}
+
+
+int bp_compact_dict(bp_db_t* tree, const uint64_t dict_size, const int pages) {
+  int ret;
+  uint64_t size;
+  char* dict;
+
+  /* cleaning copies compressed blocks as they are */
+  if (tree->segments != NULL) return BP_ESEGMENT;
+
+  if (dict_size == 0) return bp__tree_compact(tree, NULL, 0, 0, 1);
+  if (!bp__codec_supported(BP_CODEC_ZSTD)) return BP_ECODEC;
+
+  size = dict_size;
+  ret = bp__tree_train_dict(tree, &size, &dict);
+  if (ret != BP_OK) return ret;
+
+  ret = bp__tree_compact(tree, dict, size, pages, 1);
+  bp__free(dict);
+
+  return ret;
+}
+
+
+int bp__tree_compact(bp_db_t* tree,
+                     const char* dict,
+                     const uint64_t dict_size,
+                     const int dict_pages,
+                     const int values) {
   int ret;
+  int copy_values;
+  uint64_t generation;
   char* compacted_name;
+  char* vlog_name;
   bp_db_t compacted;
+  bp_options_t options;
+
+  /*
+   * Opened snapshots are referencing pages in the current file. Compaction
+   * pins current tree like a snapshot while it's copied, so space released
+   * by concurrent writes isn't reused until it's done.
+   */
+  bp__rwlock_wrlock(&tree->rwlock);
+  ret = tree->snapshots == 0 ? BP_OK : BP_ECOMPACT_SNAPSHOT;
+  if (ret == BP_OK) tree->snapshots++;
+  bp__rwlock_wrunlock(&tree->rwlock);
+  if (ret != BP_OK) return ret;
 
   /* get name of compacted database (prefixed with .compact) */
   ret = bp__writer_compact_name((bp__writer_t*) tree, &compacted_name);
-  if (ret != BP_OK) return ret;
+  if (ret != BP_OK) {
+    bp__rwlock_wrlock(&tree->rwlock);
+    tree->snapshots--;
+    bp__rwlock_wrunlock(&tree->rwlock);
+    return ret;
+  }
 
-  /* open it */
-  ret = bp_open(&compacted, compacted_name);
-  free(compacted_name);
-  if (ret != BP_OK) return ret;
+  /* open it, keys of compacted database are stored the same way */
+  options.key_mode = tree->head.flags & BP__HEAD_FLAG_UINT64_KEYS ?
+      BP_KEY_UINT64 : BP_KEY_BYTES;
+  options.compare = BP__HEAD_COMPARE(tree->head.flags);
+  if (tree->codec == BP__CODEC_LEGACY) {
+    options.codec = bp__codec_default();
+  } else {
+    options.codec = tree->codec;
+  }
+  options.codec_level = tree->codec_level;
+  options.codec_min_saving = tree->codec_min_saving;
+  options.alignment = (int) tree->alignment;
+  options.dict = dict;
+  options.dict_size = dict_size;
+  options.dict_pages = dict_pages;
+  options.reuse_space = (tree->head.flags & BP__HEAD_FLAG_REUSE) != 0;
+  options.segment_size = 0;
+  options.value_log = 0;
+  options.chunk_size = tree->chunk_size;
+  options.expiry = (tree->head.flags & BP__HEAD_FLAG_EXPIRY) != 0;
+  ret = bp_open_opts(&compacted, compacted_name, &options);
+  if (ret != BP_OK) {
+    /* don't leave partially created file behind */
+    unlink(compacted_name);
+    bp__free(compacted_name);
+    bp__rwlock_wrlock(&tree->rwlock);
+    tree->snapshots--;
+    bp__rwlock_wrunlock(&tree->rwlock);
+    return ret;
+  }
+  bp__free(compacted_name);
+
+  /*
+   * Pages of compacted database reference the same value log, values are
+   * copied only into the log of the next generation (named after source
+   * database, it replaces current one after rename)
+   */
+  copy_values = values || tree->vlog == NULL;
+  generation = BP__HEAD_VLOG(tree->head.flags);
+  if (tree->vlog != NULL) {
+    compacted.head.flags |= BP__HEAD_FLAG_VLOG;
+    compacted.head.flags |=
+        ((generation + values) & BP__HEAD_VLOG_MASK) << BP__HEAD_VLOG_SHIFT;
+
+    ret = bp__tree_open_vlog(&compacted, tree->filename, values);
+    if (ret != BP_OK) goto fatal;
+  }
 
   /* destroy stub head page */
   bp__page_destroy(&compacted, compacted.head.page);
+  compacted.head.page = NULL;
 
   bp__rwlock_rdlock(&tree->rwlock);
 
   /* clone source tree's head page */
   ret = bp__page_clone(&compacted, tree->head.page, &compacted.head.page);
 
-  bp__rwlock_unlock(&tree->rwlock);
+  bp__rwlock_rdunlock(&tree->rwlock);
+  if (ret != BP_OK) goto fatal;
 
   /* copy all pages starting from head */
-  ret = bp__page_copy(tree, &compacted, compacted.head.page);
-  if (ret != BP_OK) return ret;
+  bp__arena_enter();
+  ret = bp__page_copy(tree, &compacted, compacted.head.page, copy_values);
+  bp__arena_leave();
+  if (ret != BP_OK) goto fatal;
 
   ret = bp__tree_write_head((bp__writer_t*) &compacted, NULL);
-  if (ret != BP_OK) return ret;
+  if (ret != BP_OK) goto fatal;
+
+  bp__rwlock_wrlock(&tree->rwlock);
+
+  tree->snapshots--;
+  if (tree->snapshots == 0) {
+    ret = bp__writer_compact_finalize((bp__writer_t*) tree,
+                                      (bp__writer_t*) &compacted);
+
+    /* nothing references previous value log after rename */
+    if (ret == BP_OK && tree->vlog != NULL && values &&
+        bp__writer_vlog_name(tree->filename, generation, &vlog_name) ==
+            BP_OK) {
+      unlink(vlog_name);
+      bp__free(vlog_name);
+    }
+  } else {
+    /* snapshot was opened while compacting - drop compacted database */
+    unlink(compacted.filename);
+    if (compacted.vlog != NULL && values) unlink(compacted.vlog->filename);
+    bp_close(&compacted);
+    ret = BP_ECOMPACT_SNAPSHOT;
+  }
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return ret;
+
+fatal:
+  /* remove compacted database, so the next compaction may be started */
+  unlink(compacted.filename);
+  if (compacted.vlog != NULL && values) unlink(compacted.vlog->filename);
+  bp_close(&compacted);
 
   bp__rwlock_wrlock(&tree->rwlock);
+  tree->snapshots--;
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+int bp__tree_clean(bp_db_t* t, const int min_garbage) {
+  int ret = BP_OK;
+  int moved;
+  char* victims;
+  uint64_t i, count, last;
+  bp__segment_t* segment;
+
+  bp__rwlock_wrlock(&t->rwlock);
+
+  /* opened snapshots may reference blocks in any segment */
+  if (t->snapshots != 0) {
+    bp__rwlock_wrunlock(&t->rwlock);
+    return BP_ECOMPACT_SNAPSHOT;
+  }
+
+  count = t->segments->count;
+  victims = bp__malloc(count);
+  if (victims == NULL) {
+    bp__rwlock_wrunlock(&t->rwlock);
+    return BP_EALLOC;
+  }
+
+  /*
+   * Last segment is being written and the first one has only dictionary
+   * (if database has it), others are cleaned if they have enough garbage
+   */
+  moved = 0;
+  last = count - 1;
+  for (i = 0; i < count; i++) {
+    segment = &t->segments->list[i];
+    victims[i] = i != last && segment->fd != -1 &&
+                 !(i == 0 && (t->head.flags & BP__HEAD_FLAG_DICT)) &&
+                 segment->dead * 100 >= segment->size * min_garbage;
+    moved |= victims[i];
+  }
+
+  /* copy live blocks from them, tree is rewritten up to the head */
+  if (moved) {
+    bp__arena_enter();
+    ret = bp__page_relocate(t, t->head.page, victims, count, &moved);
+    if (ret == BP_OK &&
+        (moved || victims[BP__SEGMENT(t->head.page->offset)])) {
+      ret = bp__page_release(t, t->head.page);
+      if (ret == BP_OK) ret = bp__page_save(t, t->head.page);
+    }
+    if (ret == BP_OK) ret = bp__tree_write_segments(t);
+    if (ret == BP_OK) {
+      ret = bp__tree_write_head((bp__writer_t*) t, NULL);
+    }
+    bp__arena_leave();
+
+    /* segments are removed only when new head is durable */
+    if (ret == BP_OK) ret = bp__writer_fsync((bp__writer_t*) t);
+    for (i = 0; ret == BP_OK && i < count; i++) {
+      if (victims[i]) ret = bp__segments_remove(t->segments, i);
+    }
+  }
 
-  ret = bp__writer_compact_finalize((bp__writer_t*) tree,
-                                    (bp__writer_t*) &compacted);
-  bp__rwlock_unlock(&tree->rwlock);
+  bp__free(victims);
+  bp__rwlock_wrunlock(&t->rwlock);
 
   return ret;
 }
@@ -229,19 +797,36 @@ int bp_get_filtered_range(bp_db_t* tree,
                           bp_filter_cb filter,
                           bp_range_cb cb,
                           void* arg) {
+  return bp_get_stoppable_range(tree, start, end, filter, NULL, cb, arg);
+}
+
+
+int bp_get_stoppable_range(bp_db_t* tree,
+                           const bp_key_t* start,
+                           const bp_key_t* end,
+                           bp_filter_cb filter,
+                           bp_stop_cb stop,
+                           bp_range_cb cb,
+                           void* arg) {
   int ret;
 
   bp__rwlock_rdlock(&tree->rwlock);
+  bp__arena_enter();
 
   ret = bp__page_get_range(tree,
                            tree->head.page,
                            start,
                            end,
                            filter,
+                           stop,
                            cb,
                            arg);
 
-  bp__rwlock_unlock(&tree->rwlock);
+  /* scan was stopped */
+  if (ret == BP_ERANGEABORT) ret = BP_OK;
+
+  bp__arena_leave();
+  bp__rwlock_rdunlock(&tree->rwlock);
 
   return ret;
 }
@@ -261,97 +846,449 @@ int bp_get_range(bp_db_t* tree,
 }
 
 
-/* Wrappers to allow string to string set/get/remove */
-
-
-int bp_gets(bp_db_t* tree, const char* key, char** value) {
+int bp_snapshot_open(bp_db_t* tree, bp_snapshot_t* snapshot) {
   int ret;
-  bp_key_t bkey;
-  bp_value_t bvalue;
 
-  BP__STOVAL(key, bkey);
+  bp__rwlock_wrlock(&tree->rwlock);
 
-  ret = bp_get(tree, &bkey, &bvalue);
-  if (ret != BP_OK) return ret;
+  ret = bp__snapshot_init(tree,
+                          tree->head.offset,
+                          tree->head.config,
+                          snapshot);
+  if (ret == BP_OK) tree->snapshots++;
 
-  *value = bvalue.value;
+  bp__rwlock_wrunlock(&tree->rwlock);
 
-  return BP_OK;
+  return ret;
 }
 
 
-int bp_updates(bp_db_t* tree,
-               const char* key,
-               const char* value,
-               bp_update_cb update_cb,
-               void* arg) {
-  bp_key_t bkey;
-  bp_value_t bvalue;
+int bp_snapshot_open_at(bp_db_t* tree,
+                        const uint64_t revision,
+                        bp_snapshot_t* snapshot) {
+  int ret;
+  bp__tree_head_t head;
 
-  BP__STOVAL(key, bkey);
-  BP__STOVAL(value, bvalue);
+  bp__rwlock_wrlock(&tree->rwlock);
 
-  return bp_update(tree, &bkey, &bvalue, update_cb, arg);
+  /* blocks of older revisions may be reused already */
+  if ((tree->head.flags & BP__HEAD_FLAG_REUSE) &&
+      revision != tree->head.record) {
+    ret = BP_ENOTFOUND;
+  } else {
+    ret = bp__tree_load_head(tree, revision, &head);
+  }
+  if (ret == BP_OK) {
+    ret = bp__snapshot_init(tree, head.offset, head.config, snapshot);
+  }
+  if (ret == BP_OK) tree->snapshots++;
+
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return ret;
 }
 
 
-int bp_sets(bp_db_t* tree, const char* key, const char* value) {
-  return bp_updates(tree, key, value, NULL, NULL);
+int bp_snapshot_close(bp_db_t* tree, bp_snapshot_t* snapshot) {
+  bp__rwlock_wrlock(&tree->rwlock);
+
+  bp__snapshot_destroy(tree, snapshot);
+  tree->snapshots--;
+
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return BP_OK;
 }
 
 
-int bp_bulk_updates(bp_db_t* tree,
-                    const uint64_t count,
-                    const char** keys,
-                    const char** values,
-                    bp_update_cb update_cb,
-                    void* arg) {
+int bp_get_revisions(bp_db_t* tree, bp_revision_cb cb, void* arg) {
   int ret;
-  bp_key_t* bkeys;
-  bp_value_t* bvalues;
-  uint64_t i;
+  uint64_t offset;
+  bp__tree_head_t head;
+  bp_revision_t revision;
 
-  /* allocated memory for keys/values */
-  bkeys = malloc(sizeof(*bkeys) * count);
-  if (bkeys == NULL) return BP_EALLOC;
+  bp__rwlock_rdlock(&tree->rwlock);
 
-  bvalues = malloc(sizeof(*bvalues) * count);
-  if (bvalues == NULL) {
-    free(bkeys);
-    return BP_EALLOC;
-  }
+  /* walk through the chain of heads */
+  offset = tree->head.record;
+  for (;;) {
+    ret = bp__tree_load_head(tree, offset, &head);
 
-  /* copy keys/values to allocated memory */
-  for (i = 0; i < count; i++) {
-    BP__STOVAL(keys[i], bkeys[i]);
-    BP__STOVAL(values[i], bvalues[i]);
-  }
+    /* segment with older heads was removed by bp_clean */
+    if (ret == BP_ENOTFOUND && offset != tree->head.record &&
+        tree->segments != NULL) {
+      ret = BP_OK;
+      break;
+    }
+    if (ret != BP_OK) break;
 
-  ret = bp_bulk_update(tree,
-                       count,
-                       (const bp_key_t**) &bkeys,
-                       (const bp_value_t**) &bvalues,
-                       update_cb,
-                       arg);
+    revision.offset = offset;
+    revision.seq = head.seq;
+    revision.time = head.time;
+    cb(arg, &revision);
+
+    /* first head of the file (or head written by older version) */
+    if (head.seq <= 1) break;
+
+    /* space of previous heads is reused */
+    if (head.flags & BP__HEAD_FLAG_REUSE) break;
+    offset = head.prev;
+  }
 
-  free(bkeys);
-  free(bvalues);
+  bp__rwlock_rdunlock(&tree->rwlock);
 
   return ret;
 }
 
 
-int bp_bulk_sets(bp_db_t* tree,
-                 const uint64_t count,
-                 const char** keys,
-                 const char** values) {
-  return bp_bulk_updates(tree, count, keys, values, NULL, NULL);
-}
+int bp_snapshot_get(bp_db_t* tree,
+                    bp_snapshot_t* snapshot,
+                    const bp_key_t* key,
+                    bp_value_t* value) {
+  int ret;
 
+  bp__rwlock_rdlock(&tree->rwlock);
+  bp__arena_enter();
 
-int bp_removevs(bp_db_t* tree,
-                const char* key,
-                bp_remove_cb remove_cb,
+  ret = bp__page_get(tree, snapshot->page, key, value, NULL);
+
+  bp__arena_leave();
+  bp__rwlock_rdunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+int bp_snapshot_get_filtered_range(bp_db_t* tree,
+                                   bp_snapshot_t* snapshot,
+                                   const bp_key_t* start,
+                                   const bp_key_t* end,
+                                   bp_filter_cb filter,
+                                   bp_range_cb cb,
+                                   void* arg) {
+  int ret;
+
+  bp__rwlock_rdlock(&tree->rwlock);
+  bp__arena_enter();
+
+  ret = bp__page_get_range(tree,
+                           snapshot->page,
+                           start,
+                           end,
+                           filter,
+                           NULL,
+                           cb,
+                           arg);
+
+  bp__arena_leave();
+  bp__rwlock_rdunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+int bp_snapshot_get_range(bp_db_t* tree,
+                          bp_snapshot_t* snapshot,
+                          const bp_key_t* start,
+                          const bp_key_t* end,
+                          bp_range_cb cb,
+                          void* arg) {
+  return bp_snapshot_get_filtered_range(tree,
+                                        snapshot,
+                                        start,
+                                        end,
+                                        bp__default_filter_cb,
+                                        cb,
+                                        arg);
+}
+
+
+int bp_cursor_open(bp_db_t* tree,
+                   bp_snapshot_t* snapshot,
+                   const bp_key_t* start,
+                   const bp_key_t* end,
+                   bp_cursor_t* cursor) {
+  int ret;
+
+  if (snapshot == NULL) {
+    ret = bp_snapshot_open(tree, &cursor->own_snapshot);
+    if (ret != BP_OK) return ret;
+
+    snapshot = &cursor->own_snapshot;
+  }
+  cursor->snapshot = snapshot;
+
+  bp__rwlock_rdlock(&tree->rwlock);
+  ret = bp__cursor_init(tree, cursor, start, end);
+  bp__rwlock_rdunlock(&tree->rwlock);
+
+  if (ret != BP_OK && snapshot == &cursor->own_snapshot) {
+    bp_snapshot_close(tree, snapshot);
+  }
+
+  return ret;
+}
+
+
+int bp_cursor_next(bp_db_t* tree,
+                   bp_cursor_t* cursor,
+                   bp_key_t* key,
+                   bp_value_t* value) {
+  int ret;
+
+  bp__rwlock_rdlock(&tree->rwlock);
+  bp__arena_enter();
+  ret = bp__cursor_next(tree, cursor, key, value);
+  bp__arena_leave();
+  bp__rwlock_rdunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+int bp_cursor_close(bp_db_t* tree, bp_cursor_t* cursor) {
+  bp__cursor_destroy(tree, cursor);
+
+  if (cursor->snapshot == &cursor->own_snapshot) {
+    return bp_snapshot_close(tree, cursor->snapshot);
+  }
+
+  return BP_OK;
+}
+
+
+int bp_stream_open(bp_db_t* tree, const bp_key_t* key, bp_stream_t* stream) {
+  int ret;
+  bp__kv_t ref;
+
+  /* blocks of value can't be reused until stream is closed */
+  bp__rwlock_wrlock(&tree->rwlock);
+  bp__arena_enter();
+
+  ret = bp__page_get(tree, tree->head.page, key, NULL, &ref);
+  if (ret == BP_OK) ret = bp__stream_init(tree, stream, ref.offset, ref.config);
+  if (ret == BP_OK) tree->snapshots++;
+
+  bp__arena_leave();
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+int bp_stream_read(bp_db_t* tree,
+                   bp_stream_t* stream,
+                   const uint64_t offset,
+                   const uint64_t length,
+                   char* data,
+                   uint64_t* read) {
+  int ret;
+
+  bp__rwlock_rdlock(&tree->rwlock);
+  bp__arena_enter();
+  ret = bp__stream_read(tree, stream, offset, length, data, read);
+  bp__arena_leave();
+  bp__rwlock_rdunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+int bp_stream_create(bp_db_t* tree, bp_stream_t* stream) {
+  int ret;
+
+  bp__rwlock_wrlock(&tree->rwlock);
+
+  ret = bp__stream_create(tree, stream);
+  if (ret == BP_OK) tree->snapshots++;
+
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+int bp_stream_write(bp_db_t* tree,
+                    bp_stream_t* stream,
+                    const char* data,
+                    const uint64_t length) {
+  int ret;
+
+  bp__rwlock_wrlock(&tree->rwlock);
+  bp__arena_enter();
+  ret = bp__stream_write(tree, stream, data, length);
+  bp__arena_leave();
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+int bp_stream_commit(bp_db_t* tree,
+                     bp_stream_t* stream,
+                     const bp_key_t* key) {
+  int ret;
+  bp_value_t value;
+
+  bp__rwlock_wrlock(&tree->rwlock);
+  bp__arena_enter();
+
+  ret = bp__stream_value(tree, stream, &value);
+  if (ret == BP_OK) {
+    ret = bp__page_insert(tree,
+                          tree->head.page,
+                          key,
+                          &value,
+                          0,
+                          BP__MERGE_NONE,
+                          NULL,
+                          NULL);
+  }
+  if (ret == BP_OK) {
+    ret = bp__tree_write_head((bp__writer_t*) tree, NULL);
+  }
+  if (ret == BP_OK) {
+    bp__stream_committed(stream);
+  } else {
+    bp__writer_discard((bp__writer_t*) tree);
+  }
+
+  bp__arena_leave();
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+int bp_stream_close(bp_db_t* tree, bp_stream_t* stream) {
+  int ret;
+
+  bp__rwlock_wrlock(&tree->rwlock);
+  bp__arena_enter();
+
+  ret = bp__stream_destroy(tree, stream);
+
+  /* released chunks of uncommitted value weren't referenced by any head */
+  if (tree->freelist != NULL) bp__freelist_seal(tree->freelist);
+  tree->snapshots--;
+
+  bp__arena_leave();
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return ret;
+}
+
+
+/* Wrappers to allow string to string set/get/remove */
+
+
+int bp_gets(bp_db_t* tree, const char* key, char** value) {
+  int ret;
+  bp_key_t bkey;
+  bp_value_t bvalue;
+
+  BP__STOVAL(key, bkey);
+
+  ret = bp_get(tree, &bkey, &bvalue);
+  if (ret != BP_OK) return ret;
+
+  *value = bvalue.value;
+
+  return BP_OK;
+}
+
+
+int bp_snapshot_gets(bp_db_t* tree,
+                     bp_snapshot_t* snapshot,
+                     const char* key,
+                     char** value) {
+  int ret;
+  bp_key_t bkey;
+  bp_value_t bvalue;
+
+  BP__STOVAL(key, bkey);
+
+  ret = bp_snapshot_get(tree, snapshot, &bkey, &bvalue);
+  if (ret != BP_OK) return ret;
+
+  *value = bvalue.value;
+
+  return BP_OK;
+}
+
+
+int bp_updates(bp_db_t* tree,
+               const char* key,
+               const char* value,
+               bp_update_cb update_cb,
+               void* arg) {
+  bp_key_t bkey;
+  bp_value_t bvalue;
+
+  BP__STOVAL(key, bkey);
+  BP__STOVAL(value, bvalue);
+
+  return bp_update(tree, &bkey, &bvalue, update_cb, arg);
+}
+
+
+int bp_sets(bp_db_t* tree, const char* key, const char* value) {
+  return bp_updates(tree, key, value, NULL, NULL);
+}
+
+
+int bp_bulk_updates(bp_db_t* tree,
+                    const uint64_t count,
+                    const char** keys,
+                    const char** values,
+                    bp_update_cb update_cb,
+                    void* arg) {
+  int ret;
+  bp_key_t* bkeys;
+  bp_value_t* bvalues;
+  uint64_t i;
+
+  /* allocated memory for keys/values */
+  bkeys = bp__malloc(sizeof(*bkeys) * count);
+  if (bkeys == NULL) return BP_EALLOC;
+
+  bvalues = bp__malloc(sizeof(*bvalues) * count);
+  if (bvalues == NULL) {
+    bp__free(bkeys);
+    return BP_EALLOC;
+  }
+
+  /* copy keys/values to allocated memory */
+  for (i = 0; i < count; i++) {
+    BP__STOVAL(keys[i], bkeys[i]);
+    BP__STOVAL(values[i], bvalues[i]);
+  }
+
+  ret = bp_bulk_update(tree,
+                       count,
+                       (const bp_key_t**) &bkeys,
+                       (const bp_value_t**) &bvalues,
+                       update_cb,
+                       arg);
+
+  bp__free(bkeys);
+  bp__free(bvalues);
+
+  return ret;
+}
+
+
+int bp_bulk_sets(bp_db_t* tree,
+                 const uint64_t count,
+                 const char** keys,
+                 const char** values) {
+  return bp_bulk_updates(tree, count, keys, values, NULL, NULL);
+}
+
+
+int bp_removevs(bp_db_t* tree,
+                const char* key,
+                bp_remove_cb remove_cb,
                 void *arg) {
   bp_key_t bkey;
 
@@ -396,11 +1333,61 @@ int bp_get_ranges(bp_db_t* tree,
 }
 
 
+int bp_snapshot_get_ranges(bp_db_t* tree,
+                           bp_snapshot_t* snapshot,
+                           const char* start,
+                           const char* end,
+                           bp_range_cb cb,
+                           void* arg) {
+  bp_key_t bstart;
+  bp_key_t bend;
+
+  BP__STOVAL(start, bstart);
+  BP__STOVAL(end, bend);
+
+  return bp_snapshot_get_range(tree, snapshot, &bstart, &bend, cb, arg);
+}
+
+
 /* various functions */
 
 
 void bp_set_compare_cb(bp_db_t* tree, bp_compare_cb cb) {
+  uint64_t i;
+
   tree->compare_cb = cb;
+  tree->compare_id = bp__compare_id(cb);
+
+  /* key prefixes of head page were computed for previous comparator */
+  if (tree->head.page != NULL) {
+    for (i = 0; i < tree->head.page->length; i++) {
+      bp__page_set_prefix(tree, tree->head.page, i);
+    }
+  }
+}
+
+
+int bp_set_codec(bp_db_t* tree, const int codec, const int level) {
+  if (!(tree->head.flags & BP__HEAD_FLAG_CODEC_TAGS)) return BP_ECODEC;
+  if (codec == BP__CODEC_LEGACY || !bp__codec_supported(codec)) {
+    return BP_ECODEC;
+  }
+  if (level < 0 || level > BP__HEAD_CODEC_MASK) return BP_ECODEC;
+
+  bp__rwlock_wrlock(&tree->rwlock);
+
+  /* will be persisted with next head */
+  tree->head.flags &= ~((uint64_t) BP__HEAD_CODEC_MASK <<
+                        BP__HEAD_CODEC_SHIFT);
+  tree->head.flags &= ~((uint64_t) BP__HEAD_CODEC_MASK <<
+                        BP__HEAD_CODEC_LEVEL_SHIFT);
+  tree->head.flags |= (uint64_t) codec << BP__HEAD_CODEC_SHIFT;
+  tree->head.flags |= (uint64_t) level << BP__HEAD_CODEC_LEVEL_SHIFT;
+  bp__tree_set_codec(tree);
+
+  bp__rwlock_wrunlock(&tree->rwlock);
+
+  return BP_OK;
 }
 
 
@@ -408,8 +1395,8 @@ int bp_fsync(bp_db_t* tree) {
   int ret;
 
   bp__rwlock_wrlock(&tree->rwlock);
-  ret = bp__writer_fsync((bp__writer_t*) tree);
-  bp__rwlock_unlock(&tree->rwlock);
+  ret = bp__tree_sync(tree);
+  bp__rwlock_wrunlock(&tree->rwlock);
 
   return ret;
 }
@@ -418,26 +1405,159 @@ int bp_fsync(bp_db_t* tree) {
 /* internal utils */
 
 
-int bp__tree_read_head(bp__writer_t* w, void* data) {
+int bp__snapshot_init(bp_db_t* tree,
+                      const uint64_t offset,
+                      const uint64_t config,
+                      bp_snapshot_t* snapshot) {
+  snapshot->offset = offset;
+  snapshot->config = config;
+
+  return bp__page_load(tree, offset, config, kHeapAlloc, &snapshot->page);
+}
+
+
+void bp__snapshot_destroy(bp_db_t* tree, bp_snapshot_t* snapshot) {
+  bp__page_destroy(tree, snapshot->page);
+  snapshot->page = NULL;
+}
+
+
+int bp__tree_parse_head(const void* data, bp__tree_head_t* head) {
+  const bp__tree_head_t* nhead = (const bp__tree_head_t*) data;
+
+  head->offset = ntohll(nhead->offset);
+  head->config = ntohll(nhead->config);
+  head->page_size = ntohll(nhead->page_size);
+  head->hash = ntohll(nhead->hash);
+  head->seq = ntohll(nhead->seq);
+  head->prev = ntohll(nhead->prev);
+  head->time = ntohll(nhead->time);
+  head->flags = ntohll(nhead->flags);
+  if (head->flags & BP__HEAD_FLAG_REUSE) {
+    head->free_offset = ntohll(nhead->free_offset);
+    head->free_size = ntohll(nhead->free_size);
+    head->free_next = ntohll(nhead->free_next);
+    head->free_used = ntohll(nhead->free_used);
+    head->free_last = ntohll(nhead->free_last);
+    head->free_last_used = ntohll(nhead->free_last_used);
+  } else {
+    head->free_offset = 0;
+    head->free_size = 0;
+    head->free_next = 0;
+    head->free_used = 0;
+    head->free_last = 0;
+    head->free_last_used = 0;
+  }
+  if (head->flags & BP__HEAD_FLAG_SEGMENTS) {
+    head->segments_offset = ntohll(nhead->segments_offset);
+    head->segments_size = ntohll(nhead->segments_size);
+  } else {
+    head->segments_offset = 0;
+    head->segments_size = 0;
+  }
+
+  return bp__tree_head_hash(head) == head->hash ? BP_OK : BP_ENOTFOUND;
+}
+
+
+int bp__tree_load_head(bp_db_t* t,
+                       const uint64_t offset,
+                       bp__tree_head_t* head) {
+  int ret;
+  uint64_t size = BP__HEAD_MAX_SIZE;
+  char buff[BP__HEAD_MAX_SIZE];
+  void* data;
+
+  /* head at the end of file may be shorter, the rest is zeroes */
+  if (offset < t->filesize && t->filesize - offset < size) {
+    size = t->filesize - offset;
+  }
+  ret = bp__writer_read((bp__writer_t*) t,
+                        kNotCompressed,
+                        kArenaAlloc,
+                        offset,
+                        &size,
+                        &data);
+  if (ret == BP_EFILEREAD_OOB) return BP_ENOTFOUND;
+  if (ret != BP_OK) return ret;
+
+  memset(buff, 0, sizeof(buff));
+  memcpy(buff, data, (size_t) size);
+  bp__arena_free(data);
+
+  return bp__tree_parse_head(buff, head);
+}
+
+
+int bp__tree_read_head(bp__writer_t* w, const uint64_t offset, void* data) {
   int ret;
   bp_db_t* t = (bp_db_t*) w;
-  bp__tree_head_t* head = (bp__tree_head_t*) data;
+  bp__tree_head_t head;
 
-  t->head.offset = ntohll(head->offset);
-  t->head.config = ntohll(head->config);
-  t->head.page_size = ntohll(head->page_size);
-  t->head.hash = ntohll(head->hash);
+  ret = bp__tree_parse_head(data, &head);
 
   /* we've copied all data - free it */
-  free(data);
+  bp__arena_free(data);
 
   /* Check hash first */
-  if (bp__compute_hashl(t->head.offset) != t->head.hash) return 1;
+  if (ret != BP_OK) return 1;
+
+  t->head.offset = head.offset;
+  t->head.config = head.config;
+  t->head.page_size = head.page_size;
+  t->head.hash = head.hash;
+  t->head.flags = head.flags;
+  t->head.free_offset = head.free_offset;
+  t->head.free_size = head.free_size;
+  t->head.free_next = head.free_next;
+  t->head.free_used = head.free_used;
+  t->head.free_last = head.free_last;
+  t->head.free_last_used = head.free_last_used;
+  t->head.segments_offset = head.segments_offset;
+  t->head.segments_size = head.segments_size;
 
-  ret = bp__page_load(t, t->head.offset, t->head.config, &t->head.page);
+  /*
+   * Key prefixes of loaded pages depend on comparator.
+   * Head with unknown comparator or codec is still a match,
+   * bp__init will fail.
+   */
+  bp__tree_set_codec(t);
+  bp__tree_set_alignment(t);
+  bp__tree_set_segment_size(t);
+  bp__tree_set_chunk_size(t);
+  t->compare_cb = bp__compare_builtin(BP__HEAD_COMPARE(head.flags));
+  if (t->compare_cb == NULL || !bp__tree_codecs_supported(t)) return BP_OK;
+  t->compare_id = BP__HEAD_COMPARE(head.flags);
+
+  /* pages may be compressed with dictionary, it's the same for all heads */
+  if ((head.flags & BP__HEAD_FLAG_DICT) && t->dict == NULL) {
+    ret = bp__tree_load_dict(t);
+    if (ret != BP_OK) return ret;
+  }
+
+  /* and so is value log (until compaction of values) */
+  if ((head.flags & BP__HEAD_FLAG_VLOG) && t->vlog == NULL) {
+    ret = bp__tree_open_vlog(t, t->filename, 0);
+    if (ret != BP_OK) return ret;
+  }
+
+  ret = bp__page_load(t,
+                      t->head.offset,
+                      t->head.config,
+                      kHeapAlloc,
+                      &t->head.page);
   if (ret != BP_OK) return ret;
 
   t->head.page->is_head = 1;
+  t->head.seq = head.seq;
+  t->head.prev = head.prev;
+  t->head.time = head.time;
+  t->head.record = offset;
+
+  if (head.flags & BP__HEAD_FLAG_REUSE) ret = bp__tree_load_freelist(t);
+  if ((head.flags & BP__HEAD_FLAG_SEGMENTS) && t->segments != NULL) {
+    ret = bp__tree_load_segments(t);
+  }
 
   return ret;
 }
@@ -449,13 +1569,15 @@ int bp__tree_write_head(bp__writer_t* w, void* data) {
   bp__tree_head_t nhead;
   uint64_t offset;
   uint64_t size;
+  uint64_t free_offset;
+  uint64_t free_size;
 
   if (t->head.page == NULL) {
     /* TODO: page size should be configurable */
     t->head.page_size = 64;
 
     /* Create empty leaf page */
-    ret = bp__page_create(t, kLeaf, 0, 1, &t->head.page);
+    ret = bp__page_create(t, kLeaf, 0, 1, kHeapAlloc, &t->head.page);
     if (ret != BP_OK) return ret;
 
     t->head.page->is_head = 1;
@@ -465,35 +1587,583 @@ int bp__tree_write_head(bp__writer_t* w, void* data) {
   t->head.offset = t->head.page->offset;
   t->head.config = t->head.page->config;
 
-  t->head.hash = bp__compute_hashl(t->head.offset);
+  /* free list is written only if it has changed */
+  free_offset = t->head.free_offset;
+  free_size = t->head.free_size;
+  if (t->head.flags & BP__HEAD_FLAG_REUSE) {
+    ret = bp__writer_reuse(w);
+    if (ret != BP_OK) return ret;
+
+    /* slot of new head in ring is taken by the last durable one */
+    if (t->head.seq + 1 >= t->durable_seq + BP__HEAD_RING_SLOTS) {
+      ret = bp__tree_sync(t);
+      if (ret != BP_OK) return ret;
+    }
+
+    if (t->freelist->dirty) {
+      ret = bp__tree_write_freelist(t, &free_offset, &free_size);
+      if (ret != BP_OK) return ret;
+    }
+  }
+
+  /* Link new revision to the previous one */
+  nhead.seq = t->head.seq + 1;
+  nhead.prev = t->head.record;
+  nhead.time = (uint64_t) time(NULL);
+  nhead.offset = t->head.offset;
+  nhead.config = t->head.config;
+  nhead.page_size = t->head.page_size;
+  nhead.flags = t->head.flags;
+  nhead.free_offset = free_offset;
+  nhead.free_size = free_size;
+  if (t->freelist != NULL) {
+    nhead.free_next = t->freelist->next;
+    nhead.free_used = t->freelist->used;
+    nhead.free_last = t->freelist->last;
+    nhead.free_last_used = t->freelist->last_used;
+  } else {
+    nhead.free_next = 0;
+    nhead.free_used = 0;
+    nhead.free_last = 0;
+    nhead.free_last_used = 0;
+  }
+  nhead.segments_offset = t->head.segments_offset;
+  nhead.segments_size = t->head.segments_size;
+
+  t->head.hash = bp__tree_head_hash(&nhead);
 
   /* Create temporary head with fields in network byte order */
   nhead.offset = htonll(t->head.offset);
   nhead.config = htonll(t->head.config);
   nhead.page_size = htonll(t->head.page_size);
   nhead.hash = htonll(t->head.hash);
+  nhead.seq = htonll(nhead.seq);
+  nhead.prev = htonll(nhead.prev);
+  nhead.time = htonll(nhead.time);
+  nhead.flags = htonll(nhead.flags);
+  nhead.free_offset = htonll(free_offset);
+  nhead.free_size = htonll(free_size);
+  nhead.free_next = htonll(nhead.free_next);
+  nhead.free_used = htonll(nhead.free_used);
+  nhead.free_last = htonll(nhead.free_last);
+  nhead.free_last_used = htonll(nhead.free_last_used);
+  nhead.segments_offset = htonll(nhead.segments_offset);
+  nhead.segments_size = htonll(nhead.segments_size);
+
+  if (t->head.flags & BP__HEAD_FLAG_REUSE) {
+    offset = (t->head.seq + 1) % BP__HEAD_RING_SLOTS * BP__HEAD_MAX_SIZE;
+    ret = bp__writer_write_at(w, &nhead, offset, BP__HEAD_MAX_SIZE);
+  } else {
+    size = t->head.flags & BP__HEAD_FLAG_SEGMENTS ? BP__HEAD_MAX_SIZE :
+                                                    BP__HEAD_SIZE;
+    ret = bp__writer_write(w,
+                           kNotCompressed,
+                           &nhead,
+                           &offset,
+                           &size);
+  }
+  if (ret != BP_OK) return ret;
+
+  /* previous head is garbage of its segment */
+  if (t->segments != NULL && t->head.seq != 0) {
+    ret = bp__writer_release(w, t->head.record, BP__HEAD_MAX_SIZE);
+  }
+
+  /*
+   * Blocks released by modification aren't referenced by new head,
+   * neither is free list (if it was rewritten)
+   */
+  if (t->freelist != NULL) {
+    if (free_offset != t->head.free_offset) {
+      t->freelist->dirty = 0;
+      ret = bp__writer_release(w, t->head.free_offset, t->head.free_size);
+    }
+    bp__freelist_seal(t->freelist);
+  }
+  t->head.free_offset = free_offset;
+  t->head.free_size = free_size;
+  t->head.free_next = ntohll(nhead.free_next);
+  t->head.free_used = ntohll(nhead.free_used);
+  t->head.free_last = ntohll(nhead.free_last);
+  t->head.free_last_used = ntohll(nhead.free_last_used);
+
+  t->head.seq = ntohll(nhead.seq);
+  t->head.prev = ntohll(nhead.prev);
+  t->head.time = ntohll(nhead.time);
+  t->head.record = offset;
+
+  return ret;
+}
+
 
-  size = BP__HEAD_SIZE;
-  ret = bp__writer_write(w,
+int bp__tree_read_ring(bp_db_t* t) {
+  int ret;
+  uint64_t size, i, slot;
+  char* ring;
+  void* data;
+  bp__tree_head_t head;
+  uint64_t seq = 0;
+
+  if (t->filesize < BP__HEAD_RING_SIZE) return BP_ENOTFOUND;
+
+  size = BP__HEAD_RING_SIZE;
+  ret = bp__writer_read((bp__writer_t*) t,
+                        kNotCompressed,
+                        kArenaAlloc,
+                        0,
+                        &size,
+                        (void**) &ring);
+  if (ret != BP_OK) return ret;
+
+  /* the latest of valid heads, torn one is skipped */
+  slot = BP__HEAD_RING_SLOTS;
+  for (i = 0; i < BP__HEAD_RING_SLOTS; i++) {
+    if (bp__tree_parse_head(ring + i * BP__HEAD_MAX_SIZE, &head) != BP_OK ||
+        !(head.flags & BP__HEAD_FLAG_REUSE) ||
+        (slot != BP__HEAD_RING_SLOTS && head.seq <= seq)) {
+      continue;
+    }
+    slot = i;
+    seq = head.seq;
+  }
+  if (slot == BP__HEAD_RING_SLOTS) {
+    bp__arena_free(ring);
+    return BP_ENOTFOUND;
+  }
+
+  /* read callback takes ownership of data */
+  data = bp__arena_alloc(BP__HEAD_MAX_SIZE);
+  if (data == NULL) {
+    bp__arena_free(ring);
+    return BP_EALLOC;
+  }
+  memcpy(data, ring + slot * BP__HEAD_MAX_SIZE, BP__HEAD_MAX_SIZE);
+  bp__arena_free(ring);
+
+  ret = bp__tree_read_head((bp__writer_t*) t,
+                           slot * BP__HEAD_MAX_SIZE,
+                           data);
+  if (ret != BP_OK) return ret;
+
+  /* it was written by previous session, which might have not synced it */
+  t->durable_seq = t->head.seq;
+
+  return BP_OK;
+}
+
+
+int bp__tree_write_ring(bp_db_t* t) {
+  int ret;
+  uint64_t offset;
+  uint64_t size;
+  char* ring;
+
+  size = BP__HEAD_RING_SIZE;
+  ring = bp__arena_alloc(size);
+  if (ring == NULL) return BP_EALLOC;
+  memset(ring, 0, (size_t) size);
+
+  ret = bp__writer_write((bp__writer_t*) t,
                          kNotCompressed,
-                         &nhead,
+                         ring,
                          &offset,
                          &size);
+  bp__arena_free(ring);
+  if (ret != BP_OK) return ret;
+  assert(offset == 0);
+
+  return BP_OK;
+}
+
+
+int bp__tree_sync(bp_db_t* t) {
+  int ret;
+
+  ret = bp__writer_fsync((bp__writer_t*) t);
+  if (ret != BP_OK) return ret;
+
+  /*
+   * Heads written so far are durable, space they've released may be reused
+   * (unless it's still referenced by opened snapshots)
+   */
+  t->durable_seq = t->head.seq;
+  if (t->freelist != NULL && t->snapshots == 0) {
+    ret = bp__freelist_commit(t->freelist);
+  }
+
+  return ret;
+}
+
+
+int bp__tree_load_freelist(bp_db_t* t) {
+  int ret;
+  uint64_t size;
+  char* data;
+
+  ret = bp__writer_reuse((bp__writer_t*) t);
+  if (ret != BP_OK) return ret;
+  if (t->head.free_size == 0) return BP_OK;
+
+  size = t->head.free_size;
+  ret = bp__writer_read((bp__writer_t*) t,
+                        kNotCompressed,
+                        kArenaAlloc,
+                        t->head.free_offset,
+                        &size,
+                        (void**) &data);
+  if (ret != BP_OK) return ret;
+
+  ret = bp__freelist_decode(t->freelist,
+                            data,
+                            size,
+                            t->head.free_next,
+                            t->head.free_used,
+                            t->head.free_last,
+                            t->head.free_last_used);
+  bp__arena_free(data);
 
   return ret;
 }
 
 
-int bp__default_compare_cb(const bp_key_t* a, const bp_key_t* b) {
-  uint32_t i, len = a->length < b->length ? a->length : b->length;
+int bp__tree_write_freelist(bp_db_t* t, uint64_t* offset, uint64_t* size) {
+  int ret;
+  char* buff;
+
+  /*
+   * Block may be written into extent from the list itself, allocation
+   * position stored in head covers it then
+   */
+  *size = bp__freelist_size(t->freelist);
+  buff = bp__arena_alloc(*size);
+  if (buff == NULL) return BP_EALLOC;
+
+  bp__freelist_encode(t->freelist, buff);
+  ret = bp__writer_write((bp__writer_t*) t,
+                         kNotCompressed,
+                         buff,
+                         offset,
+                         size);
+  bp__arena_free(buff);
+
+  return ret;
+}
 
-  for (i = 0; i < len; i++) {
-    if (a->value[i] != b->value[i]) {
-      return (uint8_t) a->value[i] > (uint8_t) b->value[i] ? 1 : -1;
+
+void bp__tree_set_codec(bp_db_t* t) {
+  if (t->head.flags & BP__HEAD_FLAG_CODEC_TAGS) {
+    t->codec = BP__HEAD_CODEC(t->head.flags);
+    t->codec_level = BP__HEAD_CODEC_LEVEL(t->head.flags);
+  } else {
+    t->codec = BP__CODEC_LEGACY;
+    t->codec_level = 0;
+  }
+  bp__writer_vlog_update((bp__writer_t*) t);
+}
+
+
+void bp__tree_set_alignment(bp_db_t* t) {
+  uint64_t align_log;
+
+  /* reads don't depend on alignment, larger ones (4096 is 13) are clamped */
+  align_log = (t->head.flags >> BP__HEAD_ALIGN_SHIFT) & BP__HEAD_ALIGN_MASK;
+  if (align_log == 0) {
+    t->alignment = BP_PADDING;
+  } else if (align_log > 13) {
+    t->alignment = BP__WRITER_MAX_ALIGNMENT;
+  } else {
+    t->alignment = (uint64_t) 1 << (align_log - 1);
+  }
+}
+
+
+void bp__tree_set_segment_size(bp_db_t* t) {
+  uint64_t segment_log;
+
+  segment_log = (t->head.flags >> BP__HEAD_SEGMENT_SHIFT) &
+                BP__HEAD_SEGMENT_MASK;
+  if (segment_log == 0) {
+    t->segment_size = 0;
+  } else {
+    t->segment_size = (uint64_t) 1 << (segment_log - 1);
+  }
+}
+
+
+void bp__tree_set_chunk_size(bp_db_t* t) {
+  uint64_t chunk_log;
+
+  chunk_log = (t->head.flags >> BP__HEAD_CHUNK_SHIFT) & BP__HEAD_CHUNK_MASK;
+  if (chunk_log == 0) {
+    t->chunk_size = 0;
+  } else {
+    t->chunk_size = (uint64_t) 1 << (chunk_log - 1);
+  }
+}
+
+
+int bp__tree_load_segments(bp_db_t* t) {
+  int ret;
+  uint64_t size;
+  char* data;
+
+  if (t->head.segments_size == 0) return BP_OK;
+
+  size = t->head.segments_size;
+  ret = bp__writer_read((bp__writer_t*) t,
+                        kNotCompressed,
+                        kArenaAlloc,
+                        t->head.segments_offset,
+                        &size,
+                        (void**) &data);
+  if (ret != BP_OK) return ret;
+
+  ret = bp__segments_decode(t->segments, data, size);
+  bp__arena_free(data);
+
+  return ret;
+}
+
+
+int bp__tree_write_segments(bp_db_t* t) {
+  int ret;
+  uint64_t offset;
+  uint64_t size;
+  char* buff;
+
+  /* previous block is garbage too once next head is written */
+  ret = bp__writer_release((bp__writer_t*) t,
+                           t->head.segments_offset,
+                           t->head.segments_size);
+  if (ret != BP_OK) return ret;
+
+  size = bp__segments_size(t->segments);
+  buff = bp__arena_alloc(size);
+  if (buff == NULL) return BP_EALLOC;
+
+  bp__segments_encode(t->segments, buff);
+  ret = bp__writer_write((bp__writer_t*) t,
+                         kNotCompressed,
+                         buff,
+                         &offset,
+                         &size);
+  bp__arena_free(buff);
+  if (ret != BP_OK) return ret;
+
+  t->head.segments_offset = offset;
+  t->head.segments_size = size;
+  t->segments->dirty = 0;
+
+  return BP_OK;
+}
+
+
+int bp__tree_open_vlog(bp_db_t* t, const char* filename, const int fresh) {
+  int ret;
+  char* name;
+
+  ret = bp__writer_vlog_name(filename, BP__HEAD_VLOG(t->head.flags), &name);
+  if (ret != BP_OK) return ret;
+
+  /* log of the next generation may be left by interrupted compaction */
+  if (fresh) unlink(name);
+
+  ret = bp__writer_open_vlog((bp__writer_t*) t, name);
+  bp__free(name);
+
+  return ret;
+}
+
+
+int bp__tree_codecs_supported(const bp_db_t* t) {
+  if (!bp__codec_supported(t->codec)) return 0;
+  if (t->head.flags & BP__HEAD_FLAG_DICT) {
+    return bp__codec_supported(BP_CODEC_ZSTD);
+  }
+  return 1;
+}
+
+
+uint64_t bp__tree_dict_offset(const bp_db_t* t) {
+  uint64_t size;
+
+  if (!(t->head.flags & BP__HEAD_FLAG_REUSE)) return 0;
+
+  /* ring of heads is padded as any other record */
+  size = BP__HEAD_RING_SIZE;
+  return size + (t->alignment - size % t->alignment) % t->alignment;
+}
+
+
+int bp__tree_load_dict(bp_db_t* t) {
+  int ret;
+  uint64_t offset;
+  uint64_t size;
+  char* data;
+
+  /* size of dictionary, then dictionary itself */
+  offset = bp__tree_dict_offset(t);
+  size = sizeof(size);
+  ret = bp__writer_read((bp__writer_t*) t,
+                        kNotCompressed,
+                        kArenaAlloc,
+                        offset,
+                        &size,
+                        (void**) &data);
+  if (ret != BP_OK) return ret;
+
+  size = ntohll(*(uint64_t*) data);
+  bp__arena_free(data);
+  if (size == 0) return BP_EFILEREAD;
+
+  ret = bp__writer_read((bp__writer_t*) t,
+                        kNotCompressed,
+                        kArenaAlloc,
+                        offset + sizeof(size),
+                        &size,
+                        (void**) &data);
+  if (ret != BP_OK) return ret;
+
+  ret = bp__dict_create(data,
+                        (size_t) size,
+                        t->codec == BP_CODEC_ZSTD ? t->codec_level : 0,
+                        &t->dict);
+  bp__arena_free(data);
+
+  return ret;
+}
+
+
+int bp__tree_write_dict(bp_db_t* t, const char* dict, const uint64_t size) {
+  int ret;
+  uint64_t offset;
+  uint64_t buff_size;
+  char* buff;
+
+  buff_size = sizeof(size) + size;
+  buff = bp__arena_alloc(buff_size);
+  if (buff == NULL) return BP_EALLOC;
+
+  *(uint64_t*) buff = htonll(size);
+  memcpy(buff + sizeof(size), dict, size);
+
+  ret = bp__writer_write((bp__writer_t*) t,
+                         kNotCompressed,
+                         buff,
+                         &offset,
+                         &buff_size);
+  bp__arena_free(buff);
+  if (ret != BP_OK) return ret;
+  assert(offset == bp__tree_dict_offset(t));
+
+  return bp__dict_create(dict,
+                         (size_t) size,
+                         t->codec == BP_CODEC_ZSTD ? t->codec_level : 0,
+                         &t->dict);
+}
+
+
+int bp__tree_train_dict(bp_db_t* t, uint64_t* size, char** dict) {
+  int ret;
+  uint64_t capacity, used, count, max_count;
+  size_t dict_size;
+  size_t* sizes;
+  size_t* tmp;
+  char* samples;
+  bp_cursor_t cursor;
+  bp_key_t key;
+  bp_value_t value;
+
+  /* take values in order of keys until there're enough samples */
+  capacity = *size * BP__DICT_SAMPLE_RATIO;
+  samples = bp__malloc(capacity);
+  max_count = 1024;
+  sizes = bp__malloc(max_count * sizeof(*sizes));
+  *dict = bp__malloc(*size);
+  if (samples == NULL || sizes == NULL || *dict == NULL) {
+    ret = BP_EALLOC;
+    goto fatal;
+  }
+
+  ret = bp_cursor_open(t, NULL, NULL, NULL, &cursor);
+  if (ret != BP_OK) goto fatal;
+
+  used = 0;
+  count = 0;
+  while (used < capacity) {
+    ret = bp_cursor_next(t, &cursor, &key, &value);
+    if (ret != BP_OK) break;
+
+    if (value.length > capacity - used) value.length = capacity - used;
+    memcpy(samples + used, value.value, value.length);
+    used += value.length;
+
+    if (count == max_count) {
+      tmp = bp__malloc(2 * max_count * sizeof(*sizes));
+      if (tmp != NULL) memcpy(tmp, sizes, max_count * sizeof(*sizes));
+      bp__free(sizes);
+      sizes = tmp;
+      max_count *= 2;
     }
+    if (sizes != NULL) sizes[count++] = value.length;
+
+    bp__free(key.value);
+    bp__free(value.value);
+    if (sizes == NULL) {
+      ret = BP_EALLOC;
+      break;
+    }
+  }
+  bp_cursor_close(t, &cursor);
+  if (ret != BP_OK && ret != BP_ENOTFOUND) goto fatal;
+
+  dict_size = (size_t) *size;
+  ret = bp__dict_train(samples, sizes, (unsigned) count, *dict, &dict_size);
+  if (ret != BP_OK) goto fatal;
+
+  *size = dict_size;
+  bp__free(samples);
+  bp__free(sizes);
+  return BP_OK;
+
+fatal:
+  bp__free(samples);
+  bp__free(sizes);
+  bp__free(*dict);
+  return ret;
+}
+
+
+uint64_t bp__tree_head_hash(const bp__tree_head_t* head) {
+  uint64_t hash = bp__compute_hashl(head->offset);
+
+  /* heads written by older versions have only offset hashed */
+  if (head->seq == 0) return hash;
+
+  hash ^= bp__compute_hashl(head->config ^ hash);
+  hash ^= bp__compute_hashl(head->page_size ^ hash);
+  hash ^= bp__compute_hashl(head->seq ^ hash);
+  hash ^= bp__compute_hashl(head->prev ^ hash);
+  hash ^= bp__compute_hashl(head->time ^ hash);
+
+  /* databases without flags have the same hash as before flags were added */
+  if (head->flags != 0) hash ^= bp__compute_hashl(head->flags ^ hash);
+
+  /* state of free list is a part of head too */
+  if (head->flags & BP__HEAD_FLAG_REUSE) {
+    hash ^= bp__compute_hashl(head->free_offset ^ hash);
+    hash ^= bp__compute_hashl(head->free_size ^ hash);
+    hash ^= bp__compute_hashl(head->free_next ^ hash);
+    hash ^= bp__compute_hashl(head->free_used ^ hash);
+    hash ^= bp__compute_hashl(head->free_last ^ hash);
+    hash ^= bp__compute_hashl(head->free_last_used ^ hash);
+  }
+  if (head->flags & BP__HEAD_FLAG_SEGMENTS) {
+    hash ^= bp__compute_hashl(head->segments_offset ^ hash);
+    hash ^= bp__compute_hashl(head->segments_size ^ hash);
   }
 
-  return a->length - b->length;
+  return hash;
 }
 
 
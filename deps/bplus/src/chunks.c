@@ -0,0 +1,423 @@
+#include <string.h> /* memcpy */
+#include <assert.h> /* assert */
+
+#include "bplus.h"
+#include "private/chunks.h"
+#include "private/values.h"
+#include "private/writer.h"
+#include "private/utils.h"
+
+
+void bp__chunks_init(bp__chunks_t* c, const uint64_t chunk_size) {
+  c->length = 0;
+  c->chunk_size = chunk_size;
+  c->list = NULL;
+  c->count = 0;
+  c->capacity = 0;
+}
+
+
+void bp__chunks_destroy(bp__chunks_t* c) {
+  bp__free(c->list);
+  c->list = NULL;
+  c->count = 0;
+  c->capacity = 0;
+}
+
+
+uint64_t bp__chunks_length(const bp__chunks_t* c, const uint64_t index) {
+  uint64_t start = index * c->chunk_size;
+
+  return c->length - start < c->chunk_size ? c->length - start :
+                                             c->chunk_size;
+}
+
+
+static int bp__chunks_grow(bp__chunks_t* c, const uint64_t count) {
+  bp__chunk_t* tmp;
+  uint64_t new_capacity;
+
+  if (count <= c->capacity) return BP_OK;
+
+  new_capacity = c->capacity == 0 ? 16 : c->capacity;
+  while (new_capacity < count) new_capacity *= 2;
+
+  tmp = bp__malloc(new_capacity * sizeof(*tmp));
+  if (tmp == NULL) return BP_EALLOC;
+
+  if (c->list != NULL) {
+    memcpy(tmp, c->list, c->count * sizeof(*tmp));
+    bp__free(c->list);
+  }
+  c->list = tmp;
+  c->capacity = new_capacity;
+
+  return BP_OK;
+}
+
+
+int bp__chunks_append(bp_db_t* t,
+                      bp__chunks_t* c,
+                      const char* data,
+                      const uint64_t size) {
+  int ret;
+  uint64_t offset;
+  uint64_t csize;
+
+  /* only the last chunk may be shorter */
+  assert(c->length % c->chunk_size == 0);
+  assert(size != 0 && size <= c->chunk_size);
+
+  ret = bp__chunks_grow(c, c->count + 1);
+  if (ret != BP_OK) return ret;
+
+  csize = size;
+  ret = bp__writer_write(bp__value_writer(t),
+                         kDictCompressed,
+                         data,
+                         &offset,
+                         &csize);
+  if (ret != BP_OK) return ret;
+
+  c->list[c->count].offset = offset;
+  c->list[c->count].size = csize;
+  c->count++;
+  c->length += size;
+
+  return BP_OK;
+}
+
+
+int bp__chunks_read(bp_db_t* t,
+                    const bp__chunks_t* c,
+                    const uint64_t index,
+                    const enum alloc_type alloc,
+                    char** data) {
+  int ret;
+  uint64_t size;
+
+  size = c->list[index].size;
+  ret = bp__writer_read(bp__value_writer(t),
+                        kCompressed,
+                        alloc,
+                        c->list[index].offset,
+                        &size,
+                        (void**) data);
+  if (ret != BP_OK) return ret;
+
+  if (size != bp__chunks_length(c, index)) {
+    bp__arena_free(*data);
+    return BP_EFILEREAD;
+  }
+
+  return BP_OK;
+}
+
+
+int bp__chunks_save(bp_db_t* t,
+                    const bp__chunks_t* c,
+                    const uint64_t prev_offset,
+                    const uint64_t prev_config,
+                    uint64_t* offset,
+                    uint64_t* config) {
+  int ret;
+  uint64_t i;
+  char* buff;
+  char* p;
+  bp__arena_mark_t mark;
+
+  bp__arena_mark(&mark);
+  *config = BP__CHUNKS_HEADER_SIZE + c->count * 2 * sizeof(uint64_t);
+  buff = bp__arena_alloc(*config);
+  if (buff == NULL) return BP_EALLOC;
+
+  *(uint64_t*) buff = htonll(prev_offset);
+  *(uint64_t*) (buff + 8) = htonll(prev_config);
+  *(uint64_t*) (buff + 16) = htonll(c->length);
+  *(uint64_t*) (buff + 24) = htonll(c->chunk_size);
+  *(uint64_t*) (buff + 32) = htonll(c->count);
+  p = buff + BP__CHUNKS_HEADER_SIZE;
+  for (i = 0; i < c->count; i++) {
+    *(uint64_t*) p = htonll(c->list[i].offset);
+    *(uint64_t*) (p + 8) = htonll(c->list[i].size);
+    p += 2 * sizeof(uint64_t);
+  }
+
+  ret = bp__writer_write(bp__value_writer(t),
+                         kCompressed,
+                         buff,
+                         offset,
+                         config);
+  bp__arena_free(buff);
+  bp__arena_rewind(&mark);
+  *config |= BP__CHUNKED;
+
+  return ret;
+}
+
+
+int bp__chunks_load(bp_db_t* t,
+                    const uint64_t offset,
+                    const uint64_t config,
+                    bp__chunks_t* c,
+                    uint64_t* prev_offset,
+                    uint64_t* prev_config) {
+  int ret;
+  uint64_t i, size, count;
+  char* buff;
+  const char* p;
+  bp__arena_mark_t mark;
+
+  bp__arena_mark(&mark);
+  size = BP__VALUE_SIZE(config);
+  ret = bp__writer_read(bp__value_writer(t),
+                        kCompressed,
+                        kArenaAlloc,
+                        offset,
+                        &size,
+                        (void**) &buff);
+  if (ret != BP_OK) return ret;
+
+  ret = BP_EFILEREAD;
+  if (size < BP__CHUNKS_HEADER_SIZE) goto done;
+
+  bp__chunks_init(c, ntohll(*(uint64_t*) (buff + 24)));
+  c->length = ntohll(*(uint64_t*) (buff + 16));
+  count = ntohll(*(uint64_t*) (buff + 32));
+
+  /* every chunk but the last one is full */
+  if (c->chunk_size == 0 ||
+      size != BP__CHUNKS_HEADER_SIZE + count * 2 * sizeof(uint64_t) ||
+      count != (c->length + c->chunk_size - 1) / c->chunk_size) {
+    goto done;
+  }
+
+  ret = bp__chunks_grow(c, count);
+  if (ret != BP_OK) goto done;
+
+  p = buff + BP__CHUNKS_HEADER_SIZE;
+  for (i = 0; i < count; i++) {
+    c->list[i].offset = ntohll(*(uint64_t*) p);
+    c->list[i].size = ntohll(*(uint64_t*) (p + 8));
+    p += 2 * sizeof(uint64_t);
+  }
+  c->count = count;
+
+  *prev_offset = ntohll(*(uint64_t*) buff);
+  *prev_config = ntohll(*(uint64_t*) (buff + 8));
+  ret = BP_OK;
+
+done:
+  bp__arena_free(buff);
+  bp__arena_rewind(&mark);
+
+  return ret;
+}
+
+
+int bp__chunks_release(bp_db_t* t, const bp__chunks_t* c) {
+  int ret;
+  uint64_t i;
+
+  for (i = 0; i < c->count; i++) {
+    ret = bp__writer_release(bp__value_writer(t),
+                             c->list[i].offset,
+                             c->list[i].size);
+    if (ret != BP_OK) return ret;
+  }
+
+  return BP_OK;
+}
+
+
+int bp__stream_init(bp_db_t* t,
+                    bp_stream_t* stream,
+                    const uint64_t offset,
+                    const uint64_t config) {
+  int ret;
+  uint64_t prev_offset, prev_config;
+  bp_value_t value;
+
+  stream->writing = 0;
+  stream->buffer = NULL;
+  stream->buffer_index = 0;
+  stream->buffer_size = 0;
+
+  /* only table is loaded, chunks are read on demand */
+  if (config & BP__CHUNKED) {
+    ret = bp__chunks_load(t,
+                          offset,
+                          config,
+                          &stream->chunks,
+                          &prev_offset,
+                          &prev_config);
+    if (ret != BP_OK) return ret;
+
+    stream->length = stream->chunks.length;
+    return BP_OK;
+  }
+
+  /* small value is read at once */
+  ret = bp__value_load(t, offset, config, &value);
+  if (ret != BP_OK) return ret;
+
+  bp__chunks_init(&stream->chunks, 0);
+  stream->length = value.length;
+  stream->buffer = value.value;
+  stream->buffer_size = value.length;
+
+  return BP_OK;
+}
+
+
+int bp__stream_read(bp_db_t* t,
+                    bp_stream_t* stream,
+                    const uint64_t offset,
+                    const uint64_t length,
+                    char* data,
+                    uint64_t* read) {
+  int ret;
+  uint64_t position, index, start, size;
+  char* chunk;
+
+  *read = 0;
+  while (*read < length && offset + *read < stream->length) {
+    position = offset + *read;
+
+    if (stream->chunks.count == 0) {
+      start = 0;
+    } else {
+      index = position / stream->chunks.chunk_size;
+      start = index * stream->chunks.chunk_size;
+
+      /* keep only one chunk in memory */
+      if (stream->buffer == NULL || stream->buffer_index != index) {
+        ret = bp__chunks_read(t, &stream->chunks, index, kHeapAlloc, &chunk);
+        if (ret != BP_OK) return ret;
+
+        bp__free(stream->buffer);
+        stream->buffer = chunk;
+        stream->buffer_index = index;
+        stream->buffer_size = bp__chunks_length(&stream->chunks, index);
+      }
+    }
+
+    size = stream->buffer_size - (position - start);
+    if (size > length - *read) size = length - *read;
+    memcpy(data + *read, stream->buffer + (position - start), size);
+    *read += size;
+  }
+
+  return BP_OK;
+}
+
+
+int bp__stream_create(bp_db_t* t, bp_stream_t* stream) {
+  if (t->chunk_size == 0) return BP_ECHUNK;
+
+  stream->buffer = bp__malloc(t->chunk_size);
+  if (stream->buffer == NULL) return BP_EALLOC;
+
+  stream->writing = 1;
+  stream->length = 0;
+  stream->buffer_index = 0;
+  stream->buffer_size = 0;
+  bp__chunks_init(&stream->chunks, t->chunk_size);
+
+  return BP_OK;
+}
+
+
+int bp__stream_write(bp_db_t* t,
+                     bp_stream_t* stream,
+                     const char* data,
+                     const uint64_t length) {
+  int ret;
+  uint64_t written, size, chunk_size;
+
+  assert(stream->writing);
+  chunk_size = stream->chunks.chunk_size;
+
+  for (written = 0; written < length; written += size) {
+    size = length - written;
+
+    /* full chunks are written without copying */
+    if (stream->buffer_size == 0 && size >= chunk_size) {
+      size = chunk_size;
+      ret = bp__chunks_append(t, &stream->chunks, data + written, size);
+      if (ret != BP_OK) return ret;
+      continue;
+    }
+
+    if (size > chunk_size - stream->buffer_size) {
+      size = chunk_size - stream->buffer_size;
+    }
+    memcpy(stream->buffer + stream->buffer_size, data + written, size);
+    stream->buffer_size += size;
+
+    if (stream->buffer_size == chunk_size) {
+      ret = bp__chunks_append(t,
+                              &stream->chunks,
+                              stream->buffer,
+                              stream->buffer_size);
+      if (ret != BP_OK) {
+        stream->buffer_size -= size;
+        return ret;
+      }
+      stream->buffer_size = 0;
+    }
+  }
+  stream->length += length;
+
+  return BP_OK;
+}
+
+
+int bp__stream_value(bp_db_t* t, bp_stream_t* stream, bp_value_t* value) {
+  int ret;
+
+  assert(stream->writing);
+
+  /* value isn't larger than one chunk */
+  if (stream->chunks.count == 0) {
+    value->value = stream->buffer;
+    value->length = stream->buffer_size;
+    return BP_OK;
+  }
+
+  if (stream->buffer_size != 0) {
+    ret = bp__chunks_append(t,
+                            &stream->chunks,
+                            stream->buffer,
+                            stream->buffer_size);
+    if (ret != BP_OK) return ret;
+    stream->buffer_size = 0;
+  }
+
+  value->value = (char*) &stream->chunks;
+  value->length = BP__CHUNKED;
+  return BP_OK;
+}
+
+
+void bp__stream_committed(bp_stream_t* stream) {
+  /* chunks are referenced by database now */
+  bp__chunks_destroy(&stream->chunks);
+  bp__chunks_init(&stream->chunks, stream->chunks.chunk_size);
+  stream->buffer_size = 0;
+  stream->length = 0;
+}
+
+
+int bp__stream_destroy(bp_db_t* t, bp_stream_t* stream) {
+  int ret = BP_OK;
+
+  /* chunks of value that wasn't committed are garbage */
+  if (stream->writing) ret = bp__chunks_release(t, &stream->chunks);
+
+  bp__chunks_destroy(&stream->chunks);
+  bp__free(stream->buffer);
+  stream->buffer = NULL;
+
+  return ret;
+}
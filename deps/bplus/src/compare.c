@@ -0,0 +1,195 @@
+#include <string.h> /* memcmp */
+
+#include "bplus.h"
+#include "private/compare.h"
+#include "private/packed.h"
+
+/*
+ * Search loop specialized for comparator, compare is called only for keys
+ * with the same prefix. Prefix of uint64 key is the key itself.
+ */
+#define BP__COMPARE_SEARCH(compare)\
+    for (; i < page->length; i++) {\
+      if (page->prefixes[i] != prefix) {\
+        *cmp = 1;\
+      } else if (t->head.flags & BP__HEAD_FLAG_UINT64_KEYS) {\
+        *cmp = 0;\
+      } else {\
+        *cmp = compare((bp_key_t*) &page->keys[i], key);\
+      }\
+      if (*cmp >= 0) break;\
+    }
+
+
+static int bp__compare_bytes(const bp_key_t* a, const bp_key_t* b) {
+  uint64_t len = a->length < b->length ? a->length : b->length;
+  int cmp;
+
+  cmp = len == 0 ? 0 : memcmp(a->value, b->value, len);
+  if (cmp != 0) return cmp > 0 ? 1 : -1;
+  if (a->length == b->length) return 0;
+
+  return a->length > b->length ? 1 : -1;
+}
+
+
+static int bp__compare_uint(const bp_key_t* a, const bp_key_t* b) {
+  uint64_t i, j;
+  int cmp;
+
+  /* leading zeroes doesn't change value */
+  i = 0;
+  while (i < a->length && a->value[i] == 0) i++;
+  j = 0;
+  while (j < b->length && b->value[j] == 0) j++;
+
+  if (a->length - i != b->length - j) {
+    return a->length - i > b->length - j ? 1 : -1;
+  }
+  if (a->length == i) return 0;
+
+  cmp = memcmp(a->value + i, b->value + j, a->length - i);
+  if (cmp == 0) return 0;
+
+  return cmp > 0 ? 1 : -1;
+}
+
+
+static int bp__compare_reverse(const bp_key_t* a, const bp_key_t* b) {
+  return bp__compare_bytes(b, a);
+}
+
+
+int bp__default_compare_cb(const bp_key_t* a, const bp_key_t* b) {
+  return bp__compare_bytes(a, b);
+}
+
+
+int bp__uint_compare_cb(const bp_key_t* a, const bp_key_t* b) {
+  return bp__compare_uint(a, b);
+}
+
+
+int bp__reverse_compare_cb(const bp_key_t* a, const bp_key_t* b) {
+  return bp__compare_reverse(a, b);
+}
+
+
+bp_compare_cb bp__compare_builtin(const int id) {
+  switch (id) {
+    case BP_COMPARE_BYTES: return bp__default_compare_cb;
+    case BP_COMPARE_UINT: return bp__uint_compare_cb;
+    case BP_COMPARE_REVERSE: return bp__reverse_compare_cb;
+    default: return NULL;
+  }
+}
+
+
+int bp__compare_id(bp_compare_cb cb) {
+  if (cb == bp__default_compare_cb) return BP_COMPARE_BYTES;
+  if (cb == bp__uint_compare_cb) return BP_COMPARE_UINT;
+  if (cb == bp__reverse_compare_cb) return BP_COMPARE_REVERSE;
+
+  return BP__COMPARE_CUSTOM;
+}
+
+
+int bp__compare(const bp_db_t* t, const bp_key_t* a, const bp_key_t* b) {
+  switch (t->compare_id) {
+    case BP_COMPARE_BYTES: return bp__compare_bytes(a, b);
+    case BP_COMPARE_UINT: return bp__compare_uint(a, b);
+    case BP_COMPARE_REVERSE: return bp__compare_reverse(a, b);
+    default: return t->compare_cb(a, b);
+  }
+}
+
+
+uint64_t bp__compare_prefix(const bp_db_t* t, const bp_key_t* key) {
+  uint64_t i, prefix;
+
+  switch (t->compare_id) {
+    case BP_COMPARE_BYTES:
+      return bp__kv_prefix(key);
+    case BP_COMPARE_REVERSE:
+      return ~bp__kv_prefix(key);
+    case BP_COMPARE_UINT:
+      i = 0;
+      while (i < key->length && key->value[i] == 0) i++;
+
+      /* values that don't fit into uint64 are all greater */
+      if (key->length - i > sizeof(prefix)) return ~(uint64_t) 0;
+
+      prefix = 0;
+      for (; i < key->length; i++) {
+        prefix = (prefix << 8) | (uint8_t) key->value[i];
+      }
+      return prefix;
+    default:
+      return 0;
+  }
+}
+
+
+uint64_t bp__compare_search(const bp_db_t* t,
+                            const bp__page_t* page,
+                            const uint64_t start,
+                            const bp_key_t* key,
+                            int* cmp) {
+  uint64_t i, prefix;
+
+  *cmp = -1;
+  i = start;
+
+  if (t->compare_id == BP__COMPARE_CUSTOM) {
+    for (; i < page->length; i++) {
+      *cmp = t->compare_cb((bp_key_t*) &page->keys[i], key);
+      if (*cmp >= 0) break;
+    }
+    return i;
+  }
+
+  prefix = bp__compare_prefix(t, key);
+  i = bp__packed_lower_bound(page->prefixes, i, page->length, prefix);
+
+  switch (t->compare_id) {
+    case BP_COMPARE_BYTES:
+      BP__COMPARE_SEARCH(bp__compare_bytes)
+      break;
+    case BP_COMPARE_UINT:
+      BP__COMPARE_SEARCH(bp__compare_uint)
+      break;
+    case BP_COMPARE_REVERSE:
+      BP__COMPARE_SEARCH(bp__compare_reverse)
+      break;
+  }
+
+  return i;
+}
+
+
+void bp__compare_separator(const bp_db_t* t,
+                           const bp__kv_t* left,
+                           const bp__kv_t* right,
+                           bp__kv_t* separator) {
+  uint64_t len;
+
+  *separator = *right;
+
+  /* all uint64 keys have the same length */
+  if (t->head.flags & BP__HEAD_FLAG_UINT64_KEYS) return;
+
+  if (t->compare_id == BP_COMPARE_BYTES) {
+    separator->length = bp__kv_separator((bp_key_t*) left,
+                                         (bp_key_t*) right);
+  } else if (t->compare_id == BP_COMPARE_REVERSE) {
+    /*
+     * Bytes of `left` are greater than bytes of `right`, so only proper
+     * prefix of `left` may be used
+     */
+    len = bp__kv_separator((bp_key_t*) right, (bp_key_t*) left);
+    if (len < left->length) {
+      *separator = *left;
+      separator->length = len;
+    }
+  }
+}
@@ -1,37 +1,118 @@
+#include "bplus.h"
 #include "private/compressor.h"
 #include "private/errors.h"
+#include "private/utils.h"
 
+#include <string.h> /* memcpy */
 #include <unistd.h> /* size_t */
 
-
 #if BP_USE_SNAPPY == 1
 #include <snappy-c.h>
+#endif
+
+#if BP_USE_LZ4 == 1
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
+#if BP_USE_ZSTD == 1
+#include <pthread.h>
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+typedef struct bp__codec_s bp__codec_t;
+
+struct bp__codec_s {
+  size_t (*max_compressed_size)(size_t size);
+  int (*compress)(const int level,
+                  const char* input,
+                  size_t input_length,
+                  char* compressed,
+                  size_t* compressed_length);
+  int (*uncompressed_length)(const char* compressed,
+                             size_t compressed_length,
+                             size_t* result);
+  int (*uncompress)(const char* compressed,
+                    size_t compressed_length,
+                    char* uncompressed,
+                    size_t* uncompressed_length);
+};
+
+
+/* no compression */
+
+
+static size_t bp__none_max_compressed_size(size_t size) {
+  return size;
+}
+
+
+static int bp__none_compress(const int level,
+                             const char* input,
+                             size_t input_length,
+                             char* compressed,
+                             size_t* compressed_length) {
+  memcpy(compressed, input, input_length);
+  *compressed_length = input_length;
+  return BP_OK;
+}
+
+
+static int bp__none_uncompressed_length(const char* compressed,
+                                        size_t compressed_length,
+                                        size_t* result) {
+  *result = compressed_length;
+  return BP_OK;
+}
+
 
-size_t bp__max_compressed_size(size_t size) {
+static int bp__none_uncompress(const char* compressed,
+                               size_t compressed_length,
+                               char* uncompressed,
+                               size_t* uncompressed_length) {
+  memcpy(uncompressed, compressed, compressed_length);
+  *uncompressed_length = compressed_length;
+  return BP_OK;
+}
+
+
+static const bp__codec_t bp__codec_none = {
+  bp__none_max_compressed_size,
+  bp__none_compress,
+  bp__none_uncompressed_length,
+  bp__none_uncompress
+};
+
+
+#if BP_USE_SNAPPY == 1
+static size_t bp__snappy_max_compressed_size(size_t size) {
   return snappy_max_compressed_length(size);
 }
 
 
-int bp__compress(const char* input,
-                 size_t input_length,
-                 char* compressed,
-                 size_t* compressed_length) {
+static int bp__snappy_compress(const int level,
+                               const char* input,
+                               size_t input_length,
+                               char* compressed,
+                               size_t* compressed_length) {
   int ret = snappy_compress(input, input_length, compressed, compressed_length);
   return ret == SNAPPY_OK ? BP_OK : BP_ECOMP;
 }
 
-int bp__uncompressed_length(const char* compressed,
-                            size_t compressed_length,
-                            size_t* result) {
+
+static int bp__snappy_uncompressed_length(const char* compressed,
+                                          size_t compressed_length,
+                                          size_t* result) {
   int ret = snappy_uncompressed_length(compressed, compressed_length, result);
   return ret == SNAPPY_OK ? BP_OK : BP_EDECOMP;
 }
 
 
-int bp__uncompress(const char* compressed,
-                   size_t compressed_length,
-                   char* uncompressed,
-                   size_t* uncompressed_length) {
+static int bp__snappy_uncompress(const char* compressed,
+                                 size_t compressed_length,
+                                 char* uncompressed,
+                                 size_t* uncompressed_length) {
   int ret = snappy_uncompress(compressed,
                               compressed_length,
                               uncompressed,
@@ -39,37 +120,561 @@ int bp__uncompress(const char* compressed,
 
   return ret == SNAPPY_OK ? BP_OK : BP_EDECOMP;
 }
+
+
+static const bp__codec_t bp__codec_snappy = {
+  bp__snappy_max_compressed_size,
+  bp__snappy_compress,
+  bp__snappy_uncompressed_length,
+  bp__snappy_uncompress
+};
+#define BP__CODEC_SNAPPY_PTR &bp__codec_snappy
 #else
-#include <string.h> /* memcpy */
+#define BP__CODEC_SNAPPY_PTR NULL
+#endif
 
-size_t bp__max_compressed_size(size_t size) {
-  return size;
+
+#if BP_USE_LZ4 == 1
+/*
+ * lz4 block format doesn't store uncompressed size,
+ * it's prepended to compressed data as varint
+ */
+static size_t bp__lz4_max_compressed_size(size_t size) {
+  return 10 + LZ4_compressBound((int) size);
+}
+
+
+static int bp__lz4_compress(const int level,
+                            const char* input,
+                            size_t input_length,
+                            char* compressed,
+                            size_t* compressed_length) {
+  uint64_t o;
+  int ret;
+
+  o = bp__varint_write(compressed, input_length);
+
+  /* level > 0 - slower high compression mode */
+  if (level > 0) {
+    ret = LZ4_compress_HC(input,
+                          compressed + o,
+                          (int) input_length,
+                          (int) (*compressed_length - o),
+                          level);
+  } else {
+    ret = LZ4_compress_default(input,
+                               compressed + o,
+                               (int) input_length,
+                               (int) (*compressed_length - o));
+  }
+  if (ret <= 0) return BP_ECOMP;
+
+  *compressed_length = o + ret;
+  return BP_OK;
+}
+
+
+static int bp__lz4_uncompressed_length(const char* compressed,
+                                       size_t compressed_length,
+                                       size_t* result) {
+  uint64_t size;
+
+  if (bp__varint_read(compressed,
+                      compressed + compressed_length,
+                      &size) == 0) {
+    return BP_EDECOMP;
+  }
+
+  *result = size;
+  return BP_OK;
+}
+
+
+static int bp__lz4_uncompress(const char* compressed,
+                              size_t compressed_length,
+                              char* uncompressed,
+                              size_t* uncompressed_length) {
+  uint64_t o, size;
+  int ret;
+
+  o = bp__varint_read(compressed, compressed + compressed_length, &size);
+  if (o == 0 || size > *uncompressed_length) return BP_EDECOMP;
+
+  ret = LZ4_decompress_safe(compressed + o,
+                            uncompressed,
+                            (int) (compressed_length - o),
+                            (int) size);
+  if (ret < 0 || (uint64_t) ret != size) return BP_EDECOMP;
+
+  *uncompressed_length = size;
+  return BP_OK;
+}
+
+
+static const bp__codec_t bp__codec_lz4 = {
+  bp__lz4_max_compressed_size,
+  bp__lz4_compress,
+  bp__lz4_uncompressed_length,
+  bp__lz4_uncompress
+};
+#define BP__CODEC_LZ4_PTR &bp__codec_lz4
+#else
+#define BP__CODEC_LZ4_PTR NULL
+#endif
+
+
+#if BP_USE_ZSTD == 1
+/* zstd contexts are expensive to create, every thread reuses its own */
+typedef struct bp__zstd_ctx_s bp__zstd_ctx_t;
+
+struct bp__zstd_ctx_s {
+  ZSTD_CCtx* cctx;
+  ZSTD_DCtx* dctx;
+};
+
+static pthread_once_t bp__zstd_once = PTHREAD_ONCE_INIT;
+static pthread_key_t bp__zstd_key;
+static int bp__zstd_key_ret = -1;
+
+
+static void bp__zstd_ctx_destroy(void* data) {
+  bp__zstd_ctx_t* ctx = (bp__zstd_ctx_t*) data;
+
+  ZSTD_freeCCtx(ctx->cctx);
+  ZSTD_freeDCtx(ctx->dctx);
+  bp__free(ctx);
+}
+
+
+static void bp__zstd_key_init(void) {
+  bp__zstd_key_ret = pthread_key_create(&bp__zstd_key, bp__zstd_ctx_destroy);
+}
+
+
+static bp__zstd_ctx_t* bp__zstd_ctx(void) {
+  bp__zstd_ctx_t* ctx;
+
+  pthread_once(&bp__zstd_once, bp__zstd_key_init);
+  if (bp__zstd_key_ret != 0) return NULL;
+
+  ctx = (bp__zstd_ctx_t*) pthread_getspecific(bp__zstd_key);
+  if (ctx != NULL) return ctx;
+
+  ctx = bp__malloc(sizeof(*ctx));
+  if (ctx == NULL) return NULL;
+
+  ctx->cctx = ZSTD_createCCtx();
+  ctx->dctx = ZSTD_createDCtx();
+  if (ctx->cctx == NULL || ctx->dctx == NULL ||
+      pthread_setspecific(bp__zstd_key, ctx) != 0) {
+    bp__zstd_ctx_destroy(ctx);
+    return NULL;
+  }
+
+  return ctx;
+}
+
+
+static size_t bp__zstd_max_compressed_size(size_t size) {
+  return ZSTD_compressBound(size);
+}
+
+
+static int bp__zstd_compress(const int level,
+                             const char* input,
+                             size_t input_length,
+                             char* compressed,
+                             size_t* compressed_length) {
+  size_t ret;
+  bp__zstd_ctx_t* ctx = bp__zstd_ctx();
+
+  if (ctx == NULL) return BP_EALLOC;
+  ret = ZSTD_compressCCtx(ctx->cctx,
+                          compressed,
+                          *compressed_length,
+                          input,
+                          input_length,
+                          level == 0 ? ZSTD_CLEVEL_DEFAULT : level);
+  if (ZSTD_isError(ret)) return BP_ECOMP;
+
+  *compressed_length = ret;
+  return BP_OK;
+}
+
+
+static int bp__zstd_uncompressed_length(const char* compressed,
+                                        size_t compressed_length,
+                                        size_t* result) {
+  uint64_t size;
+
+  size = ZSTD_getFrameContentSize(compressed, compressed_length);
+  if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR) {
+    return BP_EDECOMP;
+  }
+
+  *result = (size_t) size;
+  return BP_OK;
+}
+
+
+static int bp__zstd_uncompress(const char* compressed,
+                               size_t compressed_length,
+                               char* uncompressed,
+                               size_t* uncompressed_length) {
+  size_t ret;
+  bp__zstd_ctx_t* ctx = bp__zstd_ctx();
+
+  if (ctx == NULL) return BP_EALLOC;
+  ret = ZSTD_decompressDCtx(ctx->dctx,
+                            uncompressed,
+                            *uncompressed_length,
+                            compressed,
+                            compressed_length);
+  if (ZSTD_isError(ret)) return BP_EDECOMP;
+
+  *uncompressed_length = ret;
+  return BP_OK;
+}
+
+
+static const bp__codec_t bp__codec_zstd = {
+  bp__zstd_max_compressed_size,
+  bp__zstd_compress,
+  bp__zstd_uncompressed_length,
+  bp__zstd_uncompress
+};
+#define BP__CODEC_ZSTD_PTR &bp__codec_zstd
+
+
+int bp__dict_create(const char* data,
+                    const size_t size,
+                    const int level,
+                    bp__dict_t** dict) {
+  bp__dict_t* d;
+
+  d = bp__malloc(sizeof(*d));
+  if (d == NULL) return BP_EALLOC;
+
+  d->size = size;
+  d->data = bp__malloc(size);
+  d->cdict = NULL;
+  d->ddict = NULL;
+  if (d->data == NULL) goto fatal;
+  memcpy(d->data, data, size);
+
+  d->cdict = ZSTD_createCDict(d->data,
+                              size,
+                              level == 0 ? ZSTD_CLEVEL_DEFAULT : level);
+  d->ddict = ZSTD_createDDict(d->data, size);
+  if (d->cdict == NULL || d->ddict == NULL) goto fatal;
+
+  *dict = d;
+  return BP_OK;
+
+fatal:
+  bp__dict_destroy(d);
+  return BP_EALLOC;
+}
+
+
+void bp__dict_destroy(bp__dict_t* dict) {
+  if (dict == NULL) return;
+
+  ZSTD_freeDDict(dict->ddict);
+  ZSTD_freeCDict(dict->cdict);
+  bp__free(dict->data);
+  bp__free(dict);
+}
+
+
+int bp__dict_train(const char* samples,
+                   const size_t* sizes,
+                   const unsigned count,
+                   char* dict,
+                   size_t* size) {
+  size_t ret;
+
+  ret = ZDICT_trainFromBuffer(dict, *size, samples, sizes, count);
+  if (ZDICT_isError(ret)) return BP_ECOMP;
+
+  *size = ret;
+  return BP_OK;
+}
+
+
+static int bp__dict_compress(bp__dict_t* dict,
+                             const char* input,
+                             size_t input_length,
+                             char* compressed,
+                             size_t* compressed_length) {
+  size_t ret;
+  bp__zstd_ctx_t* ctx = bp__zstd_ctx();
+
+  if (ctx == NULL) return BP_EALLOC;
+  ret = ZSTD_compress_usingCDict(ctx->cctx,
+                                 compressed,
+                                 *compressed_length,
+                                 input,
+                                 input_length,
+                                 dict->cdict);
+  if (ZSTD_isError(ret)) return BP_ECOMP;
+
+  *compressed_length = ret;
+  return BP_OK;
+}
+
+
+static int bp__dict_uncompress(const bp__dict_t* dict,
+                               const char* compressed,
+                               size_t compressed_length,
+                               char* uncompressed,
+                               size_t* uncompressed_length) {
+  size_t ret;
+  bp__zstd_ctx_t* ctx = bp__zstd_ctx();
+
+  if (ctx == NULL) return BP_EALLOC;
+  ret = ZSTD_decompress_usingDDict(ctx->dctx,
+                                   uncompressed,
+                                   *uncompressed_length,
+                                   compressed,
+                                   compressed_length,
+                                   dict->ddict);
+  if (ZSTD_isError(ret)) return BP_EDECOMP;
+
+  *uncompressed_length = ret;
+  return BP_OK;
+}
+#else
+#define BP__CODEC_ZSTD_PTR NULL
+
+
+int bp__dict_create(const char* data,
+                    const size_t size,
+                    const int level,
+                    bp__dict_t** dict) {
+  return BP_ECODEC;
+}
+
+
+void bp__dict_destroy(bp__dict_t* dict) {
+}
+
+
+int bp__dict_train(const char* samples,
+                   const size_t* sizes,
+                   const unsigned count,
+                   char* dict,
+                   size_t* size) {
+  return BP_ECODEC;
+}
+
+
+/* dictionary can't be created, so these are never called */
+static int bp__dict_compress(bp__dict_t* dict,
+                             const char* input,
+                             size_t input_length,
+                             char* compressed,
+                             size_t* compressed_length) {
+  return BP_ECODEC;
+}
+
+
+static int bp__dict_uncompress(const bp__dict_t* dict,
+                               const char* compressed,
+                               size_t compressed_length,
+                               char* uncompressed,
+                               size_t* uncompressed_length) {
+  return BP_ECODEC;
+}
+#endif
+
+
+/* indexed by BP_CODEC_*, NULL - not compiled in */
+static const bp__codec_t* bp__codecs[] = {
+  &bp__codec_none,
+  BP__CODEC_SNAPPY_PTR,
+  BP__CODEC_LZ4_PTR,
+  BP__CODEC_ZSTD_PTR
+};
+#define BP__CODEC_COUNT (int) (sizeof(bp__codecs) / sizeof(bp__codecs[0]))
+
+
+static const bp__codec_t* bp__codec_get(const int codec) {
+  if (codec == BP__CODEC_LEGACY) {
+#if BP_USE_SNAPPY == 1
+    return &bp__codec_snappy;
+#else
+    return &bp__codec_none;
+#endif
+  }
+  if (codec < 0 || codec >= BP__CODEC_COUNT) return NULL;
+
+  return bp__codecs[codec];
+}
+
+
+int bp__codec_supported(const int codec) {
+  return bp__codec_get(codec) != NULL;
+}
+
+
+int bp__codec_default(void) {
+#if BP_USE_SNAPPY == 1
+  return BP_CODEC_SNAPPY;
+#else
+  return BP_CODEC_NONE;
+#endif
+}
+
+
+/* dictionary blocks are zstd frames, length is read the same way */
+static const bp__codec_t* bp__codec_tag(const char tag) {
+  if ((uint8_t) tag == BP__CODEC_ZSTD_DICT) {
+    return bp__codec_get(BP_CODEC_ZSTD);
+  }
+  return bp__codec_get((uint8_t) tag);
+}
+
+
+size_t bp__max_compressed_size(const int codec,
+                               const bp__dict_t* dict,
+                               size_t size) {
+  const bp__codec_t* c = bp__codec_get(codec);
+  size_t max_size = c->max_compressed_size(size);
+
+  if (codec == BP__CODEC_LEGACY) return max_size;
+
+  if (dict != NULL) {
+    c = bp__codec_get(BP_CODEC_ZSTD);
+    if (c->max_compressed_size(size) > max_size) {
+      max_size = c->max_compressed_size(size);
+    }
+  }
+
+  /* tag + compressed data */
+  return max_size + 1;
 }
 
 
-int bp__compress(const char* input,
+int bp__compress(const int codec,
+                 bp__dict_t* dict,
+                 const int level,
+                 const int min_saving,
+                 const char* input,
                  size_t input_length,
                  char* compressed,
                  size_t* compressed_length) {
-  memcpy(compressed, input, input_length);
-  *compressed_length = input_length;
+  int ret;
+  size_t saved;
+  const bp__codec_t* c = bp__codec_get(codec);
+
+  if (c == NULL) return BP_ECODEC;
+  if (codec == BP__CODEC_LEGACY) {
+    return c->compress(level,
+                       input,
+                       input_length,
+                       compressed,
+                       compressed_length);
+  }
+
+  /* tag block with codec, dictionary helps even tiny blocks */
+  if (dict != NULL ||
+      (codec != BP_CODEC_NONE && input_length >= BP__COMPRESS_MIN_SIZE)) {
+    *compressed_length -= 1;
+    if (dict != NULL) {
+      compressed[0] = (char) BP__CODEC_ZSTD_DICT;
+      ret = bp__dict_compress(dict,
+                              input,
+                              input_length,
+                              compressed + 1,
+                              compressed_length);
+    } else {
+      compressed[0] = (char) codec;
+      ret = c->compress(level,
+                        input,
+                        input_length,
+                        compressed + 1,
+                        compressed_length);
+    }
+    if (ret != BP_OK) return ret;
+
+    /* compression is worth it */
+    if (*compressed_length < input_length) {
+      saved = input_length - *compressed_length;
+      if (saved * 100 >= input_length * (size_t) min_saving) {
+        *compressed_length += 1;
+        return BP_OK;
+      }
+    }
+  }
+
+  /* store block raw, caller appends input after the tag */
+  compressed[0] = (char) BP_CODEC_NONE;
+  *compressed_length = 1;
+
   return BP_OK;
 }
 
-int bp__uncompressed_length(const char* compressed,
+
+int bp__compressed_raw(const int codec,
+                       const char* compressed,
+                       size_t compressed_length) {
+  return codec != BP__CODEC_LEGACY &&
+         compressed_length >= 1 &&
+         compressed[0] == (char) BP_CODEC_NONE;
+}
+
+
+int bp__uncompressed_length(const int codec,
+                            const char* compressed,
                             size_t compressed_length,
                             size_t* result) {
-  *result = compressed_length;
-  return BP_OK;
+  const bp__codec_t* c;
+
+  if (codec == BP__CODEC_LEGACY) {
+    c = bp__codec_get(codec);
+    return c->uncompressed_length(compressed, compressed_length, result);
+  }
+
+  if (compressed_length < 1) return BP_EDECOMP;
+  c = bp__codec_tag(compressed[0]);
+  if (c == NULL) return BP_ECODEC;
+
+  return c->uncompressed_length(compressed + 1, compressed_length - 1, result);
 }
 
 
-int bp__uncompress(const char* compressed,
+int bp__uncompress(const int codec,
+                   const bp__dict_t* dict,
+                   const char* compressed,
                    size_t compressed_length,
                    char* uncompressed,
                    size_t* uncompressed_length) {
-  memcpy(uncompressed, compressed, compressed_length);
-  *uncompressed_length = compressed_length;
-  return BP_OK;
+  const bp__codec_t* c;
+
+  if (codec == BP__CODEC_LEGACY) {
+    c = bp__codec_get(codec);
+    return c->uncompress(compressed,
+                         compressed_length,
+                         uncompressed,
+                         uncompressed_length);
+  }
+
+  if (compressed_length < 1) return BP_EDECOMP;
+  if ((uint8_t) compressed[0] == BP__CODEC_ZSTD_DICT) {
+    if (dict == NULL) return BP_ECODEC;
+    return bp__dict_uncompress(dict,
+                               compressed + 1,
+                               compressed_length - 1,
+                               uncompressed,
+                               uncompressed_length);
+  }
+
+  c = bp__codec_get((uint8_t) compressed[0]);
+  if (c == NULL) return BP_ECODEC;
+
+  return c->uncompress(compressed + 1,
+                       compressed_length - 1,
+                       uncompressed,
+                       uncompressed_length);
 }
-#endif
@@ -0,0 +1,164 @@
+#include <string.h> /* memcpy */
+
+#include "bplus.h"
+#include "private/cursor.h"
+#include "private/compare.h"
+
+
+static int bp__cursor_push(bp_db_t* t,
+                           bp_cursor_t* cursor,
+                           const uint64_t offset,
+                           const uint64_t config) {
+  int ret;
+  bp__page_t* child;
+
+  if (cursor->depth == BP__CURSOR_MAX_DEPTH) return BP_ECURSORDEPTH;
+
+  /* pages are kept between bp_cursor_next calls */
+  ret = bp__page_load(t, offset, config, kHeapAlloc, &child);
+  if (ret != BP_OK) return ret;
+
+  cursor->pages[cursor->depth] = child;
+  cursor->indexes[cursor->depth] = 0;
+  cursor->depth++;
+
+  return BP_OK;
+}
+
+
+static void bp__cursor_pop(bp_db_t* t, bp_cursor_t* cursor) {
+  cursor->depth--;
+
+  /* root page belongs to snapshot */
+  if (cursor->depth != 0) {
+    bp__page_destroy(t, cursor->pages[cursor->depth]);
+  }
+  cursor->pages[cursor->depth] = NULL;
+
+  /* parent should move to the next child */
+  if (cursor->depth != 0) cursor->indexes[cursor->depth - 1]++;
+}
+
+
+int bp__cursor_init(bp_db_t* t,
+                    bp_cursor_t* cursor,
+                    const bp_key_t* start,
+                    const bp_key_t* end) {
+  int ret;
+  bp__page_t* page;
+  bp__page_search_res_t res;
+
+  cursor->depth = 0;
+  cursor->has_end = end != NULL;
+
+  if (end != NULL) {
+    cursor->end.length = end->length;
+    cursor->end.value = bp__malloc(end->length + 1);
+    if (cursor->end.value == NULL) return BP_EALLOC;
+    memcpy(cursor->end.value, end->value, end->length);
+  } else {
+    cursor->end.length = 0;
+    cursor->end.value = NULL;
+  }
+
+  cursor->pages[0] = cursor->snapshot->page;
+  cursor->indexes[0] = 0;
+  cursor->depth = 1;
+
+  /* walk down to the first leaf key that is greater or equal to start */
+  for (;;) {
+    page = cursor->pages[cursor->depth - 1];
+
+    if (start != NULL) {
+      ret = bp__page_search(t, page, start, kNotLoad, &res);
+      if (ret != BP_OK) goto fatal;
+
+      cursor->indexes[cursor->depth - 1] = res.index;
+    }
+
+    if (page->type == kLeaf) break;
+
+    ret = bp__cursor_push(t,
+                          cursor,
+                          page->keys[cursor->indexes[cursor->depth - 1]].offset,
+                          page->keys[cursor->indexes[cursor->depth - 1]].config);
+    if (ret != BP_OK) goto fatal;
+  }
+
+  return BP_OK;
+
+fatal:
+  bp__cursor_destroy(t, cursor);
+  return ret;
+}
+
+
+void bp__cursor_destroy(bp_db_t* t, bp_cursor_t* cursor) {
+  while (cursor->depth > 0) bp__cursor_pop(t, cursor);
+
+  bp__free(cursor->end.value);
+  cursor->end.value = NULL;
+}
+
+
+int bp__cursor_next(bp_db_t* t,
+                    bp_cursor_t* cursor,
+                    bp_key_t* key,
+                    bp_value_t* value) {
+  int ret;
+  uint64_t index;
+  bp__page_t* page;
+  bp__kv_t* kv;
+
+  while (cursor->depth > 0) {
+    page = cursor->pages[cursor->depth - 1];
+    index = cursor->indexes[cursor->depth - 1];
+
+    /* page is exhausted - go back to parent */
+    if (index >= page->length) {
+      bp__cursor_pop(t, cursor);
+      continue;
+    }
+
+    /* parent was advanced - load its next child */
+    if (page->type == kPage) {
+      ret = bp__cursor_push(t,
+                            cursor,
+                            page->keys[index].offset,
+                            page->keys[index].config);
+      if (ret != BP_OK) return ret;
+      continue;
+    }
+
+    kv = &page->keys[index];
+
+    /* went past the end of range - no need to visit other pages */
+    if (cursor->has_end && bp__compare(t, (bp_key_t*) kv, &cursor->end) > 0) {
+      while (cursor->depth > 0) bp__cursor_pop(t, cursor);
+      break;
+    }
+
+    /* expired key is skipped without loading it's value */
+    if (bp__kv_expired(kv->expires)) {
+      cursor->indexes[cursor->depth - 1]++;
+      continue;
+    }
+
+    ret = bp__page_load_value(t, page, index, value);
+    if (ret != BP_OK) return ret;
+
+    key->length = kv->length;
+    key->value = bp__malloc(kv->length + 1);
+    if (key->value == NULL) {
+      bp__free(value->value);
+      return BP_EALLOC;
+    }
+    memcpy(key->value, kv->value, kv->length);
+
+    cursor->indexes[cursor->depth - 1]++;
+
+    return BP_OK;
+  }
+
+  return BP_ENOTFOUND;
+}
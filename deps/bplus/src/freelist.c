@@ -0,0 +1,285 @@
+#include <stdlib.h> /* qsort */
+#include <string.h> /* memcpy, memmove */
+
+#include "bplus.h"
+#include "private/freelist.h"
+#include "private/alloc.h"
+#include "private/utils.h"
+
+
+static int bp__freelist_grow(bp__extent_t** extents,
+                             uint64_t* capacity,
+                             const uint64_t count) {
+  bp__extent_t* tmp;
+  uint64_t new_capacity;
+
+  if (count <= *capacity) return BP_OK;
+
+  new_capacity = *capacity == 0 ? 64 : *capacity;
+  while (new_capacity < count) new_capacity *= 2;
+
+  tmp = bp__malloc(new_capacity * sizeof(*tmp));
+  if (tmp == NULL) return BP_EALLOC;
+
+  if (*extents != NULL) {
+    memcpy(tmp, *extents, *capacity * sizeof(*tmp));
+    bp__free(*extents);
+  }
+  *extents = tmp;
+  *capacity = new_capacity;
+
+  return BP_OK;
+}
+
+
+static int bp__freelist_compare(const void* a, const void* b) {
+  const bp__extent_t* ea = (const bp__extent_t*) a;
+  const bp__extent_t* eb = (const bp__extent_t*) b;
+
+  if (ea->offset == eb->offset) return 0;
+  return ea->offset < eb->offset ? -1 : 1;
+}
+
+
+int bp__freelist_create(bp__freelist_t** list) {
+  bp__freelist_t* l;
+
+  l = bp__malloc(sizeof(*l));
+  if (l == NULL) return BP_EALLOC;
+
+  l->free = NULL;
+  l->free_count = 0;
+  l->free_capacity = 0;
+  l->next = 0;
+  l->used = 0;
+  l->last = 0;
+  l->last_used = 0;
+  l->pending = NULL;
+  l->pending_count = 0;
+  l->pending_capacity = 0;
+  l->released_count = 0;
+  l->dirty = 0;
+
+  *list = l;
+  return BP_OK;
+}
+
+
+void bp__freelist_destroy(bp__freelist_t* list) {
+  if (list == NULL) return;
+
+  bp__free(list->free);
+  bp__free(list->pending);
+  bp__free(list);
+}
+
+
+int bp__freelist_release(bp__freelist_t* list,
+                         const uint64_t offset,
+                         const uint64_t size) {
+  int ret;
+
+  if (size == 0) return BP_OK;
+
+  ret = bp__freelist_grow(&list->pending,
+                          &list->pending_capacity,
+                          list->pending_count + 1);
+  if (ret != BP_OK) return ret;
+
+  list->pending[list->pending_count].offset = offset;
+  list->pending[list->pending_count].size = size;
+  list->pending_count++;
+  list->released_count++;
+
+  return BP_OK;
+}
+
+
+void bp__freelist_discard(bp__freelist_t* list) {
+  /* modification has failed, blocks are still referenced by current head */
+  list->pending_count -= list->released_count;
+  list->released_count = 0;
+}
+
+
+void bp__freelist_seal(bp__freelist_t* list) {
+  list->released_count = 0;
+}
+
+
+int bp__freelist_commit(bp__freelist_t* list) {
+  int ret;
+  uint64_t i, j, sealed;
+
+  sealed = list->pending_count - list->released_count;
+  if (sealed == 0) return BP_OK;
+
+  ret = bp__freelist_grow(&list->free,
+                          &list->free_capacity,
+                          list->free_count + sealed);
+  if (ret != BP_OK) return ret;
+
+  /* what's left of extents that are being allocated */
+  if (list->free_count != 0) {
+    list->free[list->next].offset += list->used;
+    list->free[list->next].size -= list->used;
+    list->free[list->last].size -= list->last_used;
+  }
+
+  memcpy(list->free + list->free_count,
+         list->pending,
+         sealed * sizeof(*list->pending));
+  list->free_count += sealed;
+
+  /* extents released by modification in progress are left pending */
+  memmove(list->pending,
+          list->pending + sealed,
+          list->released_count * sizeof(*list->pending));
+  list->pending_count = list->released_count;
+
+  /* sort, drop allocated and merge adjacent extents */
+  qsort(list->free, list->free_count, sizeof(*list->free),
+        bp__freelist_compare);
+  for (i = 0, j = 0; j < list->free_count; j++) {
+    if (list->free[j].size == 0) continue;
+
+    if (i > 0 &&
+        list->free[i - 1].offset + list->free[i - 1].size >=
+            list->free[j].offset) {
+      if (list->free[j].offset + list->free[j].size >
+          list->free[i - 1].offset + list->free[i - 1].size) {
+        list->free[i - 1].size = list->free[j].offset + list->free[j].size -
+                                 list->free[i - 1].offset;
+      }
+    } else {
+      list->free[i++] = list->free[j];
+    }
+  }
+  list->free_count = i;
+
+  list->next = 0;
+  list->used = 0;
+  list->last = i == 0 ? 0 : i - 1;
+  list->last_used = 0;
+  list->dirty = 1;
+
+  return BP_OK;
+}
+
+
+static uint64_t bp__freelist_available(const bp__freelist_t* list,
+                                       const uint64_t index) {
+  uint64_t size = list->free[index].size;
+
+  if (index == list->next) size -= list->used;
+  if (index == list->last) size -= list->last_used;
+
+  return size;
+}
+
+
+int bp__freelist_alloc(bp__freelist_t* list,
+                       const uint64_t size,
+                       uint64_t* offset) {
+  uint64_t i;
+
+  if (list->free_count == 0) return BP_ENOTFOUND;
+
+  if (size < BP__FREELIST_SMALL_SIZE) {
+    /* small blocks go from the end */
+    for (i = list->last; i > list->next; i--) {
+      if (bp__freelist_available(list, i) >= size) break;
+    }
+    if (bp__freelist_available(list, i) < size) return BP_ENOTFOUND;
+
+    /* skipped remainder is free again after commit */
+    if (i != list->last) {
+      list->free[list->last].size -= list->last_used;
+      list->last = i;
+      list->last_used = 0;
+    }
+    list->last_used += size;
+    *offset = list->free[i].offset + list->free[i].size - list->last_used;
+  } else {
+    for (i = list->next; i < list->last; i++) {
+      if (bp__freelist_available(list, i) >= size) break;
+    }
+    if (bp__freelist_available(list, i) < size) return BP_ENOTFOUND;
+
+    if (i != list->next) {
+      list->free[list->next].offset += list->used;
+      list->free[list->next].size -= list->used;
+      list->next = i;
+      list->used = 0;
+    }
+    *offset = list->free[i].offset + list->used;
+    list->used += size;
+  }
+
+  return BP_OK;
+}
+
+
+uint64_t bp__freelist_size(const bp__freelist_t* list) {
+  return sizeof(uint64_t) + list->free_count * 2 * sizeof(uint64_t);
+}
+
+
+void bp__freelist_encode(const bp__freelist_t* list, char* buff) {
+  uint64_t i;
+
+  *(uint64_t*) buff = htonll(list->free_count);
+  buff += sizeof(uint64_t);
+  for (i = 0; i < list->free_count; i++) {
+    *(uint64_t*) buff = htonll(list->free[i].offset);
+    *(uint64_t*) (buff + 8) = htonll(list->free[i].size);
+    buff += 2 * sizeof(uint64_t);
+  }
+}
+
+
+int bp__freelist_decode(bp__freelist_t* list,
+                        const char* buff,
+                        const uint64_t size,
+                        const uint64_t next,
+                        const uint64_t used,
+                        const uint64_t last,
+                        const uint64_t last_used) {
+  int ret;
+  uint64_t i, count;
+
+  if (size < sizeof(uint64_t)) return BP_EFILEREAD;
+  count = ntohll(*(uint64_t*) buff);
+  if (size != sizeof(uint64_t) + count * 2 * sizeof(uint64_t) ||
+      (count != 0 && (next > last || last >= count))) {
+    return BP_EFILEREAD;
+  }
+  buff += sizeof(uint64_t);
+
+  ret = bp__freelist_grow(&list->free, &list->free_capacity, count);
+  if (ret != BP_OK) return ret;
+
+  for (i = 0; i < count; i++) {
+    list->free[i].offset = ntohll(*(uint64_t*) buff);
+    list->free[i].size = ntohll(*(uint64_t*) (buff + 8));
+    buff += 2 * sizeof(uint64_t);
+
+    /* allocated as of head */
+    if (i < next || i > last) list->free[i].size = 0;
+  }
+  list->free_count = count;
+  list->next = count == 0 ? 0 : next;
+  list->used = count == 0 ? 0 : used;
+  list->last = count == 0 ? 0 : last;
+  list->last_used = count == 0 ? 0 : last_used;
+  list->dirty = 0;
+
+  if (count != 0 &&
+      (used > list->free[next].size ||
+       last_used > list->free[last].size ||
+       (next == last && used + last_used > list->free[next].size))) {
+    return BP_EFILEREAD;
+  }
+
+  return BP_OK;
+}
@@ -0,0 +1,329 @@
+#include <string.h> /* memcpy */
+#include <arpa/inet.h> /* htonl, ntohl */
+
+#include "bplus.h"
+#include "private/leaf.h"
+#include "private/compare.h"
+#include "private/utils.h"
+
+typedef struct bp__leaf_entry_s bp__leaf_entry_t;
+
+struct bp__leaf_entry_s {
+  uint64_t shared;
+  uint64_t unshared;
+  uint64_t offset;
+  uint64_t config;
+  uint64_t expires;
+  const char* suffix;
+};
+
+
+static const char* bp__leaf_read_entry(const char* p,
+                                       const char* end,
+                                       const int expiry,
+                                       bp__leaf_entry_t* entry) {
+  uint64_t len;
+
+  if ((len = bp__varint_read(p, end, &entry->shared)) == 0) return NULL;
+  p += len;
+  if ((len = bp__varint_read(p, end, &entry->unshared)) == 0) return NULL;
+  p += len;
+  if ((len = bp__varint_read(p, end, &entry->offset)) == 0) return NULL;
+  p += len;
+  if ((len = bp__varint_read(p, end, &entry->config)) == 0) return NULL;
+  p += len;
+
+  entry->expires = 0;
+  if (expiry) {
+    if ((len = bp__varint_read(p, end, &entry->expires)) == 0) return NULL;
+    p += len;
+  }
+
+  if (entry->unshared > (uint64_t) (end - p)) return NULL;
+  entry->suffix = p;
+
+  return p + entry->unshared;
+}
+
+
+static int bp__leaf_read_restarts(const char* buff,
+                                  const uint64_t size,
+                                  const char** entries_end,
+                                  uint64_t* count) {
+  uint32_t tmp;
+
+  if (size < sizeof(tmp)) return BP_EDECOMP;
+
+  memcpy(&tmp, buff + size - sizeof(tmp), sizeof(tmp));
+  *count = ntohl(tmp);
+  if (*count > (size - sizeof(tmp)) / sizeof(tmp)) return BP_EDECOMP;
+
+  *entries_end = buff + size - sizeof(tmp) * (*count + 1);
+
+  return BP_OK;
+}
+
+
+static uint64_t bp__leaf_restart(const char* entries_end, const uint64_t i) {
+  uint32_t tmp;
+
+  memcpy(&tmp, entries_end + i * sizeof(tmp), sizeof(tmp));
+  return ntohl(tmp);
+}
+
+
+uint64_t bp__leaf_max_size(const bp__page_t* page) {
+  /*
+   * Five varints (at most 10 bytes each, expiry time is optional) are
+   * replacing 24 bytes of header, plus restart offset for each entry in the
+   * worst case and restart count
+   */
+  return page->byte_size + page->length * (26 + sizeof(uint32_t)) +
+         sizeof(uint32_t);
+}
+
+
+int bp__leaf_encode(bp_db_t* t,
+                    const bp__page_t* page,
+                    char* buff,
+                    uint64_t* size) {
+  uint64_t i, o, shared, max_shared;
+  uint32_t tmp, restart_count;
+  uint32_t* restarts;
+  const bp__kv_t* kv;
+  const bp__kv_t* prev;
+
+  restart_count = (page->length + BP__LEAF_RESTART_INTERVAL - 1) /
+                  BP__LEAF_RESTART_INTERVAL;
+  restarts = bp__arena_alloc(sizeof(*restarts) * (restart_count + 1));
+  if (restarts == NULL) return BP_EALLOC;
+
+  o = 0;
+  prev = NULL;
+  for (i = 0; i < page->length; i++) {
+    kv = &page->keys[i];
+
+    shared = 0;
+    if (i % BP__LEAF_RESTART_INTERVAL == 0) {
+      restarts[i / BP__LEAF_RESTART_INTERVAL] = htonl((uint32_t) o);
+    } else {
+      max_shared = prev->length < kv->length ? prev->length : kv->length;
+      while (shared < max_shared && prev->value[shared] == kv->value[shared]) {
+        shared++;
+      }
+    }
+
+    o += bp__varint_write(buff + o, shared);
+    o += bp__varint_write(buff + o, kv->length - shared);
+    o += bp__varint_write(buff + o, kv->offset);
+    o += bp__varint_write(buff + o, kv->config);
+    if (t->head.flags & BP__HEAD_FLAG_EXPIRY) {
+      o += bp__varint_write(buff + o, kv->expires);
+    }
+    memcpy(buff + o, kv->value + shared, kv->length - shared);
+    o += kv->length - shared;
+
+    prev = kv;
+  }
+
+  memcpy(buff + o, restarts, sizeof(*restarts) * restart_count);
+  o += sizeof(*restarts) * restart_count;
+
+  tmp = htonl(restart_count);
+  memcpy(buff + o, &tmp, sizeof(tmp));
+  o += sizeof(tmp);
+
+  bp__arena_free(restarts);
+
+  *size = o;
+  return BP_OK;
+}
+
+
+int bp__leaf_decode(bp_db_t* t,
+                    bp__page_t* page,
+                    const char* buff,
+                    const uint64_t size) {
+  int ret;
+  uint64_t i, restart_count, total, prev_length, byte_size;
+  const char* p;
+  const char* entries_end;
+  char* keys;
+  char* key;
+  int expiry;
+  bp__leaf_entry_t entry;
+
+  expiry = (t->head.flags & BP__HEAD_FLAG_EXPIRY) != 0;
+  if (size == 0) {
+    /* empty head page was never written */
+    entries_end = buff;
+  } else {
+    ret = bp__leaf_read_restarts(buff, size, &entries_end, &restart_count);
+    if (ret != BP_OK) return ret;
+  }
+
+  /* calculate space needed for keys */
+  total = 0;
+  prev_length = 0;
+  i = 0;
+  for (p = buff; p < entries_end; i++) {
+    p = bp__leaf_read_entry(p, entries_end, expiry, &entry);
+    if (p == NULL) return BP_EDECOMP;
+    if (entry.shared > prev_length || i == t->head.page_size) {
+      return BP_EDECOMP;
+    }
+
+    prev_length = entry.shared + entry.unshared;
+    total += prev_length;
+  }
+
+  keys = bp__alloc(page->alloc, total + 1);
+  if (keys == NULL) return BP_EALLOC;
+
+  /* restore keys */
+  key = keys;
+  byte_size = 0;
+  i = 0;
+  for (p = buff; p < entries_end; i++) {
+    p = bp__leaf_read_entry(p, entries_end, expiry, &entry);
+
+    if (entry.shared != 0) {
+      memcpy(key, page->keys[i - 1].value, entry.shared);
+    }
+    memcpy(key + entry.shared, entry.suffix, entry.unshared);
+
+    page->keys[i].value = key;
+    page->keys[i].length = entry.shared + entry.unshared;
+    page->keys[i].offset = entry.offset;
+    page->keys[i].config = entry.config;
+    page->keys[i].expires = entry.expires;
+    page->keys[i].allocated = 0;
+    bp__page_set_prefix(t, page, i);
+
+    key += page->keys[i].length;
+    byte_size += BP__KV_SIZE(page->keys[i]);
+  }
+  page->length = i;
+  page->byte_size = byte_size;
+
+  if (page->buff_ != NULL) {
+    bp__arena_free(page->buff_);
+  }
+  page->buff_ = keys;
+
+  return BP_OK;
+}
+
+
+int bp__leaf_get(bp_db_t* t,
+                 const uint64_t offset,
+                 const uint64_t config,
+                 const bp_key_t* key,
+                 bp_value_t* value,
+                 bp__kv_t* ref) {
+  int ret, cmp, expiry;
+  uint64_t size, restart_count, start, end, middle, restart;
+  char* buff;
+  char* scratch;
+  const char* p;
+  const char* entries_end;
+  bp_key_t current;
+  bp__leaf_entry_t entry;
+  bp__arena_mark_t mark;
+
+  bp__arena_mark(&mark);
+
+  expiry = (t->head.flags & BP__HEAD_FLAG_EXPIRY) != 0;
+  size = config >> 1;
+  ret = bp__writer_read((bp__writer_t*) t,
+                        kCompressed,
+                        kArenaAlloc,
+                        offset,
+                        &size,
+                        (void**) &buff);
+  if (ret != BP_OK) return ret;
+
+  scratch = NULL;
+  if (size == 0) {
+    ret = BP_ENOTFOUND;
+    goto done;
+  }
+
+  ret = bp__leaf_read_restarts(buff, size, &entries_end, &restart_count);
+  if (ret != BP_OK) goto done;
+
+  /* find last restart point with key lower or equal to the searched one */
+  start = 0;
+  end = restart_count;
+  while (start < end) {
+    middle = start + ((end - start) >> 1);
+
+    restart = bp__leaf_restart(entries_end, middle);
+    if (restart >= (uint64_t) (entries_end - buff) ||
+        bp__leaf_read_entry(buff + restart,
+                            entries_end,
+                            expiry,
+                            &entry) == NULL ||
+        entry.shared != 0) {
+      ret = BP_EDECOMP;
+      goto done;
+    }
+
+    current.value = (char*) entry.suffix;
+    current.length = entry.unshared;
+    if (bp__compare(t, &current, key) <= 0) {
+      start = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+
+  if (start == 0) {
+    ret = BP_ENOTFOUND;
+    goto done;
+  }
+
+  /* keys in page are not longer than page itself */
+  scratch = bp__arena_alloc(size);
+  if (scratch == NULL) {
+    ret = BP_EALLOC;
+    goto done;
+  }
+
+  /* decode keys one-by-one starting from restart point */
+  ret = BP_ENOTFOUND;
+  current.value = scratch;
+  current.length = 0;
+  for (p = buff + bp__leaf_restart(entries_end, start - 1); p < entries_end;) {
+    p = bp__leaf_read_entry(p, entries_end, expiry, &entry);
+    if (p == NULL || entry.shared > current.length) {
+      ret = BP_EDECOMP;
+      break;
+    }
+
+    memcpy(scratch + entry.shared, entry.suffix, entry.unshared);
+    current.length = entry.shared + entry.unshared;
+
+    cmp = bp__compare(t, &current, key);
+    if (cmp < 0) continue;
+
+    /* expired key is missing, it's value isn't loaded */
+    if (cmp != 0 || bp__kv_expired(entry.expires)) break;
+
+    if (ref != NULL) {
+      ref->offset = entry.offset;
+      ref->config = entry.config;
+      ret = BP_OK;
+    } else {
+      ret = bp__value_load(t, entry.offset, entry.config, value);
+    }
+    break;
+  }
+
+done:
+  bp__arena_free(scratch);
+  bp__arena_free(buff);
+  bp__arena_rewind(&mark);
+
+  return ret;
+}
@@ -0,0 +1,168 @@
+#include <stdlib.h> /* qsort */
+#include <string.h> /* memcpy */
+
+#include "bplus.h"
+#include "private/merge.h"
+#include "private/utils.h"
+
+
+static int bp__merge_read_int(const bp_value_t* value, int64_t* number) {
+  uint64_t tmp;
+
+  if (value->length != sizeof(tmp)) return BP_EMERGE;
+
+  memcpy(&tmp, value->value, sizeof(tmp));
+  *number = (int64_t) ntohll(tmp);
+
+  return BP_OK;
+}
+
+
+static int bp__merge_write_int(const uint64_t number, bp_value_t* result) {
+  uint64_t tmp;
+
+  result->value = bp__malloc(sizeof(tmp));
+  if (result->value == NULL) return BP_EALLOC;
+
+  tmp = htonll(number);
+  memcpy(result->value, &tmp, sizeof(tmp));
+  result->length = sizeof(tmp);
+
+  return BP_OK;
+}
+
+
+static int bp__merge_int(const int op,
+                         const bp_value_t* previous,
+                         const bp_value_t* operand,
+                         bp_value_t* result) {
+  int ret;
+  int64_t a, b;
+
+  ret = bp__merge_read_int(operand, &b);
+  if (ret != BP_OK) return ret;
+  if (previous == NULL) return bp__merge_write_int((uint64_t) b, result);
+
+  ret = bp__merge_read_int(previous, &a);
+  if (ret != BP_OK) return ret;
+
+  /* counter wraps around on overflow */
+  if (op == BP_MERGE_ADD) {
+    return bp__merge_write_int((uint64_t) a + (uint64_t) b, result);
+  }
+  if (op == BP_MERGE_MAX) {
+    return bp__merge_write_int((uint64_t) (a > b ? a : b), result);
+  }
+  return bp__merge_write_int((uint64_t) (a < b ? a : b), result);
+}
+
+
+static int bp__merge_append(const bp_value_t* previous,
+                            const bp_value_t* operand,
+                            bp_value_t* result) {
+  uint64_t length;
+
+  length = previous == NULL ? 0 : previous->length;
+  result->value = bp__malloc(length + operand->length + 1);
+  if (result->value == NULL) return BP_EALLOC;
+
+  if (length != 0) memcpy(result->value, previous->value, length);
+  memcpy(result->value + length, operand->value, operand->length);
+  result->length = length + operand->length;
+
+  return BP_OK;
+}
+
+
+static int bp__merge_compare_ids(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+
+  return x == y ? 0 : x > y ? 1 : -1;
+}
+
+
+static uint64_t bp__merge_read_id(const char* p) {
+  uint64_t tmp;
+
+  memcpy(&tmp, p, sizeof(tmp));
+  return ntohll(tmp);
+}
+
+
+static int bp__merge_union(const bp_value_t* previous,
+                           const bp_value_t* operand,
+                           bp_value_t* result) {
+  uint64_t i, j, count, prev_count, id, tmp;
+  uint64_t* ids;
+  char* out;
+
+  if (operand->length % sizeof(id) != 0 ||
+      (previous != NULL && previous->length % sizeof(id) != 0)) {
+    return BP_EMERGE;
+  }
+
+  /* operand may be in any order, previous set is sorted */
+  count = operand->length / sizeof(id);
+  prev_count = previous == NULL ? 0 : previous->length / sizeof(id);
+
+  ids = bp__malloc(count * sizeof(id) + 1);
+  if (ids == NULL) return BP_EALLOC;
+  for (i = 0; i < count; i++) {
+    ids[i] = bp__merge_read_id(operand->value + i * sizeof(id));
+  }
+  qsort(ids, count, sizeof(id), bp__merge_compare_ids);
+
+  result->value = bp__malloc((count + prev_count) * sizeof(id) + 1);
+  if (result->value == NULL) {
+    bp__free(ids);
+    return BP_EALLOC;
+  }
+
+  /* merge both sorted sets skipping duplicates */
+  out = result->value;
+  i = 0;
+  j = 0;
+  while (i < prev_count || j < count) {
+    if (j == count ||
+        (i < prev_count &&
+         bp__merge_read_id(previous->value + i * sizeof(id)) < ids[j])) {
+      id = bp__merge_read_id(previous->value + i * sizeof(id));
+      i++;
+    } else {
+      id = ids[j];
+      j++;
+    }
+
+    if (out != result->value && bp__merge_read_id(out - sizeof(id)) == id) {
+      continue;
+    }
+
+    tmp = htonll(id);
+    memcpy(out, &tmp, sizeof(tmp));
+    out += sizeof(tmp);
+  }
+  result->length = out - result->value;
+  bp__free(ids);
+
+  return BP_OK;
+}
+
+
+int bp__merge(const int op,
+              const bp_value_t* previous,
+              const bp_value_t* operand,
+              bp_value_t* result) {
+  switch (op) {
+    case BP_MERGE_ADD:
+    case BP_MERGE_MAX:
+    case BP_MERGE_MIN:
+      return bp__merge_int(op, previous, operand, result);
+    case BP_MERGE_APPEND:
+      return bp__merge_append(previous, operand, result);
+    case BP_MERGE_UNION:
+      return bp__merge_union(previous, operand, result);
+    default:
+      return BP_EMERGE;
+  }
+}
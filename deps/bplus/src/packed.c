@@ -0,0 +1,158 @@
+#include <string.h> /* memcpy, memset */
+#include <assert.h> /* assert */
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+#include "bplus.h"
+#include "private/packed.h"
+#include "private/utils.h"
+
+#define BP__PACKED_ENTRY_SIZE (3 * sizeof(uint64_t))
+
+#if defined(__AVX2__) || defined(__SSE4_2__)
+/* number of set bits in 4-bit comparison mask */
+static const uint64_t bp__packed_bits[16] = {
+  0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
+};
+#endif
+
+
+/* expiry time of keys is stored only in leaf pages */
+static int bp__packed_expiry(const bp_db_t* t, const bp__page_t* page) {
+  return page->type == kLeaf && (t->head.flags & BP__HEAD_FLAG_EXPIRY);
+}
+
+
+uint64_t bp__packed_encode(const bp_db_t* t,
+                           const bp__page_t* page,
+                           char* buff) {
+  uint64_t i, tmp;
+  const uint64_t length = page->length;
+  const int expiry = bp__packed_expiry(t, page);
+
+  for (i = 0; i < length; i++) {
+    if (page->keys[i].length == sizeof(tmp)) {
+      memcpy(buff + i * sizeof(tmp), page->keys[i].value, sizeof(tmp));
+    } else {
+      /* left element of non-leaf page is empty, it's never compared */
+      assert(page->type == kPage && i == 0 && page->keys[i].length == 0);
+      memset(buff + i * sizeof(tmp), 0, sizeof(tmp));
+    }
+
+    tmp = htonll(page->keys[i].offset);
+    memcpy(buff + (length + i) * sizeof(tmp), &tmp, sizeof(tmp));
+    tmp = htonll(page->keys[i].config);
+    memcpy(buff + (2 * length + i) * sizeof(tmp), &tmp, sizeof(tmp));
+    if (expiry) {
+      tmp = htonll(page->keys[i].expires);
+      memcpy(buff + (3 * length + i) * sizeof(tmp), &tmp, sizeof(tmp));
+    }
+  }
+
+  return length * (BP__PACKED_ENTRY_SIZE + (expiry ? sizeof(tmp) : 0));
+}
+
+
+int bp__packed_decode(bp_db_t* t,
+                      bp__page_t* page,
+                      char* buff,
+                      const uint64_t size) {
+  uint64_t i, length, tmp, entry_size;
+  const int expiry = bp__packed_expiry(t, page);
+
+  entry_size = BP__PACKED_ENTRY_SIZE + (expiry ? sizeof(tmp) : 0);
+  if (size % entry_size != 0) return BP_EDECOMP;
+
+  length = size / entry_size;
+  if (length > t->head.page_size) return BP_EDECOMP;
+
+  for (i = 0; i < length; i++) {
+    page->keys[i].value = buff + i * sizeof(tmp);
+    page->keys[i].length = sizeof(tmp);
+    page->keys[i].allocated = 0;
+
+    bp__page_set_prefix(t, page, i);
+
+    memcpy(&tmp, buff + (length + i) * sizeof(tmp), sizeof(tmp));
+    page->keys[i].offset = ntohll(tmp);
+    memcpy(&tmp, buff + (2 * length + i) * sizeof(tmp), sizeof(tmp));
+    page->keys[i].config = ntohll(tmp);
+    page->keys[i].expires = 0;
+    if (expiry) {
+      memcpy(&tmp, buff + (3 * length + i) * sizeof(tmp), sizeof(tmp));
+      page->keys[i].expires = ntohll(tmp);
+    }
+  }
+  page->length = length;
+  page->byte_size = length * (BP__PACKED_ENTRY_SIZE + sizeof(tmp));
+
+  if (page->buff_ != NULL) {
+    bp__arena_free(page->buff_);
+  }
+  page->buff_ = buff;
+
+  return BP_OK;
+}
+
+
+uint64_t bp__packed_lower_bound(const uint64_t* keys,
+                                const uint64_t start,
+                                const uint64_t end,
+                                const uint64_t key) {
+  uint64_t i, half, length;
+
+#if defined(__AVX2__)
+  __m256i sign, needle, items;
+  int mask;
+
+  /* there is no unsigned comparison, flip sign bits to compare as signed */
+  sign = _mm256_set1_epi64x((int64_t) ((uint64_t) 1 << 63));
+  needle = _mm256_xor_si256(_mm256_set1_epi64x((int64_t) key), sign);
+
+  for (i = start; i + 4 <= end; i += 4) {
+    items = _mm256_loadu_si256((const __m256i*) (keys + i));
+    items = _mm256_xor_si256(items, sign);
+    mask = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpgt_epi64(needle, items)));
+
+    /* keys are sorted, lower ones are always in the low bits of mask */
+    if (mask != 0xf) return i + bp__packed_bits[mask];
+  }
+#elif defined(__SSE4_2__)
+  __m128i sign, needle, items;
+  int mask;
+
+  /* there is no unsigned comparison, flip sign bits to compare as signed */
+  sign = _mm_set1_epi64x((int64_t) ((uint64_t) 1 << 63));
+  needle = _mm_xor_si128(_mm_set1_epi64x((int64_t) key), sign);
+
+  for (i = start; i + 2 <= end; i += 2) {
+    items = _mm_loadu_si128((const __m128i*) (keys + i));
+    items = _mm_xor_si128(items, sign);
+    mask = _mm_movemask_pd(_mm_castsi128_pd(_mm_cmpgt_epi64(needle, items)));
+
+    /* keys are sorted, lower ones are always in the low bits of mask */
+    if (mask != 0x3) return i + bp__packed_bits[mask];
+  }
+#else
+  i = start;
+#endif
+
+  /* binary search in the rest of keys */
+  length = end - i;
+  while (length > 0) {
+    half = length >> 1;
+    if (keys[i + half] < key) {
+      i += half + 1;
+      length -= half + 1;
+    } else {
+      length = half;
+    }
+  }
+
+  return i;
+}
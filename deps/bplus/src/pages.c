@@ -1,22 +1,31 @@
-#include <stdlib.h> /* malloc, free */
 #include <string.h> /* memcpy */
 #include <assert.h> /* assert */
 
 #include "bplus.h"
 #include "private/pages.h"
+#include "private/compare.h"
+#include "private/merge.h"
+#include "private/leaf.h"
+#include "private/packed.h"
 #include "private/utils.h"
 
 int bp__page_create(bp_db_t* t,
                     const enum page_type type,
                     const uint64_t offset,
                     const uint64_t config,
+                    const enum alloc_type alloc,
                     bp__page_t** page) {
   /* Allocate space for page + keys */
   bp__page_t* p;
 
-  p = malloc(sizeof(*p) + sizeof(p->keys[0]) * (t->head.page_size - 1));
+  p = bp__alloc(alloc,
+                sizeof(*p) +
+                    sizeof(p->keys[0]) * (t->head.page_size - 1) +
+                    sizeof(p->prefixes[0]) * t->head.page_size);
   if (p == NULL) return BP_EALLOC;
 
+  p->prefixes = (uint64_t*) &p->keys[t->head.page_size];
+
   p->type = type;
   if (type == kLeaf) {
     p->length = 0;
@@ -28,7 +37,9 @@ int bp__page_create(bp_db_t* t,
     p->keys[0].length = 0;
     p->keys[0].offset = 0;
     p->keys[0].config = 0;
+    p->keys[0].expires = 0;
     p->keys[0].allocated = 0;
+    p->prefixes[0] = 0;
     p->byte_size = BP__KV_SIZE(p->keys[0]);
   }
 
@@ -38,6 +49,7 @@ int bp__page_create(bp_db_t* t,
 
   p->buff_ = NULL;
   p->is_head = 0;
+  p->alloc = alloc;
 
   *page = p;
   return BP_OK;
@@ -49,32 +61,38 @@ void bp__page_destroy(bp_db_t* t, bp__page_t* page) {
   uint64_t i = 0;
   for (i = 0; i < page->length; i++) {
     if (page->keys[i].allocated) {
-      free(page->keys[i].value);
+      bp__arena_free(page->keys[i].value);
       page->keys[i].value = NULL;
     }
   }
 
   if (page->buff_ != NULL) {
-    free(page->buff_);
+    bp__arena_free(page->buff_);
     page->buff_ = NULL;
   }
 
   /* Free page itself */
-  free(page);
+  bp__arena_free(page);
 }
 
 
 int bp__page_clone(bp_db_t* t, bp__page_t* page, bp__page_t** clone) {
   int ret = BP_OK;
   uint64_t i = 0;
-  ret = bp__page_create(t, page->type, page->offset, page->config, clone);
+  ret = bp__page_create(t,
+                        page->type,
+                        page->offset,
+                        page->config,
+                        page->alloc,
+                        clone);
   if (ret != BP_OK) return ret;
 
   (*clone)->is_head = page->is_head;
 
   (*clone)->length = 0;
   for (i = 0; i < page->length; i++) {
-    ret = bp__kv_copy(&page->keys[i], &(*clone)->keys[i], 1);
+    ret = bp__kv_copy(&page->keys[i], &(*clone)->keys[i], (*clone)->alloc);
+    (*clone)->prefixes[i] = page->prefixes[i];
     (*clone)->length++;
     if (ret != BP_OK) break;
   }
@@ -99,10 +117,38 @@ int bp__page_read(bp_db_t* t, bp__page_t* page) {
   size = page->config >> 1;
   page->type = page->config & 1 ? kLeaf : kPage;
 
+  if (page->type == kLeaf && (t->head.flags & BP__HEAD_FLAG_FRONTCODED)) {
+    /* Keys are restored into separate buffer, encoded data is temporary */
+    ret = bp__writer_read(w,
+                          kCompressed,
+                          kArenaAlloc,
+                          page->offset,
+                          &size,
+                          (void**) &buff);
+    if (ret != BP_OK) return ret;
+
+    ret = bp__leaf_decode(t, page, buff, size);
+    bp__arena_free(buff);
+
+    return ret;
+  }
+
   /* Read page data */
-  ret = bp__writer_read(w, kCompressed, page->offset, &size, (void**) &buff);
+  ret = bp__writer_read(w,
+                        kCompressed,
+                        page->alloc,
+                        page->offset,
+                        &size,
+                        (void**) &buff);
   if (ret != BP_OK) return ret;
 
+  if (t->head.flags & BP__HEAD_FLAG_UINT64_KEYS) {
+    ret = bp__packed_decode(t, page, buff, size);
+    if (ret != BP_OK) bp__arena_free(buff);
+
+    return ret;
+  }
+
   /* Parse data */
   i = 0;
   o = 0;
@@ -110,8 +156,10 @@ int bp__page_read(bp_db_t* t, bp__page_t* page) {
     page->keys[i].length = ntohll(*(uint64_t*) (buff + o));
     page->keys[i].offset = ntohll(*(uint64_t*) (buff + o + 8));
     page->keys[i].config = ntohll(*(uint64_t*) (buff + o + 16));
+    page->keys[i].expires = 0;
     page->keys[i].value = buff + o + 24;
     page->keys[i].allocated = 0;
+    bp__page_set_prefix(t, page, i);
 
     o += BP__KV_SIZE(page->keys[i]);
     i++;
@@ -120,7 +168,7 @@ int bp__page_read(bp_db_t* t, bp__page_t* page) {
   page->byte_size = size;
 
   if (page->buff_ != NULL) {
-    free(page->buff_);
+    bp__arena_free(page->buff_);
   }
   page->buff_ = buff;
 
@@ -131,11 +179,12 @@ int bp__page_read(bp_db_t* t, bp__page_t* page) {
 int bp__page_load(bp_db_t* t,
                   const uint64_t offset,
                   const uint64_t config,
+                  const enum alloc_type alloc,
                   bp__page_t** page) {
   int ret;
 
   bp__page_t* new_page;
-  ret = bp__page_create(t, 0, offset, config, &new_page);
+  ret = bp__page_create(t, 0, offset, config, alloc, &new_page);
   if (ret != BP_OK) return ret;
 
   ret = bp__page_read(t, new_page);
@@ -157,40 +206,70 @@ int bp__page_save(bp_db_t* t, bp__page_t* page) {
   uint64_t i;
   uint64_t o;
   char* buff;
+  bp__arena_mark_t mark;
 
   assert(page->type == kLeaf || page->length != 0);
 
-  /* Allocate space for serialization (header + keys); */
-  buff = malloc(page->byte_size);
-  if (buff == NULL) return BP_EALLOC;
+  bp__arena_mark(&mark);
 
-  o = 0;
-  for (i = 0; i < page->length; i++) {
-    assert(o + BP__KV_SIZE(page->keys[i]) <= page->byte_size);
+  if (page->type == kLeaf && (t->head.flags & BP__HEAD_FLAG_FRONTCODED)) {
+    buff = bp__arena_alloc(bp__leaf_max_size(page));
+    if (buff == NULL) return BP_EALLOC;
 
-    *(uint64_t*) (buff + o) = htonll(page->keys[i].length);
-    *(uint64_t*) (buff + o + 8) = htonll(page->keys[i].offset);
-    *(uint64_t*) (buff + o + 16) = htonll(page->keys[i].config);
+    ret = bp__leaf_encode(t, page, buff, &page->config);
+    if (ret != BP_OK) {
+      bp__arena_rewind(&mark);
+      return ret;
+    }
+  } else if (t->head.flags & BP__HEAD_FLAG_UINT64_KEYS) {
+    buff = bp__arena_alloc(page->byte_size);
+    if (buff == NULL) return BP_EALLOC;
 
-    memcpy(buff + o + 24, page->keys[i].value, page->keys[i].length);
+    page->config = bp__packed_encode(t, page, buff);
+  } else {
+    /* Allocate space for serialization (header + keys); */
+    buff = bp__arena_alloc(page->byte_size);
+    if (buff == NULL) return BP_EALLOC;
 
-    o += BP__KV_SIZE(page->keys[i]);
+    o = 0;
+    for (i = 0; i < page->length; i++) {
+      assert(o + BP__KV_SIZE(page->keys[i]) <= page->byte_size);
+
+      *(uint64_t*) (buff + o) = htonll(page->keys[i].length);
+      *(uint64_t*) (buff + o + 8) = htonll(page->keys[i].offset);
+      *(uint64_t*) (buff + o + 16) = htonll(page->keys[i].config);
+
+      memcpy(buff + o + 24, page->keys[i].value, page->keys[i].length);
+
+      o += BP__KV_SIZE(page->keys[i]);
+    }
+    assert(o == page->byte_size);
+
+    page->config = page->byte_size;
   }
-  assert(o == page->byte_size);
 
-  page->config = page->byte_size;
   ret = bp__writer_write(w,
-                         kCompressed,
+                         t->head.flags & BP__HEAD_FLAG_DICT_PAGES ?
+                             kDictCompressed : kCompressed,
                          buff,
                          &page->offset,
                          &page->config);
   page->config = (page->config << 1) | (page->type == kLeaf);
 
-  free(buff);
+  bp__arena_free(buff);
+  bp__arena_rewind(&mark);
   return ret;
 }
 
 
+int bp__page_release(bp_db_t* t, bp__page_t* page) {
+  /* block of page is replaced by the one written with bp__page_save */
+  return bp__writer_release((bp__writer_t*) t,
+                            page->offset,
+                            page->config >> 1);
+}
+
+
 int bp__page_load_value(bp_db_t* t,
                         bp__page_t* page,
                         const uint64_t index,
@@ -208,38 +287,77 @@ int bp__page_save_value(bp_db_t* t,
                         const int cmp,
                         const bp_key_t* key,
                         const bp_value_t* value,
+                        const uint64_t expires,
+                        const int merge,
                         bp_update_cb update_cb,
                         void* arg) {
   int ret;
+  int found;
   bp__kv_t previous, tmp;
+  bp_value_t prev_value, merged;
+
+  /* missing (or expired) key is a conflict for bp_update_existing */
+  if (merge == BP__MERGE_EXISTING &&
+      (cmp != 0 || bp__kv_expired(page->keys[index].expires))) {
+    return BP_EUPDATECONFLICT;
+  }
+
+  /* merged value replaces previous one, expiry time is kept */
+  if (merge != BP__MERGE_NONE && merge != BP__MERGE_EXISTING) {
+    found = cmp == 0 && !bp__kv_expired(page->keys[index].expires);
+    if (found) {
+      ret = bp__page_load_value(t, page, index, &prev_value);
+      if (ret != BP_OK) return ret;
+    }
+
+    ret = bp__merge(merge, found ? &prev_value : NULL, value, &merged);
+    if (found) bp__free(prev_value.value);
+    if (ret != BP_OK) return ret;
+
+    ret = bp__page_save_value(t,
+                              page,
+                              index,
+                              cmp,
+                              key,
+                              &merged,
+                              found ? page->keys[index].expires : expires,
+                              BP__MERGE_NONE,
+                              update_cb,
+                              arg);
+    bp__free(merged.value);
+    return ret;
+  }
 
   /* replace item with same key from page */
   if (cmp == 0) {
-    /* solve conflicts if callback was provided */
-    if (update_cb != NULL) {
-      bp_value_t prev_value;
-
+    /* solve conflicts if callback was provided (expired key is missing) */
+    if (update_cb != NULL && !bp__kv_expired(page->keys[index].expires)) {
       ret = bp__page_load_value(t, page, index, &prev_value);
       if (ret != BP_OK) return ret;
 
       ret = update_cb(arg, &prev_value, value);
-      free(prev_value.value);
+      bp__free(prev_value.value);
 
       if (!ret) return BP_EUPDATECONFLICT;
     }
     previous.offset = page->keys[index].offset;
     previous.length = page->keys[index].config;
+
+    ret = bp__value_release(t, previous.offset, previous.length);
+    if (ret != BP_OK) return ret;
     bp__page_remove_idx(t, page, index);
   }
 
   /* store key */
   tmp.value = key->value;
   tmp.length = key->length;
+  tmp.expires = expires;
 
-  /* store value */
+  /* store value (previous one may be overwritten if space is reused) */
   ret = bp__value_save(t,
                        value,
-                       cmp == 0 ? &previous : NULL,
+                       cmp == 0 && !(t->head.flags & BP__HEAD_FLAG_REUSE) ?
+                           &previous : NULL,
                        &tmp.offset,
                        &tmp.config);
   if (ret != BP_OK) return ret;
@@ -248,12 +366,13 @@ int bp__page_save_value(bp_db_t* t,
   bp__page_shiftr(t, page, index);
 
   /* Insert key in the middle */
-  ret = bp__kv_copy(&tmp, &page->keys[index], 1);
+  ret = bp__kv_copy(&tmp, &page->keys[index], page->alloc);
   if (ret != BP_OK) {
     /* shift keys back */
     bp__page_shiftl(t, page, index);
     return ret;
   }
+  bp__page_set_prefix(t, page, index);
 
   page->byte_size += BP__KV_SIZE(tmp);
   page->length++;
@@ -268,21 +387,20 @@ int bp__page_search(bp_db_t* t,
                     const enum search_type type,
                     bp__page_search_res_t* result) {
   int ret;
-  uint64_t i = page->type == kPage;
-  int cmp = -1;
+  uint64_t i;
+  int cmp;
   bp__page_t* child;
 
   /* assert infinite recursion */
   assert(page->type == kLeaf || page->length > 0);
 
-  while (i < page->length) {
-    /* left key is always lower in non-leaf nodes */
-    cmp = t->compare_cb((bp_key_t*) &page->keys[i], key);
-
-    if (cmp >= 0) break;
-    i++;
+  if (t->head.flags & BP__HEAD_FLAG_UINT64_KEYS) {
+    if (key->length != sizeof(uint64_t)) return BP_EKEYSIZE;
   }
 
+  /* left key is always lower in non-leaf nodes */
+  i = bp__compare_search(t, page, page->type == kPage, key, &cmp);
+
   result->cmp = cmp;
 
   if (page->type == kLeaf) {
@@ -298,6 +416,7 @@ int bp__page_search(bp_db_t* t,
       ret = bp__page_load(t,
                           page->keys[i].offset,
                           page->keys[i].config,
+                          kArenaAlloc,
                           &child);
       if (ret != BP_OK) return ret;
 
@@ -316,18 +435,42 @@ int bp__page_search(bp_db_t* t,
 int bp__page_get(bp_db_t* t,
                  bp__page_t* page,
                  const bp_key_t* key,
-                 bp_value_t* value) {
+                 bp_value_t* value,
+                 bp__kv_t* ref) {
   int ret;
   bp__page_search_res_t res;
-  ret = bp__page_search(t, page, key, kLoad, &res);
-  if (ret != BP_OK) return ret;
+  bp__kv_t* child;
+
+  if (page->type == kPage && (t->head.flags & BP__HEAD_FLAG_FRONTCODED)) {
+    ret = bp__page_search(t, page, key, kNotLoad, &res);
+    if (ret != BP_OK) return ret;
+
+    /* lookup in encoded leaf without restoring all its keys */
+    child = &page->keys[res.index];
+    if (child->config & 1) {
+      return bp__leaf_get(t, child->offset, child->config, key, value, ref);
+    }
+
+    ret = bp__page_load(t, child->offset, child->config, kArenaAlloc,
+                        &res.child);
+    if (ret != BP_OK) return ret;
+  } else {
+    ret = bp__page_search(t, page, key, kLoad, &res);
+    if (ret != BP_OK) return ret;
+  }
 
   if (res.child == NULL) {
     if (res.cmp != 0) return BP_ENOTFOUND;
+    if (bp__kv_expired(page->keys[res.index].expires)) return BP_ENOTFOUND;
 
+    if (ref != NULL) {
+      ref->offset = page->keys[res.index].offset;
+      ref->config = page->keys[res.index].config;
+      return BP_OK;
+    }
     return bp__page_load_value(t, page, res.index, value);
   } else {
-    ret = bp__page_get(t, res.child, key, value);
+    ret = bp__page_get(t, res.child, key, value, ref);
     bp__page_destroy(t, res.child);
     res.child = NULL;
     return ret;
@@ -340,10 +483,12 @@ int bp__page_get_range(bp_db_t* t,
                        const bp_key_t* start,
                        const bp_key_t* end,
                        bp_filter_cb filter,
+                       bp_stop_cb stop,
                        bp_range_cb cb,
                        void* arg) {
   int ret;
   uint64_t i;
+  bp_value_t value;
   bp__page_search_res_t start_res, end_res;
 
   /* find start and end indexes */
@@ -354,41 +499,53 @@ int bp__page_get_range(bp_db_t* t,
 
   if (page->type == kLeaf) {
     /* on leaf pages end-key should always be greater or equal than first key */
-    if (end_res.cmp > 0 && end_res.index == 0) return BP_OK;
+    if (end_res.cmp != 0 && end_res.index == 0) return BP_OK;
 
-    if (end_res.cmp < 0) end_res.index--;
+    /* found key is either greater than end-key or past the last one */
+    if (end_res.cmp != 0) end_res.index--;
   }
 
   /* go through each page item */
   for (i = start_res.index; i <= end_res.index; i++) {
-    /* run filter */
-    if (!filter(arg, (bp_key_t*) &page->keys[i])) continue;
-
     if (page->type == kPage) {
       /* load child page and apply range get to it */
       bp__page_t* child;
+      bp__arena_mark_t mark;
 
+      bp__arena_mark(&mark);
       ret = bp__page_load(t,
                           page->keys[i].offset,
                           page->keys[i].config,
+                          kArenaAlloc,
                           &child);
       if (ret != BP_OK) return ret;
 
-      ret = bp__page_get_range(t, child, start, end, filter, cb, arg);
+      ret = bp__page_get_range(t, child, start, end, filter, stop, cb, arg);
 
       /* destroy child regardless of error */
       bp__page_destroy(t, child);
+      bp__arena_rewind(&mark);
 
       if (ret != BP_OK) return ret;
     } else {
+      if (stop != NULL && stop(arg)) return BP_ERANGEABORT;
+
+      /* expired keys are skipped without loading their values */
+      if (bp__kv_expired(page->keys[i].expires)) continue;
+
+      /*
+       * run filter on leaf keys only, separators of inner pages aren't
+       * real keys (and may be truncated)
+       */
+      if (!filter(arg, (bp_key_t*) &page->keys[i])) continue;
+
       /* load value and pass it to callback */
-      bp_value_t value;
       ret = bp__page_load_value(t, page, i, &value);
       if (ret != BP_OK) return ret;
 
       cb(arg, (bp_key_t*) &page->keys[i], &value);
 
-      free(value.value);
+      bp__free(value.value);
     }
   }
 
@@ -400,6 +557,8 @@ int bp__page_insert(bp_db_t* t,
                     bp__page_t* page,
                     const bp_key_t* key,
                     const bp_value_t* value,
+                    const uint64_t expires,
+                    const int merge,
                     bp_update_cb update_cb,
                     void* arg) {
   int ret;
@@ -415,12 +574,21 @@ int bp__page_insert(bp_db_t* t,
                               res.cmp,
                               key,
                               value,
+                              expires,
+                              merge,
                               update_cb,
                               arg);
     if (ret != BP_OK) return ret;
   } else {
     /* Insert kv in child page */
-    ret = bp__page_insert(t, res.child, key, value, update_cb, arg);
+    ret = bp__page_insert(t,
+                          res.child,
+                          key,
+                          value,
+                          expires,
+                          merge,
+                          update_cb,
+                          arg);
 
     /* kv was inserted but page is full now */
     if (ret == BP_ESPLITPAGE) {
@@ -451,6 +619,9 @@ int bp__page_insert(bp_db_t* t,
 
   assert(page->length < t->head.page_size);
 
+  ret = bp__page_release(t, page);
+  if (ret != BP_OK) return ret;
+
   ret = bp__page_save(t, page);
   if (ret != BP_OK) return ret;
 
@@ -468,10 +639,12 @@ int bp__page_bulk_insert(bp_db_t* t,
                          void* arg) {
   int ret;
   bp__page_search_res_t res;
+  bp__arena_mark_t mark;
 
   while (*count > 0 &&
-         (limit == NULL || t->compare_cb(limit, *keys) > 0)) {
+         (limit == NULL || bp__compare(t, limit, *keys) > 0)) {
 
+    bp__arena_mark(&mark);
     ret = bp__page_search(t, page, *keys, kLoad, &res);
     if (ret != BP_OK) return ret;
 
@@ -483,6 +656,8 @@ int bp__page_bulk_insert(bp_db_t* t,
                                 res.cmp,
                                 *keys,
                                 *values,
+                                0,
+                                BP__MERGE_NONE,
                                 update_cb,
                                 arg);
       /*
@@ -521,6 +696,9 @@ int bp__page_bulk_insert(bp_db_t* t,
       bp__page_destroy(t, res.child);
       res.child = NULL;
 
+      /* middle keys are on heap, nothing else refers to child's memory */
+      bp__arena_rewind(&mark);
+
       if (ret != BP_OK) return ret;
     }
 
@@ -537,6 +715,9 @@ int bp__page_bulk_insert(bp_db_t* t,
     assert(page->length < t->head.page_size);
   }
 
+  ret = bp__page_release(t, page);
+  if (ret != BP_OK) return ret;
+
   return bp__page_save(t, page);
 }
 
@@ -562,10 +743,14 @@ int bp__page_remove(bp_db_t* t,
       if (ret != BP_OK) return ret;
 
       ret = remove_cb(arg, &prev_val);
-      free(prev_val.value);
+      bp__free(prev_val.value);
 
       if (!ret) return BP_EREMOVECONFLICT;
     }
+    ret = bp__value_release(t,
+                            page->keys[res.index].offset,
+                            page->keys[res.index].config);
+    if (ret != BP_OK) return ret;
     bp__page_remove_idx(t, page, res.index);
 
     if (page->length == 0 && !page->is_head) return BP_EEMPTYPAGE;
@@ -582,11 +767,16 @@ int bp__page_remove(bp_db_t* t,
       bp__page_remove_idx(t, page, res.index);
 
       /* we don't need child now */
+      ret = bp__page_release(t, res.child);
       bp__page_destroy(t, res.child);
       res.child = NULL;
+      if (ret != BP_OK) return ret;
 
       /* only one item left - lift kv from last child to current page */
       if (page->length == 1) {
+        ret = bp__page_release(t, page);
+        if (ret != BP_OK) return ret;
+
         page->offset = page->keys[0].offset;
         page->config = page->keys[0].config;
 
@@ -608,32 +798,95 @@ int bp__page_remove(bp_db_t* t,
     }
   }
 
+  ret = bp__page_release(t, page);
+  if (ret != BP_OK) return ret;
+
   return bp__page_save(t, page);
 }
 
 
-int bp__page_copy(bp_db_t* source, bp_db_t* target, bp__page_t* page) {
+static int bp__page_copy_chunks(bp_db_t* source,
+                                bp_db_t* target,
+                                bp__kv_t* kv) {
+  int ret;
+  uint64_t i, prev_offset, prev_config;
+  char* chunk;
+  bp__chunks_t c, copy;
+  bp__arena_mark_t mark;
+
+  ret = bp__chunks_load(source,
+                        kv->offset,
+                        kv->config,
+                        &c,
+                        &prev_offset,
+                        &prev_config);
+  if (ret != BP_OK) return ret;
+
+  /* large value is copied chunk by chunk */
+  bp__chunks_init(&copy, c.chunk_size);
+  for (i = 0; i < c.count; i++) {
+    bp__arena_mark(&mark);
+    ret = bp__chunks_read(source, &c, i, kArenaAlloc, &chunk);
+    if (ret != BP_OK) break;
+
+    ret = bp__chunks_append(target, &copy, chunk, bp__chunks_length(&c, i));
+    bp__arena_free(chunk);
+    bp__arena_rewind(&mark);
+    if (ret != BP_OK) break;
+  }
+
+  if (ret == BP_OK) {
+    ret = bp__chunks_save(target, &copy, 0, 0, &kv->offset, &kv->config);
+  }
+  bp__chunks_destroy(&copy);
+  bp__chunks_destroy(&c);
+
+  return ret;
+}
+
+
+int bp__page_copy(bp_db_t* source,
+                  bp_db_t* target,
+                  bp__page_t* page,
+                  const int values) {
   int ret;
   uint64_t i;
   for (i = 0; i < page->length; i++) {
     if (page->type == kPage) {
       /* copy child page */
       bp__page_t* child;
+      bp__arena_mark_t mark;
+
+      bp__arena_mark(&mark);
       ret = bp__page_load(source,
                           page->keys[i].offset,
                           page->keys[i].config,
+                          kArenaAlloc,
                           &child);
       if (ret != BP_OK) return ret;
 
-      ret = bp__page_copy(source, target, child);
+      ret = bp__page_copy(source, target, child, values);
       if (ret != BP_OK) return ret;
 
-      /* update child position */
-      page->keys[i].offset = child->offset;
-      page->keys[i].config = child->config;
+      /* update child position, subtree with only expired keys is dropped */
+      if (child->length == 0) {
+        bp__page_remove_idx(target, page, i);
+        i--;
+      } else {
+        page->keys[i].offset = child->offset;
+        page->keys[i].config = child->config;
+      }
 
       bp__page_destroy(source, child);
-    } else {
+      bp__arena_rewind(&mark);
+    } else if (bp__kv_expired(page->keys[i].expires)) {
+      /* expired key isn't copied (neither is it's value) */
+      bp__page_remove_idx(target, page, i);
+      i--;
+    } else if (values && (page->keys[i].config & BP__CHUNKED)) {
+      ret = bp__page_copy_chunks(source, target, &page->keys[i]);
+      if (ret != BP_OK) return ret;
+    } else if (values) {
       /* copy value */
       bp_value_t value;
 
@@ -648,22 +901,235 @@ int bp__page_copy(bp_db_t* source, bp_db_t* target, bp__page_t* page) {
                            &page->keys[i].config);
 
       /* value is not needed anymore */
-      free(value.value);
+      bp__free(value.value);
       if (ret != BP_OK) return ret;
     }
   }
 
+  if (page->length == 0) {
+    /* parent drops empty page */
+    if (!page->is_head) return BP_OK;
+
+    /* and empty head becomes leaf */
+    page->type = kLeaf;
+    page->byte_size = 0;
+  }
+
   return bp__page_save(target, page);
 }
 
 
+static int bp__page_victim(const uint64_t offset,
+                           const char* victims,
+                           const uint64_t count) {
+  return BP__SEGMENT(offset) < count && victims[BP__SEGMENT(offset)];
+}
+
+
+/* block is copied as it's stored, with codec (and previous value) */
+static int bp__page_move_block(bp_db_t* t,
+                               uint64_t* offset,
+                               const uint64_t size) {
+  int ret;
+  uint64_t csize;
+  char* data;
+
+  csize = size;
+  ret = bp__writer_read((bp__writer_t*) t,
+                        kNotCompressed,
+                        kArenaAlloc,
+                        *offset,
+                        &csize,
+                        (void**) &data);
+  if (ret != BP_OK) return ret;
+
+  ret = bp__writer_write((bp__writer_t*) t,
+                         kNotCompressed,
+                         data,
+                         offset,
+                         &csize);
+  bp__arena_free(data);
+
+  return ret;
+}
+
+
+static int bp__page_relocate_chunks(bp_db_t* t,
+                                    bp__kv_t* kv,
+                                    const char* victims,
+                                    const uint64_t count,
+                                    int* moved) {
+  int ret = BP_OK;
+  int chunks_moved = 0;
+  uint64_t i, prev_offset, prev_config;
+  bp__chunks_t c;
+
+  ret = bp__chunks_load(t,
+                        kv->offset,
+                        kv->config,
+                        &c,
+                        &prev_offset,
+                        &prev_config);
+  if (ret != BP_OK) return ret;
+
+  for (i = 0; i < c.count; i++) {
+    if (!bp__page_victim(c.list[i].offset, victims, count)) continue;
+
+    ret = bp__page_move_block(t, &c.list[i].offset, c.list[i].size);
+    if (ret != BP_OK) goto done;
+    chunks_moved = 1;
+  }
+
+  /* table references moved chunks, so it's written again */
+  if (chunks_moved || bp__page_victim(kv->offset, victims, count)) {
+    if (!bp__page_victim(kv->offset, victims, count)) {
+      ret = bp__writer_release((bp__writer_t*) t,
+                               kv->offset,
+                               BP__VALUE_SIZE(kv->config));
+      if (ret != BP_OK) goto done;
+    }
+    ret = bp__chunks_save(t,
+                          &c,
+                          prev_offset,
+                          prev_config,
+                          &kv->offset,
+                          &kv->config);
+    if (ret == BP_OK) *moved = 1;
+  }
+
+done:
+  bp__chunks_destroy(&c);
+  return ret;
+}
+
+
+int bp__page_relocate(bp_db_t* t,
+                      bp__page_t* page,
+                      const char* victims,
+                      const uint64_t count,
+                      int* moved) {
+  int ret;
+  int child_moved;
+  uint64_t i;
+
+  *moved = 0;
+  for (i = 0; i < page->length; i++) {
+    if (page->type == kPage) {
+      bp__page_t* child;
+      bp__arena_mark_t mark;
+
+      bp__arena_mark(&mark);
+      ret = bp__page_load(t,
+                          page->keys[i].offset,
+                          page->keys[i].config,
+                          kArenaAlloc,
+                          &child);
+      if (ret != BP_OK) return ret;
+
+      ret = bp__page_relocate(t, child, victims, count, &child_moved);
+      if (ret == BP_OK &&
+          (child_moved || bp__page_victim(child->offset, victims, count))) {
+        ret = bp__page_release(t, child);
+        if (ret == BP_OK) ret = bp__page_save(t, child);
+        if (ret == BP_OK) {
+          page->keys[i].offset = child->offset;
+          page->keys[i].config = child->config;
+          *moved = 1;
+        }
+      }
+
+      bp__page_destroy(t, child);
+      bp__arena_rewind(&mark);
+      if (ret != BP_OK) return ret;
+    } else if (page->keys[i].config & BP__CHUNKED) {
+      ret = bp__page_relocate_chunks(t, &page->keys[i], victims, count, moved);
+      if (ret != BP_OK) return ret;
+    } else if (bp__page_victim(page->keys[i].offset, victims, count)) {
+      ret = bp__page_move_block(t,
+                                &page->keys[i].offset,
+                                page->keys[i].config);
+      if (ret != BP_OK) return ret;
+
+      *moved = 1;
+    }
+  }
+
+  return BP_OK;
+}
+
+
+int bp__page_expire(bp_db_t* t,
+                    bp__page_t* page,
+                    uint64_t* limit,
+                    int* changed) {
+  int ret;
+  int child_changed;
+  uint64_t i;
+
+  *changed = 0;
+  i = 0;
+  while (i < page->length && *limit > 0) {
+    if (page->type == kPage) {
+      bp__page_t* child;
+      bp__arena_mark_t mark;
+
+      bp__arena_mark(&mark);
+      ret = bp__page_load(t,
+                          page->keys[i].offset,
+                          page->keys[i].config,
+                          kArenaAlloc,
+                          &child);
+      if (ret != BP_OK) return ret;
+
+      ret = bp__page_expire(t, child, limit, &child_changed);
+      if (ret == BP_OK && child_changed) {
+        ret = bp__page_release(t, child);
+        if (ret == BP_OK && child->length == 0) {
+          /* whole subtree has expired */
+          bp__page_remove_idx(t, page, i);
+          i--;
+        } else if (ret == BP_OK) {
+          ret = bp__page_save(t, child);
+          page->keys[i].offset = child->offset;
+          page->keys[i].config = child->config;
+        }
+        *changed = 1;
+      }
+
+      bp__page_destroy(t, child);
+      bp__arena_rewind(&mark);
+      if (ret != BP_OK) return ret;
+    } else if (bp__kv_expired(page->keys[i].expires)) {
+      ret = bp__value_release(t,
+                              page->keys[i].offset,
+                              page->keys[i].config);
+      if (ret != BP_OK) return ret;
+
+      bp__page_remove_idx(t, page, i);
+      i--;
+      (*limit)--;
+      *changed = 1;
+    }
+    i++;
+  }
+
+  /* empty head becomes leaf, other empty pages are removed by parent */
+  if (page->length == 0 && page->is_head) {
+    page->type = kLeaf;
+    page->byte_size = 0;
+  }
+
+  return BP_OK;
+}
+
+
 int bp__page_remove_idx(bp_db_t* t, bp__page_t* page, const uint64_t index) {
   assert(index < page->length);
 
   /* Free memory allocated for kv and reduce byte_size of page */
   page->byte_size -= BP__KV_SIZE(page->keys[index]);
   if (page->keys[index].allocated) {
-    free(page->keys[index].value);
+    bp__arena_free(page->keys[index].value);
     page->keys[index].value = NULL;
   }
 
@@ -684,29 +1150,56 @@ int bp__page_split(bp_db_t* t,
   uint64_t i, middle;
   bp__page_t* left = NULL;
   bp__page_t* right = NULL;
-  bp__kv_t middle_key;
-
-  bp__page_create(t, child->type, 0, 0, &left);
-  bp__page_create(t, child->type, 0, 0, &right);
+  bp__kv_t middle_key, separator;
 
+  /*
+   * Any key in (left's last key, right's first key] divides leaf pages,
+   * (see bp__compare_separator). Keys of inner pages are bounds of whole
+   * subtrees and are kept as they are.
+   */
   middle = t->head.page_size >> 1;
-  ret = bp__kv_copy(&child->keys[middle], &middle_key, 1);
+  if (child->type == kLeaf) {
+    bp__compare_separator(t,
+                          &child->keys[middle - 1],
+                          &child->keys[middle],
+                          &separator);
+  } else {
+    separator = child->keys[middle];
+  }
+
+  /* child is replaced by two new pages */
+  ret = bp__page_release(t, child);
+  if (ret != BP_OK) return ret;
+
+  /* middle key will outlive child, it may be inserted into head page */
+  ret = bp__kv_copy(&separator, &middle_key, kHeapAlloc);
+  if (ret != BP_OK) return ret;
+  middle_key.expires = 0;
+
+  ret = bp__page_create(t, child->type, 0, 0, kArenaAlloc, &left);
+  if (ret != BP_OK) goto fatal;
+  ret = bp__page_create(t, child->type, 0, 0, kArenaAlloc, &right);
   if (ret != BP_OK) goto fatal;
 
-  /* non-leaf nodes has byte_size > 0 nullify it first */
+  /*
+   * left and right pages are saved and destroyed before child,
+   * so they may reference child's keys without copying them
+   */
   left->byte_size = 0;
   left->length = 0;
   for (i = 0; i < middle; i++) {
-    ret = bp__kv_copy(&child->keys[i], &left->keys[left->length++], 1);
-    if (ret != BP_OK) goto fatal;
+    bp__kv_copy(&child->keys[i], &left->keys[left->length], kNoAlloc);
+    left->prefixes[left->length] = child->prefixes[i];
+    left->keys[left->length++].allocated = 0;
     left->byte_size += BP__KV_SIZE(child->keys[i]);
   }
 
   right->byte_size = 0;
   right->length = 0;
   for (; i < t->head.page_size; i++) {
-    ret = bp__kv_copy(&child->keys[i], &right->keys[right->length++], 1);
-    if (ret != BP_OK) goto fatal;
+    bp__kv_copy(&child->keys[i], &right->keys[right->length], kNoAlloc);
+    right->prefixes[right->length] = child->prefixes[i];
+    right->keys[right->length++].allocated = 0;
     right->byte_size += BP__KV_SIZE(child->keys[i]);
   }
 
@@ -723,7 +1216,8 @@ int bp__page_split(bp_db_t* t,
 
   /* insert middle key into parent page */
   bp__page_shiftr(t, parent, index + 1);
-  bp__kv_copy(&middle_key, &parent->keys[index + 1], 0);
+  bp__kv_copy(&middle_key, &parent->keys[index + 1], kNoAlloc);
+  bp__page_set_prefix(t, parent, index + 1);
 
   parent->byte_size += BP__KV_SIZE(middle_key);
   parent->length++;
@@ -735,8 +1229,9 @@ int bp__page_split(bp_db_t* t,
   ret = BP_OK;
 fatal:
   /* cleanup */
-  bp__page_destroy(t, left);
-  bp__page_destroy(t, right);
+  if (ret != BP_OK) bp__free(middle_key.value);
+  if (left != NULL) bp__page_destroy(t, left);
+  if (right != NULL) bp__page_destroy(t, right);
   return ret;
 }
 
@@ -744,7 +1239,9 @@ fatal:
 int bp__page_split_head(bp_db_t* t, bp__page_t** page) {
   int ret;
   bp__page_t* new_head = NULL;
-  bp__page_create(t, 0, 0, 0, &new_head);
+
+  ret = bp__page_create(t, 0, 0, 0, kHeapAlloc, &new_head);
+  if (ret != BP_OK) return ret;
   new_head->is_head = 1;
 
   ret = bp__page_split(t, new_head, 0, *page);
@@ -761,12 +1258,21 @@ int bp__page_split_head(bp_db_t* t, bp__page_t** page) {
 }
 
 
+void bp__page_set_prefix(bp_db_t* t,
+                         bp__page_t* page,
+                         const uint64_t index) {
+  page->prefixes[index] = bp__compare_prefix(t,
+                                             (bp_key_t*) &page->keys[index]);
+}
+
+
 void bp__page_shiftr(bp_db_t* t, bp__page_t* p, const uint64_t index) {
   uint64_t i;
 
   if (p->length != 0) {
     for (i = p->length - 1; i >= index; i--) {
-      bp__kv_copy(&p->keys[i], &p->keys[i + 1], 0);
+      bp__kv_copy(&p->keys[i], &p->keys[i + 1], kNoAlloc);
+      p->prefixes[i + 1] = p->prefixes[i];
 
       if (i == 0) break;
     }
@@ -777,6 +1283,7 @@ void bp__page_shiftr(bp_db_t* t, bp__page_t* p, const uint64_t index) {
 void bp__page_shiftl(bp_db_t* t, bp__page_t* p, const uint64_t index) {
   uint64_t i;
   for (i = index + 1; i < p->length; i++) {
-    bp__kv_copy(&p->keys[i], &p->keys[i - 1], 0);
+    bp__kv_copy(&p->keys[i], &p->keys[i - 1], kNoAlloc);
+    p->prefixes[i - 1] = p->prefixes[i];
   }
 }
@@ -0,0 +1,622 @@
+#include <fcntl.h> /* open */
+#include <unistd.h> /* close, read, write, fsync */
+#include <sys/stat.h> /* S_IWUSR, S_IRUSR */
+#include <errno.h> /* errno */
+#include <string.h> /* strlen, memcpy */
+#include <stdio.h> /* sprintf */
+
+#include "bplus.h"
+#include "private/partitions.h"
+#include "private/compare.h"
+#include "private/alloc.h"
+#include "private/utils.h"
+
+/* manifest: type, count and hash of bounds (big-endian uint64 each) */
+#define BP__PDB_META_SIZE 24
+
+
+static void bp__pdb_free_bounds(bp_pdb_t* db, const uint64_t count) {
+  uint64_t i;
+
+  if (db->bounds == NULL) return;
+
+  for (i = 0; i < count; i++) {
+    bp__free(db->bounds[i].value);
+  }
+  bp__free(db->bounds);
+  db->bounds = NULL;
+}
+
+
+static void bp__pdb_meta_encode(bp_pdb_t* db,
+                                const uint64_t count,
+                                uint64_t meta[3]) {
+  uint64_t i, hash;
+
+  hash = 0;
+  if (db->bounds != NULL) {
+    for (i = 0; i < count - 1; i++) {
+      hash = bp__compute_hashl(hash ^ db->bounds[i].length);
+      hash = bp__compute_hashl(hash ^
+                               bp__compute_hashb(db->bounds[i].value,
+                                                 db->bounds[i].length));
+    }
+  }
+
+  meta[0] = htonll((uint64_t) db->type);
+  meta[1] = htonll(count);
+  meta[2] = htonll(hash);
+}
+
+
+static char* bp__pdb_meta_name(const char* filename) {
+  char* name;
+
+  name = bp__malloc(strlen(filename) + sizeof(".meta"));
+  if (name != NULL) sprintf(name, "%s.meta", filename);
+
+  return name;
+}
+
+
+/*
+ * Compare partitioning with the one stored in `filename.meta`,
+ * BP_ENOTFOUND if database is new (or was created without manifest)
+ */
+static int bp__pdb_meta_check(bp_pdb_t* db,
+                              const char* filename,
+                              const uint64_t count) {
+  int fd;
+  char* name;
+  uint64_t meta[3];
+  uint64_t stored[3];
+  ssize_t size;
+
+  name = bp__pdb_meta_name(filename);
+  if (name == NULL) return BP_EALLOC;
+
+  fd = open(name, O_RDONLY);
+  bp__free(name);
+  if (fd == -1) return errno == ENOENT ? BP_ENOTFOUND : BP_EFILE;
+
+  size = read(fd, stored, BP__PDB_META_SIZE);
+  close(fd);
+  if (size != BP__PDB_META_SIZE) return BP_EPARTITION;
+
+  bp__pdb_meta_encode(db, count, meta);
+  if (memcmp(meta, stored, BP__PDB_META_SIZE) != 0) return BP_EPARTITION;
+
+  return BP_OK;
+}
+
+
+static int bp__pdb_meta_write(bp_pdb_t* db,
+                              const char* filename,
+                              const uint64_t count) {
+  int ret, fd;
+  char* name;
+  uint64_t meta[3];
+
+  name = bp__pdb_meta_name(filename);
+  if (name == NULL) return BP_EALLOC;
+
+  fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+  bp__free(name);
+  if (fd == -1) return BP_EFILE;
+
+  bp__pdb_meta_encode(db, count, meta);
+
+  ret = BP_OK;
+  if (write(fd, meta, BP__PDB_META_SIZE) != BP__PDB_META_SIZE) {
+    ret = BP_EFILEWRITE;
+  } else if (fsync(fd) != 0) {
+    ret = BP_EFILEFLUSH;
+  }
+  close(fd);
+
+  return ret;
+}
+
+
+int bp__pdb_open(bp_pdb_t* db,
+                 const char* filename,
+                 const int type,
+                 const uint64_t count,
+                 const bp_key_t* bounds) {
+  int ret, fresh;
+  uint64_t i;
+  char* name;
+
+  if (count == 0) return BP_ENOTFOUND;
+
+  db->type = type;
+  db->count = 0;
+  db->bounds = NULL;
+
+  db->trees = bp__malloc(sizeof(*db->trees) * count);
+  if (db->trees == NULL) return BP_EALLOC;
+
+  /* copy partition bounds */
+  if (type == BP_PARTITION_RANGE && count > 1) {
+    db->bounds = bp__malloc(sizeof(*db->bounds) * (count - 1));
+    if (db->bounds == NULL) {
+      ret = BP_EALLOC;
+      goto fatal;
+    }
+
+    for (i = 0; i < count - 1; i++) {
+      db->bounds[i].length = bounds[i].length;
+      db->bounds[i].value = bp__malloc(bounds[i].length + 1);
+      if (db->bounds[i].value == NULL) {
+        bp__pdb_free_bounds(db, i);
+        ret = BP_EALLOC;
+        goto fatal;
+      }
+      memcpy(db->bounds[i].value, bounds[i].value, bounds[i].length);
+    }
+  }
+
+  /* existing partitions are opened only with the same partitioning */
+  ret = bp__pdb_meta_check(db, filename, count);
+  fresh = ret == BP_ENOTFOUND;
+  if (ret != BP_OK && !fresh) goto fatal_bounds;
+
+  /* `filename.N` */
+  name = bp__malloc(strlen(filename) + 22);
+  if (name == NULL) {
+    ret = BP_EALLOC;
+    goto fatal_bounds;
+  }
+
+  for (i = 0; i < count; i++) {
+    sprintf(name, "%s.%lu", filename, (unsigned long) i);
+
+    ret = bp_open(&db->trees[i], name);
+    if (ret != BP_OK) break;
+
+    db->count++;
+  }
+  bp__free(name);
+  if (ret != BP_OK) goto fatal_trees;
+
+  /* bounds are searched with comparator of partitions */
+  for (i = 1; db->bounds != NULL && i < count - 1; i++) {
+    if (bp__compare(&db->trees[0], &db->bounds[i - 1], &db->bounds[i]) >= 0) {
+      ret = BP_EPARTITION;
+      goto fatal_trees;
+    }
+  }
+
+  if (fresh) ret = bp__pdb_meta_write(db, filename, count);
+  if (ret == BP_OK) return BP_OK;
+
+fatal_trees:
+  for (i = 0; i < db->count; i++) {
+    bp_close(&db->trees[i]);
+  }
+  db->count = 0;
+fatal_bounds:
+  bp__pdb_free_bounds(db, count - 1);
+fatal:
+  bp__free(db->trees);
+  db->trees = NULL;
+  return ret;
+}
+
+
+uint64_t bp__pdb_route(bp_pdb_t* db, const bp_key_t* key) {
+  uint64_t start, end, middle;
+
+  if (db->count == 1) return 0;
+
+  if (db->type == BP_PARTITION_HASH) {
+    return bp__compute_hashb(key->value, key->length) % db->count;
+  }
+
+  /* find first bound that is greater than key */
+  start = 0;
+  end = db->count - 1;
+  while (start < end) {
+    middle = start + ((end - start) >> 1);
+    if (bp__compare(&db->trees[0], &db->bounds[middle], key) > 0) {
+      end = middle;
+    } else {
+      start = middle + 1;
+    }
+  }
+
+  return start;
+}
+
+
+int bp_pdb_open(bp_pdb_t* db, const char* filename, const uint64_t count) {
+  return bp__pdb_open(db, filename, BP_PARTITION_HASH, count, NULL);
+}
+
+
+int bp_pdb_open_range(bp_pdb_t* db,
+                      const char* filename,
+                      const uint64_t count,
+                      const bp_key_t* bounds) {
+  return bp__pdb_open(db, filename, BP_PARTITION_RANGE, count, bounds);
+}
+
+
+int bp_pdb_close(bp_pdb_t* db) {
+  int ret, res;
+  uint64_t i;
+
+  ret = BP_OK;
+  for (i = 0; i < db->count; i++) {
+    res = bp_close(&db->trees[i]);
+    if (res != BP_OK) ret = res;
+  }
+
+  if (db->count > 0) bp__pdb_free_bounds(db, db->count - 1);
+  bp__free(db->trees);
+  db->trees = NULL;
+  db->count = 0;
+
+  return ret;
+}
+
+
+int bp_pdb_get(bp_pdb_t* db, const bp_key_t* key, bp_value_t* value) {
+  return bp_get(&db->trees[bp__pdb_route(db, key)], key, value);
+}
+
+
+int bp_pdb_update(bp_pdb_t* db,
+                  const bp_key_t* key,
+                  const bp_value_t* value,
+                  bp_update_cb update_cb,
+                  void* arg) {
+  return bp_update(&db->trees[bp__pdb_route(db, key)],
+                   key,
+                   value,
+                   update_cb,
+                   arg);
+}
+
+
+int bp_pdb_set(bp_pdb_t* db, const bp_key_t* key, const bp_value_t* value) {
+  return bp_pdb_update(db, key, value, NULL, NULL);
+}
+
+
+int bp_pdb_removev(bp_pdb_t* db,
+                   const bp_key_t* key,
+                   bp_remove_cb remove_cb,
+                   void* arg) {
+  return bp_removev(&db->trees[bp__pdb_route(db, key)], key, remove_cb, arg);
+}
+
+
+int bp_pdb_remove(bp_pdb_t* db, const bp_key_t* key) {
+  return bp_pdb_removev(db, key, NULL, NULL);
+}
+
+
+int bp_pdb_bulk_set(bp_pdb_t* db,
+                    const uint64_t count,
+                    const bp_key_t** keys,
+                    const bp_value_t** values) {
+  int ret;
+  uint64_t i, j, part, part_count;
+  bp_key_t* part_keys;
+  bp_value_t* part_values;
+
+  part_keys = bp__malloc(sizeof(*part_keys) * count);
+  if (part_keys == NULL) return BP_EALLOC;
+
+  part_values = bp__malloc(sizeof(*part_values) * count);
+  if (part_values == NULL) {
+    bp__free(part_keys);
+    return BP_EALLOC;
+  }
+
+  /* group keys by partition, preserving their order */
+  ret = BP_OK;
+  for (part = 0; part < db->count; part++) {
+    part_count = 0;
+    for (i = 0; i < count; i++) {
+      if (bp__pdb_route(db, &(*keys)[i]) != part) continue;
+
+      j = part_count++;
+      part_keys[j] = (*keys)[i];
+      part_values[j] = (*values)[i];
+    }
+    if (part_count == 0) continue;
+
+    ret = bp_bulk_set(&db->trees[part],
+                      part_count,
+                      (const bp_key_t**) &part_keys,
+                      (const bp_value_t**) &part_values);
+    if (ret != BP_OK) break;
+  }
+
+  bp__free(part_keys);
+  bp__free(part_values);
+
+  return ret;
+}
+
+
+int bp_pdb_compact(bp_pdb_t* db) {
+  int ret;
+  uint64_t i;
+
+  for (i = 0; i < db->count; i++) {
+    ret = bp_compact(&db->trees[i]);
+    if (ret != BP_OK) return ret;
+  }
+
+  return BP_OK;
+}
+
+
+int bp_pdb_fsync(bp_pdb_t* db) {
+  int ret;
+  uint64_t i;
+
+  for (i = 0; i < db->count; i++) {
+    ret = bp_fsync(&db->trees[i]);
+    if (ret != BP_OK) return ret;
+  }
+
+  return BP_OK;
+}
+
+
+void bp_pdb_set_compare_cb(bp_pdb_t* db, bp_compare_cb cb) {
+  uint64_t i;
+
+  for (i = 0; i < db->count; i++) {
+    bp_set_compare_cb(&db->trees[i], cb);
+  }
+}
+
+
+/* k-way merge of partition cursors */
+
+
+static int bp__pdb_cursor_less(bp_pdb_cursor_t* cursor,
+                               const uint64_t a,
+                               const uint64_t b) {
+  int cmp = bp__compare(&cursor->db->trees[0],
+                        &cursor->keys[a],
+                        &cursor->keys[b]);
+
+  return cmp < 0 || (cmp == 0 && a < b);
+}
+
+
+static void bp__pdb_cursor_sift_down(bp_pdb_cursor_t* cursor,
+                                     uint64_t index) {
+  uint64_t child, tmp;
+
+  for (;;) {
+    child = (index << 1) + 1;
+    if (child >= cursor->heap_size) break;
+
+    if (child + 1 < cursor->heap_size &&
+        bp__pdb_cursor_less(cursor,
+                            cursor->heap[child + 1],
+                            cursor->heap[child])) {
+      child++;
+    }
+
+    if (!bp__pdb_cursor_less(cursor,
+                             cursor->heap[child],
+                             cursor->heap[index])) {
+      break;
+    }
+
+    tmp = cursor->heap[index];
+    cursor->heap[index] = cursor->heap[child];
+    cursor->heap[child] = tmp;
+    index = child;
+  }
+}
+
+
+int bp_pdb_cursor_open(bp_pdb_t* db,
+                       const bp_key_t* start,
+                       const bp_key_t* end,
+                       bp_pdb_cursor_t* cursor) {
+  int ret;
+  uint64_t i, first, last;
+
+  cursor->db = db;
+  cursor->heap_size = 0;
+  cursor->cursors = bp__malloc(sizeof(*cursor->cursors) * db->count);
+  cursor->keys = bp__malloc(sizeof(*cursor->keys) * db->count);
+  cursor->values = bp__malloc(sizeof(*cursor->values) * db->count);
+  cursor->heap = bp__malloc(sizeof(*cursor->heap) * db->count);
+  if (cursor->cursors == NULL || cursor->keys == NULL ||
+      cursor->values == NULL || cursor->heap == NULL) {
+    ret = BP_EALLOC;
+    goto fatal;
+  }
+
+  /* in range partitioned database only some partitions may match */
+  first = 0;
+  last = db->count - 1;
+  if (db->type == BP_PARTITION_RANGE) {
+    if (start != NULL) first = bp__pdb_route(db, start);
+    if (end != NULL) last = bp__pdb_route(db, end);
+  }
+
+  for (i = first; i <= last; i++) {
+    ret = bp_cursor_open(&db->trees[i], NULL, start, end, &cursor->cursors[i]);
+    if (ret != BP_OK) goto fatal;
+
+    ret = bp_cursor_next(&db->trees[i],
+                         &cursor->cursors[i],
+                         &cursor->keys[i],
+                         &cursor->values[i]);
+    if (ret == BP_ENOTFOUND) {
+      bp_cursor_close(&db->trees[i], &cursor->cursors[i]);
+      continue;
+    }
+    if (ret != BP_OK) {
+      bp_cursor_close(&db->trees[i], &cursor->cursors[i]);
+      goto fatal;
+    }
+
+    cursor->heap[cursor->heap_size++] = i;
+  }
+
+  /* heapify */
+  for (i = cursor->heap_size >> 1; i > 0; i--) {
+    bp__pdb_cursor_sift_down(cursor, i - 1);
+  }
+
+  return BP_OK;
+
+fatal:
+  bp_pdb_cursor_close(cursor);
+  return ret;
+}
+
+
+int bp_pdb_cursor_next(bp_pdb_cursor_t* cursor,
+                       bp_key_t* key,
+                       bp_value_t* value) {
+  int ret;
+  uint64_t top;
+  bp_key_t top_key;
+  bp_value_t top_value;
+
+  if (cursor->heap_size == 0) return BP_ENOTFOUND;
+
+  top = cursor->heap[0];
+  top_key = cursor->keys[top];
+  top_value = cursor->values[top];
+
+  /* advance partition's cursor */
+  ret = bp_cursor_next(&cursor->db->trees[top],
+                       &cursor->cursors[top],
+                       &cursor->keys[top],
+                       &cursor->values[top]);
+  if (ret == BP_ENOTFOUND) {
+    bp_cursor_close(&cursor->db->trees[top], &cursor->cursors[top]);
+    cursor->heap[0] = cursor->heap[--cursor->heap_size];
+  } else if (ret != BP_OK) {
+    cursor->keys[top] = top_key;
+    cursor->values[top] = top_value;
+    return ret;
+  }
+  bp__pdb_cursor_sift_down(cursor, 0);
+
+  *key = top_key;
+  *value = top_value;
+
+  return BP_OK;
+}
+
+
+int bp_pdb_cursor_close(bp_pdb_cursor_t* cursor) {
+  uint64_t i, part;
+
+  if (cursor->heap != NULL) {
+    for (i = 0; i < cursor->heap_size; i++) {
+      part = cursor->heap[i];
+
+      bp__free(cursor->keys[part].value);
+      bp__free(cursor->values[part].value);
+      bp_cursor_close(&cursor->db->trees[part], &cursor->cursors[part]);
+    }
+  }
+  cursor->heap_size = 0;
+
+  bp__free(cursor->cursors);
+  bp__free(cursor->keys);
+  bp__free(cursor->values);
+  bp__free(cursor->heap);
+  cursor->cursors = NULL;
+  cursor->keys = NULL;
+  cursor->values = NULL;
+  cursor->heap = NULL;
+
+  return BP_OK;
+}
+
+
+int bp_pdb_get_range(bp_pdb_t* db,
+                     const bp_key_t* start,
+                     const bp_key_t* end,
+                     bp_range_cb cb,
+                     void* arg) {
+  int ret;
+  bp_pdb_cursor_t cursor;
+  bp_key_t key;
+  bp_value_t value;
+
+  ret = bp_pdb_cursor_open(db, start, end, &cursor);
+  if (ret != BP_OK) return ret;
+
+  while ((ret = bp_pdb_cursor_next(&cursor, &key, &value)) == BP_OK) {
+    cb(arg, &key, &value);
+
+    bp__free(key.value);
+    bp__free(value.value);
+  }
+  bp_pdb_cursor_close(&cursor);
+
+  return ret == BP_ENOTFOUND ? BP_OK : ret;
+}
+
+
+/* Wrappers to allow string to string set/get/remove */
+
+
+int bp_pdb_gets(bp_pdb_t* db, const char* key, char** value) {
+  int ret;
+  bp_key_t bkey;
+  bp_value_t bvalue;
+
+  BP__STOVAL(key, bkey);
+
+  ret = bp_pdb_get(db, &bkey, &bvalue);
+  if (ret != BP_OK) return ret;
+
+  *value = bvalue.value;
+
+  return BP_OK;
+}
+
+
+int bp_pdb_sets(bp_pdb_t* db, const char* key, const char* value) {
+  bp_key_t bkey;
+  bp_value_t bvalue;
+
+  BP__STOVAL(key, bkey);
+  BP__STOVAL(value, bvalue);
+
+  return bp_pdb_set(db, &bkey, &bvalue);
+}
+
+
+int bp_pdb_removes(bp_pdb_t* db, const char* key) {
+  bp_key_t bkey;
+
+  BP__STOVAL(key, bkey);
+
+  return bp_pdb_remove(db, &bkey);
+}
+
+
+int bp_pdb_get_ranges(bp_pdb_t* db,
+                      const char* start,
+                      const char* end,
+                      bp_range_cb cb,
+                      void* arg) {
+  bp_key_t bstart;
+  bp_key_t bend;
+
+  BP__STOVAL(start, bstart);
+  BP__STOVAL(end, bend);
+
+  return bp_pdb_get_range(db, &bstart, &bend, cb, arg);
+}
@@ -0,0 +1,318 @@
+#include <fcntl.h> /* open */
+#include <unistd.h> /* close, unlink, lseek */
+#include <sys/stat.h> /* mkdir, S_IWUSR, S_IRUSR */
+#include <dirent.h> /* opendir, readdir */
+#include <stdio.h> /* sprintf */
+#include <stdlib.h> /* strtoul */
+#include <string.h> /* strlen, strcmp, memcpy */
+#include <errno.h> /* errno */
+
+#include "bplus.h"
+#include "private/segments.h"
+#include "private/alloc.h"
+#include "private/utils.h"
+
+/* segments are named by their number: 0000002a.seg */
+#define BP__SEGMENT_NAME_SIZE sizeof("00000000.seg")
+
+
+static int bp__segments_sync_fd(const int fd) {
+#ifdef F_FULLFSYNC
+  /* OSX support */
+  return fcntl(fd, F_FULLFSYNC);
+#else
+  return fdatasync(fd) == 0 ? BP_OK : BP_EFILEFLUSH;
+#endif
+}
+
+
+static char* bp__segments_path(const bp__segments_t* s,
+                               const uint64_t index) {
+  char* path;
+
+  path = bp__malloc(strlen(s->dir) + 1 + BP__SEGMENT_NAME_SIZE);
+  if (path == NULL) return NULL;
+
+  sprintf(path, "%s/%08lx.seg", s->dir, (unsigned long) index);
+  return path;
+}
+
+
+static int bp__segments_grow(bp__segments_t* s, const uint64_t count) {
+  bp__segment_t* tmp;
+  uint64_t new_capacity;
+  uint64_t i;
+
+  if (count > s->capacity) {
+    new_capacity = s->capacity == 0 ? 16 : s->capacity;
+    while (new_capacity < count) new_capacity *= 2;
+
+    tmp = bp__malloc(new_capacity * sizeof(*tmp));
+    if (tmp == NULL) return BP_EALLOC;
+
+    if (s->list != NULL) {
+      memcpy(tmp, s->list, s->count * sizeof(*tmp));
+      bp__free(s->list);
+    }
+    s->list = tmp;
+    s->capacity = new_capacity;
+  }
+
+  /* there may be holes left by removed segments */
+  for (i = s->count; i < count; i++) {
+    s->list[i].fd = -1;
+    s->list[i].size = 0;
+    s->list[i].dead = 0;
+  }
+  s->count = count;
+
+  return BP_OK;
+}
+
+
+static int bp__segments_open_one(bp__segments_t* s,
+                                 const uint64_t index,
+                                 const int flags) {
+  char* path;
+  off_t size;
+  int fd;
+
+  path = bp__segments_path(s, index);
+  if (path == NULL) return BP_EALLOC;
+
+  fd = open(path, O_RDWR | O_APPEND | flags, S_IWUSR | S_IRUSR);
+  bp__free(path);
+  if (fd == -1) return BP_EFILE;
+
+  size = lseek(fd, 0, SEEK_END);
+  if (size == -1) {
+    close(fd);
+    return BP_EFILE;
+  }
+
+  s->list[index].fd = fd;
+  s->list[index].size = (uint64_t) size;
+
+  return BP_OK;
+}
+
+
+int bp__segments_mkdir(const char* dir) {
+  if (mkdir(dir, S_IRWXU | S_IRGRP | S_IXGRP) == 0 || errno == EEXIST) {
+    return BP_OK;
+  }
+  return BP_EFILE;
+}
+
+
+int bp__segments_open(bp__segments_t** s, const char* dir) {
+  int ret = BP_OK;
+  bp__segments_t* segments;
+  struct dirent* entry;
+  DIR* d;
+  char* end;
+  unsigned long index;
+  size_t dir_length;
+
+  segments = bp__malloc(sizeof(*segments));
+  if (segments == NULL) return BP_EALLOC;
+
+  dir_length = strlen(dir) + 1;
+  segments->dir = bp__malloc(dir_length);
+  if (segments->dir == NULL) {
+    bp__free(segments);
+    return BP_EALLOC;
+  }
+  memcpy(segments->dir, dir, dir_length);
+
+  segments->list = NULL;
+  segments->count = 0;
+  segments->capacity = 0;
+  segments->dirty = 0;
+  segments->dir_dirty = 0;
+
+  d = opendir(dir);
+  if (d == NULL) {
+    bp__segments_destroy(segments);
+    return BP_EFILE;
+  }
+
+  while ((entry = readdir(d)) != NULL) {
+    if (strlen(entry->d_name) + 1 != BP__SEGMENT_NAME_SIZE) continue;
+
+    index = strtoul(entry->d_name, &end, 16);
+    if (end != entry->d_name + 8 || strcmp(end, ".seg") != 0) continue;
+
+    if (index >= segments->count) {
+      ret = bp__segments_grow(segments, index + 1);
+      if (ret != BP_OK) break;
+    }
+    ret = bp__segments_open_one(segments, index, 0);
+    if (ret != BP_OK) break;
+  }
+  closedir(d);
+
+  if (ret == BP_OK && segments->count == 0) ret = bp__segments_next(segments);
+  if (ret != BP_OK) {
+    bp__segments_destroy(segments);
+    return ret;
+  }
+
+  *s = segments;
+  return BP_OK;
+}
+
+
+int bp__segments_destroy(bp__segments_t* s) {
+  int ret = BP_OK;
+  uint64_t i;
+
+  for (i = 0; i < s->count; i++) {
+    if (s->list[i].fd != -1 && close(s->list[i].fd)) ret = BP_EFILE;
+  }
+  bp__free(s->list);
+  bp__free(s->dir);
+  bp__free(s);
+
+  return ret;
+}
+
+
+int bp__segments_next(bp__segments_t* s) {
+  int ret;
+  uint64_t index;
+
+  /* blocks of previous segments are durable after bp__segments_fsync */
+  index = s->count;
+  if (index != 0 && s->list[index - 1].fd != -1) {
+    ret = bp__segments_sync_fd(s->list[index - 1].fd);
+    if (ret != BP_OK) return ret;
+  }
+
+  ret = bp__segments_grow(s, index + 1);
+  if (ret != BP_OK) return ret;
+
+  ret = bp__segments_open_one(s, index, O_CREAT);
+  if (ret != BP_OK) {
+    s->count--;
+    return ret;
+  }
+  s->dir_dirty = 1;
+
+  return BP_OK;
+}
+
+
+int bp__segments_fd(const bp__segments_t* s,
+                    const uint64_t offset,
+                    const uint64_t size,
+                    int* fd) {
+  uint64_t index = BP__SEGMENT(offset);
+
+  if (index >= s->count || s->list[index].fd == -1) return BP_ENOTFOUND;
+  if (s->list[index].size < BP__SEGMENT_OFFSET(offset) + size) {
+    return BP_EFILEREAD_OOB;
+  }
+
+  *fd = s->list[index].fd;
+  return BP_OK;
+}
+
+
+int bp__segments_fsync(bp__segments_t* s) {
+  int ret;
+  int fd;
+
+  ret = bp__segments_sync_fd(s->list[s->count - 1].fd);
+  if (ret != BP_OK || !s->dir_dirty) return ret;
+
+  /* entries of new segments */
+  fd = open(s->dir, O_RDONLY);
+  if (fd == -1) return BP_EFILEFLUSH;
+  ret = fsync(fd) == 0 ? BP_OK : BP_EFILEFLUSH;
+  close(fd);
+  if (ret == BP_OK) s->dir_dirty = 0;
+
+  return ret;
+}
+
+
+void bp__segments_release(bp__segments_t* s,
+                          const uint64_t offset,
+                          const uint64_t size) {
+  bp__segment_t* segment;
+
+  if (BP__SEGMENT(offset) >= s->count) return;
+
+  segment = &s->list[BP__SEGMENT(offset)];
+  if (segment->fd == -1) return;
+
+  segment->dead += size;
+  if (segment->dead > segment->size) segment->dead = segment->size;
+  s->dirty = 1;
+}
+
+
+int bp__segments_remove(bp__segments_t* s, const uint64_t index) {
+  int ret = BP_OK;
+  char* path;
+
+  path = bp__segments_path(s, index);
+  if (path == NULL) return BP_EALLOC;
+
+  if (close(s->list[index].fd)) ret = BP_EFILE;
+  if (unlink(path) != 0) ret = BP_EFILE;
+  bp__free(path);
+
+  s->list[index].fd = -1;
+  s->list[index].size = 0;
+  s->list[index].dead = 0;
+  s->dirty = 1;
+  s->dir_dirty = 1;
+
+  return ret;
+}
+
+
+uint64_t bp__segments_size(const bp__segments_t* s) {
+  return sizeof(uint64_t) + s->count * sizeof(uint64_t);
+}
+
+
+void bp__segments_encode(const bp__segments_t* s, char* buff) {
+  uint64_t i;
+
+  *(uint64_t*) buff = htonll(s->count);
+  buff += sizeof(uint64_t);
+  for (i = 0; i < s->count; i++) {
+    *(uint64_t*) buff = htonll(s->list[i].dead);
+    buff += sizeof(uint64_t);
+  }
+}
+
+
+int bp__segments_decode(bp__segments_t* s,
+                        const char* buff,
+                        const uint64_t size) {
+  uint64_t i, count;
+
+  if (size < sizeof(uint64_t)) return BP_EFILEREAD;
+  count = ntohll(*(uint64_t*) buff);
+  if (size != sizeof(uint64_t) + count * sizeof(uint64_t)) {
+    return BP_EFILEREAD;
+  }
+  buff += sizeof(uint64_t);
+
+  /* segments created after it was written have no known garbage */
+  for (i = 0; i < count && i < s->count; i++) {
+    if (s->list[i].fd != -1) {
+      s->list[i].dead = ntohll(*(uint64_t*) (buff + i * sizeof(uint64_t)));
+      if (s->list[i].dead > s->list[i].size) {
+        s->list[i].dead = s->list[i].size;
+      }
+    }
+  }
+  s->dirty = 0;
+
+  return BP_OK;
+}
@@ -3,6 +3,7 @@
 #include <pthread.h>
 
 #include <stdlib.h>
+#include <sched.h> /* sched_yield */
 
 #ifndef NDEBUG
 #include <stdio.h>
@@ -39,6 +40,98 @@ void bp__mutex_unlock(bp__mutex_t* mutex) {
 }
 
 
+#if BP_USE_SCALABLE_RWLOCK
+
+static pthread_once_t bp__rwlock_once = PTHREAD_ONCE_INIT;
+static pthread_key_t bp__rwlock_key;
+static int bp__rwlock_key_ret;
+static volatile uint64_t bp__rwlock_next_slot = 0;
+
+
+static void bp__rwlock_key_init(void) {
+  bp__rwlock_key_ret = pthread_key_create(&bp__rwlock_key, NULL);
+}
+
+
+static uint64_t bp__rwlock_slot(void) {
+  uint64_t slot;
+
+  /* slot + 1 is stored, because NULL means `not assigned yet` */
+  slot = (uint64_t) (intptr_t) pthread_getspecific(bp__rwlock_key);
+  if (slot != 0) return slot - 1;
+
+  slot = __sync_fetch_and_add(&bp__rwlock_next_slot, 1) % BP__RWLOCK_SLOTS;
+  pthread_setspecific(bp__rwlock_key, (void*) (intptr_t) (slot + 1));
+
+  return slot;
+}
+
+
+int bp__rwlock_init(bp__rwlock_t* rwlock) {
+  int i;
+
+  if (pthread_once(&bp__rwlock_once, bp__rwlock_key_init) != 0 ||
+      bp__rwlock_key_ret != 0) {
+    return BP_ERWLOCK;
+  }
+
+  for (i = 0; i < BP__RWLOCK_SLOTS; i++) {
+    rwlock->slots[i].readers = 0;
+  }
+  rwlock->writer = 0;
+
+  return bp__mutex_init(&rwlock->mutex) == BP_OK ? BP_OK : BP_ERWLOCK;
+}
+
+
+void bp__rwlock_destroy(bp__rwlock_t* rwlock) {
+  bp__mutex_destroy(&rwlock->mutex);
+}
+
+
+void bp__rwlock_rdlock(bp__rwlock_t* rwlock) {
+  bp__rwlock_slot_t* slot = &rwlock->slots[bp__rwlock_slot()];
+
+  for (;;) {
+    /* full barrier: writer will either see us or we'll see writer */
+    __sync_fetch_and_add(&slot->readers, 1);
+    if (!rwlock->writer) return;
+
+    /* writer is active or waiting - let it go first */
+    __sync_fetch_and_sub(&slot->readers, 1);
+    bp__mutex_lock(&rwlock->mutex);
+    bp__mutex_unlock(&rwlock->mutex);
+  }
+}
+
+
+void bp__rwlock_wrlock(bp__rwlock_t* rwlock) {
+  int i;
+
+  bp__mutex_lock(&rwlock->mutex);
+  rwlock->writer = 1;
+  __sync_synchronize();
+
+  /* wait for active readers */
+  for (i = 0; i < BP__RWLOCK_SLOTS; i++) {
+    while (rwlock->slots[i].readers != 0) sched_yield();
+  }
+}
+
+
+void bp__rwlock_rdunlock(bp__rwlock_t* rwlock) {
+  __sync_fetch_and_sub(&rwlock->slots[bp__rwlock_slot()].readers, 1);
+}
+
+
+void bp__rwlock_wrunlock(bp__rwlock_t* rwlock) {
+  __sync_synchronize();
+  rwlock->writer = 0;
+  bp__mutex_unlock(&rwlock->mutex);
+}
+
+#else
+
 int bp__rwlock_init(bp__rwlock_t* rwlock) {
   return pthread_rwlock_init(rwlock, NULL) == 0 ? BP_OK : BP_ERWLOCK;
 }
@@ -59,6 +152,13 @@ void bp__rwlock_wrlock(bp__rwlock_t* rwlock) {
 }
 
 
-void bp__rwlock_unlock(bp__rwlock_t* rwlock) {
+void bp__rwlock_rdunlock(bp__rwlock_t* rwlock) {
   ENSURE(pthread_rwlock_unlock(rwlock));
 }
+
+
+void bp__rwlock_wrunlock(bp__rwlock_t* rwlock) {
+  ENSURE(pthread_rwlock_unlock(rwlock));
+}
+
+#endif /* BP_USE_SCALABLE_RWLOCK */
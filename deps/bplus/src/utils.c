@@ -27,6 +27,50 @@ uint64_t bp__compute_hashl(uint64_t key) {
 }
 
 
+/* FNV-1a */
+uint64_t bp__compute_hashb(const char* data, const uint64_t length) {
+  uint64_t i;
+  uint64_t hash = ((uint64_t) 0xcbf29ce4 << 32) | 0x84222325;
+
+  for (i = 0; i < length; i++) {
+    hash ^= (uint8_t) data[i];
+    hash *= ((uint64_t) 0x100 << 32) | 0x1b3;
+  }
+
+  return hash;
+}
+
+
+/* LEB128, returns number of bytes written */
+uint64_t bp__varint_write(char* buff, uint64_t value) {
+  uint64_t i = 0;
+
+  while (value >= 0x80) {
+    buff[i++] = (char) ((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  buff[i++] = (char) value;
+
+  return i;
+}
+
+
+/* returns number of bytes read or 0 if varint is malformed */
+uint64_t bp__varint_read(const char* buff, const char* end, uint64_t* value) {
+  uint64_t i, shift;
+  uint8_t byte;
+
+  *value = 0;
+  for (i = 0, shift = 0; buff + i < end && shift < 64; i++, shift += 7) {
+    byte = (uint8_t) buff[i];
+    *value |= (uint64_t) (byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) return i + 1;
+  }
+
+  return 0;
+}
+
+
 uint64_t htonll(uint64_t value) {
     static const int num = 23;
 
@@ -1,10 +1,64 @@
 #include "bplus.h"
 #include "private/values.h"
+#include "private/chunks.h"
 #include "private/writer.h"
 #include "private/utils.h"
 
-#include <stdlib.h> /* malloc, free */
 #include <string.h> /* memcpy */
+#include <time.h> /* time */
+
+
+/* values are stored in value log if database has it */
+bp__writer_t* bp__value_writer(bp_db_t* t) {
+  return t->vlog != NULL ? t->vlog : (bp__writer_t*) t;
+}
+
+
+static int bp__value_load_chunks(bp_db_t* t,
+                                 const uint64_t offset,
+                                 const uint64_t config,
+                                 bp_value_t* value) {
+  int ret;
+  uint64_t i;
+  char* chunk;
+  bp__chunks_t c;
+  bp__arena_mark_t mark;
+
+  ret = bp__chunks_load(t,
+                        offset,
+                        config,
+                        &c,
+                        &value->_prev_offset,
+                        &value->_prev_length);
+  if (ret != BP_OK) return ret;
+
+  value->value = bp__malloc(c.length);
+  if (value->value == NULL) {
+    bp__chunks_destroy(&c);
+    return BP_EALLOC;
+  }
+  value->length = c.length;
+
+  /* only one chunk is uncompressed at a time */
+  for (i = 0; i < c.count; i++) {
+    bp__arena_mark(&mark);
+    ret = bp__chunks_read(t, &c, i, kArenaAlloc, &chunk);
+    if (ret != BP_OK) break;
+
+    memcpy(value->value + i * c.chunk_size,
+           chunk,
+           bp__chunks_length(&c, i));
+    bp__arena_free(chunk);
+    bp__arena_rewind(&mark);
+  }
+  bp__chunks_destroy(&c);
+
+  if (ret != BP_OK) {
+    bp__free(value->value);
+    value->value = NULL;
+  }
+  return ret;
+}
 
 
 int bp__value_load(bp_db_t* t,
@@ -14,18 +68,28 @@ int bp__value_load(bp_db_t* t,
   int ret;
   char* buff;
   uint64_t buff_len = length;
+  bp__arena_mark_t mark;
+
+  /* large value is stored as table of chunks */
+  if (length & BP__CHUNKED) {
+    return bp__value_load_chunks(t, offset, length, value);
+  }
 
   /* read data from disk first */
-  ret = bp__writer_read((bp__writer_t*) t,
+  bp__arena_mark(&mark);
+  ret = bp__writer_read(bp__value_writer(t),
                         kCompressed,
+                        kArenaAlloc,
                         offset,
                         &buff_len,
                         (void**) &buff);
   if (ret != BP_OK) return ret;
 
-  value->value = malloc(buff_len - 16);
+  /* value is returned to user */
+  value->value = bp__malloc(buff_len - 16);
   if (value->value == NULL) {
-    free(buff);
+    bp__arena_free(buff);
+    bp__arena_rewind(&mark);
     return BP_EALLOC;
   }
 
@@ -37,12 +101,47 @@ int bp__value_load(bp_db_t* t,
   memcpy(value->value, buff + 16, buff_len - 16);
   value->length = buff_len - 16;
 
-  free(buff);
+  bp__arena_free(buff);
+  bp__arena_rewind(&mark);
 
   return BP_OK;
 }
 
 
+static int bp__value_save_chunks(bp_db_t* t,
+                                 const bp_value_t* value,
+                                 const bp__kv_t* previous,
+                                 uint64_t* offset,
+                                 uint64_t* config) {
+  int ret = BP_OK;
+  uint64_t i, size;
+  bp__chunks_t c;
+
+  /* chunks are compressed from user's buffer, without copying it */
+  bp__chunks_init(&c, t->chunk_size);
+  for (i = 0; i < value->length; i += size) {
+    size = value->length - i;
+    if (size > c.chunk_size) size = c.chunk_size;
+
+    ret = bp__chunks_append(t, &c, value->value + i, size);
+    if (ret != BP_OK) break;
+  }
+
+  if (ret == BP_OK) {
+    ret = bp__chunks_save(t,
+                          &c,
+                          previous != NULL ? previous->offset : 0,
+                          previous != NULL ? previous->length : 0,
+                          offset,
+                          config);
+  }
+  if (ret != BP_OK) bp__chunks_release(t, &c);
+  bp__chunks_destroy(&c);
+
+  return ret;
+}
+
+
 int bp__value_save(bp_db_t* t,
                    const bp_value_t* value,
                    const bp__kv_t* previous,
@@ -50,8 +149,23 @@ int bp__value_save(bp_db_t* t,
                    uint64_t* length) {
   int ret;
   char* buff;
+  bp__arena_mark_t mark;
+
+  /* chunks of stream were written already (see bp__stream_value) */
+  if (value->length == BP__CHUNKED) {
+    return bp__chunks_save(t,
+                           (const bp__chunks_t*) value->value,
+                           previous != NULL ? previous->offset : 0,
+                           previous != NULL ? previous->length : 0,
+                           offset,
+                           length);
+  }
+  if (t->chunk_size != 0 && value->length > t->chunk_size) {
+    return bp__value_save_chunks(t, value, previous, offset, length);
+  }
 
-  buff = malloc(value->length + 16);
+  bp__arena_mark(&mark);
+  buff = bp__arena_alloc(value->length + 16);
   if (buff == NULL) return BP_EALLOC;
 
   /* insert offset, length of previous value */
@@ -67,21 +181,87 @@ int bp__value_save(bp_db_t* t,
   memcpy(buff + 16, value->value, value->length);
 
   *length = value->length + 16;
-  ret = bp__writer_write((bp__writer_t*) t,
-                         kCompressed,
+  ret = bp__writer_write(bp__value_writer(t),
+                         kDictCompressed,
                          buff,
                          offset,
                          length);
-  free(buff);
+  bp__arena_free(buff);
+  bp__arena_rewind(&mark);
 
   return ret;
 }
 
 
-int bp__kv_copy(const bp__kv_t* source, bp__kv_t* target, int alloc) {
+int bp__value_release(bp_db_t* t,
+                      const uint64_t offset,
+                      const uint64_t length) {
+  int ret;
+  uint64_t prev_offset, prev_config;
+  bp__writer_t* w;
+  bp__chunks_t c;
+
+  w = bp__value_writer(t);
+
+  /* chunks are released too, only if space is tracked at all */
+  if ((length & BP__CHUNKED) && (w->freelist != NULL || w->segments != NULL)) {
+    ret = bp__chunks_load(t, offset, length, &c, &prev_offset, &prev_config);
+    if (ret != BP_OK) return ret;
+
+    ret = bp__chunks_release(t, &c);
+    bp__chunks_destroy(&c);
+    if (ret != BP_OK) return ret;
+  }
+
+  return bp__writer_release(w, offset, BP__VALUE_SIZE(length));
+}
+
+
+uint64_t bp__kv_prefix(const bp_key_t* key) {
+  uint64_t i, prefix;
+
+  /*
+   * First 8 bytes of key in big-endian (zero-padded),
+   * prefixes are ordered the same way as keys in bp__default_compare_cb,
+   * but equal prefixes doesn't mean that keys are equal.
+   */
+  if (key->length >= sizeof(prefix)) {
+    memcpy(&prefix, key->value, sizeof(prefix));
+    return ntohll(prefix);
+  }
+
+  prefix = 0;
+  for (i = 0; i < sizeof(prefix); i++) {
+    prefix <<= 8;
+    if (i < key->length) prefix |= (uint8_t) key->value[i];
+  }
+
+  return prefix;
+}
+
+
+uint64_t bp__kv_separator(const bp_key_t* left, const bp_key_t* right) {
+  uint64_t i, len;
+
+  /*
+   * Length of the shortest prefix of `right` that is still greater than
+   * `left` in terms of bp__default_compare_cb (`left` < `right`).
+   */
+  len = left->length < right->length ? left->length : right->length;
+  for (i = 0; i < len; i++) {
+    if (left->value[i] != right->value[i]) break;
+  }
+
+  return i + 1;
+}
+
+
+int bp__kv_copy(const bp__kv_t* source,
+                bp__kv_t* target,
+                const enum alloc_type alloc) {
   /* copy key fields */
-  if (alloc) {
-    target->value = malloc(source->length);
+  if (alloc != kNoAlloc) {
+    target->value = bp__alloc(alloc, source->length);
     if (target->value == NULL) return BP_EALLOC;
 
     memcpy(target->value, source->value, source->length);
@@ -96,6 +276,12 @@ int bp__kv_copy(const bp__kv_t* source, bp__kv_t* target, int alloc) {
   /* copy rest */
   target->offset = source->offset;
   target->config = source->config;
+  target->expires = source->expires;
 
   return BP_OK;
 }
+
+
+int bp__kv_expired(const uint64_t expires) {
+  return expires != 0 && expires <= (uint64_t) time(NULL);
+}
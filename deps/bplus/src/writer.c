@@ -5,54 +5,150 @@
 
 #include <fcntl.h> /* open */
 #include <unistd.h> /* close, write, read */
+#include <sys/uio.h> /* writev */
 #include <sys/stat.h> /* S_IWUSR, S_IRUSR */
-#include <stdlib.h> /* malloc, free */
 #include <stdio.h> /* sprintf */
-#include <string.h> /* memset */
+#include <string.h> /* memcpy, memset */
 #include <errno.h> /* errno */
+#include <assert.h> /* assert */
+
+/* source of padding */
+static const char bp__writer_zeroes[BP__WRITER_MAX_ALIGNMENT] = { 0 };
+
+
+static uint64_t bp__writer_aligned(bp__writer_t* w, const uint64_t size) {
+  return size + (w->alignment - size % w->alignment) % w->alignment;
+}
+
+
+/* `size` bytes were appended to the file (or the last segment) */
+static void bp__writer_appended(bp__writer_t* w, const uint64_t size) {
+  w->filesize += size;
+  if (w->segments != NULL) {
+    w->segments->list[w->segments->count - 1].size += size;
+  }
+}
+
+
+static int bp__writer_pwrite(const int fd,
+                             const struct iovec* iov,
+                             const int iovcnt,
+                             uint64_t offset) {
+  ssize_t written;
+  int i;
+
+  for (i = 0; i < iovcnt; i++) {
+    written = pwrite(fd, iov[i].iov_base, iov[i].iov_len, (off_t) offset);
+    if ((size_t) written != iov[i].iov_len) return BP_EFILEWRITE;
+    offset += iov[i].iov_len;
+  }
+
+  return BP_OK;
+}
 
 
 int bp__writer_create(bp__writer_t* w, const char* filename) {
+  int ret;
   off_t filesize;
   size_t filename_length;
+  struct stat st;
 
   /* copy filename + '\0' char */
   filename_length = strlen(filename) + 1;
-  w->filename = malloc(filename_length);
+  w->filename = bp__malloc(filename_length);
   if (w->filename == NULL) return BP_EALLOC;
   memcpy(w->filename, filename, filename_length);
 
-  w->fd = open(filename,
-               O_RDWR | O_APPEND | O_CREAT,
-               S_IRUSR | S_IRGRP | S_IWGRP | S_IWUSR);
-  if (w->fd == -1) goto error;
+  /* segmented database is a directory */
+  w->segments = NULL;
+  w->segment_size = 0;
+  if (stat(filename, &st) == 0 && S_ISDIR(st.st_mode)) {
+    ret = bp__segments_open(&w->segments, filename);
+    if (ret != BP_OK) {
+      bp__free(w->filename);
+      return ret;
+    }
+
+    w->fd = w->segments->list[w->segments->count - 1].fd;
+    w->filesize = ((w->segments->count - 1) << BP__SEGMENT_SHIFT) |
+                  w->segments->list[w->segments->count - 1].size;
+  } else {
+    w->fd = open(filename,
+                 O_RDWR | O_APPEND | O_CREAT,
+                 S_IRUSR | S_IRGRP | S_IWGRP | S_IWUSR);
+    if (w->fd == -1) goto error;
 
-  /* Determine filesize */
-  filesize = lseek(w->fd, 0, SEEK_END);
-  if (filesize == -1) goto error;
+    /* Determine filesize */
+    filesize = lseek(w->fd, 0, SEEK_END);
+    if (filesize == -1) goto error;
+
+    w->filesize = (uint64_t) filesize;
+  }
 
-  w->filesize = (uint64_t) filesize;
+  /* tree will set database's codec after reading head */
+  w->codec = BP__CODEC_LEGACY;
+  w->codec_level = 0;
+  w->codec_min_saving = BP__COMPRESS_MIN_SAVING;
+  w->dict = NULL;
 
-  /* Nullify padding to shut up valgrind */
-  memset(&w->padding, 0, sizeof(w->padding));
+  /* tree will set database's alignment too */
+  w->alignment = BP_PADDING;
+
+  /* and enable space reuse if database has it */
+  w->pfd = -1;
+  w->freelist = NULL;
+
+  /* value log is opened after reading head too */
+  w->vlog = NULL;
 
   return BP_OK;
 
 error:
-  free(w->filename);
+  bp__free(w->filename);
   return BP_EFILE;
 }
 
 
 int bp__writer_destroy(bp__writer_t* w) {
-  free(w->filename);
+  int ret;
+
+  bp__free(w->filename);
   w->filename = NULL;
+  bp__dict_destroy(w->dict);
+  w->dict = NULL;
+  bp__freelist_destroy(w->freelist);
+  w->freelist = NULL;
+  if (w->vlog != NULL) {
+    /* dictionary belongs to database */
+    w->vlog->dict = NULL;
+    bp__writer_destroy(w->vlog);
+    bp__free(w->vlog);
+    w->vlog = NULL;
+  }
+  if (w->pfd != -1 && close(w->pfd)) return BP_EFILE;
+  w->pfd = -1;
+  if (w->segments != NULL) {
+    /* `fd` belongs to the last segment */
+    ret = bp__segments_destroy(w->segments);
+    w->segments = NULL;
+    return ret;
+  }
   if (close(w->fd)) return BP_EFILE;
   return BP_OK;
 }
 
 
 int bp__writer_fsync(bp__writer_t* w) {
+  int ret;
+
+  /* values should be durable before pages referencing them */
+  if (w->vlog != NULL) {
+    ret = bp__writer_fsync(w->vlog);
+    if (ret != BP_OK) return ret;
+  }
+
+  if (w->segments != NULL) return bp__segments_fsync(w->segments);
+
 #ifdef F_FULLFSYNC
   /* OSX support */
   return fcntl(w->fd, F_FULLFSYNC);
@@ -63,12 +159,12 @@ int bp__writer_fsync(bp__writer_t* w) {
 
 
 int bp__writer_compact_name(bp__writer_t* w, char** compact_name) {
-  char* filename = malloc(strlen(w->filename) + sizeof(".compact") + 1);
+  char* filename = bp__malloc(strlen(w->filename) + sizeof(".compact") + 1);
   if (filename == NULL) return BP_EALLOC;
 
   sprintf(filename, "%s.compact", w->filename);
   if (access(filename, F_OK) != -1 || errno != ENOENT) {
-    free(filename);
+    bp__free(filename);
     return BP_ECOMPACT_EXISTS;
   }
 
@@ -79,10 +175,12 @@ int bp__writer_compact_name(bp__writer_t* w, char** compact_name) {
 
 int bp__writer_compact_finalize(bp__writer_t* s, bp__writer_t* t) {
   int ret;
+  int min_saving;
   char* name;
   char* compacted_name;
 
   /* save filename and prevent freeing it */
+  min_saving = s->codec_min_saving;
   name = s->filename;
   compacted_name = t->filename;
   s->filename = NULL;
@@ -98,11 +196,12 @@ int bp__writer_compact_finalize(bp__writer_t* s, bp__writer_t* t) {
   /* reopen source tree */
   ret = bp__writer_create(s, name);
   if (ret != BP_OK) goto fatal;
+  s->codec_min_saving = min_saving;
   ret = bp__init((bp_db_t*) s);
 
 fatal:
-  free(compacted_name);
-  free(name);
+  bp__free(compacted_name);
+  bp__free(name);
 
   return ret;
 }
@@ -110,13 +209,25 @@ fatal:
 
 int bp__writer_read(bp__writer_t* w,
                     const enum comp_type comp,
+                    const enum alloc_type alloc,
                     const uint64_t offset,
                     uint64_t* size,
                     void** data) {
+  int ret;
+  int fd;
+  uint64_t local;
   ssize_t bytes_read;
   char* cdata;
 
-  if (w->filesize < offset + *size) return BP_EFILEREAD_OOB;
+  fd = w->fd;
+  local = offset;
+  if (w->segments != NULL) {
+    ret = bp__segments_fd(w->segments, offset, *size, &fd);
+    if (ret != BP_OK) return ret;
+    local = BP__SEGMENT_OFFSET(offset);
+  } else if (w->filesize < offset + *size) {
+    return BP_EFILEREAD_OOB;
+  }
 
   /* Ignore empty reads */
   if (*size == 0) {
@@ -124,42 +235,61 @@ int bp__writer_read(bp__writer_t* w,
     return BP_OK;
   }
 
-  cdata = malloc(*size);
+  /* compressed data is always temporary */
+  if (comp == kNotCompressed) {
+    cdata = bp__alloc(alloc, *size);
+  } else {
+    cdata = bp__scratch_alloc(*size);
+  }
   if (cdata == NULL) return BP_EALLOC;
 
-  bytes_read = pread(w->fd, cdata, (size_t) *size, (off_t) offset);
+  bytes_read = pread(fd, cdata, (size_t) *size, (off_t) local);
   if ((uint64_t) bytes_read != *size) {
-    free(cdata);
+    if (comp == kNotCompressed) {
+      bp__arena_free(cdata);
+    } else {
+      bp__scratch_release(cdata);
+    }
     return BP_EFILEREAD;
   }
 
   /* no compression for head */
   if (comp == kNotCompressed) {
     *data = cdata;
+  } else if (bp__compressed_raw(w->codec, cdata, *size)) {
+    /* skip codec */
+    *size -= 1;
+    *data = bp__alloc(alloc, *size);
+    if (*data != NULL) memcpy(*data, cdata + 1, (size_t) *size);
+    bp__scratch_release(cdata);
+    if (*data == NULL) return BP_EALLOC;
   } else {
-    int ret = 0;
-
     char* uncompressed = NULL;
     size_t usize;
 
-    if (bp__uncompressed_length(cdata, *size, &usize) != BP_OK) {
-      ret = BP_EDECOMP;
-    } else {
-      uncompressed = malloc(usize);
+    ret = bp__uncompressed_length(w->codec, cdata, *size, &usize);
+    if (ret == BP_OK) {
+      uncompressed = bp__alloc(alloc, usize);
       if (uncompressed == NULL) {
         ret = BP_EALLOC;
-      } else if (bp__uncompress(cdata, *size, uncompressed, &usize) != BP_OK) {
-        ret = BP_EDECOMP;
       } else {
-        *data = uncompressed;
-        *size = usize;
+        ret = bp__uncompress(w->codec,
+                             w->dict,
+                             cdata,
+                             *size,
+                             uncompressed,
+                             &usize);
       }
     }
+    if (ret == BP_OK) {
+      *data = uncompressed;
+      *size = usize;
+    }
 
-    free(cdata);
+    bp__scratch_release(cdata);
 
     if (ret != BP_OK) {
-      free(uncompressed);
+      bp__arena_free(uncompressed);
       return ret;
     }
   }
@@ -173,84 +303,331 @@ int bp__writer_write(bp__writer_t* w,
                      const void* data,
                      uint64_t* offset,
                      uint64_t* size) {
+  int ret;
   ssize_t written;
-  uint32_t padding = sizeof(w->padding) - (w->filesize % sizeof(w->padding));
-
-  /* Write padding */
-  if (padding != sizeof(w->padding)) {
-    written = write(w->fd, &w->padding, (size_t) padding);
-    if ((uint32_t) written != padding) return BP_EFILEWRITE;
-    w->filesize += padding;
-  }
+  uint64_t padding;
+  uint64_t total;
+  int iovcnt;
+  struct iovec iov[3];
+  char* compressed = NULL;
+
+  /* padding goes to the same syscall as record */
+  padding = (w->alignment - w->filesize % w->alignment) % w->alignment;
+  iov[0].iov_base = (void*) bp__writer_zeroes;
+  iov[0].iov_len = (size_t) padding;
+  iovcnt = 1;
 
   /* Ignore empty writes */
   if (size == NULL || *size == 0) {
+    if (padding != 0) {
+      written = writev(w->fd, iov, iovcnt);
+      if ((uint64_t) written != padding) return BP_EFILEWRITE;
+      bp__writer_appended(w, padding);
+    }
     if (offset != NULL) *offset = w->filesize;
     return BP_OK;
   }
 
   /* head shouldn't be compressed */
   if (comp == kNotCompressed) {
-    written = write(w->fd, data, *size);
+    iov[iovcnt].iov_base = (void*) data;
+    iov[iovcnt++].iov_len = (size_t) *size;
   } else {
-    int ret;
-    size_t max_csize = bp__max_compressed_size(*size);
+    bp__dict_t* dict = comp == kDictCompressed ? w->dict : NULL;
+    size_t max_csize = bp__max_compressed_size(w->codec, dict, *size);
     size_t result_size;
-    char* compressed = malloc(max_csize);
+    compressed = bp__scratch_alloc(max_csize);
     if (compressed == NULL) return BP_EALLOC;
 
     result_size = max_csize;
-    ret = bp__compress(data, *size, compressed, &result_size);
+    ret = bp__compress(w->codec,
+                       dict,
+                       w->codec_level,
+                       w->codec_min_saving,
+                       data,
+                       *size,
+                       compressed,
+                       &result_size);
     if (ret != BP_OK) {
-      free(compressed);
-      return BP_ECOMP;
+      bp__scratch_release(compressed);
+      return ret;
     }
 
-    *size = result_size;
-    written = write(w->fd, compressed, result_size);
-    free(compressed);
+    iov[iovcnt].iov_base = compressed;
+    iov[iovcnt++].iov_len = result_size;
+    if (bp__compressed_raw(w->codec, compressed, result_size)) {
+      /* raw block - tag is followed by data itself, no need to copy it */
+      iov[iovcnt].iov_base = (void*) data;
+      iov[iovcnt++].iov_len = (size_t) *size;
+      *size += result_size;
+    } else {
+      *size = result_size;
+    }
+  }
+
+  /*
+   * Blocks may go into free extent, they're aligned already. Heads of
+   * databases reusing space are written in place and their ring and
+   * dictionary are written before free list is created.
+   */
+  if (w->freelist != NULL &&
+      bp__freelist_alloc(w->freelist,
+                         bp__writer_aligned(w, *size),
+                         offset) == BP_OK) {
+    ret = bp__writer_pwrite(w->pfd, iov + 1, iovcnt - 1, *offset);
+    bp__scratch_release(compressed);
+
+    return ret;
+  }
+
+  /* records don't cross segments, the next one is started instead */
+  if (w->segments != NULL && w->segment_size != 0 &&
+      BP__SEGMENT_OFFSET(w->filesize) != 0 &&
+      BP__SEGMENT_OFFSET(w->filesize) + padding + *size > w->segment_size) {
+    ret = bp__writer_next_segment(w);
+    if (ret != BP_OK) {
+      bp__scratch_release(compressed);
+      return ret;
+    }
+    padding = 0;
+    iov[0].iov_len = 0;
   }
 
-  if ((uint64_t) written != *size) return BP_EFILEWRITE;
+  total = padding + *size;
+  written = writev(w->fd, iov, iovcnt);
+  bp__scratch_release(compressed);
+
+  if ((uint64_t) written != total) return BP_EFILEWRITE;
 
   /* change offset */
-  *offset = w->filesize;
-  w->filesize += written;
+  *offset = w->filesize + padding;
+  bp__writer_appended(w, total);
 
   return BP_OK;
 }
 
 
-int bp__writer_find(bp__writer_t* w,
-                    const enum comp_type comp,
-                    const uint64_t size,
-                    void* data,
-                    bp__writer_cb seek,
-                    bp__writer_cb miss) {
-  int ret = 0;
-  int match = 0;
-  uint64_t offset, size_tmp;
+int bp__writer_reuse(bp__writer_t* w) {
+  int ret;
+
+  if (w->freelist != NULL) return BP_OK;
 
-  /* Write padding first */
-  ret = bp__writer_write(w, kNotCompressed, NULL, NULL, NULL);
+  /* pwrite() ignores offset on descriptors opened with O_APPEND */
+  w->pfd = open(w->filename, O_RDWR);
+  if (w->pfd == -1) return BP_EFILE;
+
+  ret = bp__freelist_create(&w->freelist);
+  if (ret != BP_OK) {
+    close(w->pfd);
+    w->pfd = -1;
+  }
+
+  return ret;
+}
+
+
+int bp__writer_write_at(bp__writer_t* w,
+                        const void* data,
+                        const uint64_t offset,
+                        const uint64_t size) {
+  struct iovec iov;
+
+  assert(w->pfd != -1);
+  assert(offset + size <= w->filesize);
+
+  iov.iov_base = (void*) data;
+  iov.iov_len = (size_t) size;
+
+  return bp__writer_pwrite(w->pfd, &iov, 1, offset);
+}
+
+
+int bp__writer_release(bp__writer_t* w,
+                       const uint64_t offset,
+                       const uint64_t size) {
+  uint64_t aligned;
+
+  if (size == 0) return BP_OK;
+  if (w->segments != NULL) {
+    bp__segments_release(w->segments, offset, bp__writer_aligned(w, size));
+    return BP_OK;
+  }
+  if (w->freelist == NULL) return BP_OK;
+
+  /* padding after block belongs to it, extents are kept aligned */
+  aligned = bp__writer_aligned(w, size);
+  if (offset + aligned > w->filesize) {
+    aligned = w->filesize - offset;
+    aligned -= aligned % w->alignment;
+  }
+
+  return bp__freelist_release(w->freelist, offset, aligned);
+}
+
+
+int bp__writer_next_segment(bp__writer_t* w) {
+  int ret;
+  uint64_t last;
+
+  ret = bp__segments_next(w->segments);
   if (ret != BP_OK) return ret;
 
-  offset = w->filesize;
-  size_tmp = size;
+  last = w->segments->count - 1;
+  w->fd = w->segments->list[last].fd;
+  w->filesize = last << BP__SEGMENT_SHIFT;
+
+  return BP_OK;
+}
+
+
+int bp__writer_vlog_name(const char* filename,
+                         const uint64_t generation,
+                         char** name) {
+  *name = bp__malloc(strlen(filename) + sizeof(".00.vlog"));
+  if (*name == NULL) return BP_EALLOC;
+
+  sprintf(*name, "%s.%02x.vlog", filename, (unsigned int) generation);
+  return BP_OK;
+}
+
+
+int bp__writer_open_vlog(bp__writer_t* w, const char* name) {
+  int ret;
+  bp__writer_t* vlog;
+
+  vlog = bp__malloc(sizeof(*vlog));
+  if (vlog == NULL) return BP_EALLOC;
+
+  ret = bp__writer_create(vlog, name);
+  if (ret != BP_OK) {
+    bp__free(vlog);
+    return ret;
+  }
+
+  w->vlog = vlog;
+  bp__writer_vlog_update(w);
+
+  return BP_OK;
+}
+
+
+void bp__writer_vlog_update(bp__writer_t* w) {
+  if (w->vlog == NULL) return;
+
+  w->vlog->codec = w->codec;
+  w->vlog->codec_level = w->codec_level;
+  w->vlog->codec_min_saving = w->codec_min_saving;
+  w->vlog->dict = w->dict;
+  w->vlog->alignment = w->alignment;
+}
+
+
+void bp__writer_discard(bp__writer_t* w) {
+  if (w->freelist != NULL) bp__freelist_discard(w->freelist);
+}
 
-  /* Start seeking from bottom of file */
-  while (offset >= size) {
-    ret = bp__writer_read(w, comp, offset - size, &size_tmp, &data);
-    if (ret != BP_OK) break;
 
-    /* Break if matched */
-    if (seek(w, data) == 0) {
-      match = 1;
+/*
+ * Check candidates in file `fd` of `filesize` bytes from the last one,
+ * `base` is added to their offsets (see bp__writer_find)
+ */
+static int bp__writer_find_in(bp__writer_t* w,
+                              const int fd,
+                              const uint64_t base,
+                              const uint64_t filesize,
+                              const uint64_t size,
+                              bp__writer_seek_cb seek,
+                              int* match) {
+  int ret = BP_OK;
+  uint64_t offset, start, len, i;
+  ssize_t bytes_read;
+  char* window;
+  void* candidate;
+
+  if (filesize == 0) return BP_OK;
+
+  window = bp__malloc(BP__WRITER_FIND_WINDOW);
+  if (window == NULL) return BP_EALLOC;
+
+  offset = filesize - 1;
+  for (;;) {
+    start = offset > BP__WRITER_FIND_WINDOW - size ?
+        offset - (BP__WRITER_FIND_WINDOW - size) : 0;
+    len = offset + size > filesize ? filesize - start :
+                                     offset + size - start;
+
+    bytes_read = pread(fd, window, (size_t) len, (off_t) start);
+    if ((uint64_t) bytes_read != len) {
+      ret = BP_EFILEREAD;
       break;
     }
+    memset(window + len, 0, (size_t) (offset + size - start - len));
+
+    for (i = offset - start + 1; i > 0; i--) {
+      /* seek callback takes ownership of data */
+      candidate = bp__arena_alloc(size);
+      if (candidate == NULL) {
+        ret = BP_EALLOC;
+        break;
+      }
+      memcpy(candidate, window + i - 1, (size_t) size);
+
+      /* Break if matched */
+      if (seek(w, base + start + i - 1, candidate) == 0) {
+        *match = 1;
+        break;
+      }
+    }
 
-    offset -= size;
+    if (*match || ret != BP_OK || start == 0) break;
+    offset = start - 1;
+  }
+
+  bp__free(window);
+  return ret;
+}
+
+
+int bp__writer_find(bp__writer_t* w,
+                    const enum comp_type comp,
+                    const uint64_t size,
+                    void* data,
+                    bp__writer_seek_cb seek,
+                    bp__writer_cb miss) {
+  int ret = 0;
+  int match = 0;
+  uint64_t i;
+  bp__segment_t* segment;
+
+  /* records of fixed size only */
+  assert(comp == kNotCompressed);
+  assert(size <= BP__WRITER_FIND_WINDOW);
+
+  /*
+   * Start seeking from bottom of file. Alignment of records is stored in
+   * database itself, so every offset is a candidate. File is read by
+   * windows, candidates [start, offset] are checked from the last one.
+   * Records at the end of file may be shorter than `size` (heads of older
+   * versions, heads without free list), so file is treated as zero-padded.
+   * Segments are checked from the last one too.
+   */
+  if (w->segments == NULL) {
+    ret = bp__writer_find_in(w, w->fd, 0, w->filesize, size, seek, &match);
+  } else {
+    for (i = w->segments->count; i > 0 && !match && ret == BP_OK; i--) {
+      segment = &w->segments->list[i - 1];
+      if (segment->fd == -1) continue;
+
+      ret = bp__writer_find_in(w,
+                               segment->fd,
+                               (i - 1) << BP__SEGMENT_SHIFT,
+                               segment->size,
+                               size,
+                               seek,
+                               &match);
+    }
   }
+  if (ret != BP_OK) return ret;
 
   /* Not found - invoke miss */
   if (!match) {
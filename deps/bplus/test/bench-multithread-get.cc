@@ -1,15 +1,21 @@
 #include "test.h"
 
 const int num = 100000;
-const int rnum = 4;
+const int max_rnum = 64;
 static char* keys[num];
 
-void* reader_thread(void* db_) {
-  bp_db_t* db = (bp_db_t*) db_;
+struct reader_arg_s {
+  bp_db_t* db;
+  int start;
+  int end;
+};
 
-  for (int i = 0; i < num; i++) {
+void* reader_thread(void* arg_) {
+  struct reader_arg_s* arg = (struct reader_arg_s*) arg_;
+
+  for (int i = arg->start; i < arg->end; i++) {
     char* value;
-    bp_gets(db, keys[i], &value);
+    bp_gets(arg->db, keys[i], &value);
     free(value);
   }
 
@@ -17,8 +23,9 @@ void* reader_thread(void* db_) {
 }
 
 TEST_START("multi-threaded get benchmark", "mt-get-bench")
-  int i;
-  pthread_t readers[rnum];
+  int i, rnum;
+  pthread_t readers[max_rnum];
+  struct reader_arg_s args[max_rnum];
 
   for (i = 0; i < num; i++) {
     keys[i] = (char*) malloc(20);
@@ -30,13 +37,23 @@ TEST_START("multi-threaded get benchmark", "mt-get-bench")
                (const char**) keys,
                (const char**) keys);
 
-  BENCH_START(get, rnum * num)
-  for (i = 0; i < rnum; i++) {
-    pthread_create(&readers[i], NULL, reader_thread, (void*) &db);
-  }
-
-  for (i = 0; i < rnum; i++) {
-    pthread_join(readers[i], NULL);
+  /* same amount of work split between 1..64 threads */
+  for (rnum = 1; rnum <= max_rnum; rnum <<= 1) {
+    for (i = 0; i < rnum; i++) {
+      args[i].db = &db;
+      args[i].start = (num / rnum) * i;
+      args[i].end = i == rnum - 1 ? num : (num / rnum) * (i + 1);
+    }
+
+    fprintf(stdout, "%d threads\n", rnum);
+    BENCH_START(get, num)
+    for (i = 0; i < rnum; i++) {
+      pthread_create(&readers[i], NULL, reader_thread, (void*) &args[i]);
+    }
+
+    for (i = 0; i < rnum; i++) {
+      pthread_join(readers[i], NULL);
+    }
+    BENCH_END(get, num)
   }
-  BENCH_END(get, rnum * num)
 TEST_END("multi-threaded get benchmark", "mt-get-bench")
@@ -0,0 +1,104 @@
+#include "test.h"
+
+static const int alignments[] = { 1, 64, 4096 };
+
+
+void fill(bp_db_t* db, const int n) {
+  char key[32];
+  char value[32];
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key-%d", i);
+    sprintf(value, "value-%d", i);
+    assert(bp_sets(db, key, value) == BP_OK);
+  }
+}
+
+
+void check(bp_db_t* db, const int n) {
+  char key[32];
+  char expected[32];
+  char* value;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key-%d", i);
+    sprintf(expected, "value-%d", i);
+    assert(bp_gets(db, key, &value) == BP_OK);
+    assert(strcmp(value, expected) == 0);
+    free(value);
+  }
+}
+
+
+uint64_t file_size(const char* file) {
+  struct stat st;
+
+  assert(stat(file, &st) == 0);
+  return st.st_size;
+}
+
+
+TEST_START("alignment test", "alignment")
+  const int n = 1000;
+  bp_options_t options;
+  uint64_t sizes[3];
+  uint64_t size;
+  unsigned int i;
+  int fd;
+
+  assert(bp_close(&db) == BP_OK);
+
+  for (i = 0; i < sizeof(alignments) / sizeof(alignments[0]); i++) {
+    bp_options_init(&options);
+    options.alignment = alignments[i];
+
+    unlink(__db_file);
+    assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+    fill(&db, n);
+    check(&db, n);
+    assert(bp_close(&db) == BP_OK);
+
+    /* head is the last record */
+    sizes[i] = file_size(__db_file);
+    assert((sizes[i] - BP_PADDING) % alignments[i] == 0);
+
+    /* alignment is stored in database */
+    assert(bp_open(&db, __db_file) == BP_OK);
+    check(&db, n);
+    assert(bp_sets(&db, "key-0", "value-0") == BP_OK);
+    assert(bp_close(&db) == BP_OK);
+    size = file_size(__db_file);
+    assert((size - BP_PADDING) % alignments[i] == 0);
+
+    /* head is found after partially written record */
+    fd = open(__db_file, O_WRONLY | O_APPEND);
+    assert(fd != -1);
+    assert(write(fd, "garbage", 7) == 7);
+    assert(close(fd) == 0);
+    assert(bp_open(&db, __db_file) == BP_OK);
+    check(&db, n);
+
+    assert(bp_compact(&db) == BP_OK);
+    check(&db, n);
+    assert(bp_sets(&db, "key-0", "value-0") == BP_OK);
+    assert(bp_close(&db) == BP_OK);
+    size = file_size(__db_file);
+    assert((size - BP_PADDING) % alignments[i] == 0);
+  }
+
+  /* less padding - smaller file */
+  assert(sizes[0] < sizes[1] && sizes[1] < sizes[2]);
+
+  /* alignment should be a power of two */
+  bp_options_init(&options);
+  options.alignment = 3;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_EALIGNMENT);
+  options.alignment = 8192;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_EALIGNMENT);
+  options.alignment = 0;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_EALIGNMENT);
+
+  assert(bp_open(&db, __db_file) == BP_OK);
+TEST_END("alignment test", "alignment")
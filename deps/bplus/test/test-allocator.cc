@@ -0,0 +1,76 @@
+#include "test.h"
+
+static uint64_t mallocs = 0;
+static uint64_t frees = 0;
+
+void* counting_malloc(size_t size) {
+  mallocs++;
+  return malloc(size);
+}
+
+void counting_free(void* ptr) {
+  frees++;
+  free(ptr);
+}
+
+TEST_START("allocator test", "allocator")
+  const int n = 5000;
+  char key[100];
+  char val[100];
+  char* result;
+  int i;
+  uint64_t before;
+
+  /* reopen database with custom allocator */
+  assert(bp_close(&db) == BP_OK);
+  bp_set_allocator(counting_malloc, counting_free);
+  assert(bp_open(&db, __db_file) == BP_OK);
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key %04d", i);
+    sprintf(val, "value %04d", i);
+    assert(bp_sets(&db, key, val) == BP_OK);
+  }
+  assert(mallocs > 0);
+
+  /* warm up arena */
+  assert(bp_gets(&db, "key 0000", &result) == BP_OK);
+  counting_free(result);
+
+  /* only returned value should be taken from allocator */
+  before = mallocs;
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key %04d", i);
+    sprintf(val, "value %04d", i);
+    assert(bp_gets(&db, key, &result) == BP_OK);
+    assert(strcmp(result, val) == 0);
+    counting_free(result);
+  }
+  assert(mallocs - before == (uint64_t) n);
+
+  /* pages that were split and overwritten should be still readable */
+  for (i = 0; i < n; i += 2) {
+    sprintf(key, "key %04d", i);
+    assert(bp_removes(&db, key) == BP_OK);
+  }
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key %04d", i);
+    sprintf(val, "value %04d", i);
+    if (i % 2 == 0) {
+      assert(bp_gets(&db, key, &result) == BP_ENOTFOUND);
+      continue;
+    }
+    assert(bp_gets(&db, key, &result) == BP_OK);
+    assert(strcmp(result, val) == 0);
+    counting_free(result);
+  }
+
+  assert(bp_compact(&db) == BP_OK);
+  assert(bp_close(&db) == BP_OK);
+
+  /* only thread's arena (one chunk and scratch buffer in it) is alive */
+  assert(mallocs - frees <= 3);
+
+  bp_set_allocator(NULL, NULL);
+  assert(bp_open(&db, __db_file) == BP_OK);
+TEST_END("allocator test", "allocator")
@@ -28,6 +28,27 @@ TEST_START("API test", "api")
 
   assert(bp_compact(&db) == BP_OK);
 
+  /* missing key isn't created by update of existing one */
+  {
+    bp_key_t kkey;
+    bp_value_t kval;
+    char* result = NULL;
+
+    BP__STOVAL("some missing key", kkey);
+    BP__STOVAL("some value", kval);
+    assert(bp_update_existing(&db, &kkey, &kval, update_cb, NULL) ==
+           BP_EUPDATECONFLICT);
+    assert(bp_gets(&db, "some missing key", &result) == BP_ENOTFOUND);
+
+    sprintf(key, "some key %d", 0);
+    sprintf(val, "some long long long long long value %d", 0);
+    sprintf(expected, "some long long long long long value %d", 0);
+    BP__STOVAL(key, kkey);
+    BP__STOVAL(val, kval);
+    assert(bp_update_existing(&db, &kkey, &kval, update_cb, expected) ==
+           BP_OK);
+  }
+
   for (i = 0; i < n; i++) {
     sprintf(key, "some key %d", i);
     sprintf(val, "some updated long long long long long value %d", i);
@@ -0,0 +1,217 @@
+#include "test.h"
+
+static const int codecs[] = {
+  BP_CODEC_NONE,
+  BP_CODEC_SNAPPY,
+  BP_CODEC_LZ4,
+  BP_CODEC_ZSTD
+};
+
+
+void fill(bp_db_t* db, const int from, const int to) {
+  char key[32];
+  char value[128];
+  int i;
+
+  for (i = from; i < to; i++) {
+    sprintf(key, "key-%08d", i);
+    sprintf(value, "value-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", i);
+    assert(bp_sets(db, key, value) == BP_OK);
+  }
+}
+
+
+void check(bp_db_t* db, const int n) {
+  char key[32];
+  char expected[128];
+  char* value;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key-%08d", i);
+    sprintf(expected, "value-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa", i);
+    assert(bp_gets(db, key, &value) == BP_OK);
+    assert(strcmp(value, expected) == 0);
+    free(value);
+  }
+}
+
+
+uint64_t file_size(const char* file) {
+  struct stat st;
+
+  assert(stat(file, &st) == 0);
+  return st.st_size;
+}
+
+
+uint64_t fill_size(const char* file, const int min_saving, const int random) {
+  bp_db_t db;
+  bp_options_t options;
+  char key[32];
+  char value[256];
+  char* result;
+  int i, j;
+
+  bp_options_init(&options);
+  options.codec_min_saving = min_saving;
+
+  unlink(file);
+  assert(bp_open_opts(&db, file, &options) == BP_OK);
+
+  srand(42);
+  for (i = 0; i < 1000; i++) {
+    for (j = 0; j < (int) sizeof(value) - 1; j++) {
+      value[j] = random ? 1 + rand() % 255 : 'a' + j % 4;
+    }
+    value[sizeof(value) - 1] = 0;
+
+    sprintf(key, "key-%08d", i);
+    assert(bp_sets(&db, key, value) == BP_OK);
+    assert(bp_gets(&db, key, &result) == BP_OK);
+    assert(strcmp(result, value) == 0);
+    free(result);
+  }
+  assert(bp_close(&db) == BP_OK);
+
+  return file_size(file);
+}
+
+
+void fill_json(bp_db_t* db, const int n) {
+  char key[32];
+  char value[256];
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "user-%08d", i);
+    sprintf(value,
+            "{\"id\":%d,\"name\":\"user %d\","
+            "\"email\":\"user%d@example.com\",\"active\":%s,"
+            "\"score\":%d,\"tags\":[\"a\",\"b\"]}",
+            i, i, i, i % 2 ? "true" : "false", i * 7 % 1000);
+    assert(bp_sets(db, key, value) == BP_OK);
+  }
+}
+
+
+void check_json(bp_db_t* db, const int n) {
+  char key[32];
+  char* value;
+  int i, id;
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "user-%08d", i);
+    assert(bp_gets(db, key, &value) == BP_OK);
+    assert(sscanf(value, "{\"id\":%d,", &id) == 1 && id == i);
+    free(value);
+  }
+}
+
+
+TEST_START("compression codecs test", "codecs")
+  const int n = 5000;
+  bp_options_t options;
+  bp_db_t db2;
+  uint64_t size;
+  unsigned int i;
+  int ret;
+
+  assert(bp_close(&db) == BP_OK);
+
+  for (i = 0; i < sizeof(codecs) / sizeof(codecs[0]); i++) {
+    bp_options_init(&options);
+    options.codec = codecs[i];
+
+    unlink(__db_file);
+    ret = bp_open_opts(&db, __db_file, &options);
+
+    /* codec wasn't compiled in */
+    if (ret == BP_ECODEC) {
+      assert(codecs[i] != BP_CODEC_NONE);
+      continue;
+    }
+    assert(ret == BP_OK);
+
+    fill(&db, 0, n / 2);
+
+    /* blocks written with different codecs coexist */
+    assert(bp_set_codec(&db, BP_CODEC_NONE, 0) == BP_OK);
+    fill(&db, n / 2, n);
+    check(&db, n);
+    assert(bp_close(&db) == BP_OK);
+
+    /* codec is stored in database */
+    assert(bp_open(&db, __db_file) == BP_OK);
+    check(&db, n);
+    assert(bp_set_codec(&db, codecs[i], 1) == BP_OK);
+    fill(&db, 0, n / 4);
+    assert(bp_compact(&db) == BP_OK);
+    check(&db, n);
+    assert(bp_close(&db) == BP_OK);
+
+    assert(bp_open(&db, __db_file) == BP_OK);
+    check(&db, n);
+    assert(bp_close(&db) == BP_OK);
+  }
+
+  /* blocks are stored raw if compression doesn't save enough */
+  assert(fill_size(__db_file, 100, 0) >= fill_size(__db_file, 0, 0));
+  assert(fill_size(__db_file, 100, 1) >= fill_size(__db_file, 10, 1));
+
+  /* zstd dictionary trained from values */
+  unlink(__db_file);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  fill_json(&db, n);
+  assert(bp_compact(&db) == BP_OK);
+  size = file_size(__db_file);
+
+  ret = bp_compact_dict(&db, 8192, 0);
+  if (ret == BP_ECODEC) {
+    bp_options_init(&options);
+    options.dict = "dict";
+    options.dict_size = 4;
+    assert(bp_open_opts(&db2, __db_file, &options) == BP_ECODEC);
+  } else {
+    assert(ret == BP_OK);
+    assert(file_size(__db_file) < size);
+    check_json(&db, n);
+    assert(bp_close(&db) == BP_OK);
+
+    /* dictionary is stored in file and kept by compaction */
+    assert(bp_open(&db, __db_file) == BP_OK);
+    check_json(&db, n);
+    fill_json(&db, n / 10);
+    size = file_size(__db_file);
+    assert(bp_compact(&db) == BP_OK);
+    assert(file_size(__db_file) < size);
+    check_json(&db, n);
+
+    /* pages too */
+    assert(bp_compact_dict(&db, 8192, 1) == BP_OK);
+    check_json(&db, n);
+    assert(bp_close(&db) == BP_OK);
+    assert(bp_open(&db, __db_file) == BP_OK);
+    check_json(&db, n);
+
+    /* remove it */
+    assert(bp_compact_dict(&db, 0, 0) == BP_OK);
+    check_json(&db, n);
+  }
+  assert(bp_close(&db) == BP_OK);
+
+  /* unknown codecs and levels are rejected */
+  bp_options_init(&options);
+  options.codec = 0x7f;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_ECODEC);
+  options.codec = BP_CODEC_NONE;
+  options.codec_level = 0x100;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_ECODEC);
+  options.codec_level = 0;
+  options.codec_min_saving = 101;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_ECODEC);
+
+  assert(bp_open(&db, __db_file) == BP_OK);
+  assert(bp_set_codec(&db, 0x7f, 0) == BP_ECODEC);
+  assert(bp_set_codec(&db, BP_CODEC_NONE, -1) == BP_ECODEC);
+TEST_END("compression codecs test", "codecs")
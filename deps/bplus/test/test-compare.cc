@@ -0,0 +1,187 @@
+#include "test.h"
+
+struct test_key_s {
+  char value[16];
+  uint64_t length;
+};
+
+typedef int (*ref_compare_cb)(const struct test_key_s* a,
+                              const struct test_key_s* b);
+
+
+static int compare_bytes(const struct test_key_s* a,
+                         const struct test_key_s* b) {
+  uint64_t len = a->length < b->length ? a->length : b->length;
+  int cmp = memcmp(a->value, b->value, len);
+
+  if (cmp != 0) return cmp;
+  if (a->length == b->length) return 0;
+  return a->length < b->length ? -1 : 1;
+}
+
+
+static int compare_reverse(const struct test_key_s* a,
+                           const struct test_key_s* b) {
+  return compare_bytes(b, a);
+}
+
+
+static int compare_uint(const struct test_key_s* a,
+                        const struct test_key_s* b) {
+  uint64_t i = 0, j = 0;
+
+  while (i < a->length && a->value[i] == 0) i++;
+  while (j < b->length && b->value[j] == 0) j++;
+  if (a->length - i != b->length - j) {
+    return a->length - i < b->length - j ? -1 : 1;
+  }
+  return memcmp(a->value + i, b->value + j, a->length - i);
+}
+
+
+/* length first, then bytes */
+static int compare_length(const struct test_key_s* a,
+                          const struct test_key_s* b) {
+  if (a->length != b->length) return a->length < b->length ? -1 : 1;
+  return memcmp(a->value, b->value, a->length);
+}
+
+
+static int custom_compare_cb(const bp_key_t* a, const bp_key_t* b) {
+  struct test_key_s ka, kb;
+
+  ka.length = a->length;
+  kb.length = b->length;
+  memcpy(ka.value, a->value, a->length);
+  memcpy(kb.value, b->value, b->length);
+
+  return compare_length(&ka, &kb);
+}
+
+
+static ref_compare_cb qsort_compare;
+
+
+static int qsort_cb(const void* a, const void* b) {
+  return qsort_compare((const struct test_key_s*) a,
+                       (const struct test_key_s*) b);
+}
+
+
+void check_order(bp_db_t* db, ref_compare_cb compare, const int n) {
+  struct test_key_s* keys;
+  struct test_key_s found;
+  bp_key_t key;
+  bp_value_t value;
+  bp_cursor_t cursor;
+  int i, j, unique;
+
+  keys = (struct test_key_s*) calloc(n, sizeof(*keys));
+  srand(42);
+  for (i = 0; i < n; i++) {
+    keys[i].length = 1 + rand() % 12;
+    for (j = 0; j < (int) keys[i].length; j++) {
+      switch (rand() % 4) {
+        case 0: keys[i].value[j] = 0; break;
+        case 1: keys[i].value[j] = (char) 0xff; break;
+        case 2: keys[i].value[j] = (char) (0x80 + rand() % 2); break;
+        default: keys[i].value[j] = 'a' + rand() % 2; break;
+      }
+    }
+
+    key.value = keys[i].value;
+    key.length = keys[i].length;
+    assert(bp_set(db, &key, &key) == BP_OK);
+  }
+
+  qsort_compare = compare;
+  qsort(keys, n, sizeof(*keys), qsort_cb);
+
+  unique = 0;
+  for (i = 0; i < n; i++) {
+    if (i > 0 && compare(&keys[unique - 1], &keys[i]) == 0) continue;
+    keys[unique++] = keys[i];
+  }
+
+  for (i = 0; i < unique; i++) {
+    key.value = keys[i].value;
+    key.length = keys[i].length;
+    assert(bp_get(db, &key, &value) == BP_OK);
+    free(value.value);
+  }
+
+  /* keys should come out in order of comparator */
+  assert(bp_cursor_open(db, NULL, NULL, NULL, &cursor) == BP_OK);
+  for (i = 0; i < unique; i++) {
+    assert(bp_cursor_next(db, &cursor, &key, &value) == BP_OK);
+
+    found.length = key.length;
+    memcpy(found.value, key.value, key.length);
+    assert(compare(&found, &keys[i]) == 0);
+
+    free(key.value);
+    free(value.value);
+  }
+  assert(bp_cursor_next(db, &cursor, &key, &value) == BP_ENOTFOUND);
+  assert(bp_cursor_close(db, &cursor) == BP_OK);
+
+  free(keys);
+}
+
+
+TEST_START("comparators test", "compare")
+  const int n = 3000;
+  bp_options_t options;
+  bp_db_t db2;
+  bp_key_t key;
+  bp_value_t value;
+
+  /* default comparator */
+  check_order(&db, compare_bytes, n);
+  assert(bp_close(&db) == BP_OK);
+
+  /* custom one */
+  unlink(__db_file);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  bp_set_compare_cb(&db, custom_compare_cb);
+  check_order(&db, compare_length, n);
+  assert(bp_close(&db) == BP_OK);
+
+  /* built-in comparators are stored in database */
+  bp_options_init(&options);
+
+  options.compare = BP_COMPARE_REVERSE;
+  unlink(__db_file);
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+  check_order(&db, compare_reverse, n);
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  check_order(&db, compare_reverse, n);
+  assert(bp_compact(&db) == BP_OK);
+  check_order(&db, compare_reverse, n);
+  assert(bp_close(&db) == BP_OK);
+
+  options.compare = BP_COMPARE_UINT;
+  unlink(__db_file);
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+  check_order(&db, compare_uint, n);
+
+  /* leading zeroes are ignored */
+  key.value = (char*) "\x01";
+  key.length = 1;
+  assert(bp_set(&db, &key, &key) == BP_OK);
+  key.value = (char*) "\0\0\x01";
+  key.length = 3;
+  assert(bp_get(&db, &key, &value) == BP_OK);
+  assert(value.length == 1 && value.value[0] == 1);
+  free(value.value);
+  assert(bp_remove(&db, &key) == BP_OK);
+  assert(bp_close(&db) == BP_OK);
+
+  assert(bp_open(&db, __db_file) == BP_OK);
+  check_order(&db, compare_uint, n);
+
+  /* unknown comparator */
+  options.compare = 0x7f;
+  assert(bp_open_opts(&db2, __db_file, &options) == BP_ECOMPARE);
+TEST_END("comparators test", "compare")
@@ -0,0 +1,140 @@
+#include "test.h"
+
+static void encode_key(uint64_t num, char* key) {
+  int i;
+
+  /* big-endian */
+  for (i = 7; i >= 0; i--) {
+    key[i] = (char) (num & 0xff);
+    num >>= 8;
+  }
+}
+
+
+static uint64_t decode_key(const char* key) {
+  uint64_t num = 0;
+  int i;
+
+  for (i = 0; i < 8; i++) {
+    num = (num << 8) | (uint8_t) key[i];
+  }
+  return num;
+}
+
+
+static uint64_t key_num(const int i) {
+  /* spread keys over whole range, including ones with highest bit set */
+  return (uint64_t) i * 0x9e3779b97f4a7c15ULL;
+}
+
+
+void check_int_db(bp_db_t* db, const int n) {
+  char kbuff[8];
+  bp_key_t key;
+  bp_value_t value;
+  bp_cursor_t cursor;
+  uint64_t last;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    encode_key(key_num(i), kbuff);
+    key.value = kbuff;
+    key.length = sizeof(kbuff);
+    assert(bp_get(db, &key, &value) == BP_OK);
+    assert(value.length == sizeof(i));
+    assert(memcmp(value.value, &i, sizeof(i)) == 0);
+    free(value.value);
+  }
+
+  /* missing keys */
+  encode_key(key_num(n) + 1, kbuff);
+  assert(bp_get(db, &key, &value) == BP_ENOTFOUND);
+  encode_key(0xffffffffffffffffULL, kbuff);
+  assert(bp_get(db, &key, &value) == BP_ENOTFOUND);
+
+  /* keys are ordered numerically */
+  assert(bp_cursor_open(db, NULL, NULL, NULL, &cursor) == BP_OK);
+  last = 0;
+  for (i = 0; i < n; i++) {
+    assert(bp_cursor_next(db, &cursor, &key, &value) == BP_OK);
+    assert(key.length == 8);
+    assert(i == 0 || decode_key(key.value) > last);
+    last = decode_key(key.value);
+    free(key.value);
+    free(value.value);
+  }
+  assert(bp_cursor_next(db, &cursor, &key, &value) == BP_ENOTFOUND);
+  assert(bp_cursor_close(db, &cursor) == BP_OK);
+}
+
+
+TEST_START("uint64 keys test", "intkeys")
+  const int n = 20000;
+  char kbuff[8];
+  char skey[32];
+  char* result;
+  bp_key_t key;
+  bp_value_t value;
+  bp_options_t options;
+  int i;
+
+  /* reopen with integer keys */
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+
+  bp_options_init(&options);
+  options.key_mode = BP_KEY_UINT64;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+
+  for (i = 0; i < n; i++) {
+    encode_key(key_num(i), kbuff);
+    key.value = kbuff;
+    key.length = sizeof(kbuff);
+    value.value = (char*) &i;
+    value.length = sizeof(i);
+    assert(bp_set(&db, &key, &value) == BP_OK);
+  }
+  check_int_db(&db, n);
+
+  /* keys of other size are rejected */
+  assert(bp_sets(&db, "key", "value") == BP_EKEYSIZE);
+  assert(bp_gets(&db, "key", &result) == BP_EKEYSIZE);
+
+  /* mode is stored in database */
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  check_int_db(&db, n);
+  assert(bp_sets(&db, "key", "value") == BP_EKEYSIZE);
+
+  assert(bp_compact(&db) == BP_OK);
+  check_int_db(&db, n);
+  assert(bp_sets(&db, "key", "value") == BP_EKEYSIZE);
+
+  BENCH_START(uint64_read, n)
+  for (i = 0; i < n; i++) {
+    encode_key(key_num(i), kbuff);
+    key.value = kbuff;
+    key.length = sizeof(kbuff);
+    bp_get(&db, &key, &value);
+    free(value.value);
+  }
+  BENCH_END(uint64_read, n)
+
+  /* compare with the same number of string keys */
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  for (i = 0; i < n; i++) {
+    sprintf(skey, "%020llu", (unsigned long long) key_num(i));
+    assert(bp_sets(&db, skey, skey) == BP_OK);
+  }
+  assert(bp_compact(&db) == BP_OK);
+
+  BENCH_START(string_read, n)
+  for (i = 0; i < n; i++) {
+    sprintf(skey, "%020llu", (unsigned long long) key_num(i));
+    bp_gets(&db, skey, &result);
+    free(result);
+  }
+  BENCH_END(string_read, n)
+TEST_END("uint64 keys test", "intkeys")
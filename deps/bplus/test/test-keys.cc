@@ -0,0 +1,120 @@
+#include "test.h"
+
+struct test_key_s {
+  char value[16];
+  uint64_t length;
+};
+
+static int compare_keys(const void* a, const void* b) {
+  const struct test_key_s* ka = (const struct test_key_s*) a;
+  const struct test_key_s* kb = (const struct test_key_s*) b;
+  uint64_t len = ka->length < kb->length ? ka->length : kb->length;
+  int cmp = memcmp(ka->value, kb->value, len);
+
+  if (cmp != 0) return cmp;
+  if (ka->length == kb->length) return 0;
+  return ka->length < kb->length ? -1 : 1;
+}
+
+void range_cb(void* arg, const bp_key_t* key, const bp_value_t* value) {
+  assert(strcmp(key->value, value->value) == 0);
+  (*(int*) arg)++;
+}
+
+TEST_START("binary keys test", "keys")
+  const int n = 3000;
+  struct test_key_s* keys;
+  bp_key_t key;
+  bp_value_t value;
+  bp_cursor_t cursor;
+  int i, j, unique;
+
+  /*
+   * Short keys, keys with zero and high bytes, keys sharing
+   * first 8 bytes and differing only in length
+   */
+  keys = (struct test_key_s*) calloc(n, sizeof(*keys));
+  srand(42);
+  for (i = 0; i < n; i++) {
+    keys[i].length = 1 + rand() % 12;
+    for (j = 0; j < (int) keys[i].length; j++) {
+      switch (rand() % 4) {
+        case 0: keys[i].value[j] = 0; break;
+        case 1: keys[i].value[j] = (char) 0xff; break;
+        case 2: keys[i].value[j] = (char) (0x80 + rand() % 2); break;
+        default: keys[i].value[j] = 'a'; break;
+      }
+    }
+  }
+  qsort(keys, n, sizeof(*keys), compare_keys);
+
+  /* insert in reverse order */
+  for (i = n - 1; i >= 0; i--) {
+    key.value = keys[i].value;
+    key.length = keys[i].length;
+    value.value = (char*) &i;
+    value.length = sizeof(i);
+    assert(bp_set(&db, &key, &value) == BP_OK);
+  }
+
+  unique = 0;
+  for (i = 0; i < n; i++) {
+    if (i > 0 && compare_keys(&keys[i - 1], &keys[i]) == 0) continue;
+    keys[unique++] = keys[i];
+  }
+
+  for (i = 0; i < unique; i++) {
+    key.value = keys[i].value;
+    key.length = keys[i].length;
+    assert(bp_get(&db, &key, &value) == BP_OK);
+    free(value.value);
+  }
+
+  /* keys should come out in the same order */
+  assert(bp_cursor_open(&db, NULL, NULL, NULL, &cursor) == BP_OK);
+  for (i = 0; i < unique; i++) {
+    assert(bp_cursor_next(&db, &cursor, &key, &value) == BP_OK);
+    assert(key.length == keys[i].length);
+    assert(memcmp(key.value, keys[i].value, key.length) == 0);
+    free(key.value);
+    free(value.value);
+  }
+  assert(bp_cursor_next(&db, &cursor, &key, &value) == BP_ENOTFOUND);
+  assert(bp_cursor_close(&db, &cursor) == BP_OK);
+
+  free(keys);
+
+  /* long keys sharing most of their bytes */
+  {
+    char lkey[300];
+    char* result;
+    int matched;
+
+    for (i = 0; i < n; i++) {
+      sprintf(lkey,
+              "http://example.com/some/very/long/path/%d/"
+              "with/even/longer/tail/that/does/not/matter",
+              (i * 7919) % n);
+      assert(bp_sets(&db, lkey, lkey) == BP_OK);
+    }
+
+    for (i = 0; i < n; i++) {
+      sprintf(lkey,
+              "http://example.com/some/very/long/path/%d/"
+              "with/even/longer/tail/that/does/not/matter",
+              i);
+      assert(bp_gets(&db, lkey, &result) == BP_OK);
+      assert(strcmp(result, lkey) == 0);
+      free(result);
+    }
+
+    /* separators shouldn't cut off keys from range */
+    matched = 0;
+    assert(bp_get_ranges(&db,
+                         "http://example.com/some/very/long/path/1",
+                         "http://example.com/some/very/long/path/2",
+                         range_cb,
+                         &matched) == BP_OK);
+    assert(matched == 1111);
+  }
+TEST_END("binary keys test", "keys")
@@ -0,0 +1,289 @@
+#include "test.h"
+
+/*
+ * Database with 8 keys (`legacy 000` ... `legacy 007`) written and compacted
+ * by library before front-coded leaves: head flags are zero, leaf keeps
+ * fixed 24-byte kv layout and blocks are compressed with snappy without
+ * codec tags. Records are aligned to 64 bytes.
+ */
+const int legacy_count = 8;
+const char legacy_value_prefix[] = "\x1b\x00\x00\x3a\x01\x00\x28";
+const char legacy_leaf[] =
+  "\x98\x02\x00\x00\x09\x01\x00\x0b\x09\x07\x04\x00"
+  "\x40\x0d\x08\x28\x12\x6c\x65\x67\x61\x63\x79\x20"
+  "\x30\x30\x30\x0d\x12\x15\x23\x00\x80\x0d\x11\x19"
+  "\x23\x00\x31\x0d\x12\x15\x23\x00\xc0\x0d\x11\x19"
+  "\x23\x00\x32\x0d\x12\x11\x23\x00\x01\x11\x10\x19"
+  "\x23\x00\x33\x11\x13\x0d\x8c\x00\x01\x46\x8c\x00"
+  "\x00\x34\x3e\x23\x00\x00\x80\x0d\x11\x19\x46\x00"
+  "\x35\x0d\x12\x15\x46\x46\x8c\x00\x00\x36\x3a\x23"
+  "\x00\x00\x02\x11\x10\x2c\x12\x6c\x65\x67\x61\x63"
+  "\x79\x20\x30\x30\x37\x00";
+const char legacy_first_head[] =
+  "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+  "\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00\x00\x40"
+  "\xca\xa3\xca\xa3\xca\xa3\xca\xa3";
+const char legacy_head[] =
+  "\x00\x00\x00\x00\x00\x00\x02\x40\x00\x00\x00\x00"
+  "\x00\x00\x00\xe5\x00\x00\x00\x00\x00\x00\x00\x40"
+  "\xca\xa3\xca\xa3\x67\x1e\x4e\x2a";
+
+
+void write_legacy(const char* name) {
+  char record[64];
+  int fd, i;
+
+  fd = open(name, O_RDWR | O_CREAT | O_TRUNC, S_IWUSR | S_IRUSR);
+  assert(fd != -1);
+
+  memset(record, 0, sizeof(record));
+  memcpy(record, legacy_first_head, sizeof(legacy_first_head) - 1);
+  assert(write(fd, record, sizeof(record)) == sizeof(record));
+
+  /* values */
+  for (i = 0; i < legacy_count; i++) {
+    memset(record, 0, sizeof(record));
+    memcpy(record, legacy_value_prefix, sizeof(legacy_value_prefix) - 1);
+    sprintf(record + sizeof(legacy_value_prefix) - 1, "legacy %03d", i);
+    assert(write(fd, record, sizeof(record)) == sizeof(record));
+  }
+
+  /* leaf (two records) and head */
+  memset(record, 0, sizeof(record));
+  memcpy(record, legacy_leaf, sizeof(record));
+  assert(write(fd, record, sizeof(record)) == sizeof(record));
+  memset(record, 0, sizeof(record));
+  memcpy(record,
+         legacy_leaf + sizeof(record),
+         sizeof(legacy_leaf) - 1 - sizeof(record));
+  assert(write(fd, record, sizeof(record)) == sizeof(record));
+
+  memset(record, 0, sizeof(record));
+  memcpy(record, legacy_head, sizeof(legacy_head) - 1);
+  assert(write(fd, record, sizeof(record)) == sizeof(record));
+
+  assert(close(fd) == 0);
+}
+
+
+void check_legacy(bp_db_t* db, const int count) {
+  char key[100];
+  char* result;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    sprintf(key, "legacy %03d", i);
+
+    /* removed */
+    if (i == 100) {
+      assert(bp_gets(db, key, &result) == BP_ENOTFOUND);
+      continue;
+    }
+    assert(bp_gets(db, key, &result) == BP_OK);
+    assert(strcmp(result, key) == 0);
+    free(result);
+  }
+}
+
+
+void range_cb(void* arg, const bp_key_t* key, const bp_value_t* value) {
+  (*(int*) arg)++;
+}
+
+
+TEST_START("front-coded leaf test", "leaf")
+  const int n = 1000;
+  const char* prefix = "http://example.com/some/long/shared/prefix/of/key/";
+  char key[200];
+  char name[256];
+  char vlog_name[256];
+  char* result;
+  char original[16];
+  char* corrupted;
+  int i, fd, matched, round, patch;
+  off_t size, offset;
+  bp_key_t bkey;
+  bp_value_t bvalue;
+  bp_value_t empty_value;
+  bp_cursor_t cursor;
+  bp_db_t cdb;
+  bp_options_t options;
+
+  /*
+   * Leaves hold up to 64 keys with restart point every 16 entries:
+   * every key is looked up (at restart points and between them),
+   * then keys that fall between stored ones
+   */
+  for (i = 0; i < n; i++) {
+    sprintf(key, "%s%05d", prefix, (i * 7919) % n);
+    assert(bp_sets(&db, key, key) == BP_OK);
+  }
+
+  for (round = 0; round < 2; round++) {
+    for (i = 0; i < n; i++) {
+      sprintf(key, "%s%05d", prefix, i);
+      assert(bp_gets(&db, key, &result) == BP_OK);
+      assert(strcmp(result, key) == 0);
+      free(result);
+
+      sprintf(key, "%s%05d-", prefix, i);
+      assert(bp_gets(&db, key, &result) == BP_ENOTFOUND);
+    }
+    assert(bp_gets(&db, "http://example.com/", &result) == BP_ENOTFOUND);
+    assert(bp_gets(&db, "http://example.com/t", &result) == BP_ENOTFOUND);
+
+    /* compaction writes full leaves */
+    assert(bp_compact(&db) == BP_OK);
+  }
+
+  /* empty key is the first one */
+  bkey.value = NULL;
+  bkey.length = 0;
+  bvalue.value = (char*) "empty";
+  bvalue.length = 6;
+  assert(bp_set(&db, &bkey, &bvalue) == BP_OK);
+  assert(bp_get(&db, &bkey, &empty_value) == BP_OK);
+  assert(strcmp(empty_value.value, "empty") == 0);
+  free(empty_value.value);
+
+  assert(bp_cursor_open(&db, NULL, NULL, NULL, &cursor) == BP_OK);
+  assert(bp_cursor_next(&db, &cursor, &bkey, &bvalue) == BP_OK);
+  assert(bkey.length == 0);
+  assert(strcmp(bvalue.value, "empty") == 0);
+  free(bkey.value);
+  free(bvalue.value);
+  assert(bp_cursor_next(&db, &cursor, &bkey, &bvalue) == BP_OK);
+  sprintf(key, "%s%05d", prefix, 0);
+  assert(strcmp(bkey.value, key) == 0);
+  free(bkey.value);
+  free(bvalue.value);
+  assert(bp_cursor_close(&db, &cursor) == BP_OK);
+
+  bkey.value = NULL;
+  bkey.length = 0;
+
+  assert(bp_remove(&db, &bkey) == BP_OK);
+  assert(bp_get(&db, &bkey, &empty_value) == BP_ENOTFOUND);
+
+  /*
+   * Corrupted leaf: entry following restart point is patched to have
+   * suffix running past the end of leaf, then to have malformed varint
+   */
+  sprintf(name, "%s.corrupt", __db_file);
+  sprintf(vlog_name, "%s.00.vlog", name);
+  unlink(name);
+  unlink(vlog_name);
+
+  bp_options_init(&options);
+  options.codec = BP_CODEC_NONE;
+  options.alignment = 1;
+  options.value_log = 1;
+  assert(bp_open_opts(&cdb, name, &options) == BP_OK);
+  for (i = 0; i < n; i++) {
+    sprintf(key, "leaf key %05d", i);
+    assert(bp_sets(&cdb, key, "v") == BP_OK);
+  }
+  assert(bp_compact(&cdb) == BP_OK);
+  assert(bp_close(&cdb) == BP_OK);
+
+  /* only restart point stores whole key */
+  fd = open(name, O_RDWR);
+  assert(fd != -1);
+  size = lseek(fd, 0, SEEK_END);
+  assert(size > 0);
+  corrupted = (char*) malloc(size);
+  assert(pread(fd, corrupted, size, 0) == size);
+
+  offset = -1;
+  for (i = 0; i + 15 <= size; i++) {
+    if (memcmp(corrupted + i, "leaf key 00016", 15) == 0) {
+      assert(offset == -1);
+      offset = i + 15;
+    }
+  }
+  assert(offset != -1);
+  memcpy(original, corrupted + offset, sizeof(original));
+
+  for (patch = 0; patch < 2; patch++) {
+    if (patch == 0) {
+      /* shared and unshared lengths of the next key are one byte each */
+      memcpy(corrupted + offset + 1, "\xff\xff\x03", 3);
+    } else {
+      memset(corrupted + offset, 0xff, sizeof(original));
+    }
+    assert(pwrite(fd, corrupted + offset, sizeof(original), offset) ==
+           sizeof(original));
+
+    assert(bp_open_opts(&cdb, name, &options) == BP_OK);
+
+    /* keys before corrupted entry are still found */
+    assert(bp_gets(&cdb, "leaf key 00015", &result) == BP_OK);
+    free(result);
+    assert(bp_gets(&cdb, "leaf key 00016", &result) == BP_OK);
+    free(result);
+    assert(bp_gets(&cdb, "leaf key 00017", &result) == BP_EDECOMP);
+    assert(bp_gets(&cdb, "leaf key 00018", &result) == BP_EDECOMP);
+
+    /* whole leaf is decoded by range and update */
+    matched = 0;
+    assert(bp_get_ranges(&cdb,
+                         "leaf key 00000",
+                         "leaf key 00999",
+                         range_cb,
+                         &matched) == BP_EDECOMP);
+    assert(bp_sets(&cdb, "leaf key 00017", "v") == BP_EDECOMP);
+
+    assert(bp_close(&cdb) == BP_OK);
+
+    memcpy(corrupted + offset, original, sizeof(original));
+    assert(pwrite(fd, original, sizeof(original), offset) ==
+           sizeof(original));
+  }
+  free(corrupted);
+  assert(close(fd) == 0);
+
+  assert(bp_open_opts(&cdb, name, &options) == BP_OK);
+  assert(bp_gets(&cdb, "leaf key 00017", &result) == BP_OK);
+  free(result);
+  assert(bp_close(&cdb) == BP_OK);
+  unlink(name);
+  unlink(vlog_name);
+
+  /* legacy blocks are snappy-compressed, skip if it wasn't compiled in */
+  sprintf(name, "%s.legacy", __db_file);
+  unlink(name);
+  options.codec = BP_CODEC_SNAPPY;
+  if (bp_open_opts(&cdb, name, &options) == BP_OK) {
+    assert(bp_close(&cdb) == BP_OK);
+
+    /* fixed kv layout is read and written until compaction */
+    write_legacy(name);
+    assert(bp_open(&cdb, name) == BP_OK);
+    check_legacy(&cdb, legacy_count);
+
+    for (i = legacy_count; i < 200; i++) {
+      sprintf(key, "legacy %03d", i);
+      assert(bp_sets(&cdb, key, key) == BP_OK);
+    }
+    assert(bp_removes(&cdb, "legacy 100") == BP_OK);
+    check_legacy(&cdb, 200);
+
+    assert(bp_close(&cdb) == BP_OK);
+    assert(bp_open(&cdb, name) == BP_OK);
+    check_legacy(&cdb, 200);
+
+    assert(bp_compact(&cdb) == BP_OK);
+    check_legacy(&cdb, 200);
+    assert(bp_close(&cdb) == BP_OK);
+
+    assert(bp_open(&cdb, name) == BP_OK);
+    check_legacy(&cdb, 200);
+    for (i = 200; i < 300; i++) {
+      sprintf(key, "legacy %03d", i);
+      assert(bp_sets(&cdb, key, key) == BP_OK);
+    }
+    check_legacy(&cdb, 300);
+    assert(bp_close(&cdb) == BP_OK);
+  }
+  unlink(name);
+TEST_END("front-coded leaf test", "leaf")
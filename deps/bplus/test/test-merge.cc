@@ -0,0 +1,148 @@
+#include "test.h"
+
+
+void make_int(bp_value_t* value, char* buff, const int64_t number) {
+  uint64_t n;
+  int i;
+
+  /* big-endian */
+  n = (uint64_t) number;
+  for (i = 7; i >= 0; i--) {
+    buff[i] = (char) (n & 0xff);
+    n >>= 8;
+  }
+  value->value = buff;
+  value->length = 8;
+}
+
+
+int64_t read_int(const char* buff) {
+  uint64_t n;
+  int i;
+
+  n = 0;
+  for (i = 0; i < 8; i++) n = (n << 8) | (unsigned char) buff[i];
+  return (int64_t) n;
+}
+
+
+void merge_int(bp_db_t* db, const char* key, const int op, const int64_t n) {
+  bp_key_t bkey;
+  bp_value_t value;
+  char buff[8];
+
+  BP__STOVAL(key, bkey);
+  make_int(&value, buff, n);
+  assert(bp_merge(db, &bkey, op, &value) == BP_OK);
+}
+
+
+void check_int(bp_db_t* db, const char* key, const int64_t expected) {
+  bp_key_t bkey;
+  bp_value_t value;
+
+  BP__STOVAL(key, bkey);
+  assert(bp_get(db, &bkey, &value) == BP_OK);
+  assert(value.length == 8);
+  assert(read_int(value.value) == expected);
+  free(value.value);
+}
+
+
+/* add ids from `from` to `to` (in reverse order) */
+void merge_ids(bp_db_t* db, const int from, const int to) {
+  bp_key_t key;
+  bp_value_t value;
+  char* buff;
+  int i;
+
+  buff = (char*) malloc((to - from + 1) * 8);
+  for (i = to; i >= from; i--) make_int(&value, buff + (to - i) * 8, i);
+  value.value = buff;
+  value.length = (to - from + 1) * 8;
+
+  BP__STOVAL("set", key);
+  assert(bp_merge(db, &key, BP_MERGE_UNION, &value) == BP_OK);
+  free(buff);
+}
+
+
+TEST_START("merge operators test", "merge")
+  const int count = 1000;
+  bp_options_t options;
+  bp_key_t key;
+  bp_value_t value;
+  char buff[8];
+  int i;
+
+  /* counters */
+  for (i = 1; i <= count; i++) merge_int(&db, "counter", BP_MERGE_ADD, i);
+  check_int(&db, "counter", count * (count + 1) / 2);
+  merge_int(&db, "counter", BP_MERGE_ADD, -count * (count + 1));
+  check_int(&db, "counter", -count * (count + 1) / 2);
+
+  /* max and min */
+  for (i = 0; i < count; i++) {
+    merge_int(&db, "max", BP_MERGE_MAX, (i * 37) % count - 500);
+    merge_int(&db, "min", BP_MERGE_MIN, (i * 37) % count - 500);
+  }
+  check_int(&db, "max", count - 501);
+  check_int(&db, "min", -500);
+
+  /* append */
+  BP__STOVAL("log", key);
+  for (i = 0; i < 3; i++) {
+    BP__STOVAL("abc", value);
+    value.length = 3;
+    assert(bp_merge(&db, &key, BP_MERGE_APPEND, &value) == BP_OK);
+  }
+  assert(bp_get(&db, &key, &value) == BP_OK);
+  assert(value.length == 9);
+  assert(memcmp(value.value, "abcabcabc", 9) == 0);
+  free(value.value);
+
+  /* set union keeps ids sorted and unique */
+  merge_ids(&db, 100, 200);
+  merge_ids(&db, 50, 150);
+  merge_ids(&db, 300, 300);
+  merge_ids(&db, 120, 130);
+  BP__STOVAL("set", key);
+  assert(bp_get(&db, &key, &value) == BP_OK);
+  assert(value.length == 152 * 8);
+  for (i = 0; i < 151; i++) assert(read_int(value.value + i * 8) == 50 + i);
+  assert(read_int(value.value + 151 * 8) == 300);
+  free(value.value);
+
+  /* values of wrong size and unknown operators are rejected */
+  BP__STOVAL("log", key);
+  make_int(&value, buff, 1);
+  assert(bp_merge(&db, &key, BP_MERGE_ADD, &value) == BP_EMERGE);
+  assert(bp_merge(&db, &key, BP_MERGE_UNION, &value) == BP_EMERGE);
+  BP__STOVAL("counter", key);
+  assert(bp_merge(&db, &key, 100, &value) == BP_EMERGE);
+  BP__STOVAL("abc", value);
+  assert(bp_merge(&db, &key, BP_MERGE_MAX, &value) == BP_EMERGE);
+  check_int(&db, "counter", -count * (count + 1) / 2);
+
+  /* merged values are persisted */
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  check_int(&db, "counter", -count * (count + 1) / 2);
+  check_int(&db, "max", count - 501);
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+
+  /* expiry time is kept, expired value is missing */
+  bp_options_init(&options);
+  options.expiry = 1;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+  BP__STOVAL("session", key);
+  make_int(&value, buff, 10);
+  assert(bp_set_ttl(&db, &key, &value, 1) == BP_OK);
+  merge_int(&db, "session", BP_MERGE_ADD, 5);
+  check_int(&db, "session", 15);
+  sleep(2);
+  assert(bp_get(&db, &key, &value) == BP_ENOTFOUND);
+  merge_int(&db, "session", BP_MERGE_ADD, 5);
+  check_int(&db, "session", 5);
+TEST_END("merge operators test", "merge")
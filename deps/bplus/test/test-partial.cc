@@ -0,0 +1,75 @@
+#include "test.h"
+
+
+void fill(char* data, const uint64_t length) {
+  uint64_t i;
+
+  for (i = 0; i < length; i++) data[i] = (char) ((i % 251) * 7 + i / 4096);
+}
+
+
+void check_partial(bp_db_t* db,
+                   const char* key,
+                   const char* expected,
+                   const uint64_t total,
+                   const uint64_t offset,
+                   const uint64_t length) {
+  bp_key_t bkey;
+  bp_value_t value;
+  uint64_t size;
+
+  size = offset < total ? total - offset : 0;
+  if (size > length) size = length;
+
+  BP__STOVAL(key, bkey);
+  assert(bp_get_partial(db, &bkey, offset, length, &value) == BP_OK);
+  assert(value.length == size);
+  assert(memcmp(value.value, expected + offset, size) == 0);
+  free(value.value);
+}
+
+
+TEST_START("partial reads test", "partial")
+  const uint64_t large = 100000;
+  bp_options_t options;
+  bp_key_t key;
+  bp_value_t value;
+  char* expected;
+
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+
+  bp_options_init(&options);
+  options.chunk_size = 4096;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+
+  expected = (char*) malloc(large);
+  fill(expected, large);
+  BP__STOVAL("large", key);
+  value.value = expected;
+  value.length = large;
+  assert(bp_set(&db, &key, &value) == BP_OK);
+  value.length = 1000;
+  BP__STOVAL("small", key);
+  assert(bp_set(&db, &key, &value) == BP_OK);
+
+  /* ranges inside of one chunk, across chunks and at the end of value */
+  check_partial(&db, "large", expected, large, 0, 300);
+  check_partial(&db, "large", expected, large, 4000, 200);
+  check_partial(&db, "large", expected, large, 8192, 4096);
+  check_partial(&db, "large", expected, large, 5000, 30000);
+  check_partial(&db, "large", expected, large, large - 10, 100);
+  check_partial(&db, "large", expected, large, large, 100);
+  check_partial(&db, "large", expected, large, large * 2, 100);
+  check_partial(&db, "large", expected, large, 0, large * 2);
+
+  /* values that aren't chunked are sliced */
+  check_partial(&db, "small", expected, 1000, 0, 10);
+  check_partial(&db, "small", expected, 1000, 990, 100);
+  check_partial(&db, "small", expected, 1000, 2000, 100);
+
+  BP__STOVAL("unknown", key);
+  assert(bp_get_partial(&db, &key, 0, 10, &value) == BP_ENOTFOUND);
+
+  free(expected);
+TEST_END("partial reads test", "partial")
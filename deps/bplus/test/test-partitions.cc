@@ -0,0 +1,186 @@
+#include "test.h"
+
+void range_cb(void* last, const bp_key_t* key, const bp_value_t* value) {
+  int* index = (int*) last;
+  int current;
+
+  assert(sscanf(key->value, "key %04d", &current) == 1);
+  assert(current > *index);
+  *index = current;
+}
+
+
+void unlink_partitions(const char* prefix, int count) {
+  char name[256];
+  int i;
+
+  for (i = 0; i < count; i++) {
+    sprintf(name, "%s.%d", prefix, i);
+    unlink(name);
+  }
+  sprintf(name, "%s.meta", prefix);
+  unlink(name);
+}
+
+
+void check_partitioned(bp_pdb_t* pdb, const int n) {
+  char key[100];
+  char val[100];
+  char* result;
+  int i, last;
+  bp_pdb_cursor_t cursor;
+  bp_key_t ckey;
+  bp_value_t cvalue;
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key %04d", i);
+    sprintf(val, "value %04d", i);
+    assert(bp_pdb_gets(pdb, key, &result) == BP_OK);
+    assert(strcmp(result, val) == 0);
+    free(result);
+  }
+
+  /* merged cursor should return keys from all partitions in order */
+  assert(bp_pdb_cursor_open(pdb, NULL, NULL, &cursor) == BP_OK);
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key %04d", i);
+
+    assert(bp_pdb_cursor_next(&cursor, &ckey, &cvalue) == BP_OK);
+    assert(strcmp(ckey.value, key) == 0);
+
+    free(ckey.value);
+    free(cvalue.value);
+  }
+  assert(bp_pdb_cursor_next(&cursor, &ckey, &cvalue) == BP_ENOTFOUND);
+  assert(bp_pdb_cursor_close(&cursor) == BP_OK);
+
+  last = 99;
+  assert(bp_pdb_get_ranges(pdb,
+                           "key 0100",
+                           "key 0199",
+                           range_cb,
+                           &last) == BP_OK);
+  assert(last == 199);
+}
+
+
+TEST_START("partitions test", "partitions")
+  const int n = 1000;
+  const int count = 4;
+  char key[100];
+  char val[100];
+  char* result;
+  int i;
+  bp_pdb_t pdb;
+  bp_key_t bounds[3];
+  bp_key_t* keys;
+  bp_value_t* values;
+
+  unlink_partitions(__db_file, count);
+
+  /* hash partitioned */
+  assert(bp_pdb_open(&pdb, __db_file, count) == BP_OK);
+  for (i = 0; i < n / 2; i++) {
+    sprintf(key, "key %04d", i);
+    sprintf(val, "value %04d", i);
+    assert(bp_pdb_sets(&pdb, key, val) == BP_OK);
+  }
+
+  /* bulk insert spans all partitions */
+  keys = (bp_key_t*) malloc(sizeof(*keys) * (n - n / 2));
+  values = (bp_value_t*) malloc(sizeof(*values) * (n - n / 2));
+  for (i = n / 2; i < n; i++) {
+    keys[i - n / 2].value = (char*) malloc(100);
+    values[i - n / 2].value = (char*) malloc(100);
+    sprintf(keys[i - n / 2].value, "key %04d", i);
+    sprintf(values[i - n / 2].value, "value %04d", i);
+    keys[i - n / 2].length = strlen(keys[i - n / 2].value) + 1;
+    values[i - n / 2].length = strlen(values[i - n / 2].value) + 1;
+  }
+  assert(bp_pdb_bulk_set(&pdb,
+                         n - n / 2,
+                         (const bp_key_t**) &keys,
+                         (const bp_value_t**) &values) == BP_OK);
+  for (i = 0; i < n - n / 2; i++) {
+    free(keys[i].value);
+    free(values[i].value);
+  }
+  free(keys);
+  free(values);
+
+  check_partitioned(&pdb, n);
+
+  assert(bp_pdb_compact(&pdb) == BP_OK);
+  assert(bp_pdb_close(&pdb) == BP_OK);
+
+  /* partitioning can't be changed */
+  assert(bp_pdb_open(&pdb, __db_file, count - 1) == BP_EPARTITION);
+  assert(bp_pdb_open(&pdb, __db_file, count + 1) == BP_EPARTITION);
+  sprintf(key, "%s.%d", __db_file, count);
+  assert(access(key, F_OK) != 0);
+
+  /* reopen */
+  assert(bp_pdb_open(&pdb, __db_file, count) == BP_OK);
+  check_partitioned(&pdb, n);
+  assert(bp_pdb_removes(&pdb, "key 0500") == BP_OK);
+  assert(bp_pdb_removes(&pdb, "key 0500") == BP_ENOTFOUND);
+  assert(bp_pdb_close(&pdb) == BP_OK);
+
+  unlink_partitions(__db_file, count);
+
+  /* range partitioned */
+  bounds[0].value = (char*) "key 0250";
+  bounds[1].value = (char*) "key 0500";
+  bounds[2].value = (char*) "key 0750";
+  for (i = 0; i < count - 1; i++) {
+    bounds[i].length = strlen(bounds[i].value) + 1;
+  }
+
+  assert(bp_pdb_open_range(&pdb, __db_file, count, bounds) == BP_OK);
+  for (i = n - 1; i >= 0; i--) {
+    sprintf(key, "key %04d", i);
+    sprintf(val, "value %04d", i);
+    assert(bp_pdb_sets(&pdb, key, val) == BP_OK);
+  }
+  check_partitioned(&pdb, n);
+
+  /* keys are split by bounds */
+  assert(bp_gets(&pdb.trees[0], "key 0249", &result) == BP_OK);
+  free(result);
+  assert(bp_gets(&pdb.trees[1], "key 0250", &result) == BP_OK);
+  free(result);
+  assert(bp_gets(&pdb.trees[0], "key 0250", &result) == BP_ENOTFOUND);
+  assert(bp_gets(&pdb.trees[3], "key 0999", &result) == BP_OK);
+  free(result);
+
+  assert(bp_pdb_close(&pdb) == BP_OK);
+
+  /* bounds and type should match too */
+  assert(bp_pdb_open(&pdb, __db_file, count) == BP_EPARTITION);
+  bounds[1].value = (char*) "key 0600";
+  assert(bp_pdb_open_range(&pdb, __db_file, count, bounds) == BP_EPARTITION);
+  bounds[1].value = (char*) "key 0500";
+  assert(bp_pdb_open_range(&pdb, __db_file, count, bounds) == BP_OK);
+  check_partitioned(&pdb, n);
+  assert(bp_pdb_close(&pdb) == BP_OK);
+  unlink_partitions(__db_file, count);
+
+  /* bounds should be strictly sorted */
+  bounds[1].value = (char*) "key 0250";
+  assert(bp_pdb_open_range(&pdb, __db_file, count, bounds) == BP_EPARTITION);
+  bounds[1].value = (char*) "key 0900";
+  assert(bp_pdb_open_range(&pdb, __db_file, count, bounds) == BP_EPARTITION);
+  unlink_partitions(__db_file, count);
+
+  /* failed open of first or later partition releases everything */
+  bounds[1].value = (char*) "key 0500";
+  for (i = 0; i < count; i += count - 1) {
+    sprintf(key, "%s.%d", __db_file, i);
+    assert(symlink("/nonexistent/partition", key) == 0);
+
+    assert(bp_pdb_open_range(&pdb, __db_file, count, bounds) == BP_EFILE);
+    assert(pdb.trees == NULL && pdb.bounds == NULL);
+
+    unlink_partitions(__db_file, count);
+  }
+TEST_END("partitions test", "partitions")
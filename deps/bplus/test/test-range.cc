@@ -5,6 +5,24 @@ void range_cb(void* matched, const bp_key_t* key, const bp_value_t* value) {
   (*(int*) matched)++;
 }
 
+
+/* stops scan after 100 matched keys */
+int limit_stop(void* matched) {
+  return *(int*) matched == 100;
+}
+
+
+/* any non-zero value is a match */
+int negative_filter(void* arg, const bp_key_t* key) {
+  return -1;
+}
+
+
+/* matches keys with even last byte (before '\0') */
+int even_filter(void* arg, const bp_key_t* key) {
+  return key->length == 7 && (key->value[5] & 1) == 0;
+}
+
 TEST_START("range get test", "range")
   /* write some stuff */
   const int n = 250;
@@ -12,6 +30,8 @@ TEST_START("range get test", "range")
   char key[100];
   char value[100];
   int matched;
+  bp_key_t start;
+  bp_key_t end;
 
   sprintf(key, "key: x");
   sprintf(value, "val: x");
@@ -48,4 +68,44 @@ TEST_START("range get test", "range")
   bp_get_ranges(&db, "key: \x01", "key: \xfa", range_cb, &matched);
 
   assert(matched == 249);
+
+  matched = 0;
+
+  /* filter is applied to keys in all leaf-pages */
+  bp_get_filtered_ranges(&db,
+                         "key: \x01",
+                         "key: \xfa",
+                         even_filter,
+                         range_cb,
+                         &matched);
+
+  assert(matched == 124);
+
+  matched = 0;
+
+  bp_get_filtered_ranges(&db,
+                         "key: \x01",
+                         "key: \xfa",
+                         negative_filter,
+                         range_cb,
+                         &matched);
+
+  assert(matched == 249);
+
+  matched = 0;
+
+  /* scan may be stopped */
+  start.value = (char*) "key: \x01";
+  start.length = 7;
+  end.value = (char*) "key: \xfa";
+  end.length = 7;
+  assert(bp_get_stoppable_range(&db,
+                                &start,
+                                &end,
+                                negative_filter,
+                                limit_stop,
+                                range_cb,
+                                &matched) == BP_OK);
+
+  assert(matched == 100);
 TEST_END("range get test", "range")
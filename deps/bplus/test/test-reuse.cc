@@ -0,0 +1,321 @@
+#include "test.h"
+
+
+void update(bp_db_t* db, const int from, const int to, const int round) {
+  char key[32];
+  char value[128];
+  int i;
+
+  for (i = from; i < to; i++) {
+    sprintf(key, "key-%08d", i);
+    sprintf(value, "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa", i, round);
+    assert(bp_sets(db, key, value) == BP_OK);
+  }
+}
+
+
+void remove_range(bp_db_t* db, const int from, const int to) {
+  char key[32];
+  int i;
+
+  for (i = from; i < to; i++) {
+    sprintf(key, "key-%08d", i);
+    assert(bp_removes(db, key) == BP_OK);
+  }
+}
+
+
+void check(bp_db_t* db, const int from, const int to, const int round) {
+  char key[32];
+  char expected[128];
+  char* value;
+  int i;
+
+  for (i = from; i < to; i++) {
+    sprintf(key, "key-%08d", i);
+    sprintf(expected, "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa", i, round);
+    assert(bp_gets(db, key, &value) == BP_OK);
+    assert(strcmp(value, expected) == 0);
+    free(value);
+  }
+}
+
+
+/* value may be set in any of two rounds */
+void check_either(bp_db_t* db, const int n, const int a, const int b) {
+  char key[32];
+  char first[128];
+  char second[128];
+  char* value;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key-%08d", i);
+    sprintf(first, "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa", i, a);
+    sprintf(second, "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa", i, b);
+    assert(bp_gets(db, key, &value) == BP_OK);
+    assert(strcmp(value, first) == 0 || strcmp(value, second) == 0);
+    free(value);
+  }
+}
+
+
+struct writer_arg {
+  bp_db_t* db;
+  int n;
+  int round;
+  volatile int done;
+};
+
+
+/* update keys in reverse order, syncing database every 50 writes */
+void* reverse_writer(void* arg_) {
+  struct writer_arg* arg = (struct writer_arg*) arg_;
+  char key[32];
+  char value[128];
+  int i, j;
+
+  for (j = 0; j < 5; j++) {
+    for (i = arg->n - 1; i >= 0; i--) {
+      sprintf(key, "key-%08d", i);
+      sprintf(value,
+              "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa",
+              i,
+              arg->round);
+      assert(bp_sets(arg->db, key, value) == BP_OK);
+      if (i % 50 == 0) assert(bp_fsync(arg->db) == BP_OK);
+    }
+  }
+  arg->done = 1;
+
+  return NULL;
+}
+
+
+void check_snapshot(bp_db_t* db,
+                    bp_snapshot_t* snapshot,
+                    const int n,
+                    const int round) {
+  char key[32];
+  char expected[128];
+  char* value;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key-%08d", i);
+    sprintf(expected, "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa", i, round);
+    assert(bp_snapshot_gets(db, snapshot, key, &value) == BP_OK);
+    assert(strcmp(value, expected) == 0);
+    free(value);
+  }
+}
+
+
+uint64_t file_size(const char* file) {
+  struct stat st;
+
+  assert(stat(file, &st) == 0);
+  return st.st_size;
+}
+
+
+/* copy `size` bytes at `offset` of one file into another one */
+void copy_range(const char* from,
+                const char* to,
+                const uint64_t offset,
+                const uint64_t size) {
+  char buff[4096];
+  uint64_t pos;
+  ssize_t len;
+  int in, out;
+
+  in = open(from, O_RDONLY);
+  assert(in != -1);
+  out = open(to, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR);
+  assert(out != -1);
+
+  for (pos = offset; pos < offset + size; pos += len) {
+    len = offset + size - pos < sizeof(buff) ? offset + size - pos :
+                                                sizeof(buff);
+    assert(pread(in, buff, len, pos) == len);
+    assert(pwrite(out, buff, len, pos) == len);
+  }
+
+  assert(close(in) == 0);
+  assert(close(out) == 0);
+}
+
+
+void copy_file(const char* from, const char* to) {
+  unlink(to);
+  copy_range(from, to, 0, file_size(from));
+}
+
+
+/* flip byte at `offset` as if write of it was torn */
+void corrupt(const char* file, const uint64_t offset) {
+  char byte;
+  int fd;
+
+  fd = open(file, O_RDWR);
+  assert(fd != -1);
+  assert(pread(fd, &byte, 1, offset) == 1);
+  byte = ~byte;
+  assert(pwrite(fd, &byte, 1, offset) == 1);
+  assert(close(fd) == 0);
+}
+
+
+void collect_revision(void* arg, const bp_revision_t* revision) {
+  uint64_t* offsets = (uint64_t*) arg;
+
+  if (offsets[0]++ == 0) offsets[1] = revision->offset;
+}
+
+
+uint64_t rounds_size(const char* file, const int reuse, const int n) {
+  bp_db_t db;
+  bp_options_t options;
+  int round;
+
+  bp_options_init(&options);
+  options.reuse_space = reuse;
+
+  unlink(file);
+  assert(bp_open_opts(&db, file, &options) == BP_OK);
+  for (round = 0; round < 10; round++) {
+    update(&db, 0, n, round);
+    assert(bp_fsync(&db) == BP_OK);
+  }
+  check(&db, 0, n, 9);
+  assert(bp_close(&db) == BP_OK);
+
+  return file_size(file);
+}
+
+
+TEST_START("space reuse test", "reuse")
+  const int n = 1000;
+  const char* durable_file = "/tmp/bptest/reuse-durable.bp";
+  const char* crash_file = "/tmp/bptest/reuse-crash.bp";
+
+  /* heads are kept in ring of 64 slots at the start of file */
+  const uint64_t ring_size = 64 * 16 * sizeof(uint64_t);
+  bp_db_t crashed;
+  bp_snapshot_t snapshot;
+  bp_value_t value;
+  bp_key_t key;
+  uint64_t size, reuse_size;
+  uint64_t offsets[2];
+  int round;
+
+  assert(bp_close(&db) == BP_OK);
+
+  /* file of updated database stays near size of live data */
+  reuse_size = rounds_size(__db_file, 1, n);
+  assert(reuse_size * 4 < rounds_size(__db_file, 0, n));
+
+  /* flag and free list are stored in database */
+  reuse_size = rounds_size(__db_file, 1, n);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  check(&db, 0, n, 9);
+  for (round = 10; round < 20; round++) {
+    update(&db, 0, n, round);
+    assert(bp_fsync(&db) == BP_OK);
+  }
+  check(&db, 0, n, 19);
+  assert(file_size(__db_file) < reuse_size * 2);
+
+  /* previous values aren't kept */
+  key.value = (char*) "key-00000000";
+  key.length = strlen(key.value) + 1;
+  assert(bp_get(&db, &key, &value) == BP_OK);
+  assert(bp_get_previous(&db, &value, &value) == BP_ENOTFOUND);
+  free(value.value);
+
+  /* and only the latest revision is kept */
+  offsets[0] = 0;
+  assert(bp_get_revisions(&db, collect_revision, offsets) == BP_OK);
+  assert(offsets[0] == 1);
+  assert(bp_snapshot_open_at(&db, offsets[1], &snapshot) == BP_OK);
+  assert(bp_snapshot_close(&db, &snapshot) == BP_OK);
+  assert(bp_snapshot_open_at(&db, offsets[1] - 1, &snapshot) ==
+         BP_ENOTFOUND);
+
+  /* space referenced by opened snapshot isn't reused */
+  assert(bp_snapshot_open(&db, &snapshot) == BP_OK);
+  for (round = 20; round < 25; round++) {
+    update(&db, 0, n, round);
+    assert(bp_fsync(&db) == BP_OK);
+  }
+  check_snapshot(&db, &snapshot, n, 19);
+  check(&db, 0, n, 24);
+  assert(bp_snapshot_close(&db, &snapshot) == BP_OK);
+  assert(bp_fsync(&db) == BP_OK);
+
+  /* blocks of durable head aren't written over until it's synced again */
+  copy_file(__db_file, durable_file);
+  update(&db, 0, n / 20, 25);
+  copy_file(__db_file, crash_file);
+  copy_range(durable_file, crash_file, 0, ring_size);
+
+  assert(bp_open(&crashed, crash_file) == BP_OK);
+  check(&crashed, 0, n, 24);
+  assert(bp_close(&crashed) == BP_OK);
+
+  /* partially written head is skipped */
+  offsets[0] = 0;
+  assert(bp_get_revisions(&db, collect_revision, offsets) == BP_OK);
+  copy_file(__db_file, crash_file);
+  corrupt(crash_file, offsets[1] + 8);
+
+  assert(bp_open(&crashed, crash_file) == BP_OK);
+  check(&crashed, 0, n / 20 - 1, 25);
+  check(&crashed, n / 20 - 1, n, 24);
+  update(&crashed, 0, n, 27);
+  check(&crashed, 0, n, 27);
+  assert(bp_close(&crashed) == BP_OK);
+  unlink(durable_file);
+  unlink(crash_file);
+
+  /* compaction keeps space reuse */
+  assert(bp_compact(&db) == BP_OK);
+  reuse_size = file_size(__db_file);
+  for (round = 0; round < 10; round++) {
+    update(&db, 0, n, round);
+    assert(bp_fsync(&db) == BP_OK);
+  }
+  check(&db, 0, n, 9);
+  assert(file_size(__db_file) < reuse_size * 4);
+
+  /* removed values release space too */
+  update(&db, n, 2 * n, 0);
+  assert(bp_fsync(&db) == BP_OK);
+  size = file_size(__db_file);
+  for (round = 0; round < 5; round++) {
+    remove_range(&db, n, 2 * n);
+    assert(bp_fsync(&db) == BP_OK);
+    update(&db, n, 2 * n, round);
+    assert(bp_fsync(&db) == BP_OK);
+  }
+  assert(file_size(__db_file) < size + size / 2);
+  check(&db, 0, n, 9);
+
+  /* space read by compaction isn't reused by concurrent writes */
+  struct writer_arg arg;
+  pthread_t writer;
+  char compact_file[256];
+
+  arg.db = &db;
+  arg.n = n;
+  arg.round = 30;
+  arg.done = 0;
+  assert(pthread_create(&writer, NULL, reverse_writer, &arg) == 0);
+  while (!arg.done) assert(bp_compact(&db) == BP_OK);
+  assert(pthread_join(writer, NULL) == 0);
+  check_either(&db, n, 9, 30);
+
+  /* and compacted file is always removed */
+  snprintf(compact_file, sizeof(compact_file), "%s.compact", __db_file);
+  assert(access(compact_file, F_OK) == -1);
+TEST_END("space reuse test", "reuse")
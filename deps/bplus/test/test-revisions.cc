@@ -0,0 +1,72 @@
+#include "test.h"
+
+static bp_revision_t revisions[1000];
+static int revision_count;
+
+void revision_cb(void* arg, const bp_revision_t* revision) {
+  revisions[revision_count++] = *revision;
+}
+
+TEST_START("revisions test", "revisions")
+  const int n = 100;
+  char key[100];
+  char val[100];
+  char* result;
+  int i, j;
+  uint64_t seq;
+  bp_snapshot_t snapshot;
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key %d", i);
+    sprintf(val, "value %d", i);
+    assert(bp_sets(&db, key, val) == BP_OK);
+  }
+
+  /* revisions should survive reopen */
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, __db_file) == BP_OK);
+
+  revision_count = 0;
+  assert(bp_get_revisions(&db, revision_cb, NULL) == BP_OK);
+
+  /* one revision per write + empty one */
+  assert(revision_count == n + 1);
+  for (i = 0; i < revision_count; i++) {
+    assert(revisions[i].seq == (uint64_t) (revision_count - i));
+  }
+
+  /* look into the past */
+  for (i = 0; i < revision_count; i++) {
+    seq = revisions[i].seq;
+    assert(bp_snapshot_open_at(&db, revisions[i].offset, &snapshot) == BP_OK);
+
+    for (j = 0; j < n; j++) {
+      sprintf(key, "key %d", j);
+
+      /* revision with sequence `seq` contains `seq - 1` keys */
+      if ((uint64_t) j + 1 >= seq) {
+        assert(bp_snapshot_gets(&db, &snapshot, key, &result) == BP_ENOTFOUND);
+        continue;
+      }
+
+      sprintf(val, "value %d", j);
+      assert(bp_snapshot_gets(&db, &snapshot, key, &result) == BP_OK);
+      assert(strcmp(result, val) == 0);
+      free(result);
+    }
+
+    assert(bp_snapshot_close(&db, &snapshot) == BP_OK);
+  }
+
+  /* not a revision */
+  assert(bp_snapshot_open_at(&db,
+                             revisions[0].offset + 1,
+                             &snapshot) == BP_ENOTFOUND);
+
+  /* compaction starts new history */
+  assert(bp_compact(&db) == BP_OK);
+
+  revision_count = 0;
+  assert(bp_get_revisions(&db, revision_cb, NULL) == BP_OK);
+  assert(revision_count < n);
+TEST_END("revisions test", "revisions")
@@ -0,0 +1,88 @@
+#include "test.h"
+#include <sched.h> /* sched_yield */
+
+/*
+ * pthread_rwlock_t may prefer readers (and starve writer forever),
+ * so busy readers are only started with scalable lock
+ */
+#if BP_USE_SCALABLE_RWLOCK
+const int readers_count = 8;
+#else
+const int readers_count = 0;
+#endif
+const int writes = 100;
+
+/* writer should get lock within this time while readers are busy */
+const double max_wait_ms = 1000;
+
+struct reader_arg {
+  bp_db_t* db;
+  volatile int started;
+  volatile int done;
+};
+
+
+void* busy_reader(void* arg_) {
+  reader_arg* arg = (reader_arg*) arg_;
+  char* value;
+
+  __sync_fetch_and_add(&arg->started, 1);
+  while (!arg->done) {
+    if (bp_gets(arg->db, "key", &value) == BP_OK) free(value);
+  }
+
+  return NULL;
+}
+
+
+double elapsed_ms(struct timeval* start) {
+  struct timeval end;
+
+  gettimeofday(&end, NULL);
+  return (end.tv_sec - start->tv_sec) * 1e3 +
+         (end.tv_usec - start->tv_usec) / 1e3;
+}
+
+
+TEST_START("rwlock writer progress test", "rwlock")
+  pthread_t readers[8];
+  reader_arg arg;
+  struct timeval start;
+  char value[100];
+  char* result;
+  double wait, max_wait;
+  int i;
+
+  arg.db = &db;
+  arg.started = 0;
+  arg.done = 0;
+  assert(bp_sets(&db, "key", "value 0") == BP_OK);
+
+  for (i = 0; i < readers_count; i++) {
+    assert(pthread_create(&readers[i], NULL, busy_reader, &arg) == 0);
+  }
+  while (arg.started != readers_count) sched_yield();
+
+  /* writer makes progress while readers keep reading */
+  max_wait = 0;
+  for (i = 1; i <= writes; i++) {
+    sprintf(value, "value %d", i);
+
+    gettimeofday(&start, NULL);
+    assert(bp_sets(&db, "key", value) == BP_OK);
+    wait = elapsed_ms(&start);
+    if (wait > max_wait) max_wait = wait;
+  }
+
+  arg.done = 1;
+  for (i = 0; i < readers_count; i++) {
+    assert(pthread_join(readers[i], NULL) == 0);
+  }
+
+  assert(max_wait < max_wait_ms);
+
+  assert(bp_gets(&db, "key", &result) == BP_OK);
+  sprintf(value, "value %d", writes);
+  assert(strcmp(result, value) == 0);
+  free(result);
+TEST_END("rwlock writer progress test", "rwlock")
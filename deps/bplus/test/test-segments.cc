@@ -0,0 +1,170 @@
+#include "test.h"
+#include <dirent.h>
+
+static const char* db_dir = "/tmp/bptest/segments.bpd";
+
+
+void update(bp_db_t* db, const int from, const int to, const int round) {
+  char key[32];
+  char value[128];
+  int i;
+
+  for (i = from; i < to; i++) {
+    sprintf(key, "key-%08d", i);
+    sprintf(value, "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa", i, round);
+    assert(bp_sets(db, key, value) == BP_OK);
+  }
+}
+
+
+void check(bp_db_t* db, const int from, const int to, const int round) {
+  char key[32];
+  char expected[128];
+  char* value;
+  int i;
+
+  for (i = from; i < to; i++) {
+    sprintf(key, "key-%08d", i);
+    sprintf(expected, "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa", i, round);
+    assert(bp_gets(db, key, &value) == BP_OK);
+    assert(strcmp(value, expected) == 0);
+    free(value);
+  }
+}
+
+
+/* count segments and their total size */
+uint64_t dir_size(const char* dir, int* count) {
+  char path[256];
+  struct dirent* entry;
+  struct stat st;
+  uint64_t size = 0;
+  DIR* d;
+
+  *count = 0;
+  d = opendir(dir);
+  assert(d != NULL);
+  while ((entry = readdir(d)) != NULL) {
+    if (entry->d_name[0] == '.') continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    assert(stat(path, &st) == 0);
+    size += st.st_size;
+    (*count)++;
+  }
+  closedir(d);
+
+  return size;
+}
+
+
+void remove_dir(const char* dir) {
+  char path[256];
+  struct dirent* entry;
+  DIR* d;
+
+  d = opendir(dir);
+  if (d == NULL) return;
+  while ((entry = readdir(d)) != NULL) {
+    if (entry->d_name[0] == '.') continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    assert(unlink(path) == 0);
+  }
+  closedir(d);
+  assert(rmdir(dir) == 0);
+}
+
+
+void count_revision(void* arg, const bp_revision_t* revision) {
+  (*(int*) arg)++;
+}
+
+
+TEST_START("segments test", "segments")
+  const int n = 2000;
+  bp_options_t options;
+  bp_snapshot_t snapshot;
+  char path[256];
+  char** keys;
+  uint64_t size, cleaned_size;
+  int count, cleaned_count, revisions, round, i;
+
+  /* only segmented database may be cleaned */
+  assert(bp_clean(&db, 50) == BP_ESEGMENT);
+  assert(bp_close(&db) == BP_OK);
+
+  remove_dir(db_dir);
+  bp_options_init(&options);
+  options.segment_size = 1000;
+  assert(bp_open_opts(&db, db_dir, &options) == BP_ESEGMENT);
+  options.segment_size = 4096 * 4;
+  options.reuse_space = 1;
+  assert(bp_open_opts(&db, db_dir, &options) == BP_ESEGMENT);
+  options.reuse_space = 0;
+  assert(bp_open_opts(&db, db_dir, &options) == BP_OK);
+  assert(bp_clean(&db, 101) == BP_ESEGMENT);
+  assert(bp_compact_dict(&db, 1024, 0) == BP_ESEGMENT);
+
+  /* cold data is written once */
+  keys = (char**) malloc(n * sizeof(*keys));
+  for (i = 0; i < n; i++) {
+    keys[i] = (char*) malloc(32);
+    sprintf(keys[i], "key-%08d", i);
+  }
+  assert(bp_bulk_sets(&db, n, (const char**) keys, (const char**) keys) ==
+         BP_OK);
+  for (i = 0; i < n; i++) free(keys[i]);
+  free(keys);
+
+  /* hot one is updated, file of database is split into segments */
+  for (round = 0; round < 5; round++) update(&db, 0, n / 10, round);
+  check(&db, 0, n / 10, 4);
+
+  /* format and garbage of segments are stored in database */
+  assert(bp_close(&db) == BP_OK);
+  size = dir_size(db_dir, &count);
+  assert(count > 4);
+  assert(bp_open(&db, db_dir) == BP_OK);
+  check(&db, 0, n / 10, 4);
+
+  /* segments with garbage are removed, segment of cold data is kept */
+  assert(bp_snapshot_open(&db, &snapshot) == BP_OK);
+  assert(bp_clean(&db, 50) == BP_ECOMPACT_SNAPSHOT);
+  assert(bp_snapshot_close(&db, &snapshot) == BP_OK);
+
+  assert(bp_clean(&db, 50) == BP_OK);
+  check(&db, 0, n / 10, 4);
+  cleaned_size = dir_size(db_dir, &cleaned_count);
+  assert(cleaned_size < size / 2);
+  assert(cleaned_count < count);
+  snprintf(path, sizeof(path), "%s/00000004.seg", db_dir);
+  assert(access(path, F_OK) == 0);
+
+  /* older revisions end with removed segments */
+  revisions = 0;
+  assert(bp_get_revisions(&db, count_revision, &revisions) == BP_OK);
+  assert(revisions >= 1);
+
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, db_dir) == BP_OK);
+  check(&db, 0, n / 10, 4);
+  update(&db, n / 10, n / 5, 5);
+  check(&db, n / 10, n / 5, 5);
+
+  /* compaction cleans all segments but the last one */
+  update(&db, 0, n / 10, 6);
+  assert(bp_compact(&db) == BP_OK);
+  check(&db, 0, n / 10, 6);
+  check(&db, n / 10, n / 5, 5);
+  size = dir_size(db_dir, &count);
+  assert(size < cleaned_size);
+  assert(access(path, F_OK) != 0);
+
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, db_dir) == BP_OK);
+  check(&db, 0, n / 10, 6);
+  check(&db, n / 10, n / 5, 5);
+  assert(bp_close(&db) == BP_OK);
+  remove_dir(db_dir);
+
+  assert(bp_open(&db, __db_file) == BP_OK);
+TEST_END("segments test", "segments")
@@ -0,0 +1,107 @@
+#include "test.h"
+
+void range_cb(void* matched, const bp_key_t* key, const bp_value_t* value) {
+  assert(strncmp(value->value, "old", 3) == 0);
+  (*(int*) matched)++;
+}
+
+TEST_START("snapshot test", "snapshot")
+  const int n = 500;
+  char key[100];
+  char val[100];
+  char* result;
+  int i, matched;
+  bp_snapshot_t snapshot;
+  bp_cursor_t cursor;
+  bp_key_t ckey;
+  bp_value_t cvalue;
+
+  for (i = 0; i < n; i++) {
+    sprintf(key, "key %03d", i);
+    sprintf(val, "old value %03d", i);
+    assert(bp_sets(&db, key, val) == BP_OK);
+  }
+
+  assert(bp_snapshot_open(&db, &snapshot) == BP_OK);
+
+  /* overwrite every key and add some new ones */
+  for (i = 0; i < 2 * n; i++) {
+    sprintf(key, "key %03d", i);
+    sprintf(val, "new value %03d", i);
+    assert(bp_sets(&db, key, val) == BP_OK);
+  }
+
+  /* snapshot should see old values only */
+  for (i = 0; i < 2 * n; i++) {
+    sprintf(key, "key %03d", i);
+
+    if (i >= n) {
+      assert(bp_snapshot_gets(&db, &snapshot, key, &result) == BP_ENOTFOUND);
+      continue;
+    }
+
+    sprintf(val, "old value %03d", i);
+    assert(bp_snapshot_gets(&db, &snapshot, key, &result) == BP_OK);
+    assert(strcmp(result, val) == 0);
+    free(result);
+
+    sprintf(val, "new value %03d", i);
+    assert(bp_gets(&db, key, &result) == BP_OK);
+    assert(strcmp(result, val) == 0);
+    free(result);
+  }
+
+  matched = 0;
+  assert(bp_snapshot_get_ranges(&db,
+                                &snapshot,
+                                "key 000",
+                                "key 999",
+                                range_cb,
+                                &matched) == BP_OK);
+  assert(matched == n);
+
+  /* compaction should not invalidate opened snapshot */
+  assert(bp_compact(&db) == BP_ECOMPACT_SNAPSHOT);
+
+  /* iterate through snapshot in order */
+  sprintf(key, "key 100");
+  ckey.value = key;
+  ckey.length = strlen(key) + 1;
+  assert(bp_cursor_open(&db, &snapshot, &ckey, NULL, &cursor) == BP_OK);
+  for (i = 100; i < n; i++) {
+    sprintf(key, "key %03d", i);
+    sprintf(val, "old value %03d", i);
+
+    assert(bp_cursor_next(&db, &cursor, &ckey, &cvalue) == BP_OK);
+    assert(strcmp(ckey.value, key) == 0);
+    assert(strcmp(cvalue.value, val) == 0);
+
+    free(ckey.value);
+    free(cvalue.value);
+  }
+  assert(bp_cursor_next(&db, &cursor, &ckey, &cvalue) == BP_ENOTFOUND);
+  assert(bp_cursor_close(&db, &cursor) == BP_OK);
+
+  assert(bp_snapshot_close(&db, &snapshot) == BP_OK);
+
+  assert(bp_compact(&db) == BP_OK);
+
+  /* cursor with it's own snapshot and bounded range */
+  sprintf(key, "key 900");
+  ckey.value = key;
+  ckey.length = strlen(key) + 1;
+  assert(bp_cursor_open(&db, NULL, NULL, &ckey, &cursor) == BP_OK);
+  for (i = 0; i <= 900; i++) {
+    sprintf(key, "key %03d", i);
+    sprintf(val, "new value %03d", i);
+
+    assert(bp_cursor_next(&db, &cursor, &ckey, &cvalue) == BP_OK);
+    assert(strcmp(ckey.value, key) == 0);
+    assert(strcmp(cvalue.value, val) == 0);
+
+    free(ckey.value);
+    free(cvalue.value);
+  }
+  assert(bp_cursor_next(&db, &cursor, &ckey, &cvalue) == BP_ENOTFOUND);
+  assert(bp_cursor_close(&db, &cursor) == BP_OK);
+TEST_END("snapshot test", "snapshot")
@@ -0,0 +1,298 @@
+#include "test.h"
+#include <dirent.h>
+
+static const char* db_dir = "/tmp/bptest/stream.bpd";
+
+
+void fill(char* data, const uint64_t length, const int seed) {
+  uint64_t i;
+
+  for (i = 0; i < length; i++) data[i] = (char) ((i % 251) * 7 + seed);
+}
+
+
+void set_large(bp_db_t* db,
+               const char* key,
+               const uint64_t length,
+               const int seed) {
+  bp_key_t bkey;
+  bp_value_t bvalue;
+
+  BP__STOVAL(key, bkey);
+  bvalue.length = length;
+  bvalue.value = (char*) malloc(length);
+  fill(bvalue.value, length, seed);
+  assert(bp_set(db, &bkey, &bvalue) == BP_OK);
+  free(bvalue.value);
+}
+
+
+void check_large(bp_db_t* db,
+                 const char* key,
+                 const uint64_t length,
+                 const int seed) {
+  bp_key_t bkey;
+  bp_value_t bvalue;
+  char* expected;
+
+  BP__STOVAL(key, bkey);
+  assert(bp_get(db, &bkey, &bvalue) == BP_OK);
+  assert(bvalue.length == length);
+
+  expected = (char*) malloc(length);
+  fill(expected, length, seed);
+  assert(memcmp(bvalue.value, expected, length) == 0);
+  free(expected);
+  free(bvalue.value);
+}
+
+
+/* read value in parts of `part` bytes */
+void check_stream(bp_db_t* db,
+                  const char* key,
+                  const uint64_t length,
+                  const int seed,
+                  const uint64_t part) {
+  bp_key_t bkey;
+  bp_stream_t stream;
+  uint64_t offset, read;
+  char* expected;
+  char* data;
+
+  expected = (char*) malloc(length);
+  data = (char*) malloc(part);
+  fill(expected, length, seed);
+
+  BP__STOVAL(key, bkey);
+  assert(bp_stream_open(db, &bkey, &stream) == BP_OK);
+  assert(stream.length == length);
+  for (offset = 0; offset < length; offset += read) {
+    assert(bp_stream_read(db, &stream, offset, part, data, &read) == BP_OK);
+    assert(read != 0 && read <= part);
+    assert(memcmp(data, expected + offset, read) == 0);
+  }
+  assert(bp_stream_read(db, &stream, length, part, data, &read) == BP_OK);
+  assert(read == 0);
+
+  /* and at random positions */
+  assert(bp_stream_read(db, &stream, length / 3, part, data, &read) == BP_OK);
+  assert(memcmp(data, expected + length / 3, read) == 0);
+  assert(bp_stream_close(db, &stream) == BP_OK);
+
+  free(data);
+  free(expected);
+}
+
+
+/* write value in parts of `part` bytes */
+void write_stream(bp_db_t* db,
+                  const char* key,
+                  const uint64_t length,
+                  const int seed,
+                  const uint64_t part) {
+  bp_key_t bkey;
+  bp_stream_t stream;
+  uint64_t offset, size;
+  char* data;
+
+  data = (char*) malloc(length);
+  fill(data, length, seed);
+
+  BP__STOVAL(key, bkey);
+  assert(bp_stream_create(db, &stream) == BP_OK);
+  for (offset = 0; offset < length; offset += size) {
+    size = length - offset < part ? length - offset : part;
+    assert(bp_stream_write(db, &stream, data + offset, size) == BP_OK);
+  }
+  assert(bp_stream_commit(db, &stream, &bkey) == BP_OK);
+  assert(bp_stream_close(db, &stream) == BP_OK);
+
+  free(data);
+}
+
+
+uint64_t file_size(const char* filename) {
+  struct stat st;
+
+  assert(stat(filename, &st) == 0);
+  return st.st_size;
+}
+
+
+void remove_dir(const char* dir) {
+  char path[256];
+  struct dirent* entry;
+  DIR* d;
+
+  d = opendir(dir);
+  if (d == NULL) return;
+  while ((entry = readdir(d)) != NULL) {
+    if (entry->d_name[0] == '.') continue;
+    snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name);
+    assert(unlink(path) == 0);
+  }
+  closedir(d);
+  assert(rmdir(dir) == 0);
+}
+
+
+TEST_START("stream test", "stream")
+  const uint64_t large = 100000;
+  bp_options_t options;
+  bp_key_t key;
+  bp_value_t value;
+  bp_value_t previous;
+  bp_stream_t stream;
+  char vlog[256];
+  char* expected;
+  uint64_t size;
+  int i;
+
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+
+  bp_options_init(&options);
+  options.chunk_size = 1000;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_ECHUNK);
+  options.chunk_size = 4096 * 3;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_ECHUNK);
+
+  /* large values are chunked, small ones aren't */
+  options.chunk_size = 4096;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+  set_large(&db, "large", large, 0);
+  set_large(&db, "small", 1000, 1);
+  set_large(&db, "exact", 4096, 2);
+  check_large(&db, "large", large, 0);
+  check_large(&db, "small", 1000, 1);
+  check_large(&db, "exact", 4096, 2);
+
+  /* previous value may be chunked too */
+  set_large(&db, "large", large + 1, 3);
+  BP__STOVAL("large", key);
+  assert(bp_get(&db, &key, &value) == BP_OK);
+  assert(bp_get_previous(&db, &value, &previous) == BP_OK);
+  expected = (char*) malloc(large);
+  fill(expected, large, 0);
+  assert(previous.length == large);
+  assert(memcmp(previous.value, expected, large) == 0);
+  free(expected);
+  free(previous.value);
+  free(value.value);
+
+  /* streams read values of any size */
+  check_stream(&db, "large", large + 1, 3, 1000);
+  check_stream(&db, "large", large + 1, 3, 10000);
+  check_stream(&db, "small", 1000, 1, 333);
+  check_stream(&db, "exact", 4096, 2, 4096);
+  BP__STOVAL("unknown", key);
+  assert(bp_stream_open(&db, &key, &stream) == BP_ENOTFOUND);
+
+  /* and write them */
+  write_stream(&db, "written", large, 4, 777);
+  write_stream(&db, "written-chunks", large, 5, 8192);
+  write_stream(&db, "written-small", 100, 6, 10);
+  check_large(&db, "written", large, 4);
+  check_large(&db, "written-chunks", large, 5);
+  check_large(&db, "written-small", 100, 6);
+  check_stream(&db, "written", large, 4, 5000);
+
+  /* stream that wasn't committed doesn't change anything */
+  BP__STOVAL("written", key);
+  assert(bp_stream_create(&db, &stream) == BP_OK);
+  assert(bp_stream_write(&db, &stream, "garbage", 7) == BP_OK);
+  assert(bp_stream_close(&db, &stream) == BP_OK);
+  check_large(&db, "written", large, 4);
+
+  /* opened streams reference blocks of database */
+  BP__STOVAL("large", key);
+  assert(bp_stream_open(&db, &key, &stream) == BP_OK);
+  assert(bp_compact(&db) == BP_ECOMPACT_SNAPSHOT);
+  assert(bp_stream_close(&db, &stream) == BP_OK);
+
+  /* chunk size is stored in database and kept by compaction */
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  check_large(&db, "large", large + 1, 3);
+  assert(bp_compact(&db) == BP_OK);
+  check_large(&db, "large", large + 1, 3);
+  check_stream(&db, "written", large, 4, 4096);
+  write_stream(&db, "after-compact", large, 7, 4097);
+  check_stream(&db, "after-compact", large, 7, 4095);
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+
+  /* database without chunks stores values as they are */
+  options.chunk_size = 0;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+  assert(bp_stream_create(&db, &stream) == BP_ECHUNK);
+  set_large(&db, "large", large, 0);
+  check_stream(&db, "large", large, 0, 1000);
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+
+  /* space of replaced (and uncommitted) chunks is reused */
+  options.chunk_size = 4096;
+  options.reuse_space = 1;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+  for (i = 0; i < 4; i++) {
+    set_large(&db, "large", large, i);
+    assert(bp_fsync(&db) == BP_OK);
+  }
+  size = file_size(__db_file);
+  for (i = 0; i < 20; i++) {
+    set_large(&db, "large", large, i);
+    write_stream(&db, "written", large, i, 5000);
+    assert(bp_stream_create(&db, &stream) == BP_OK);
+    set_large(&db, "unused", 1, i);
+    expected = (char*) malloc(large);
+    fill(expected, large, i);
+    assert(bp_stream_write(&db, &stream, expected, large) == BP_OK);
+    free(expected);
+    assert(bp_stream_close(&db, &stream) == BP_OK);
+    assert(bp_fsync(&db) == BP_OK);
+  }
+  assert(file_size(__db_file) < size * 4);
+  check_large(&db, "large", large, 19);
+  check_large(&db, "written", large, 19);
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+  options.reuse_space = 0;
+
+  /* values in log are chunked too */
+  snprintf(vlog, sizeof(vlog), "%s.00.vlog", __db_file);
+  unlink(vlog);
+  options.value_log = 1;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+  set_large(&db, "large", large, 0);
+  write_stream(&db, "written", large, 1, 3000);
+  assert(file_size(__db_file) < large / 10);
+  assert(bp_compact_values(&db) == BP_OK);
+  check_large(&db, "large", large, 0);
+  check_stream(&db, "written", large, 1, 3000);
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+  snprintf(vlog, sizeof(vlog), "%s.01.vlog", __db_file);
+  unlink(vlog);
+  options.value_log = 0;
+
+  /* chunks are moved out of cleaned segments */
+  remove_dir(db_dir);
+  options.segment_size = 4096 * 4;
+  assert(bp_open_opts(&db, db_dir, &options) == BP_OK);
+  set_large(&db, "cold", large, 0);
+  for (i = 0; i < 5; i++) set_large(&db, "hot", large / 2, i);
+  assert(bp_clean(&db, 50) == BP_OK);
+  check_large(&db, "cold", large, 0);
+  check_large(&db, "hot", large / 2, 4);
+  assert(bp_compact(&db) == BP_OK);
+  check_large(&db, "cold", large, 0);
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, db_dir) == BP_OK);
+  check_stream(&db, "cold", large, 0, 10000);
+  check_stream(&db, "hot", large / 2, 4, 10000);
+  assert(bp_close(&db) == BP_OK);
+  remove_dir(db_dir);
+
+  assert(bp_open(&db, __db_file) == BP_OK);
+TEST_END("stream test", "stream")
@@ -0,0 +1,213 @@
+#include "test.h"
+
+static const char* int_file = "/tmp/bptest/ttl-int.bp";
+static const char* empty_file = "/tmp/bptest/ttl-empty.bp";
+
+
+void make_key(bp_key_t* key, char* buff, const int uint64, const int i) {
+  uint64_t k;
+  int j;
+
+  if (uint64) {
+    /* big-endian */
+    k = (uint64_t) i;
+    for (j = 7; j >= 0; j--) {
+      buff[j] = (char) (k & 0xff);
+      k >>= 8;
+    }
+    key->value = buff;
+    key->length = 8;
+  } else {
+    snprintf(buff, 32, "%c-%04d", i < 600 ? 'a' : 'b', i);
+    BP__STOVAL(buff, (*key));
+  }
+}
+
+
+/* first 600 keys (and every even one) expire in a second */
+void fill(bp_db_t* db, const int uint64, const int count) {
+  char buff[32];
+  bp_key_t key;
+  bp_value_t value;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    make_key(&key, buff, uint64, i);
+    BP__STOVAL("value", value);
+    assert(bp_set_ttl(db, &key, &value, i < 600 || i % 2 == 0 ? 1 : 0) ==
+           BP_OK);
+  }
+}
+
+
+void check_get(bp_db_t* db, const int uint64, const int count) {
+  char buff[32];
+  bp_key_t key;
+  bp_value_t value;
+  int i;
+
+  for (i = 0; i < count; i++) {
+    make_key(&key, buff, uint64, i);
+    if (i < 600 || i % 2 == 0) {
+      assert(bp_get(db, &key, &value) == BP_ENOTFOUND);
+    } else {
+      assert(bp_get(db, &key, &value) == BP_OK);
+      assert(strcmp(value.value, "value") == 0);
+      free(value.value);
+    }
+  }
+}
+
+
+void count_cb(void* arg, const bp_key_t* key, const bp_value_t* value) {
+  (*(int*) arg)++;
+}
+
+
+int count_range(bp_db_t* db, const int uint64) {
+  char start_buff[32];
+  char end_buff[32];
+  bp_key_t start, end;
+  int count = 0;
+
+  make_key(&start, start_buff, uint64, 0);
+  make_key(&end, end_buff, uint64, 9999);
+  assert(bp_get_range(db, &start, &end, count_cb, &count) == BP_OK);
+
+  return count;
+}
+
+
+int count_cursor(bp_db_t* db) {
+  bp_cursor_t cursor;
+  bp_key_t key;
+  bp_value_t value;
+  int count = 0;
+
+  assert(bp_cursor_open(db, NULL, NULL, NULL, &cursor) == BP_OK);
+  while (bp_cursor_next(db, &cursor, &key, &value) == BP_OK) {
+    free(key.value);
+    free(value.value);
+    count++;
+  }
+  assert(bp_cursor_close(db, &cursor) == BP_OK);
+
+  return count;
+}
+
+
+int reject_cb(void* arg, const bp_value_t* previous, const bp_value_t* value) {
+  return 0;
+}
+
+
+uint64_t file_size(const char* filename) {
+  struct stat st;
+
+  assert(stat(filename, &st) == 0);
+  return st.st_size;
+}
+
+
+TEST_START("ttl test", "ttl")
+  const int count = 1000;
+  bp_options_t options;
+  bp_db_t int_db;
+  bp_db_t empty_db;
+  bp_key_t key;
+  bp_value_t value;
+  uint64_t removed, total, size;
+
+  /* database without expiry doesn't accept ttl */
+  BP__STOVAL("key", key);
+  BP__STOVAL("value", value);
+  assert(bp_set_ttl(&db, &key, &value, 1) == BP_EEXPIRY);
+  assert(bp_set_ttl(&db, &key, &value, 0) == BP_OK);
+  assert(bp_expire(&db, 10, &removed) == BP_OK);
+  assert(removed == 0);
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+
+  bp_options_init(&options);
+  options.expiry = 1;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+  fill(&db, 0, count);
+
+  unlink(empty_file);
+  assert(bp_open_opts(&empty_db, empty_file, &options) == BP_OK);
+  fill(&empty_db, 0, 500);
+
+  unlink(int_file);
+  options.key_mode = BP_KEY_UINT64;
+  assert(bp_open_opts(&int_db, int_file, &options) == BP_OK);
+  fill(&int_db, 1, count);
+
+  /* key set again without ttl doesn't expire */
+  BP__STOVAL("persist", key);
+  BP__STOVAL("value", value);
+  assert(bp_set_ttl(&db, &key, &value, 1) == BP_OK);
+  assert(bp_set(&db, &key, &value) == BP_OK);
+  sleep(2);
+  assert(bp_get(&db, &key, &value) == BP_OK);
+  free(value.value);
+  assert(bp_remove(&db, &key) == BP_OK);
+
+  /* expired keys are missing */
+  check_get(&db, 0, count);
+  check_get(&int_db, 1, count);
+  assert(count_range(&db, 0) == (count - 600) / 2);
+  assert(count_cursor(&db) == (count - 600) / 2);
+  assert(count_range(&int_db, 1) == (count - 600) / 2);
+
+  /* and aren't passed to update callback */
+  BP__STOVAL("a-0002", key);
+  BP__STOVAL("value", value);
+  assert(bp_update_existing(&db, &key, &value, NULL, NULL) ==
+         BP_EUPDATECONFLICT);
+  assert(bp_update(&db, &key, &value, reject_cb, NULL) == BP_OK);
+  assert(bp_get(&db, &key, &value) == BP_OK);
+  free(value.value);
+  assert(bp_remove(&db, &key) == BP_OK);
+
+  /* expiry time is stored in pages */
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  check_get(&db, 0, count);
+
+  /* expired keys are removed in batches */
+  total = 0;
+  do {
+    assert(bp_expire(&db, 100, &removed) == BP_OK);
+    assert(removed <= 100);
+    total += removed;
+  } while (removed == 100);
+  assert(total == count - (count - 600) / 2 - 1);
+  check_get(&db, 0, count);
+  assert(count_range(&db, 0) == (count - 600) / 2);
+  assert(count_cursor(&db) == (count - 600) / 2);
+
+  /* and dropped by compaction */
+  size = file_size(int_file);
+  assert(bp_compact(&int_db) == BP_OK);
+  assert(file_size(int_file) < size);
+  check_get(&int_db, 1, count);
+  assert(bp_expire(&int_db, 100, &removed) == BP_OK);
+  assert(removed == 0);
+  assert(bp_close(&int_db) == BP_OK);
+  unlink(int_file);
+
+  /* database with only expired keys becomes empty */
+  assert(bp_compact(&empty_db) == BP_OK);
+  assert(count_cursor(&empty_db) == 0);
+  fill(&empty_db, 0, 500);
+  sleep(2);
+  assert(bp_expire(&empty_db, 1000, &removed) == BP_OK);
+  assert(removed == 500);
+  assert(count_cursor(&empty_db) == 0);
+  BP__STOVAL("b-0000", key);
+  BP__STOVAL("value", value);
+  assert(bp_set(&empty_db, &key, &value) == BP_OK);
+  assert(count_cursor(&empty_db) == 1);
+  assert(bp_close(&empty_db) == BP_OK);
+  unlink(empty_file);
+TEST_END("ttl test", "ttl")
@@ -0,0 +1,155 @@
+#include "test.h"
+
+
+void update(bp_db_t* db, const int from, const int to, const int round) {
+  char key[32];
+  char value[128];
+  int i;
+
+  for (i = from; i < to; i++) {
+    sprintf(key, "key-%08d", i);
+    sprintf(value, "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa", i, round);
+    assert(bp_sets(db, key, value) == BP_OK);
+  }
+}
+
+
+void check(bp_db_t* db, const int from, const int to, const int round) {
+  char key[32];
+  char expected[128];
+  char* value;
+  int i;
+
+  for (i = from; i < to; i++) {
+    sprintf(key, "key-%08d", i);
+    sprintf(expected, "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa", i, round);
+    assert(bp_gets(db, key, &value) == BP_OK);
+    assert(strcmp(value, expected) == 0);
+    free(value);
+  }
+}
+
+
+void check_previous(bp_db_t* db, const int round) {
+  bp_key_t key;
+  bp_value_t value;
+  bp_value_t previous;
+  char expected[128];
+
+  BP__STOVAL("key-00000000", key);
+  assert(bp_get(db, &key, &value) == BP_OK);
+  assert(bp_get_previous(db, &value, &previous) == BP_OK);
+  sprintf(expected, "value-%08d-%08d-aaaaaaaaaaaaaaaaaaaaaaaaaaa", 0, round);
+  assert(strcmp(previous.value, expected) == 0);
+
+  free(value.value);
+  free(previous.value);
+}
+
+
+uint64_t file_size(const char* filename) {
+  struct stat st;
+
+  assert(stat(filename, &st) == 0);
+  return st.st_size;
+}
+
+
+TEST_START("value log test", "vlog")
+  const int n = 2000;
+  bp_options_t options;
+  char vlog[256];
+  char next_vlog[256];
+  uint64_t index_size, vlog_size, compacted_size;
+
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+  snprintf(vlog, sizeof(vlog), "%s.00.vlog", __db_file);
+  snprintf(next_vlog, sizeof(next_vlog), "%s.01.vlog", __db_file);
+  unlink(vlog);
+  unlink(next_vlog);
+
+  /* segments are cleaned by copying values with pages */
+  bp_options_init(&options);
+  options.value_log = 1;
+  options.segment_size = 4096 * 4;
+  assert(bp_open_opts(&db, "/tmp/bptest/vlog.bpd", &options) == BP_ESEGMENT);
+  options.segment_size = 0;
+
+  /* values are written to the log, pages aren't */
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+  update(&db, 0, n, 0);
+  update(&db, 0, n / 10, 1);
+  check(&db, 0, n / 10, 1);
+  check(&db, n / 10, n, 0);
+  check_previous(&db, 0);
+  assert(bp_fsync(&db) == BP_OK);
+
+  vlog_size = file_size(vlog);
+  assert(vlog_size > (uint64_t) (n + n / 10) * 16);
+  assert(access(next_vlog, F_OK) != 0);
+
+  /* option is stored in database */
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  check(&db, 0, n / 10, 1);
+  check(&db, n / 10, n, 0);
+  check_previous(&db, 0);
+
+  /* only pages are compacted, previous values are still in the log */
+  index_size = file_size(__db_file);
+  assert(bp_compact(&db) == BP_OK);
+  assert(file_size(__db_file) < index_size);
+  assert(file_size(vlog) == vlog_size);
+  check(&db, 0, n / 10, 1);
+  check(&db, n / 10, n, 0);
+  check_previous(&db, 0);
+
+  /* live values are copied into the next log */
+  update(&db, 0, n / 10, 2);
+  vlog_size = file_size(vlog);
+  assert(bp_compact_values(&db) == BP_OK);
+  assert(access(vlog, F_OK) != 0);
+  compacted_size = file_size(next_vlog);
+  assert(compacted_size < vlog_size);
+  check(&db, 0, n / 10, 2);
+  check(&db, n / 10, n, 0);
+
+  /* and it's used after reopening */
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  check(&db, 0, n / 10, 2);
+  check(&db, n / 10, n, 0);
+  update(&db, 0, n / 10, 3);
+  check_previous(&db, 2);
+  assert(file_size(next_vlog) > compacted_size);
+  assert(bp_close(&db) == BP_OK);
+  unlink(next_vlog);
+
+  /* space of pages is reused, values are only appended to the log */
+  unlink(__db_file);
+  options.reuse_space = 1;
+  assert(bp_open_opts(&db, __db_file, &options) == BP_OK);
+  update(&db, 0, n, 0);
+  assert(bp_fsync(&db) == BP_OK);
+  update(&db, 0, n, 1);
+  assert(bp_fsync(&db) == BP_OK);
+  index_size = file_size(__db_file);
+  vlog_size = file_size(vlog);
+  update(&db, 0, n, 2);
+  assert(bp_fsync(&db) == BP_OK);
+  update(&db, 0, n, 3);
+  assert(bp_fsync(&db) == BP_OK);
+  assert(file_size(__db_file) < index_size * 2);
+  assert(file_size(vlog) > vlog_size);
+  check(&db, 0, n, 3);
+
+  assert(bp_close(&db) == BP_OK);
+  assert(bp_open(&db, __db_file) == BP_OK);
+  check(&db, 0, n, 3);
+  assert(bp_close(&db) == BP_OK);
+  unlink(__db_file);
+  unlink(vlog);
+
+  assert(bp_open(&db, __db_file) == BP_OK);
+TEST_END("value log test", "vlog")
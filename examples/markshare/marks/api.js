@@ -1,5 +1,6 @@
 var crypto = require('crypto'),
-    marked = require('marked');
+    marked = require('marked'),
+    bplus = require('../../../');
 
 function sha1(value) {
   return crypto.createHash('sha1').update(value).digest('base64');
@@ -30,28 +31,39 @@ Marks.prototype.get = function get(req, res, next) {
 };
 
 Marks.prototype.set = function set(req, res) {
-  var mark = {
-    version: 1,
-    url: req.url,
-    password: sha1(req.body.password || ''),
-    title: req.body.title,
-    body: req.body.body
-  };
+  var self = this,
+      mark = {
+        version: 1,
+        url: req.url,
+        password: sha1(req.body.password || ''),
+        title: req.body.title,
+        body: req.body.body
+      },
+      data = JSON.stringify(mark);
+
+  // Serialized mark starts with the same version, url and password
+  var prefix = '{"version":1,"url":' + JSON.stringify(mark.url) +
+               ',"password":' + JSON.stringify(mark.password) + ',';
 
-  this.db.update(mark.url, JSON.stringify(mark), function filter(prev) {
-    // Allow updates only if password matches to previous
-    prev = JSON.parse(prev.toString());
-    return prev.password === mark.password;
-  }, function(err) {
+  // Create new mark, or allow updates only if password matches to previous
+  this.db.update(mark.url, data, null, function(err, code) {
+    if (!err || code !== bplus.errors.updateConflict) return done(err, code);
+    self.db.update(mark.url, data, { prefix: prefix }, done);
+  });
+
+  function done(err, code) {
     res.setHeader('content-type', 'application/json');
-    if (err) {
+    if (err && code === bplus.errors.updateConflict) {
       res.writeHead(400);
       res.end('{"err":"incorrect data"}');
+    } else if (err) {
+      res.writeHead(500);
+      res.end(JSON.stringify({ err: 'database error', code: code }));
     } else {
       res.writeHead(200);
       res.end('{"status":"ok"}');
     }
-  });
+  }
 };
 
 exports.create = function(db) {
@@ -11,3 +11,4 @@ try {
 // Export Bplus constructor (core)
 exports.BPlus = require('./bplus/core').BPlus;
 exports.create = require('./bplus/core').create;
+exports.errors = require('./bplus/core').errors;
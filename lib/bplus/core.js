@@ -1,5 +1,9 @@
 var bplus = require('../bplus'),
-    utils = bplus.utils;
+    utils = bplus.utils,
+    util = require('util'),
+    Buffer = require('buffer').Buffer,
+    Stream = require('stream').Stream,
+    Readable = require('stream').Readable;
 
 var core = exports;
 
@@ -9,6 +13,7 @@ var core = exports;
 //
 function BPlus() {
   this._db = new bplus.binding.BPlus();
+  this._expirer = null;
 };
 core.BPlus = BPlus;
 
@@ -20,13 +25,30 @@ core.create = function create() {
   return new BPlus();
 };
 
+// Names of merge operators (see `.merge()`)
+core.mergeOps = {
+  add: bplus.binding.BP_MERGE_ADD,
+  append: bplus.binding.BP_MERGE_APPEND,
+  max: bplus.binding.BP_MERGE_MAX,
+  min: bplus.binding.BP_MERGE_MIN,
+  union: bplus.binding.BP_MERGE_UNION
+};
+
+// Error codes passed to callbacks (`callback(true, code)`)
+core.errors = {
+  // update's filter (or compare-and-swap) has rejected new value
+  updateConflict: bplus.binding.BP_EUPDATECONFLICT
+};
+
 //
-// ### function open (filename)
+// ### function open (filename, options)
 // #### @filename {String} path to database file
+// #### @options {Object} (optional) `{ expiry: false }`, options of database
+// that is created (existing one is opened with options it was created with)
 // Opens database
 //
-BPlus.prototype.open = function open(filename) {
-  this._db.open(filename);
+BPlus.prototype.open = function open(filename, options) {
+  this._db.open(filename, options || {});
 
   return this;
 };
@@ -36,26 +58,67 @@ BPlus.prototype.open = function open(filename) {
 // Closes database
 //
 BPlus.prototype.close = function close() {
+  this.stopExpirer();
   this._db.close();
 
   return this;
 };
 
 //
-// ### function set (key, value, callback)
+// ### function set (key, value, ttl, callback)
 // #### @key {String|Buffer} key
 // #### @value {String|Buffer} value
+// #### @ttl {Number} (optional) seconds before key expires (0 - never),
+// database should be opened with `{ expiry: true }`
 // #### @callback {Function} continuation
 // Inserts key-value pair into database
 // (NOTE: if key already in database, value will be overwritten)
 //
-BPlus.prototype.set = function set(key, value, callback) {
+BPlus.prototype.set = function set(key, value, ttl, callback) {
+  if (typeof ttl === 'function') {
+    callback = ttl;
+    ttl = 0;
+  }
   callback || (callback = function() {});
 
   key = utils.toBuffer(key);
   value = utils.toBuffer(value);
 
-  this._db.set(key, value, callback);
+  this._db.set(key, value, callback, ttl || 0);
+
+  return this;
+};
+
+//
+// ### function merge (key, op, operand, callback)
+// #### @key {String|Buffer} key
+// #### @op {String} merge operator: 'add', 'append', 'max', 'min' or 'union'
+// #### @operand {Number|Array|String|Buffer} operand (number for 'add', 'max'
+// and 'min', array of numeric ids for 'union')
+// #### @callback {Function} continuation
+// Merges operand into key's value without reading it to js:
+//  * 'add', 'max', 'min' - value is 8-byte big-endian signed integer
+//  * 'append' - operand is appended to value
+//  * 'union' - value is sorted set of 8-byte big-endian ids
+// Missing key is set to operand, `utils.fromInt64()` converts value back to
+// number.
+//
+BPlus.prototype.merge = function merge(key, op, operand, callback) {
+  callback || (callback = function() {});
+
+  if (!core.mergeOps.hasOwnProperty(op)) {
+    throw new Error('Unknown merge operator: ' + op);
+  }
+
+  if (typeof operand === 'number') {
+    operand = utils.toInt64(operand);
+  } else if (Array.isArray(operand)) {
+    operand = Buffer.concat(operand.map(utils.toInt64));
+  } else {
+    operand = utils.toBuffer(operand);
+  }
+
+  this._db.merge(utils.toBuffer(key), core.mergeOps[op], operand, callback);
 
   return this;
 };
@@ -64,20 +127,38 @@ BPlus.prototype.set = function set(key, value, callback) {
 // ### function update (key, value, filter, callback)
 // #### @key {String|Buffer} key
 // #### @value {String|Buffer} value
-// #### @filter {Function} resolve conflict callback
+// #### @filter {Function|String|Buffer|Object|null} resolve conflict callback
+// or expected value
 // #### @callback {Function} continuation
 // Inserts or updates key-value pair into database
 //
 // If key is already in database - `filter(prev_value, curr_value)` will be
 // called and if result is not `false` entry will be updated.
 //
+// If `filter` is not a function, update is a compare-and-swap running in
+// thread pool: entry is updated only if its value is equal to `filter`,
+// starts with `filter.prefix` (`{ prefix: ... }`), or key is missing
+// (`null`). Otherwise `callback` receives an error.
+//
 BPlus.prototype.update = function update(key, value, filter, callback) {
   callback || (callback = function() {});
-  filter || (filter = function() {});
 
   key = utils.toBuffer(key);
   value = utils.toBuffer(value);
 
+  if (typeof filter !== 'function' && filter !== undefined) {
+    var prefix = filter !== null && filter.prefix !== undefined;
+
+    this._db.compareAndSwap(key,
+                            value,
+                            prefix ? utils.toBuffer(filter.prefix) :
+                                     utils.toBuffer(filter),
+                            prefix,
+                            callback);
+    return this;
+  }
+  filter || (filter = function() {});
+
   var res = this._db.update(key, value, function(prev, curr) {
     return filter(prev.value, curr.value);
   });
@@ -146,24 +227,50 @@ BPlus.prototype.get = function get(key, callback) {
   return this;
 };
 
+//
+// ### function getSlice (key, offset, length, callback)
+// #### @key {String|Buffer} key
+// #### @offset {Number} offset of first byte in value
+// #### @length {Number} number of bytes to read
+// #### @callback {Function} continuation
+// Calls `callback` with (err, data), where `data` is a part of key's value
+// (shorter than `length` at the end of value). Only chunks of large value
+// covering requested bytes are read.
+//
+BPlus.prototype.getSlice = function getSlice(key, offset, length, callback) {
+  callback || (callback = function() {});
+  this._db.getSlice(utils.toBuffer(key), offset, length, callback);
+
+  return this;
+};
+
 //
 // ### function getRange (start, end, filter)
 // #### @start {String|Buffer} start key
 // #### @end {String|Buffer} end key
-// #### @filter {Function} (optional) key filter
+// #### @filter {Object|Function} (optional) key predicate or filter
 // Returns a `promise` object that will emit:
 //  * ('message', key, value, ref) - for every matched key/value in range
 //  * ('error') - on any error
 //  * ('end') - once matching finished
 //
-// If filter callback is provided it'll be invoked with a `key` argument, and
-// if result is not `false` - 'message' event with that key will be emitted.
+// Predicate object is evaluated in thread pool, and values are loaded only
+// for keys that match all of its conditions: `prefix`, `suffix`, `contains`
+// (String|Buffer), `gte`, `lte` (String|Buffer, bytewise), `minLength`,
+// `maxLength` (Number).
+//
+// If filter callback is provided it'll be invoked with a `key` argument for
+// keys that were read, and if result is not `false` - 'message' event with
+// that key will be emitted.
+//
+// `promise.pause()` stops emitting of 'message' events, and range scan waits
+// once 1000 key/values are read ahead. `promise.resume()` continues it,
+// `promise.destroy()` stops it.
 //
 BPlus.prototype.getRange = function getRange(start, end, filter) {
-  var promise = new process.EventEmitter;
-
-  start = utils.toBuffer(start);
-  end = utils.toBuffer(end);
+  var promise = new process.EventEmitter,
+      self = this,
+      range;
 
   function callback(err, type, key, value) {
     if (err) return promise.emit('error', err, type);
@@ -171,24 +278,76 @@ BPlus.prototype.getRange = function getRange(start, end, filter) {
     if (type === 'message') {
       promise.emit('message', key.value, value.value, value.ref);
     } else {
+      range = null;
       promise.emit('end');
     }
   }
 
-  if (filter) {
-    var self = this;
-    process.nextTick(function() {
-      self._db.getFilteredRange(start, end, function(key) {
-        return filter(key.value)
-      }, callback);
-    });
-  } else {
-    this._db.getRange(start, end, callback);
-  }
+  range = this._range(start, end, filter, 1000, callback);
+
+  promise.pause = function pause() {
+    if (range) self._db.pauseRange(range);
+  };
+  promise.resume = function resume() {
+    if (range) self._db.resumeRange(range);
+  };
+  promise.destroy = function destroy() {
+    if (range) self._db.closeRange(range);
+    range = null;
+  };
 
   return promise;
 };
 
+//
+// ### function createRangeStream (start, end, options)
+// #### @start {String|Buffer} start key
+// #### @end {String|Buffer} end key
+// #### @options {Object} (optional) `{ highWaterMark: 16, filter: ... }`
+// Returns readable stream (in object mode) of `{ key, value }` in range,
+// `filter` is the same as in `.getRange()`. Range scan waits once
+// `highWaterMark` entries are buffered and not read.
+//
+BPlus.prototype.createRangeStream = function createRangeStream(start,
+                                                               end,
+                                                               options) {
+  if (!Readable) throw new Error('Readable streams require node 0.10');
+
+  return new RangeStream(this, start, end, options);
+};
+
+//
+// ### function _range (start, end, filter, limit, callback)
+// #### @start {String|Buffer} start key
+// #### @end {String|Buffer} end key
+// #### @filter {Object|Function} (optional) key predicate or filter
+// #### @limit {Number} number of entries to read ahead
+// #### @callback {Function} ('message', key, value) and ('end') receiver
+// Starts range scan, returns reference to it (valid until 'end')
+//
+BPlus.prototype._range = function _range(start, end, filter, limit, callback) {
+  start = utils.toBuffer(start);
+  end = utils.toBuffer(end);
+
+  function onmessage(err, type, key, value) {
+    if (!err && type === 'message' &&
+        typeof filter === 'function' && filter(key.value) === false) {
+      return;
+    }
+    callback(err, type, key, value);
+  }
+
+  if (filter && typeof filter === 'object') {
+    return this._db.getFilteredRange(start,
+                                     end,
+                                     utils.toPredicate(filter),
+                                     onmessage,
+                                     limit);
+  } else {
+    return this._db.getRange(start, end, onmessage, limit);
+  }
+};
+
 //
 // ### function getPrevious (ref, callback)
 // #### @ref {Buffer} `ref` returned by calling `.get()`
@@ -265,3 +424,371 @@ BPlus.prototype.compact = function compact(callback) {
   this._db.compact(callback);
   return this;
 };
+
+//
+// ### function expire (limit, callback)
+// #### @limit {Number} maximum number of keys to remove
+// #### @callback {Function} continuation
+// Removes expired keys from database, calls `callback` with (err, removed).
+// `removed` is less than `limit` only if there're no expired keys left.
+//
+BPlus.prototype.expire = function expire(limit, callback) {
+  callback || (callback = function() {});
+
+  this._db.expire(limit, callback);
+  return this;
+};
+
+//
+// ### function startExpirer (options)
+// #### @options {Object} (optional) `{ interval: 1000, batch: 1000 }`
+// Removes expired keys in background: batches of `batch` keys are removed
+// one after another until none is left, then it waits `interval` ms.
+//
+BPlus.prototype.startExpirer = function startExpirer(options) {
+  var self = this,
+      interval = options && options.interval || 1000,
+      batch = options && options.batch || 1000,
+      expirer = { timeout: null };
+
+  this.stopExpirer();
+  this._expirer = expirer;
+
+  function schedule(delay) {
+    expirer.timeout = setTimeout(run, delay);
+
+    // expirer doesn't keep process running
+    if (expirer.timeout.unref) expirer.timeout.unref();
+  }
+
+  function run() {
+    self.expire(batch, function(err, removed) {
+      if (self._expirer !== expirer) return;
+      schedule(!err && removed === batch ? 0 : interval);
+    });
+  }
+
+  schedule(interval);
+  return this;
+};
+
+//
+// ### function stopExpirer ()
+// Stops background expirer (batch that is being removed is finished)
+//
+BPlus.prototype.stopExpirer = function stopExpirer() {
+  if (this._expirer === null) return this;
+
+  clearTimeout(this._expirer.timeout);
+  this._expirer = null;
+  return this;
+};
+
+//
+// ### function createReadStream (key, options)
+// #### @key {String|Buffer} key
+// #### @options {Object} (optional) `{ bufferSize: 65536 }`
+// Returns readable stream of key's value, emitting it in parts of at most
+// `bufferSize` bytes. Only one chunk of a large value is loaded in memory.
+//
+BPlus.prototype.createReadStream = function createReadStream(key, options) {
+  return new ReadStream(this, key, options);
+};
+
+//
+// ### function createWriteStream (key)
+// #### @key {String|Buffer} key
+// Returns writable stream, everything written to it becomes key's value
+// once stream is ended ('close' is emitted after that).
+//
+BPlus.prototype.createWriteStream = function createWriteStream(key) {
+  return new WriteStream(this, key);
+};
+
+//
+// ### function ReadStream (db, key, options)
+// #### @db {BPlus} database
+// #### @key {String|Buffer} key
+// #### @options {Object} (optional) `{ bufferSize: 65536 }`
+// Readable stream of one value, emits 'open' with value's length,
+// 'data', 'end', 'close' and ('error', true, code)
+//
+function ReadStream(db, key, options) {
+  Stream.call(this);
+
+  this.readable = true;
+  this.paused = false;
+  this.bufferSize = options && options.bufferSize || 64 * 1024;
+  this.length = null;
+
+  this._db = db;
+  this._stream = null;
+  this._offset = 0;
+  this._reading = false;
+  this._destroyed = false;
+
+  var self = this;
+  db._db.openStream(utils.toBuffer(key), function(err, result) {
+    if (err) return self._error(result);
+
+    self._stream = result.stream;
+    self.length = result.length;
+    self.emit('open', self.length);
+
+    if (self._destroyed) return self._close();
+    self._read();
+  });
+};
+util.inherits(ReadStream, Stream);
+core.ReadStream = ReadStream;
+
+//
+// ### function _read ()
+// Reads next part of value unless stream is paused or already reading
+//
+ReadStream.prototype._read = function _read() {
+  if (this.paused || this._reading || this._stream === null) return;
+
+  if (this._offset >= this.length) {
+    this.readable = false;
+    this.emit('end');
+    return this.destroy();
+  }
+
+  var self = this;
+  this._reading = true;
+  this._db._db.readStream(this._stream,
+                          this._offset,
+                          this.bufferSize,
+                          function(err, data) {
+    self._reading = false;
+    if (self._destroyed) return self._close();
+    if (err) return self._error(data);
+
+    self._offset += data.length;
+    self.emit('data', data);
+    self._read();
+  });
+};
+
+ReadStream.prototype.pause = function pause() {
+  this.paused = true;
+};
+
+ReadStream.prototype.resume = function resume() {
+  this.paused = false;
+  this._read();
+};
+
+//
+// ### function destroy ()
+// Closes stream, value isn't emitted anymore
+//
+ReadStream.prototype.destroy = function destroy() {
+  if (this._destroyed) return;
+
+  this.readable = false;
+  this._destroyed = true;
+
+  // stream is closed after pending read
+  if (!this._reading) this._close();
+};
+
+ReadStream.prototype._close = function _close() {
+  if (this._stream !== null) {
+    this._db._db.closeStream(this._stream);
+    this._stream = null;
+  }
+  this.emit('close');
+};
+
+ReadStream.prototype._error = function _error(code) {
+  this.emit('error', true, code);
+  this.destroy();
+};
+
+//
+// ### function WriteStream (db, key)
+// #### @db {BPlus} database
+// #### @key {String|Buffer} key
+// Writable stream of one value, emits 'drain', 'close' (after value was
+// committed) and ('error', true, code)
+//
+function WriteStream(db, key) {
+  Stream.call(this);
+
+  this.writable = true;
+
+  this._db = db;
+  this._key = utils.toBuffer(key);
+  this._queue = [];
+  this._writing = false;
+  this._ending = false;
+  this._needDrain = false;
+  this._destroyed = false;
+  this._stream = db._db.createStream();
+
+  if (typeof this._stream === 'number') {
+    var self = this,
+        code = this._stream;
+
+    this._stream = null;
+    this.writable = false;
+    process.nextTick(function() {
+      self._error(code);
+    });
+  }
+};
+util.inherits(WriteStream, Stream);
+core.WriteStream = WriteStream;
+
+//
+// ### function write (data, encoding)
+// #### @data {String|Buffer} part of value
+// #### @encoding {String} (optional) encoding of string
+// Queues data to be written, returns `false` if it's not written yet
+// ('drain' will be emitted when it will be)
+//
+WriteStream.prototype.write = function write(data, encoding) {
+  if (!this.writable) throw new Error('Stream is not writable');
+
+  if (typeof data === 'string') data = new Buffer(data, encoding);
+  this._queue.push(data);
+  this._flush();
+
+  if (this._writing) this._needDrain = true;
+  return !this._writing;
+};
+
+//
+// ### function end (data, encoding)
+// #### @data {String|Buffer} (optional) last part of value
+// #### @encoding {String} (optional) encoding of string
+// Writes everything that was queued and sets key's value
+//
+WriteStream.prototype.end = function end(data, encoding) {
+  if (data) this.write(data, encoding);
+
+  this.writable = false;
+  this._ending = true;
+  this._flush();
+};
+
+WriteStream.prototype._flush = function _flush() {
+  if (this._writing || this._stream === null) return;
+
+  var self = this,
+      data = this._queue.shift();
+
+  if (data === undefined) {
+    if (this._ending) return this._commit();
+    if (this._needDrain) {
+      this._needDrain = false;
+      this.emit('drain');
+    }
+    return;
+  }
+
+  this._writing = true;
+  this._db._db.writeStream(this._stream, data, function(err, code) {
+    self._writing = false;
+    if (self._destroyed) return self.destroy();
+    if (err) return self._error(code);
+
+    self._flush();
+  });
+};
+
+WriteStream.prototype._commit = function _commit() {
+  var self = this;
+
+  this._writing = true;
+  this._db._db.commitStream(this._stream, this._key, function(err, code) {
+    self._writing = false;
+    if (err && !self._destroyed) return self._error(code);
+
+    self.destroy();
+  });
+};
+
+//
+// ### function destroy ()
+// Closes stream, value is left as it was if stream wasn't ended
+//
+WriteStream.prototype.destroy = function destroy() {
+  this.writable = false;
+  this._destroyed = true;
+  this._queue = [];
+
+  // stream is closed after pending write
+  if (this._stream === null || this._writing) return;
+
+  this._db._db.closeStream(this._stream);
+  this._stream = null;
+  this.emit('close');
+};
+
+WriteStream.prototype._error = function _error(code) {
+  this.emit('error', true, code);
+  this.destroy();
+};
+
+//
+// ### function RangeStream (db, start, end, options)
+// #### @db {BPlus} database
+// #### @start {String|Buffer} start key
+// #### @end {String|Buffer} end key
+// #### @options {Object} (optional) `{ highWaterMark: 16, filter: ... }`
+// Readable stream of key/values in range, emits `{ key, value }` objects,
+// 'close' after `.destroy()` and ('error', true, code)
+//
+function RangeStream(db, start, end, options) {
+  var highWaterMark = options && options.highWaterMark || 16;
+
+  Readable.call(this, { objectMode: true, highWaterMark: highWaterMark });
+
+  this._db = db;
+  this._paused = false;
+  this._range = db._range(start,
+                          end,
+                          options && options.filter,
+                          highWaterMark,
+                          this._onmessage.bind(this));
+};
+if (Readable) util.inherits(RangeStream, Readable);
+core.RangeStream = RangeStream;
+
+RangeStream.prototype._onmessage = function _onmessage(err, type, key, value) {
+  if (err) return this.emit('error', err, type);
+
+  if (type !== 'message') {
+    this._range = null;
+    this.push(null);
+    return;
+  }
+
+  // range is paused until next `_read()`
+  if (!this.push({ key: key.value, value: value.value }) && !this._paused) {
+    this._paused = true;
+    this._db._db.pauseRange(this._range);
+  }
+};
+
+RangeStream.prototype._read = function _read() {
+  if (!this._paused || this._range === null) return;
+
+  this._paused = false;
+  this._db._db.resumeRange(this._range);
+};
+
+//
+// ### function destroy ()
+// Stops range scan, no more entries are emitted
+//
+RangeStream.prototype.destroy = function destroy() {
+  if (this._range === null) return;
+
+  this._db._db.closeRange(this._range);
+  this._range = null;
+  this.emit('close');
+};
@@ -26,6 +26,50 @@ utils.arrayToBuffer = function arrayToBuffer(arr) {
   });
 };
 
+//
+// ### function toPredicate (predicate)
+// #### @predicate {Object} key predicate of `.getRange()`
+// Converts predicate's string keys to buffers
+//
+utils.toPredicate = function toPredicate(predicate) {
+  var result = {};
+
+  ['prefix', 'suffix', 'contains', 'gte', 'lte'].forEach(function(name) {
+    if (predicate[name] !== undefined) {
+      result[name] = utils.toBuffer(predicate[name]);
+    }
+  });
+  result.minLength = predicate.minLength;
+  result.maxLength = predicate.maxLength;
+
+  return result;
+};
+
+//
+// ### function toInt64 (number)
+// #### @number {Number} integer (precise up to 2^53)
+// Converts number to 8-byte big-endian signed integer
+//
+utils.toInt64 = function toInt64(number) {
+  var buffer = new Buffer(8),
+      high = Math.floor(number / 0x100000000),
+      low = number - high * 0x100000000;
+
+  buffer.writeInt32BE(high, 0);
+  buffer.writeUInt32BE(low, 4);
+
+  return buffer;
+};
+
+//
+// ### function fromInt64 (buffer)
+// #### @buffer {Buffer} 8-byte big-endian signed integer
+// Converts 8-byte integer to number
+//
+utils.fromInt64 = function fromInt64(buffer) {
+  return buffer.readInt32BE(0) * 0x100000000 + buffer.readUInt32BE(4);
+};
+
 //
 // ### function passSyncResult (callback, result)
 // #### @callback {Function} continuation
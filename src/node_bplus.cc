@@ -115,6 +115,9 @@ Handle<Value> InvokeCallback(Handle<Object> obj,
 }
 
 
+Persistent<FunctionTemplate> BPlus::stream_template;
+
+
 void BPlus::Initialize(Handle<Object> target) {
   Local<FunctionTemplate> t = FunctionTemplate::New(BPlus::New);
 
@@ -126,17 +129,43 @@ void BPlus::Initialize(Handle<Object> target) {
 
   NODE_SET_PROTOTYPE_METHOD(t, "set", BPlus::Set);
   NODE_SET_PROTOTYPE_METHOD(t, "bulkSet", BPlus::BulkSet);
+  NODE_SET_PROTOTYPE_METHOD(t, "merge", BPlus::Merge);
   NODE_SET_PROTOTYPE_METHOD(t, "update", BPlus::Update);
+  NODE_SET_PROTOTYPE_METHOD(t, "compareAndSwap", BPlus::CompareAndSwap);
   NODE_SET_PROTOTYPE_METHOD(t, "bulkUpdate", BPlus::BulkUpdate);
   NODE_SET_PROTOTYPE_METHOD(t, "get", BPlus::Get);
+  NODE_SET_PROTOTYPE_METHOD(t, "getSlice", BPlus::GetSlice);
   NODE_SET_PROTOTYPE_METHOD(t, "remove", BPlus::Remove);
   NODE_SET_PROTOTYPE_METHOD(t, "removev", BPlus::RemoveV);
   NODE_SET_PROTOTYPE_METHOD(t, "compact", BPlus::Compact);
+  NODE_SET_PROTOTYPE_METHOD(t, "expire", BPlus::Expire);
   NODE_SET_PROTOTYPE_METHOD(t, "getPrevious", BPlus::GetPrevious);
   NODE_SET_PROTOTYPE_METHOD(t, "getRange", BPlus::GetRange);
   NODE_SET_PROTOTYPE_METHOD(t, "getFilteredRange", BPlus::GetFilteredRange);
+  NODE_SET_PROTOTYPE_METHOD(t, "pauseRange", BPlus::PauseRange);
+  NODE_SET_PROTOTYPE_METHOD(t, "resumeRange", BPlus::ResumeRange);
+  NODE_SET_PROTOTYPE_METHOD(t, "closeRange", BPlus::CloseRange);
+  NODE_SET_PROTOTYPE_METHOD(t, "openStream", BPlus::OpenStream);
+  NODE_SET_PROTOTYPE_METHOD(t, "readStream", BPlus::ReadStream);
+  NODE_SET_PROTOTYPE_METHOD(t, "createStream", BPlus::CreateStream);
+  NODE_SET_PROTOTYPE_METHOD(t, "writeStream", BPlus::WriteStream);
+  NODE_SET_PROTOTYPE_METHOD(t, "commitStream", BPlus::CommitStream);
+  NODE_SET_PROTOTYPE_METHOD(t, "closeStream", BPlus::CloseStream);
 
   target->Set(String::NewSymbol("BPlus"), t->GetFunction());
+
+  /* streams are wrapped, so other handles can't be passed instead of them */
+  stream_template = Persistent<FunctionTemplate>::New(FunctionTemplate::New());
+  stream_template->InstanceTemplate()->SetInternalFieldCount(1);
+  stream_template->SetClassName(String::NewSymbol("BPlusStream"));
+
+  NODE_DEFINE_CONSTANT(target, BP_MERGE_ADD);
+  NODE_DEFINE_CONSTANT(target, BP_MERGE_APPEND);
+  NODE_DEFINE_CONSTANT(target, BP_MERGE_MAX);
+  NODE_DEFINE_CONSTANT(target, BP_MERGE_MIN);
+  NODE_DEFINE_CONSTANT(target, BP_MERGE_UNION);
+
+  NODE_DEFINE_CONSTANT(target, BP_EUPDATECONFLICT);
 }
 
 
@@ -161,7 +190,15 @@ Handle<Value> BPlus::Open(const Arguments &args) {
 
   String::Utf8Value v(args[0]->ToString());
 
-  int ret = bp_open(&b->db_, *v);
+  /* options are used only when database is created */
+  bp_options_t options;
+  bp_options_init(&options);
+  if (args[1]->IsObject()) {
+    Local<Object> opts = args[1].As<Object>();
+    options.expiry = opts->Get(String::NewSymbol("expiry"))->BooleanValue();
+  }
+
+  int ret = bp_open_opts(&b->db_, *v, &options);
   if (ret == BP_OK) {
     b->opened_ = true;
     return True();
@@ -191,9 +228,10 @@ void BPlus::DoWork(uv_work_t* work) {
   bp_work_req* req = container_of(work, bp_work_req, w);
   switch (req->type) {
    case kSet:
-    req->result = bp_set(&req->b->db_,
-                         &req->data.set.key,
-                         &req->data.set.value);
+    req->result = bp_set_ttl(&req->b->db_,
+                             &req->data.set.key,
+                             &req->data.set.value,
+                             req->data.set.ttl);
 
     free(req->data.set.key.value);
     free(req->data.set.value.value);
@@ -207,6 +245,35 @@ void BPlus::DoWork(uv_work_t* work) {
 
     DestroyBulkData(req);
     break;
+   case kMerge:
+    req->result = bp_merge(&req->b->db_,
+                           &req->data.merge.key,
+                           req->data.merge.op,
+                           &req->data.merge.operand);
+
+    free(req->data.merge.key.value);
+    free(req->data.merge.operand.value);
+    break;
+   case kCompareAndSwap:
+    /* missing key is a conflict unless it's expected */
+    if (req->data.cas.expected.value == NULL) {
+      req->result = bp_update(&req->b->db_,
+                              &req->data.cas.key,
+                              &req->data.cas.value,
+                              BPlus::CompareCallback,
+                              reinterpret_cast<void*>(req));
+    } else {
+      req->result = bp_update_existing(&req->b->db_,
+                                       &req->data.cas.key,
+                                       &req->data.cas.value,
+                                       BPlus::CompareCallback,
+                                       reinterpret_cast<void*>(req));
+    }
+
+    free(req->data.cas.key.value);
+    free(req->data.cas.value.value);
+    free(req->data.cas.expected.value);
+    break;
    case kGet:
     req->result = bp_get(&req->b->db_,
                          &req->data.get.key,
@@ -214,17 +281,29 @@ void BPlus::DoWork(uv_work_t* work) {
     free(req->data.get.key.value);
     req->data.get.key.value = NULL;
     break;
+   case kGetSlice:
+    req->result = bp_get_partial(&req->b->db_,
+                                 &req->data.slice.key,
+                                 req->data.slice.offset,
+                                 req->data.slice.length,
+                                 &req->data.slice.value);
+    free(req->data.slice.key.value);
+    break;
    case kGetPrevious:
     req->result = bp_get_previous(&req->b->db_,
                                   &req->data.previous.value,
                                   &req->data.previous.previous);
     break;
    case kGetRange:
-    req->result = bp_get_range(&req->b->db_,
-                               &req->data.range.start,
-                               &req->data.range.end,
-                               BPlus::GetRangeCallback,
-                               reinterpret_cast<void*>(req));
+   case kGetFilteredRange:
+    /* scan is stopped once range is closed */
+    req->result = bp_get_stoppable_range(&req->b->db_,
+                                         &req->data.range.start,
+                                         &req->data.range.end,
+                                         BPlus::GetRangeFilter,
+                                         BPlus::GetRangeStop,
+                                         BPlus::GetRangeCallback,
+                                         reinterpret_cast<void*>(req));
     free(req->data.range.start.value);
     free(req->data.range.end.value);
     break;
@@ -236,6 +315,37 @@ void BPlus::DoWork(uv_work_t* work) {
    case kCompact:
     req->result = bp_compact(&req->b->db_);
     break;
+   case kExpire:
+    req->result = bp_expire(&req->b->db_,
+                            req->data.expire.limit,
+                            &req->data.expire.removed);
+    break;
+   case kStreamOpen:
+    req->result = bp_stream_open(&req->b->db_,
+                                 &req->data.stream.key,
+                                 req->data.stream.stream);
+    free(req->data.stream.key.value);
+    break;
+   case kStreamRead:
+    req->result = bp_stream_read(&req->b->db_,
+                                 req->data.stream.stream,
+                                 req->data.stream.offset,
+                                 req->data.stream.length,
+                                 req->data.stream.data,
+                                 &req->data.stream.read);
+    break;
+   case kStreamWrite:
+    req->result = bp_stream_write(&req->b->db_,
+                                  req->data.stream.stream,
+                                  req->data.stream.data,
+                                  req->data.stream.length);
+    break;
+   case kStreamCommit:
+    req->result = bp_stream_commit(&req->b->db_,
+                                   req->data.stream.stream,
+                                   &req->data.stream.key);
+    free(req->data.stream.key.value);
+    break;
    default:
     break;
   }
@@ -259,29 +369,66 @@ void BPlus::AfterWork(uv_work_t* work) {
      case kGet:
       args[1] = ValueToObject(&req->data.get.value);
       break;
+     case kGetSlice:
+      args[1] = Buffer::New(req->data.slice.value.value,
+                            req->data.slice.value.length)->handle_;
+      free(req->data.slice.value.value);
+      break;
      case kGetPrevious:
       args[1] = ValueToObject(&req->data.previous.previous);
       break;
+     case kExpire:
+      args[1] = Number::New(req->data.expire.removed);
+      break;
      case kGetRange:
+     case kGetFilteredRange:
       req->data.range.queue->Push(new BPGetRangeMessage());
       uv_async_send(&req->data.range.notifier);
       break;
+     case kStreamOpen:
+      {
+        Local<Object> result = Object::New();
+        result->Set(String::NewSymbol("stream"),
+                    WrapStream(req->data.stream.stream));
+        result->Set(String::NewSymbol("length"),
+                    Number::New(req->data.stream.stream->length));
+        args[1] = result;
+      }
+      break;
+     case kStreamRead:
+      args[1] = Buffer::New(req->data.stream.data,
+                            req->data.stream.read)->handle_;
+      break;
      default:
       args[1] = Undefined();
       break;
     }
   }
 
-  if (req->type == kGetRange) return;
+  /* stream wasn't opened, buffers were copied to js */
+  if (req->type == kStreamOpen && req->result != BP_OK) {
+    delete req->data.stream.stream;
+  }
+  if (req->type == kStreamRead || req->type == kStreamWrite) {
+    delete[] req->data.stream.data;
+  }
+
+  if (req->type == kGetRange || req->type == kGetFilteredRange) {
+    /* error is reported before end of range */
+    if (req->result != BP_OK) {
+      if (!req->data.range.closed) {
+        InvokeCallback(req->b->handle_, req->callback, 2, args);
+      }
+      req->data.range.queue->Push(new BPGetRangeMessage());
+      uv_async_send(&req->data.range.notifier);
+    }
+    return;
+  }
 
   InvokeCallback(req->b->handle_, req->callback, 2, args);
 
   req->callback.Dispose();
   req->callback.Clear();
-  if (!req->filter.IsEmpty()) {
-    req->filter.Dispose();
-    req->filter.Clear();
-  }
   req->b->Unref();
 
   delete req;
@@ -300,6 +447,23 @@ int BPlus::UpdateCallback(void* arg,
 }
 
 
+/* called in thread pool, `expected.value` is NULL if key should be missing */
+int BPlus::CompareCallback(void* arg,
+                           const bp_value_t* previous,
+                           const bp_value_t* current) {
+  bp_work_req* req = reinterpret_cast<bp_work_req*>(arg);
+  bp_value_t* expected = &req->data.cas.expected;
+
+  if (expected->value == NULL) return 0;
+  if (req->data.cas.prefix) {
+    if (previous->length < expected->length) return 0;
+  } else if (previous->length != expected->length) {
+    return 0;
+  }
+  return memcmp(previous->value, expected->value, expected->length) == 0;
+}
+
+
 int BPlus::RemoveCallback(void* arg,
                           const bp_value_t* value) {
   bp_work_req* req = reinterpret_cast<bp_work_req*>(arg);
@@ -313,6 +477,9 @@ void BPlus::GetRangeCallback(void* arg,
                              const bp_value_t* value) {
   bp_work_req* req = reinterpret_cast<bp_work_req*>(arg);
 
+  /* wait until js will drain queue, skip rest of range if it was closed */
+  if (!req->data.range.queue->WaitForSpace()) return;
+
   req->data.range.queue->Push(new BPGetRangeMessage(key, value));
 
   uv_async_send(&req->data.range.notifier);
@@ -322,27 +489,38 @@ void BPlus::GetRangeCallback(void* arg,
 void BPlus::GetRangeNotifier(uv_async_t* async, int code) {
   bp_work_req* req = container_of(async, bp_work_req, data.range.notifier);
   BPGetRangeMessage* msg = NULL;
+  bool end = false;
+
+  /* paused range is drained on resume */
+  while (!end &&
+         !req->data.range.paused &&
+         (msg = req->data.range.queue->Shift()) != NULL) {
+    end = msg->end;
+
+    /* messages of closed range are dropped */
+    if (req->data.range.closed) {
+      delete msg;
+      continue;
+    }
 
-  while ((msg = req->data.range.queue->Shift()) != NULL) {
-    if (msg->end) {
+    if (end) {
       Handle<Value> args[2] = { Null(), String::NewSymbol("end") };
 
       InvokeCallback(req->b->handle_, req->callback, 2, args);
-      break;
+    } else {
+      Handle<Value> args[4] = {
+          Null(),
+          String::NewSymbol("message"),
+          ValueToObject(&msg->key),
+          ValueToObject(&msg->value)
+      };
+
+      InvokeCallback(req->b->handle_, req->callback, 4, args);
     }
-
-    Handle<Value> args[4] = {
-        Null(),
-        String::NewSymbol("message"),
-        ValueToObject(&msg->key),
-        ValueToObject(&msg->value)
-    };
-
-    InvokeCallback(req->b->handle_, req->callback, 4, args);
     delete msg;
   }
 
-  if (msg != NULL && msg->end) {
+  if (end) {
     uv_close(reinterpret_cast<uv_handle_t*>(&req->data.range.notifier),
              BPlus::GetRangeClose);
   }
@@ -355,31 +533,45 @@ void BPlus::GetRangeClose(uv_handle_t* handle) {
   req->callback.Clear();
   req->b->Unref();
   delete req->data.range.queue;
+  delete req->data.range.predicate;
   delete req;
 }
 
 
+/* called in thread pool */
 int BPlus::GetRangeFilter(void* arg, const bp_key_t* key) {
   bp_work_req* req = reinterpret_cast<bp_work_req*>(arg);
 
-  Handle<Value> argv[1] = { ValueToObject(const_cast<bp_value_t*>(key)) };
-  return !InvokeCallback(req->b->handle_, req->filter, 1, argv)->IsFalse();
+  if (req->data.range.predicate == NULL) return 1;
+
+  return req->data.range.predicate->Match(key);
 }
 
 
-void BPlus::GetFilteredRangeCallback(void* arg,
-                                     const bp_key_t* key,
-                                     const bp_value_t* value) {
+/* called in thread pool, values won't be emitted once queue is closed */
+int BPlus::GetRangeStop(void* arg) {
   bp_work_req* req = reinterpret_cast<bp_work_req*>(arg);
 
-  Handle<Value> argv[4] = {
-      Null(),
-      String::NewSymbol("message"),
-      ValueToObject(const_cast<bp_key_t*>(key)),
-      ValueToObject(const_cast<bp_value_t*>(value))
-  };
+  return req->data.range.queue->IsClosed();
+}
+
+
+Handle<Value> BPlus::WrapStream(bp_stream_t* stream) {
+  HandleScope scope;
+
+  Local<Object> handle = stream_template->GetFunction()->NewInstance();
+  handle->SetPointerInInternalField(0, stream);
+
+  return scope.Close(handle);
+}
 
-  InvokeCallback(req->b->handle_, req->callback, 4, argv);
+
+/* NULL if value isn't an opened stream */
+bp_stream_t* BPlus::UnwrapStream(Handle<Value> value) {
+  if (!stream_template->HasInstance(value)) return NULL;
+
+  return reinterpret_cast<bp_stream_t*>(
+      value.As<Object>()->GetPointerFromInternalField(0));
 }
 
 
@@ -397,6 +589,30 @@ Handle<Value> BPlus::Set(const Arguments &args) {
   QUEUE_WORK(b, kSet, args[2], {
     BufferToKey(args[0].As<Object>(), &req->data.set.key);
     BufferToKey(args[1].As<Object>(), &req->data.set.value);
+    req->data.set.ttl = args[3]->IsNumber() ? args[3]->IntegerValue() : 0;
+  })
+
+  return Undefined();
+}
+
+
+Handle<Value> BPlus::Merge(const Arguments &args) {
+  HandleScope scope;
+
+  UNWRAP
+  CHECK_OPENED(b)
+
+  if (!Buffer::HasInstance(args[0].As<Object>()) ||
+      !args[1]->IsNumber() ||
+      !Buffer::HasInstance(args[2].As<Object>())) {
+    return ThrowException(String::New(
+        "Arguments should be Buffer, Number and Buffer"));
+  }
+
+  QUEUE_WORK(b, kMerge, args[3], {
+    BufferToKey(args[0].As<Object>(), &req->data.merge.key);
+    req->data.merge.op = args[1]->Int32Value();
+    BufferToKey(args[2].As<Object>(), &req->data.merge.operand);
   })
 
   return Undefined();
@@ -518,6 +734,26 @@ Handle<Value> BPlus::Get(const Arguments &args) {
 }
 
 
+Handle<Value> BPlus::GetSlice(const Arguments &args) {
+  HandleScope scope;
+
+  UNWRAP
+  CHECK_OPENED(b)
+
+  if (!Buffer::HasInstance(args[0].As<Object>())) {
+    return ThrowException(String::New("First argument should be Buffer"));
+  }
+
+  QUEUE_WORK(b, kGetSlice, args[3], {
+    BufferToKey(args[0].As<Object>(), &req->data.slice.key);
+    req->data.slice.offset = args[1]->IntegerValue();
+    req->data.slice.length = args[2]->IntegerValue();
+  })
+
+  return Undefined();
+}
+
+
 Handle<Value> BPlus::GetPrevious(const Arguments &args) {
   HandleScope scope;
 
@@ -554,10 +790,27 @@ Handle<Value> BPlus::GetRange(const Arguments &args) {
                   &req->data.range.notifier,
                   BPlus::GetRangeNotifier);
 
-    req->data.range.queue = new BPQueue<BPGetRangeMessage>();
+    req->data.range.queue = new BPQueue<BPGetRangeMessage>(
+        args[3]->IsNumber() ? args[3]->IntegerValue() : 0);
+    req->data.range.predicate = NULL;
+    req->data.range.paused = false;
+    req->data.range.closed = false;
   })
 
-  return Undefined();
+  /* range is referenced until 'end' */
+  return scope.Close(External::New(req));
+}
+
+
+/* copies Buffer property of predicate object (if it's present) */
+static bool PredicateKey(Handle<Object> obj, const char* name, bp_key_t* key) {
+  Local<Value> value = obj->Get(String::NewSymbol(name));
+
+  if (value->IsUndefined()) return true;
+  if (!Buffer::HasInstance(value)) return false;
+
+  BufferToKey(value.As<Object>(), key);
+  return true;
 }
 
 
@@ -571,40 +824,92 @@ Handle<Value> BPlus::GetFilteredRange(const Arguments &args) {
       !Buffer::HasInstance(args[1].As<Object>())) {
     return ThrowException(String::New("First two arguments should be Buffers"));
   }
+  if (!args[2]->IsObject()) {
+    return ThrowException(String::New("Third argument should be an Object"));
+  }
 
-  /* initialize req manually */
-  INIT_REQ(b, kGetFilteredRange, args[3])
-  req->filter = Persistent<Function>::New(args[2].As<Function>());
+  Local<Object> obj = args[2].As<Object>();
+  BPKeyPredicate* predicate = new BPKeyPredicate();
 
-  BufferToKey(args[0].As<Object>(), &req->data.filtered_range.start);
-  BufferToKey(args[1].As<Object>(), &req->data.filtered_range.end);
+  if (!PredicateKey(obj, "prefix", &predicate->prefix) ||
+      !PredicateKey(obj, "suffix", &predicate->suffix) ||
+      !PredicateKey(obj, "contains", &predicate->substring) ||
+      !PredicateKey(obj, "gte", &predicate->gte) ||
+      !PredicateKey(obj, "lte", &predicate->lte)) {
+    delete predicate;
+    return ThrowException(String::New("Predicate keys should be Buffers"));
+  }
 
-  int ret;
+  Local<Value> length = obj->Get(String::NewSymbol("minLength"));
+  if (length->IsNumber()) predicate->min_length = length->IntegerValue();
+  length = obj->Get(String::NewSymbol("maxLength"));
+  if (length->IsNumber()) predicate->max_length = length->IntegerValue();
 
-  ret = bp_get_filtered_range(&b->db_,
-                              &req->data.filtered_range.start,
-                              &req->data.filtered_range.end,
-                              BPlus::GetRangeFilter,
-                              BPlus::GetFilteredRangeCallback,
-                              reinterpret_cast<void*>(req));
+  QUEUE_WORK(b, kGetFilteredRange, args[3], {
+    BufferToKey(args[0].As<Object>(), &req->data.range.start);
+    BufferToKey(args[1].As<Object>(), &req->data.range.end);
+    uv_async_init(uv_default_loop(),
+                  &req->data.range.notifier,
+                  BPlus::GetRangeNotifier);
 
-  Handle<Value> argv[2];
-  if (ret != BP_OK) {
-    argv[0] = True();
-    argv[1] = Number::New(ret);
-  } else {
-    argv[0] = Null();
-    argv[1] = String::NewSymbol("end");
+    req->data.range.queue = new BPQueue<BPGetRangeMessage>(
+        args[4]->IsNumber() ? args[4]->IntegerValue() : 0);
+    req->data.range.predicate = predicate;
+    req->data.range.paused = false;
+    req->data.range.closed = false;
+  })
+
+  return scope.Close(External::New(req));
+}
+
+
+BPlus::bp_work_req* BPlus::UnwrapRange(Handle<Value> value) {
+  return reinterpret_cast<bp_work_req*>(value.As<External>()->Value());
+}
+
+
+Handle<Value> BPlus::PauseRange(const Arguments &args) {
+  HandleScope scope;
+
+  if (!args[0]->IsExternal()) {
+    return ThrowException(String::New("First argument should be a range"));
   }
 
-  InvokeCallback(b->handle_, req->callback, 2, argv);
+  /* worker will block once queue is full */
+  UnwrapRange(args[0])->data.range.paused = true;
 
-  req->callback.Dispose();
-  req->callback.Clear();
+  return Undefined();
+}
 
-  delete req->data.filtered_range.start.value;
-  delete req->data.filtered_range.end.value;
-  delete req;
+
+Handle<Value> BPlus::ResumeRange(const Arguments &args) {
+  HandleScope scope;
+
+  if (!args[0]->IsExternal()) {
+    return ThrowException(String::New("First argument should be a range"));
+  }
+
+  bp_work_req* req = UnwrapRange(args[0]);
+  req->data.range.paused = false;
+  uv_async_send(&req->data.range.notifier);
+
+  return Undefined();
+}
+
+
+Handle<Value> BPlus::CloseRange(const Arguments &args) {
+  HandleScope scope;
+
+  if (!args[0]->IsExternal()) {
+    return ThrowException(String::New("First argument should be a range"));
+  }
+
+  /* rest of range is skipped, callback isn't invoked anymore */
+  bp_work_req* req = UnwrapRange(args[0]);
+  req->data.range.closed = true;
+  req->data.range.paused = false;
+  req->data.range.queue->Close();
+  uv_async_send(&req->data.range.notifier);
 
   return Undefined();
 }
@@ -662,6 +967,35 @@ Handle<Value> BPlus::RemoveV(const Arguments &args) {
 }
 
 
+Handle<Value> BPlus::CompareAndSwap(const Arguments &args) {
+  HandleScope scope;
+
+  UNWRAP
+  CHECK_OPENED(b)
+
+  if (!Buffer::HasInstance(args[0].As<Object>()) ||
+      !Buffer::HasInstance(args[1].As<Object>()) ||
+      !(args[2]->IsNull() || Buffer::HasInstance(args[2].As<Object>()))) {
+    return ThrowException(String::New(
+        "Arguments should be Buffers (expected value may be null)"));
+  }
+
+  QUEUE_WORK(b, kCompareAndSwap, args[4], {
+    BufferToKey(args[0].As<Object>(), &req->data.cas.key);
+    BufferToKey(args[1].As<Object>(), &req->data.cas.value);
+    if (args[2]->IsNull()) {
+      req->data.cas.expected.value = NULL;
+      req->data.cas.expected.length = 0;
+    } else {
+      BufferToKey(args[2].As<Object>(), &req->data.cas.expected);
+    }
+    req->data.cas.prefix = args[3]->IsTrue();
+  })
+
+  return Undefined();
+}
+
+
 Handle<Value> BPlus::Compact(const Arguments &args) {
   HandleScope scope;
 
@@ -674,6 +1008,166 @@ Handle<Value> BPlus::Compact(const Arguments &args) {
 }
 
 
+Handle<Value> BPlus::Expire(const Arguments &args) {
+  HandleScope scope;
+
+  UNWRAP
+  CHECK_OPENED(b)
+
+  QUEUE_WORK(b, kExpire, args[1], {
+    req->data.expire.limit = args[0]->IntegerValue();
+  })
+
+  return Undefined();
+}
+
+
+Handle<Value> BPlus::OpenStream(const Arguments &args) {
+  HandleScope scope;
+
+  UNWRAP
+  CHECK_OPENED(b)
+
+  if (!Buffer::HasInstance(args[0].As<Object>())) {
+    return ThrowException(String::New("First argument should be Buffer"));
+  }
+
+  QUEUE_WORK(b, kStreamOpen, args[1], {
+    BufferToKey(args[0].As<Object>(), &req->data.stream.key);
+    req->data.stream.stream = new bp_stream_t;
+  })
+
+  return Undefined();
+}
+
+
+Handle<Value> BPlus::ReadStream(const Arguments &args) {
+  HandleScope scope;
+
+  UNWRAP
+  CHECK_OPENED(b)
+
+  bp_stream_t* stream = UnwrapStream(args[0]);
+  if (stream == NULL) {
+    return ThrowException(String::New("First argument should be a stream"));
+  }
+
+  int64_t offset = args[1]->IntegerValue();
+  int64_t length = args[2]->IntegerValue();
+  if (!args[1]->IsNumber() || !args[2]->IsNumber() ||
+      offset < 0 || length < 0) {
+    return ThrowException(String::New(
+        "Offset and length should be non-negative numbers"));
+  }
+
+  /* nothing is read past the end of value */
+  if (static_cast<uint64_t>(offset) >= stream->length) {
+    length = 0;
+  } else if (static_cast<uint64_t>(length) > stream->length - offset) {
+    length = stream->length - offset;
+  }
+
+  /* data is read into request's buffer and copied to js after that */
+  QUEUE_WORK(b, kStreamRead, args[3], {
+    req->data.stream.stream = stream;
+    req->data.stream.offset = offset;
+    req->data.stream.length = length;
+    req->data.stream.data = new char[length];
+  })
+
+  return Undefined();
+}
+
+
+Handle<Value> BPlus::CreateStream(const Arguments &args) {
+  HandleScope scope;
+
+  UNWRAP
+  CHECK_OPENED(b)
+
+  bp_stream_t* stream = new bp_stream_t;
+
+  int ret = bp_stream_create(&b->db_, stream);
+  if (ret == BP_OK) {
+    return scope.Close(WrapStream(stream));
+  } else {
+    delete stream;
+    return scope.Close(Number::New(ret));
+  }
+}
+
+
+Handle<Value> BPlus::WriteStream(const Arguments &args) {
+  HandleScope scope;
+
+  UNWRAP
+  CHECK_OPENED(b)
+
+  bp_stream_t* stream = UnwrapStream(args[0]);
+  if (stream == NULL || !Buffer::HasInstance(args[1].As<Object>())) {
+    return ThrowException(String::New(
+        "First two arguments should be a stream and Buffer"));
+  }
+
+  QUEUE_WORK(b, kStreamWrite, args[2], {
+    req->data.stream.stream = stream;
+    req->data.stream.length = Buffer::Length(args[1].As<Object>());
+    req->data.stream.data = new char[req->data.stream.length];
+    memcpy(req->data.stream.data,
+           Buffer::Data(args[1].As<Object>()),
+           req->data.stream.length);
+  })
+
+  return Undefined();
+}
+
+
+Handle<Value> BPlus::CommitStream(const Arguments &args) {
+  HandleScope scope;
+
+  UNWRAP
+  CHECK_OPENED(b)
+
+  bp_stream_t* stream = UnwrapStream(args[0]);
+  if (stream == NULL || !Buffer::HasInstance(args[1].As<Object>())) {
+    return ThrowException(String::New(
+        "First two arguments should be a stream and Buffer"));
+  }
+
+  QUEUE_WORK(b, kStreamCommit, args[2], {
+    req->data.stream.stream = stream;
+    BufferToKey(args[1].As<Object>(), &req->data.stream.key);
+  })
+
+  return Undefined();
+}
+
+
+Handle<Value> BPlus::CloseStream(const Arguments &args) {
+  HandleScope scope;
+
+  UNWRAP
+  CHECK_OPENED(b)
+
+  bp_stream_t* stream = UnwrapStream(args[0]);
+  if (stream == NULL) {
+    return ThrowException(String::New("First argument should be a stream"));
+  }
+
+  int ret = bp_stream_close(&b->db_, stream);
+  delete stream;
+
+  /* handle can't be used after closing */
+  args[0].As<Object>()->SetPointerInInternalField(0, NULL);
+
+  if (ret == BP_OK) {
+    return True();
+  } else {
+    return scope.Close(Number::New(ret));
+  }
+}
+
+
 NODE_MODULE(bplus, BPlus::Initialize);
 
 } // namespace plus
@@ -58,6 +58,37 @@ void uv_mutex_unlock(uv_mutex_t* mutex) {
 }
 #endif
 
+/* polyfill uv condition variables for node 0.8.x */
+#if !NODE_VERSION_AT_LEAST(0, 9, 4)
+
+#include <pthread.h>
+
+typedef pthread_cond_t uv_cond_t;
+
+
+int uv_cond_init(uv_cond_t* cond) {
+  if (pthread_cond_init(cond, NULL))
+    return -1;
+  else
+    return 0;
+}
+
+
+void uv_cond_destroy(uv_cond_t* cond) {
+  pthread_cond_destroy(cond);
+}
+
+
+void uv_cond_signal(uv_cond_t* cond) {
+  pthread_cond_signal(cond);
+}
+
+
+void uv_cond_wait(uv_cond_t* cond, uv_mutex_t* mutex) {
+  pthread_cond_wait(cond, mutex);
+}
+#endif
+
 namespace bplus {
 
 using namespace node;
@@ -95,14 +126,21 @@ class BPQueue {
     }
   };
 
-  BPQueue() : head(NULL), current(NULL) {
+  /* `limit` - number of items to wait for in WaitForSpace (0 - unlimited) */
+  BPQueue(uint64_t limit = 0) : head(NULL),
+                                current(NULL),
+                                length(0),
+                                limit(limit),
+                                closed(false) {
     uv_mutex_init(&mutex);
+    uv_cond_init(&cond);
   }
 
   ~BPQueue() {
     /* empty queue to free data */
     T* data;
     while ((data = Shift()) != NULL) delete data;
+    uv_cond_destroy(&cond);
     uv_mutex_destroy(&mutex);
   }
 
@@ -114,6 +152,42 @@ class BPQueue {
     } else {
       current = current->Next(data);
     }
+    length++;
+    uv_mutex_unlock(&mutex);
+  }
+
+  /*
+   * Blocks producer while queue is full, returns false if queue was closed
+   * (and nothing should be pushed anymore)
+   */
+  bool WaitForSpace() {
+    bool result;
+
+    uv_mutex_lock(&mutex);
+    while (limit != 0 && length >= limit && !closed) {
+      uv_cond_wait(&cond, &mutex);
+    }
+    result = !closed;
+    uv_mutex_unlock(&mutex);
+
+    return result;
+  }
+
+  bool IsClosed() {
+    bool result;
+
+    uv_mutex_lock(&mutex);
+    result = closed;
+    uv_mutex_unlock(&mutex);
+
+    return result;
+  }
+
+  /* wakes producer, consumer won't shift items anymore */
+  void Close() {
+    uv_mutex_lock(&mutex);
+    closed = true;
+    uv_cond_signal(&cond);
     uv_mutex_unlock(&mutex);
   }
 
@@ -137,6 +211,10 @@ class BPQueue {
     head = first->next;
     delete first;
 
+    /* wake producer once there's space */
+    length--;
+    if (length + 1 == limit) uv_cond_signal(&cond);
+
     uv_mutex_unlock(&mutex);
 
     return result;
@@ -145,7 +223,11 @@ class BPQueue {
  private:
   BPQueueMember* head;
   BPQueueMember* current;
+  uint64_t length;
+  uint64_t limit;
+  bool closed;
   uv_mutex_t mutex;
+  uv_cond_t cond;
 };
 
 
@@ -156,6 +238,8 @@ class BPGetRangeMessage {
   bool end;
 
   BPGetRangeMessage() : end(true) {
+    key.value = NULL;
+    value.value = NULL;
   }
 
   BPGetRangeMessage(const bp_key_t* k, const bp_value_t* v) : end(false) {
@@ -175,20 +259,101 @@ class BPGetRangeMessage {
 };
 
 
+/* key filter evaluated in thread pool, all given conditions should match */
+class BPKeyPredicate {
+ public:
+  bp_key_t prefix;
+  bp_key_t suffix;
+  bp_key_t substring;
+  bp_key_t gte;
+  bp_key_t lte;
+  uint64_t min_length;
+  uint64_t max_length;
+
+  BPKeyPredicate() : min_length(0), max_length(static_cast<uint64_t>(-1)) {
+    prefix.value = NULL;
+    suffix.value = NULL;
+    substring.value = NULL;
+    gte.value = NULL;
+    lte.value = NULL;
+  }
+
+  ~BPKeyPredicate() {
+    delete[] prefix.value;
+    delete[] suffix.value;
+    delete[] substring.value;
+    delete[] gte.value;
+    delete[] lte.value;
+  }
+
+  bool Match(const bp_key_t* key) {
+    if (key->length < min_length || key->length > max_length) return false;
+
+    if (prefix.value != NULL &&
+        (key->length < prefix.length ||
+         memcmp(key->value, prefix.value, prefix.length) != 0)) {
+      return false;
+    }
+    if (suffix.value != NULL &&
+        (key->length < suffix.length ||
+         memcmp(key->value + key->length - suffix.length,
+                suffix.value,
+                suffix.length) != 0)) {
+      return false;
+    }
+    if (substring.value != NULL && !Contains(key)) return false;
+    if (gte.value != NULL && Compare(key, &gte) < 0) return false;
+    if (lte.value != NULL && Compare(key, &lte) > 0) return false;
+
+    return true;
+  }
+
+ private:
+  bool Contains(const bp_key_t* key) {
+    uint64_t i;
+
+    for (i = 0; i + substring.length <= key->length; i++) {
+      if (memcmp(key->value + i, substring.value, substring.length) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /* byte-wise comparison, shorter key goes first */
+  static int Compare(const bp_key_t* a, const bp_key_t* b) {
+    uint64_t length = a->length < b->length ? a->length : b->length;
+    int ret = memcmp(a->value, b->value, length);
+
+    if (ret != 0) return ret;
+    if (a->length == b->length) return 0;
+    return a->length < b->length ? -1 : 1;
+  }
+};
+
+
 class BPlus : ObjectWrap {
  public:
   enum bp_work_type {
     kSet,
     kBulkSet,
+    kMerge,
+    kCompareAndSwap,
     kUpdate,
     kBulkUpdate,
     kGet,
+    kGetSlice,
     kGetRange,
     kGetFilteredRange,
     kGetPrevious,
     kRemove,
     kRemoveV,
-    kCompact
+    kCompact,
+    kExpire,
+    kStreamOpen,
+    kStreamRead,
+    kStreamWrite,
+    kStreamCommit
   };
 
   struct bp_work_req {
@@ -201,8 +366,22 @@ class BPlus : ObjectWrap {
       struct {
         bp_key_t key;
         bp_value_t value;
+        uint64_t ttl;
       } set;
 
+      struct {
+        bp_key_t key;
+        bp_value_t operand;
+        int op;
+      } merge;
+
+      struct {
+        bp_key_t key;
+        bp_value_t value;
+        bp_value_t expected;
+        int prefix;
+      } cas;
+
       struct {
         bp_key_t* keys;
         bp_value_t* values;
@@ -214,6 +393,13 @@ class BPlus : ObjectWrap {
         bp_value_t value;
       } get;
 
+      struct {
+        bp_key_t key;
+        bp_value_t value;
+        uint64_t offset;
+        uint64_t length;
+      } slice;
+
       struct {
         bp_value_t value;
         bp_value_t previous;
@@ -224,28 +410,42 @@ class BPlus : ObjectWrap {
         bp_key_t end;
 
         BPQueue<BPGetRangeMessage>* queue;
+        BPKeyPredicate* predicate;
+        bool paused;
+        bool closed;
 
         uv_async_t notifier;
       } range;
 
       struct {
-        bp_key_t start;
-        bp_key_t end;
-      } filtered_range;
+        bp_key_t key;
+      } remove;
+
+      struct {
+        uint64_t limit;
+        uint64_t removed;
+      } expire;
 
       struct {
+        bp_stream_t* stream;
         bp_key_t key;
-      } remove;
+        uint64_t offset;
+        uint64_t length;
+        uint64_t read;
+        char* data;
+      } stream;
     } data;
 
     int result;
 
-    Persistent<Function> filter;
     Persistent<Function> callback;
   };
 
   static void Initialize(Handle<Object> target);
 
+  /* instances hold bp_stream_t* given to js */
+  static Persistent<FunctionTemplate> stream_template;
+
   BPlus() : ObjectWrap(), opened_(false) {
   }
 
@@ -264,6 +464,9 @@ class BPlus : ObjectWrap {
   static int UpdateCallback(void* arg,
                             const bp_value_t* previous,
                             const bp_value_t* current);
+  static int CompareCallback(void* arg,
+                             const bp_value_t* previous,
+                             const bp_value_t* current);
   static int RemoveCallback(void* arg,
                             const bp_value_t* value);
   static void GetRangeCallback(void* arg,
@@ -273,21 +476,36 @@ class BPlus : ObjectWrap {
   static void GetRangeClose(uv_handle_t* handle);
 
   static int GetRangeFilter(void* arg, const bp_key_t* key);
-  static void GetFilteredRangeCallback(void* arg,
-                                       const bp_key_t* key,
-                                       const bp_value_t* value);
+  static int GetRangeStop(void* arg);
+  static bp_work_req* UnwrapRange(Handle<Value> value);
+
+  static Handle<Value> WrapStream(bp_stream_t* stream);
+  static bp_stream_t* UnwrapStream(Handle<Value> value);
 
   static Handle<Value> Set(const Arguments &args);
   static Handle<Value> BulkSet(const Arguments &args);
+  static Handle<Value> Merge(const Arguments &args);
   static Handle<Value> Update(const Arguments &args);
+  static Handle<Value> CompareAndSwap(const Arguments &args);
   static Handle<Value> BulkUpdate(const Arguments &args);
   static Handle<Value> Get(const Arguments &args);
+  static Handle<Value> GetSlice(const Arguments &args);
   static Handle<Value> GetPrevious(const Arguments &args);
   static Handle<Value> GetRange(const Arguments &args);
   static Handle<Value> GetFilteredRange(const Arguments &args);
+  static Handle<Value> PauseRange(const Arguments &args);
+  static Handle<Value> ResumeRange(const Arguments &args);
+  static Handle<Value> CloseRange(const Arguments &args);
   static Handle<Value> Remove(const Arguments &args);
   static Handle<Value> RemoveV(const Arguments &args);
   static Handle<Value> Compact(const Arguments &args);
+  static Handle<Value> Expire(const Arguments &args);
+  static Handle<Value> OpenStream(const Arguments &args);
+  static Handle<Value> ReadStream(const Arguments &args);
+  static Handle<Value> CreateStream(const Arguments &args);
+  static Handle<Value> WriteStream(const Arguments &args);
+  static Handle<Value> CommitStream(const Arguments &args);
+  static Handle<Value> CloseStream(const Arguments &args);
 
   bool opened_;
   bp_db_t db_;
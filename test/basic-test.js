@@ -72,6 +72,36 @@ suite('BPlus addon', function() {
     });
   });
 
+  test('should compare and swap value', function(done) {
+    db.set('key', 'value', function(err) {
+      assert.ok(!err);
+      db.update('key', 'updated-value', 'other', function(err) {
+        assert.ok(err);
+        db.update('key', 'updated-value', 'value', function(err) {
+          assert.ok(!err);
+          db.update('key', 'value', { prefix: 'updated' }, function(err) {
+            assert.ok(!err);
+            db.update('key', 'new-value', null, function(err) {
+              assert.ok(err);
+              db.get('key', function(err, value) {
+                assert.ok(!err);
+                assert.equal(value.toString(), 'value');
+                db.update('missing', 'value', 'value', function(err, code) {
+                  assert.ok(err);
+                  assert.equal(code, bplus.errors.updateConflict);
+                  db.get('missing', function(err) {
+                    assert.ok(err);
+                    done();
+                  });
+                });
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+
   test('should set, remove and not found key after', function(done) {
     db.set('key', 'value', function(err) {
       assert.ok(!err);
@@ -208,6 +238,121 @@ suite('BPlus addon', function() {
     });
   });
 
+  test('should return correct results on .getRange(predicate)', function(done) {
+    var kvs = [
+      { key: 'a-1', value: '1' },
+      { key: 'a-22', value: '2' },
+      { key: 'b-3', value: '3' },
+      { key: 'a-4x', value: '4' }
+    ];
+    db.bulk(kvs, function(err) {
+      assert.ok(!err);
+      var matched = [];
+      db.getRange('a', 'c', {
+        prefix: 'a-',
+        maxLength: 4
+      }).on('message', function(key, value) {
+        matched.push(key.toString());
+      }).on('end', function() {
+        assert.deepEqual(matched.sort(), ['a-1', 'a-22', 'a-4x']);
+
+        matched = [];
+        db.getRange('a', 'c', {
+          contains: '-',
+          gte: 'a-3',
+          lte: 'b-3'
+        }).on('message', function(key, value) {
+          matched.push(key.toString());
+        }).on('end', function() {
+          assert.deepEqual(matched.sort(), ['a-4x', 'b-3']);
+          done();
+        });
+      });
+    });
+  });
+
+  test('should match predicate in every page of range', function(done) {
+    this.timeout(10000);
+
+    var kvs = [];
+    for (var i = 0; i < 20000; i++) {
+      kvs.push({ key: 'many-' + (100000 + i), value: 'v' });
+      if (i % 3 === 0) kvs.push({ key: 'many+' + (100000 + i), value: 'v' });
+    }
+    db.bulk(kvs, function(err) {
+      assert.ok(!err);
+
+      var matched = 0;
+      db.getRange('many', 'manz', {
+        prefix: 'many-'
+      }).on('message', function(key) {
+        assert.equal(key.toString().slice(0, 5), 'many-');
+        matched++;
+      }).on('end', function() {
+        assert.equal(matched, 20000);
+        done();
+      });
+    });
+  });
+
+  test('should stream range with backpressure', function(done) {
+    if (!require('stream').Readable) return done();
+
+    var kvs = [];
+    for (var i = 0; i < 100; i++) {
+      kvs.push({ key: 'r' + (1000 + i), value: 'v' + i });
+    }
+    db.bulk(kvs, function(err) {
+      assert.ok(!err);
+
+      var stream = db.createRangeStream('r', 's', { highWaterMark: 4 }),
+          read = 0;
+
+      stream.on('readable', function() {
+        var kv;
+        while ((kv = stream.read()) !== null) {
+          assert.equal(kv.key.toString(), 'r' + (1000 + read));
+          read++;
+        }
+      });
+      stream.on('end', function() {
+        assert.equal(read, 100);
+        done();
+      });
+    });
+  });
+
+  test('should stop range scan once stream is closed', function(done) {
+    if (!require('stream').Readable) return done();
+    this.timeout(10000);
+
+    var kvs = [];
+    for (var i = 0; i < 20000; i++) {
+      kvs.push({ key: 'stop' + (100000 + i), value: 'v' + i });
+    }
+    db.bulk(kvs, function(err) {
+      assert.ok(!err);
+
+      var stream = db.createRangeStream('stop', 'stoq', { highWaterMark: 1 }),
+          read = 0;
+
+      stream.on('data', function() {
+        if (++read !== 1) return;
+
+        /*
+         * Worker holds read lock until scan is over,
+         * so write completes only once scan is stopped
+         */
+        stream.destroy();
+        db.set('stop', 'after', function(err) {
+          assert.ok(!err);
+          assert.ok(read < 20000);
+          done();
+        });
+      });
+    });
+  });
+
   test('should insert kvs in bulk', function(done) {
     var kvs = [
       { key: '1', value: '1' },
@@ -245,4 +390,138 @@ suite('BPlus addon', function() {
       });
     });
   });
+
+  test('should write and read value with streams', function(done) {
+    var input = db.createWriteStream('stream'),
+        parts = [];
+
+    for (var i = 0; i < 64; i++) {
+      var part = new Buffer(32 * 1024);
+      part.fill(i);
+      parts.push(part);
+      input.write(part);
+    }
+    input.end();
+
+    input.on('close', function() {
+      var output = db.createReadStream('stream', { bufferSize: 10000 }),
+          offset = 0;
+
+      output.on('data', function(data) {
+        assert.ok(data.length <= 10000);
+        for (var i = 0; i < data.length; i++, offset++) {
+          assert.equal(data[i], Math.floor(offset / (32 * 1024)));
+        }
+      }).on('end', function() {
+        assert.equal(offset, 64 * 32 * 1024);
+        db.get('stream', function(err, value) {
+          assert.ok(!err);
+          assert.equal(value.length, 64 * 32 * 1024);
+          done();
+        });
+      });
+    });
+  });
+
+  test('should reject invalid stream handles and lengths', function() {
+    var input = db.createWriteStream('checked'),
+        handle = input._stream;
+
+    assert.throws(function() {
+      db._db.readStream({}, 0, 10, function() {});
+    });
+    assert.throws(function() {
+      db._db.readStream(handle, 0, -1, function() {});
+    });
+    assert.throws(function() {
+      db._db.readStream(handle, -1, 10, function() {});
+    });
+    input.destroy();
+
+    // closed stream can't be used anymore
+    assert.throws(function() {
+      db._db.closeStream(handle);
+    });
+  });
+
+  test('should get slice of value', function(done) {
+    db.set('key', 'some long value', function(err) {
+      assert.ok(!err);
+      db.getSlice('key', 5, 4, function(err, data) {
+        assert.ok(!err);
+        assert.equal(data.toString(), 'long');
+        db.getSlice('key', 10, 100, function(err, data) {
+          assert.ok(!err);
+          assert.equal(data.toString(), 'value');
+          done();
+        });
+      });
+    });
+  });
+
+  test('should merge values', function(done) {
+    db.merge('counter', 'add', 10, function(err) {
+      assert.ok(!err);
+      db.merge('counter', 'add', -3, function(err) {
+        assert.ok(!err);
+        db.merge('ids', 'union', [3, 1, 2], function(err) {
+          assert.ok(!err);
+          db.merge('ids', 'union', [2, 0], function(err) {
+            assert.ok(!err);
+            db.get('counter', function(err, value) {
+              assert.ok(!err);
+              assert.equal(bplus.utils.fromInt64(value), 7);
+              db.get('ids', function(err, value) {
+                assert.ok(!err);
+                assert.equal(value.length, 32);
+                assert.equal(bplus.utils.fromInt64(value.slice(0, 8)), 0);
+                assert.equal(bplus.utils.fromInt64(value.slice(24)), 3);
+                done();
+              });
+            });
+          });
+        });
+      });
+    });
+  });
+
+  test('should expire key with ttl', function(done) {
+    this.timeout(5000);
+
+    db.close();
+    try {
+      fs.unlinkSync('/tmp/test.bp');
+    } catch (e) {
+    }
+    db = bplus.create().open('/tmp/test.bp', { expiry: true });
+
+    db.set('key', 'value', 1, function(err) {
+      assert.ok(!err);
+      db.set('other', 'value', function(err) {
+        assert.ok(!err);
+        setTimeout(function() {
+          db.get('key', function(err) {
+            assert.ok(err);
+            db.expire(10, function(err, removed) {
+              assert.ok(!err);
+              assert.equal(removed, 1);
+              db.get('other', function(err, value) {
+                assert.ok(!err);
+                assert.equal(value.toString(), 'value');
+                done();
+              });
+            });
+          });
+        }, 2000);
+      });
+    });
+  });
+
+  test('should emit error on stream of not inserted value', function(done) {
+    db.createReadStream('key').on('error', function(err, code) {
+      assert.ok(err);
+      assert.ok(code > 0);
+      done();
+    });
+  });
 });